@@ -0,0 +1,453 @@
+/*
+ *  TsGenerator.cpp - Generates a deterministic synthetic MPEG-2 Transport
+ *  Stream for the benchmarks
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TsGenerator.h"
+#include "libdelphinus/Ts.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+using namespace MpegConstants;
+
+// The system clock runs at 27 MHz, the PTS at 90 kHz
+#define CLOCK_FREQUENCY 27000000ULL
+#define CLOCK_PER_MS (CLOCK_FREQUENCY / 1000)
+// PES packets are sent at a frame rate, with the PTS ahead of the PCR
+#define FRAMES_PER_SECOND 25
+#define PTS_DELAY 45000
+#define PES_HEADER_SIZE 14
+#define TS_PAYLOAD_SIZE (PACKET_SIZE_TS - 4)
+// Number of packets written to the file at a time
+#define WRITE_PACKETS 4096
+
+uint32_t getCrc32(const uint8_t* data, uint16_t size);
+
+uint32_t getCrc32(const uint8_t* data, uint16_t size)
+{
+    // CRC-32/MPEG-2, the speed does not matter for a few sections
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint16_t ix = 0; ix < size; ++ix)
+    {
+        crc ^= (uint32_t)data[ix] << 24;
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+TsGenerator::Config::Config()
+    :   packetSize(PACKET_SIZE_TS),
+        programs(2),
+        streamsPerProgram(3),
+        firstPmtPid(0x100),
+        muxRate(20000000),
+        videoRate(6000000),
+        audioRate(192000),
+        psiInterval(100),
+        firstPsi(500),
+        pcrInterval(40),
+        adaptationFieldPercent(5),
+        seed(1)
+{
+}
+
+TsGenerator::TsGenerator(const Config& generatorConfig)
+    :   config(generatorConfig),
+        patContinuityCounter(0),
+        nullContinuityCounter(0),
+        packetCount(0),
+        nextPsi(generatorConfig.firstPsi * CLOCK_PER_MS),
+        psiRemaining(0),
+        random(generatorConfig.seed ? generatorConfig.seed : 1)
+{
+    for (uint8_t ix = 0; ix < config.programs; ++ix)
+    {
+        Program program;
+        program.programNumber = ix + 1;
+        program.pmtPid = config.firstPmtPid + ix * 0x20;
+        program.pmtContinuityCounter = 0;
+        program.nextPcr = 0;
+        for (uint8_t iy = 0; iy < config.streamsPerProgram; ++iy)
+        {
+            Stream stream;
+            stream.pid = program.pmtPid + 1 + iy;
+            stream.streamId = (iy == 0) ? 0xE0 : 0xC0 + iy - 1;
+            stream.continuityCounter = 0;
+            stream.bitrate = (iy == 0) ? config.videoRate : config.audioRate;
+            stream.bytesSent = 0;
+            stream.pesRemaining = 0;
+            stream.pesSize = stream.bitrate / 8 / FRAMES_PER_SECOND;
+            if (stream.pesSize < TS_PAYLOAD_SIZE)
+            {
+                stream.pesSize = TS_PAYLOAD_SIZE;
+            }
+            if (iy != 0 && stream.pesSize > 0xFFFF)
+            {
+                // Only the video PES packets may leave their length unbounded
+                stream.pesSize = 0xFFFF;
+            }
+            program.streams.push_back(stream);
+        }
+        programs.push_back(program);
+    }
+}
+
+TsGenerator::~TsGenerator()
+{
+}
+
+bool TsGenerator::isValid()
+{
+    if (config.packetSize != PACKET_SIZE_TS && config.packetSize != PACKET_SIZE_TTS &&
+        config.packetSize != PACKET_SIZE_RS)
+    {
+        return false;
+    }
+    // The PAT and the PMTs must each fit in a single packet
+    if (config.programs == 0 || config.programs > 42 ||
+        config.streamsPerProgram == 0 || config.streamsPerProgram > 32)
+    {
+        return false;
+    }
+    if (config.firstPmtPid < 0x20 ||
+        config.firstPmtPid + (config.programs - 1) * 0x20 + config.streamsPerProgram >= PID_NULL)
+    {
+        return false;
+    }
+    if (config.muxRate == 0 || config.psiInterval == 0 || config.pcrInterval == 0 ||
+        config.adaptationFieldPercent > 100)
+    {
+        return false;
+    }
+    uint64_t totalRate = (uint64_t)config.programs *
+                         (config.videoRate + (uint64_t)(config.streamsPerProgram - 1) * config.audioRate);
+    return (totalRate < config.muxRate);
+}
+
+uint32_t TsGenerator::getRandom()
+{
+    // xorshift32, the same sequence on every platform
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+}
+
+uint64_t TsGenerator::getClock()
+{
+    // Time of the current packet at the mux rate, which counts only the
+    // bytes of the TS packets
+    return packetCount * PACKET_SIZE_TS * 8 * CLOCK_FREQUENCY / config.muxRate;
+}
+
+void TsGenerator::writeHeader(uint8_t* packet, uint16_t pid, bool pusi, uint8_t afc,
+                              uint8_t& continuityCounter)
+{
+    packet[0] = TS_SYNC_BYTE;
+    packet[1] = (pusi ? 0x40 : 0x00) | (pid >> 8);
+    packet[2] = pid & 0xFF;
+    packet[3] = (afc << 4) | continuityCounter;
+    if (afc & 0x01)
+    {
+        continuityCounter = (continuityCounter + 1) & 0x0F;
+    }
+}
+
+void TsGenerator::writeSection(uint8_t* packet, const uint8_t* section, uint16_t size)
+{
+    uint32_t crc = getCrc32(section, size);
+    uint8_t* payload = packet + 4;
+    // Pointer field
+    payload[0] = 0;
+    memcpy(payload + 1, section, size);
+    payload[size + 1] = crc >> 24;
+    payload[size + 2] = (crc >> 16) & 0xFF;
+    payload[size + 3] = (crc >> 8) & 0xFF;
+    payload[size + 4] = crc & 0xFF;
+    memset(payload + size + 5, 0xFF, TS_PAYLOAD_SIZE - size - 5);
+}
+
+void TsGenerator::writePat(uint8_t* packet)
+{
+    uint8_t section[PACKET_SIZE_TS];
+    uint16_t length = 5 + 4 * programs.size() + 4;
+    section[0] = TABLE_PAT;
+    section[1] = 0xB0 | (length >> 8);
+    section[2] = length & 0xFF;
+    // Transport stream ID
+    section[3] = 0x00;
+    section[4] = 0x01;
+    // Version 0, current
+    section[5] = 0xC1;
+    section[6] = 0;
+    section[7] = 0;
+    uint8_t* data = section + 8;
+    for (std::vector<Program>::const_iterator ix = programs.begin(); ix != programs.end(); ++ix)
+    {
+        data[0] = ix->programNumber >> 8;
+        data[1] = ix->programNumber & 0xFF;
+        data[2] = 0xE0 | (ix->pmtPid >> 8);
+        data[3] = ix->pmtPid & 0xFF;
+        data += 4;
+    }
+    writeHeader(packet, PID_PAT, true, 0x01, patContinuityCounter);
+    writeSection(packet, section, data - section);
+}
+
+void TsGenerator::writePmt(uint8_t* packet, Program& program)
+{
+    uint8_t section[PACKET_SIZE_TS];
+    uint16_t length = 9 + 5 * program.streams.size() + 4;
+    uint16_t pcrPid = program.streams.front().pid;
+    section[0] = TABLE_PMT;
+    section[1] = 0xB0 | (length >> 8);
+    section[2] = length & 0xFF;
+    section[3] = program.programNumber >> 8;
+    section[4] = program.programNumber & 0xFF;
+    section[5] = 0xC1;
+    section[6] = 0;
+    section[7] = 0;
+    section[8] = 0xE0 | (pcrPid >> 8);
+    section[9] = pcrPid & 0xFF;
+    // No program info descriptors
+    section[10] = 0xF0;
+    section[11] = 0x00;
+    uint8_t* data = section + 12;
+    for (std::vector<Stream>::const_iterator ix = program.streams.begin();
+         ix != program.streams.end(); ++ix)
+    {
+        data[0] = (ix == program.streams.begin()) ? STREAM_TYPE_14496_10_VIDEO :
+                                                    STREAM_TYPE_13818_7_AAC_ADTS;
+        data[1] = 0xE0 | (ix->pid >> 8);
+        data[2] = ix->pid & 0xFF;
+        data[3] = 0xF0;
+        data[4] = 0x00;
+        data += 5;
+    }
+    writeHeader(packet, program.pmtPid, true, 0x01, program.pmtContinuityCounter);
+    writeSection(packet, section, data - section);
+}
+
+void TsGenerator::writeStreamPacket(uint8_t* packet, Stream& stream, bool hasPcr)
+{
+    if (stream.pesRemaining == 0)
+    {
+        stream.pesRemaining = stream.pesSize;
+    }
+    bool pusi = (stream.pesRemaining == stream.pesSize);
+
+    // Size of the adaptation field including its length byte
+    uint8_t afSize = 0;
+    if (hasPcr)
+    {
+        afSize = 8;
+    }
+    else if (getRandom() % 100 < config.adaptationFieldPercent)
+    {
+        afSize = 2 + getRandom() % 16;
+    }
+    uint8_t payloadSize = TS_PAYLOAD_SIZE - afSize;
+    if (stream.pesRemaining < payloadSize)
+    {
+        // Stuff the last packet of the PES packet
+        afSize += payloadSize - stream.pesRemaining;
+        payloadSize = stream.pesRemaining;
+    }
+
+    writeHeader(packet, stream.pid, pusi, afSize ? 0x03 : 0x01, stream.continuityCounter);
+    uint8_t* data = packet + 4;
+    if (afSize)
+    {
+        data[0] = afSize - 1;
+        if (afSize > 1)
+        {
+            // Random access indicator on the start of the video frames
+            data[1] = (hasPcr ? 0x10 : 0x00) | ((pusi && stream.streamId == 0xE0) ? 0x40 : 0x00);
+            uint8_t fieldSize = 2;
+            if (hasPcr)
+            {
+                uint64_t clock = getClock();
+                uint64_t pcrBase = clock / 300;
+                uint16_t pcrExtension = clock % 300;
+                data[2] = (pcrBase >> 25) & 0xFF;
+                data[3] = (pcrBase >> 17) & 0xFF;
+                data[4] = (pcrBase >> 9) & 0xFF;
+                data[5] = (pcrBase >> 1) & 0xFF;
+                data[6] = ((pcrBase & 0x01) << 7) | 0x7E | (pcrExtension >> 8);
+                data[7] = pcrExtension & 0xFF;
+                fieldSize = 8;
+            }
+            memset(data + fieldSize, 0xFF, afSize - fieldSize);
+        }
+        data += afSize;
+    }
+
+    uint8_t headerSize = 0;
+    if (pusi)
+    {
+        uint64_t pts = (getClock() / 300 + PTS_DELAY) & 0x1FFFFFFFFULL;
+        uint16_t pesLength = (stream.streamId == 0xE0) ? 0 : stream.pesSize - 6;
+        data[0] = 0x00;
+        data[1] = 0x00;
+        data[2] = 0x01;
+        data[3] = stream.streamId;
+        data[4] = pesLength >> 8;
+        data[5] = pesLength & 0xFF;
+        data[6] = 0x80;
+        // Only the PTS
+        data[7] = 0x80;
+        data[8] = 5;
+        data[9] = 0x21 | ((pts >> 29) & 0x0E);
+        data[10] = (pts >> 22) & 0xFF;
+        data[11] = ((pts >> 14) & 0xFE) | 0x01;
+        data[12] = (pts >> 7) & 0xFF;
+        data[13] = ((pts << 1) & 0xFE) | 0x01;
+        headerSize = PES_HEADER_SIZE;
+    }
+    for (uint8_t ix = headerSize; ix < payloadSize; ++ix)
+    {
+        data[ix] = getRandom() & 0xFF;
+    }
+    stream.pesRemaining -= payloadSize;
+    stream.bytesSent += TS_PAYLOAD_SIZE;
+}
+
+void TsGenerator::writeNullPacket(uint8_t* packet)
+{
+    writeHeader(packet, PID_NULL, false, 0x01, nullContinuityCounter);
+    memset(packet + 4, 0xFF, TS_PAYLOAD_SIZE);
+}
+
+TsGenerator::Stream* TsGenerator::getNextStream(uint64_t clock)
+{
+    // The stream furthest behind its bitrate, if any of them is behind
+    Stream* nextStream = NULL;
+    double maxDeficit = 0;
+    for (std::vector<Program>::iterator ix = programs.begin(); ix != programs.end(); ++ix)
+    {
+        for (std::vector<Stream>::iterator iy = ix->streams.begin(); iy != ix->streams.end(); ++iy)
+        {
+            double deficit = (double)clock * iy->bitrate / (8.0 * CLOCK_FREQUENCY) - iy->bytesSent;
+            if (deficit >= maxDeficit)
+            {
+                maxDeficit = deficit;
+                nextStream = &(*iy);
+            }
+        }
+    }
+    return nextStream;
+}
+
+void TsGenerator::generate(uint8_t* data, uint64_t packets)
+{
+    assert(isValid());
+    uint8_t headerOffset = (config.packetSize == PACKET_SIZE_TTS) ? 4 : 0;
+    for (uint64_t ix = 0; ix < packets; ++ix)
+    {
+        uint64_t clock = getClock();
+        uint8_t* packet = data + headerOffset;
+        if (headerOffset)
+        {
+            // Arrival time stamp of the TTS
+            uint32_t timestamp = clock & 0x3FFFFFFF;
+            data[0] = timestamp >> 24;
+            data[1] = (timestamp >> 16) & 0xFF;
+            data[2] = (timestamp >> 8) & 0xFF;
+            data[3] = timestamp & 0xFF;
+        }
+        if (config.packetSize == PACKET_SIZE_RS)
+        {
+            memset(data + PACKET_SIZE_TS, 0, PACKET_SIZE_RS - PACKET_SIZE_TS);
+        }
+
+        if (psiRemaining == 0 && clock >= nextPsi)
+        {
+            psiRemaining = programs.size() + 1;
+            nextPsi += config.psiInterval * CLOCK_PER_MS;
+        }
+
+        Program* pcrProgram = NULL;
+        for (std::vector<Program>::iterator iy = programs.begin(); iy != programs.end(); ++iy)
+        {
+            if (clock >= iy->nextPcr)
+            {
+                pcrProgram = &(*iy);
+                break;
+            }
+        }
+
+        if (psiRemaining)
+        {
+            uint32_t psiIndex = programs.size() + 1 - psiRemaining;
+            if (psiIndex == 0)
+            {
+                writePat(packet);
+            }
+            else
+            {
+                writePmt(packet, programs[psiIndex - 1]);
+            }
+            --psiRemaining;
+        }
+        else if (pcrProgram)
+        {
+            writeStreamPacket(packet, pcrProgram->streams.front(), true);
+            pcrProgram->nextPcr += config.pcrInterval * CLOCK_PER_MS;
+        }
+        else
+        {
+            Stream* stream = getNextStream(clock);
+            if (stream)
+            {
+                writeStreamPacket(packet, *stream, false);
+            }
+            else
+            {
+                writeNullPacket(packet);
+            }
+        }
+        data += config.packetSize;
+        ++packetCount;
+    }
+}
+
+bool TsGenerator::writeFile(const char* fileName, uint64_t packets)
+{
+    FILE* file = fopen(fileName, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    std::vector<uint8_t> buffer((size_t)WRITE_PACKETS * config.packetSize);
+    bool isWritten = true;
+    while (packets && isWritten)
+    {
+        uint64_t count = (packets < WRITE_PACKETS) ? packets : WRITE_PACKETS;
+        generate(&buffer[0], count);
+        isWritten = (fwrite(&buffer[0], config.packetSize, count, file) == count);
+        packets -= count;
+    }
+    return (fclose(file) == 0 && isWritten);
+}
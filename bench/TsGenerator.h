@@ -0,0 +1,160 @@
+/*
+ *  TsGenerator.h - Generates a deterministic synthetic MPEG-2 Transport
+ *  Stream for the benchmarks
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELPHINUS_TS_GENERATOR_H
+#define DELPHINUS_TS_GENERATOR_H
+
+#include <vector>
+#include "libdelphinus/MpegConstants.h"
+
+/**
+ *  \brief  Generates a synthetic TS, byte for byte the same for the same
+ *          configuration.
+ *
+ *  The programs carry one H.264 video stream, which also carries the PCR,
+ *  followed by AAC audio streams. The packets are scheduled at a constant
+ *  mux rate, the PAT and the PMTs are repeated at the PSI interval, every
+ *  elementary stream is sent at its bitrate and the rest of the mux rate is
+ *  filled with null packets. The payloads are pseudo random bytes.
+ */
+class TsGenerator
+{
+    public:
+/**
+ *  \brief  Settings of the generated stream.
+ */
+        struct Config
+        {
+/** Size of the packets, 188, 192 (TTS) or 204. */
+            uint8_t packetSize;
+/** Number of programs, at most 42 so that the PAT fits in a packet. */
+            uint8_t programs;
+/** Number of elementary streams per program, at most 32. */
+            uint8_t streamsPerProgram;
+/** PMT PID of the first program, the following programs are 0x20 apart
+ *  and the elementary streams follow the PMT PID of their program. */
+            uint16_t firstPmtPid;
+/** Total bitrate of the TS in bits per second. */
+            uint32_t muxRate;
+/** Bitrate of the video streams in bits per second. */
+            uint32_t videoRate;
+/** Bitrate of the audio streams in bits per second. */
+            uint32_t audioRate;
+/** Interval between the repetitions of the PAT and the PMTs in ms. */
+            uint32_t psiInterval;
+/** Time of the first PAT in ms, the packets before it have no PSI. */
+            uint32_t firstPsi;
+/** Interval between the PCRs of a program in ms. */
+            uint32_t pcrInterval;
+/** Percentage of the elementary stream packets carrying adaptation field
+ *  stuffing, besides the ones carrying the PCR or ending a PES packet. */
+            uint8_t adaptationFieldPercent;
+/** Seed of the pseudo random payloads and stuffing. */
+            uint32_t seed;
+
+            Config();
+        };
+
+    private:
+        struct Stream
+        {
+            uint16_t pid;
+            uint8_t streamId;
+            uint8_t continuityCounter;
+            uint32_t bitrate;
+            uint64_t bytesSent;
+            // Bytes of the current PES packet yet to be sent
+            uint32_t pesRemaining;
+            uint32_t pesSize;
+        };
+
+        struct Program
+        {
+            uint16_t programNumber;
+            uint16_t pmtPid;
+            uint8_t pmtContinuityCounter;
+            uint64_t nextPcr;
+            std::vector<Stream> streams;
+        };
+
+        Config config;
+        std::vector<Program> programs;
+        uint8_t patContinuityCounter;
+        uint8_t nullContinuityCounter;
+        uint64_t packetCount;
+        uint64_t nextPsi;
+        // Number of PSI packets of the current repetition still to be sent
+        uint32_t psiRemaining;
+        uint32_t random;
+
+        uint32_t getRandom();
+        uint64_t getClock();
+        void writeHeader(uint8_t* packet, uint16_t pid, bool pusi, uint8_t afc,
+                         uint8_t& continuityCounter);
+        void writeSection(uint8_t* packet, const uint8_t* section, uint16_t size);
+        void writePat(uint8_t* packet);
+        void writePmt(uint8_t* packet, Program& program);
+        void writeStreamPacket(uint8_t* packet, Stream& stream, bool hasPcr);
+        void writeNullPacket(uint8_t* packet);
+        Stream* getNextStream(uint64_t clock);
+
+    public:
+/**
+ *  \brief  Set up the generator for a configuration.
+ *  \param  config Settings of the stream.
+ */
+        TsGenerator(const Config& config);
+        ~TsGenerator();
+
+/**
+ *  \brief  Check that the configuration can be generated.
+ *  \return true if the configuration is supported, false otherwise.
+ */
+        bool isValid();
+/**
+ *  \brief  Generate the packets following the ones generated so far.
+ *  \param  data Buffer for the packets.
+ *  \param  packets Number of packets to be generated.
+ */
+        void generate(uint8_t* data, uint64_t packets);
+/**
+ *  \brief  Generate the packets following the ones generated so far into
+ *          a file.
+ *  \param  fileName Path of the file, which is overwritten.
+ *  \param  packets Number of packets to be generated.
+ *  \return true if the file was written, false otherwise.
+ */
+        bool writeFile(const char* fileName, uint64_t packets);
+/**
+ *  \brief  Get the number of packets generated so far.
+ *  \return Number of packets.
+ */
+        uint64_t getPacketCount();
+};
+
+inline uint64_t TsGenerator::getPacketCount()
+{
+    return packetCount;
+}
+
+#endif
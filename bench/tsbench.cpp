@@ -0,0 +1,777 @@
+/*
+ *  tsbench.cpp - Microbenchmarks of the parsing paths of libdelphinus over a
+ *  synthetic MPEG-2 Transport Stream.
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TsGenerator.h"
+#include "libdelphinus/TsFile.h"
+#include "libdelphinus/TsHeaderBatch.h"
+#include "libdelphinus/PsiTables.h"
+#include "libdelphinus/Crc32.h"
+#include "libdelphinus/EitSchedule.h"
+#include "libdelphinus/PesAssembler.h"
+#include "libdelphinus/TimestampRecorder.h"
+#include "libdelphinus/NalScanner.h"
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+using namespace MpegConstants;
+
+#define MSG(x, ...); ::fprintf(stdout, x "\n", ##__VA_ARGS__);
+#define ERR(x, ...); ::fprintf(stderr, " " x " \n", ##__VA_ARGS__);
+
+// Number of programs of the PAT used for the append benchmark, which spans
+// two sections
+#define APPEND_PROGRAMS 40
+#define APPEND_SPLIT 80
+#define BATCH_PACKETS 1024
+// EIT schedule carousel of the aggregation benchmark
+#define EIT_SERVICES 100
+#define EIT_SECTIONS 32
+#define EIT_EVENTS 6
+#define EIT_DESCRIPTOR_SIZE 80
+// Bytes between the start codes planted for the NAL scan
+#define NAL_SPACING 1500
+
+struct BenchOptions
+{
+    TsGenerator::Config config;
+    uint64_t streamSize;
+    uint32_t rounds;
+    uint32_t sectionRounds;
+    uint32_t randomLookups;
+    const char* fileName;
+    const char* outputFileName;
+    bool keepFile;
+    bool showHelp;
+};
+
+void printUsage(char* programName);
+bool parseOptions(int argc, char* argv[], BenchOptions& options);
+double getTime();
+void printResult(const char* name, uint64_t items, const char* unit, uint64_t bytes, double seconds);
+void benchPacketParse(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds);
+void benchHeaderBatch(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds);
+void benchPcrParse(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds);
+void benchPcrBatch(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds);
+bool benchSectionParse(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds);
+void benchSectionAppend(uint32_t rounds);
+void benchCrc32(const uint8_t* data, uint64_t size, uint16_t sectionSize, uint32_t rounds);
+void benchEitSchedule(uint32_t rounds);
+void benchPesAssembly(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds);
+void benchTimestamps(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds);
+void benchNalScan(const uint8_t* data, uint64_t size, uint32_t rounds);
+bool benchCollectMetadata(const char* fileName, uint32_t rounds);
+bool benchSequentialView(const char* fileName, TsFile::IoMode mode, const char* name);
+bool benchRandomView(const char* fileName, uint32_t lookups, uint32_t seed);
+
+// The result of every benchmark is accumulated here so that the compiler
+// cannot drop the work being measured
+static uint64_t checksum = 0;
+
+void printUsage(char* programName)
+{
+    ERR("Usage: %s [OPTIONS]", programName);
+    ERR("  -p <size>     Packet size, 188, 192 (TTS) or 204 (default 188)");
+    ERR("  -n <count>    Number of programs (default 2)");
+    ERR("  -e <count>    Elementary streams per program (default 3)");
+    ERR("  -P <pid>      PMT PID of the first program (default 256)");
+    ERR("  -m <kbps>     Mux rate (default 20000)");
+    ERR("  -v <kbps>     Video bitrate (default 6000)");
+    ERR("  -a <kbps>     Audio bitrate (default 192)");
+    ERR("  -i <ms>       PSI repetition interval (default 100)");
+    ERR("  -I <ms>       Time of the first PSI (default 500)");
+    ERR("  -c <ms>       PCR interval (default 40)");
+    ERR("  -A <percent>  Packets with adaptation field stuffing (default 5)");
+    ERR("  -s <seed>     Seed of the generated payloads (default 1)");
+    ERR("  -z <MB>       Size of the generated stream (default 256)");
+    ERR("  -r <count>    Rounds over the stream in memory (default 4)");
+    ERR("  -f <file>     Temporary file for the TsFile benchmarks (default tsbench.ts)");
+    ERR("  -k            Keep the temporary file");
+    ERR("  -o <file>     Only write the generated stream to the file");
+    ERR("  -h            Print this help");
+}
+
+bool parseOptions(int argc, char* argv[], BenchOptions& options)
+{
+    options.streamSize = 256ULL << 20;
+    options.rounds = 4;
+    options.sectionRounds = 1000000;
+    options.randomLookups = 200000;
+    options.fileName = "tsbench.ts";
+    options.outputFileName = NULL;
+    options.keepFile = false;
+    options.showHelp = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "p:n:e:P:m:v:a:i:I:c:A:s:z:r:f:ko:h")) != -1)
+    {
+        uint64_t value = optarg ? strtoull(optarg, NULL, 0) : 0;
+        switch (option)
+        {
+            case 'p':
+                options.config.packetSize = value;
+                break;
+            case 'n':
+                options.config.programs = value;
+                break;
+            case 'e':
+                options.config.streamsPerProgram = value;
+                break;
+            case 'P':
+                options.config.firstPmtPid = value;
+                break;
+            case 'm':
+                options.config.muxRate = value * 1000;
+                break;
+            case 'v':
+                options.config.videoRate = value * 1000;
+                break;
+            case 'a':
+                options.config.audioRate = value * 1000;
+                break;
+            case 'i':
+                options.config.psiInterval = value;
+                break;
+            case 'I':
+                options.config.firstPsi = value;
+                break;
+            case 'c':
+                options.config.pcrInterval = value;
+                break;
+            case 'A':
+                options.config.adaptationFieldPercent = value;
+                break;
+            case 's':
+                options.config.seed = value;
+                break;
+            case 'z':
+                options.streamSize = value << 20;
+                break;
+            case 'r':
+                options.rounds = value ? value : 1;
+                break;
+            case 'f':
+                options.fileName = optarg;
+                break;
+            case 'k':
+                options.keepFile = true;
+                break;
+            case 'o':
+                options.outputFileName = optarg;
+                break;
+            case 'h':
+                options.showHelp = true;
+                break;
+            default:
+                return false;
+        }
+    }
+    return (optind == argc);
+}
+
+double getTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void printResult(const char* name, uint64_t items, const char* unit, uint64_t bytes, double seconds)
+{
+    if (seconds <= 0)
+    {
+        seconds = 1e-9;
+    }
+    MSG("%-36s %12.3f M%s/s %9.3f GB/s %9.3f s",
+        name, items / seconds / 1e6, unit, bytes / seconds / 1e9, seconds);
+}
+
+void benchPacketParse(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds)
+{
+    TsPacket tsPacket;
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        uint8_t* packet = const_cast<uint8_t*>(data);
+        for (uint64_t ix = 0; ix < packets; ++ix)
+        {
+            if (tsPacket.parse(packet, packetSize))
+            {
+                checksum += tsPacket.getPid() + tsPacket.getPayloadOffset();
+            }
+            packet += packetSize;
+        }
+    }
+    printResult("TsPacket::parse", packets * rounds, "pkts",
+                packets * rounds * packetSize, getTime() - start);
+}
+
+void benchHeaderBatch(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds)
+{
+    TsHeaderBatch batch(BATCH_PACKETS);
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        uint64_t offset = 0;
+        uint64_t size = packets * packetSize;
+        while (offset < size)
+        {
+            uint32_t count = batch.decode(data + offset, size - offset, packetSize);
+            checksum += batch.getPids()[count - 1];
+            offset += (uint64_t)count * packetSize;
+        }
+    }
+    printResult("TsHeaderBatch::decode", packets * rounds, "pkts",
+                packets * rounds * packetSize, getTime() - start);
+}
+
+void benchPcrParse(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds)
+{
+    // The PCRs through the parsed packet and adaptation field, as before
+    TsPacket tsPacket;
+    AdaptationField adaptationField;
+    uint64_t pcrs = 0;
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        uint8_t* packet = const_cast<uint8_t*>(data);
+        for (uint64_t ix = 0; ix < packets; ++ix)
+        {
+            if (tsPacket.parse(packet, packetSize) && tsPacket.hasAdaptationField())
+            {
+                adaptationField.parse(tsPacket.getAdaptationField());
+                if (adaptationField.hasPcr())
+                {
+                    checksum += adaptationField.getPcr();
+                    ++pcrs;
+                }
+            }
+            packet += packetSize;
+        }
+    }
+    double seconds = getTime() - start;
+    printResult("AdaptationField::getPcr", packets * rounds, "pkts", packets * rounds * packetSize, seconds);
+    MSG("%-36s %12" PRIu64 " PCRs", "", pcrs);
+}
+
+void benchPcrBatch(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds)
+{
+    std::vector<uint32_t> packetIndices(BATCH_PACKETS);
+    std::vector<uint64_t> pcrValues(BATCH_PACKETS);
+    uint64_t pcrs = 0;
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        for (uint64_t ix = 0; ix < packets; ix += BATCH_PACKETS)
+        {
+            uint32_t count = (packets - ix < BATCH_PACKETS) ? packets - ix : BATCH_PACKETS;
+            uint32_t found = AdaptationField::findPcrs(data + ix * packetSize, count, packetSize, PID_NULL,
+                                                       &packetIndices[0], &pcrValues[0]);
+            for (uint32_t pcr = 0; pcr < found; ++pcr)
+            {
+                checksum += pcrValues[pcr];
+            }
+            pcrs += found;
+        }
+    }
+    double seconds = getTime() - start;
+    printResult("AdaptationField::findPcrs", packets * rounds, "pkts", packets * rounds * packetSize, seconds);
+    MSG("%-36s %12" PRIu64 " PCRs", "", pcrs);
+}
+
+bool benchSectionParse(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds)
+{
+    // Parse the first PAT and PMT of the stream over and over, the same way
+    // as TsMetadata does
+    TsPacket patPacket;
+    TsPacket pmtPacket;
+    bool isPatFound = false;
+    bool isPmtFound = false;
+    uint8_t* packet = const_cast<uint8_t*>(data);
+    for (uint64_t ix = 0; ix < packets && !(isPatFound && isPmtFound); ++ix)
+    {
+        TsPacket* tsPacket = isPatFound ? &pmtPacket : &patPacket;
+        if (tsPacket->parse(packet, packetSize) && tsPacket->getPayloadUnitStartIndicator())
+        {
+            PsiSection psiSection;
+            if (tsPacket->hasPayload() && psiSection.parse(tsPacket->getPayload()))
+            {
+                if (!isPatFound && psiSection.getTableId() == TABLE_PAT)
+                {
+                    isPatFound = true;
+                }
+                else if (isPatFound && psiSection.getTableId() == TABLE_PMT)
+                {
+                    isPmtFound = true;
+                }
+            }
+        }
+        packet += packetSize;
+    }
+    if (!isPmtFound)
+    {
+        ERR("No PAT or PMT found in the generated stream");
+        return false;
+    }
+
+    PsiSection psiSection;
+    psiSection.parse(patPacket.getPayload());
+    uint16_t patSize = patPacket.getPacketSize() - psiSection.getDataOffset();
+    psiSection.parse(pmtPacket.getPayload());
+    uint16_t pmtSize = pmtPacket.getPacketSize() - psiSection.getDataOffset();
+
+    PatSection patSection;
+    double start = getTime();
+    for (uint32_t ix = 0; ix < rounds; ++ix)
+    {
+        patSection.parse(patPacket.getPayload(), patSize);
+        checksum += patSection.getPrograms().size();
+    }
+    printResult("PatSection::parse", rounds, "sects", (uint64_t)rounds * patSize, getTime() - start);
+
+    PmtSection pmtSection;
+    start = getTime();
+    for (uint32_t ix = 0; ix < rounds; ++ix)
+    {
+        pmtSection.parse(pmtPacket.getPayload(), pmtSize);
+        checksum += pmtSection.getStreamList().size();
+    }
+    printResult("PmtSection::parse", rounds, "sects", (uint64_t)rounds * pmtSize, getTime() - start);
+    return true;
+}
+
+void benchPesAssembly(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds)
+{
+    // An assembler for every PID found starting a PES, all sharing a pool
+    PesBufferPool pool;
+    std::vector<PesAssembler*> assemblers(PID_NULL + 1, NULL);
+    TsPacket tsPacket;
+    uint64_t pesCount = 0;
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        uint8_t* packet = const_cast<uint8_t*>(data);
+        for (uint64_t ix = 0; ix < packets; ++ix)
+        {
+            if (tsPacket.parse(packet, packetSize))
+            {
+                PesAssembler*& assembler = assemblers[tsPacket.getPid()];
+                if (assembler == NULL && tsPacket.getPayloadUnitStartIndicator() &&
+                    tsPacket.getPayloadSize() >= PesPacket::PES_HEADER_SIZE)
+                {
+                    const uint8_t* payload = tsPacket.getPayload();
+                    if (payload[0] == 0x00 && payload[1] == 0x00 && payload[2] == 0x01)
+                    {
+                        assembler = new PesAssembler(&pool);
+                    }
+                }
+                if (assembler)
+                {
+                    assembler->pushPacket(&tsPacket, ix);
+                    PesPacket* pesPacket;
+                    while ((pesPacket = assembler->viewNextPes()) != NULL)
+                    {
+                        checksum += pesPacket->getSize();
+                        ++pesCount;
+                    }
+                }
+            }
+            packet += packetSize;
+        }
+    }
+    double seconds = getTime() - start;
+    for (std::vector<PesAssembler*>::iterator ix = assemblers.begin(); ix != assemblers.end(); ++ix)
+    {
+        delete *ix;
+    }
+    printResult("PesAssembler::pushPacket", packets * rounds, "pkts", packets * rounds * packetSize, seconds);
+    MSG("%-36s %12" PRIu64 " PES %9" PRIu64 " allocations", "", pesCount, pool.getAllocationCount());
+}
+
+void benchTimestamps(const uint8_t* data, uint64_t packets, uint8_t packetSize, uint32_t rounds)
+{
+    TimestampRecorder recorder;
+    TsPacket tsPacket;
+    uint64_t timestamps = 0;
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        uint8_t* packet = const_cast<uint8_t*>(data);
+        for (uint64_t ix = 0; ix < packets; ++ix)
+        {
+            if (tsPacket.parse(packet, packetSize) && recorder.pushPacket(&tsPacket, ix))
+            {
+                ++timestamps;
+            }
+            packet += packetSize;
+        }
+        // Drained once per round, as a monitor would every so often
+        const std::vector<uint16_t>& pids = recorder.getPids();
+        for (std::vector<uint16_t>::const_iterator pid = pids.begin(); pid != pids.end(); ++pid)
+        {
+            const TimestampRecorder::TimestampList& list = recorder.getTimestamps(*pid);
+            for (TimestampRecorder::TimestampList::const_iterator ix = list.begin(); ix != list.end(); ++ix)
+            {
+                checksum += ix->pts;
+            }
+        }
+        recorder.clearTimestamps();
+    }
+    double seconds = getTime() - start;
+    printResult("TimestampRecorder::pushPacket", packets * rounds, "pkts", packets * rounds * packetSize, seconds);
+    MSG("%-36s %12" PRIu64 " timestamps", "", timestamps);
+}
+
+void benchNalScan(const uint8_t* data, uint64_t size, uint32_t rounds)
+{
+    // The stream stands in for a video elementary stream, with a slice NAL
+    // unit every NAL_SPACING bytes
+    std::vector<uint8_t> stream(data, data + size);
+    for (uint64_t ix = 0; ix + 4 <= size; ix += NAL_SPACING)
+    {
+        stream[ix] = 0x00;
+        stream[ix + 1] = 0x00;
+        stream[ix + 2] = 0x01;
+        stream[ix + 3] = 0x65;
+    }
+    NalScanner scanner(NalScanner::CODEC_H264);
+    uint64_t nalUnits = 0;
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        // Scanned in chunks the size of a large PES
+        for (uint64_t offset = 0; offset < size; offset += 1 << 20)
+        {
+            scanner.setData(&stream[offset], std::min(size - offset, (uint64_t)1 << 20));
+            NalScanner::NalUnit nalUnit;
+            while (scanner.nextNalUnit(nalUnit))
+            {
+                checksum += nalUnit.type + nalUnit.size;
+                ++nalUnits;
+            }
+        }
+    }
+    printResult("NalScanner::nextNalUnit", nalUnits, "NALs", size * rounds, getTime() - start);
+}
+
+void benchSectionAppend(uint32_t rounds)
+{
+    // A PAT split over two sections, the first one carries the length of
+    // the whole table
+    uint8_t first[PACKET_SIZE_TS];
+    uint8_t second[PACKET_SIZE_TS];
+    uint16_t dataLength = APPEND_PROGRAMS * 4 + 4;
+    uint16_t length = 5 + dataLength;
+    uint8_t programs[APPEND_PROGRAMS * 4 + 4];
+    for (uint16_t ix = 0; ix < APPEND_PROGRAMS; ++ix)
+    {
+        uint16_t pid = 0x100 + ix * 0x20;
+        programs[ix * 4] = (ix + 1) >> 8;
+        programs[ix * 4 + 1] = (ix + 1) & 0xFF;
+        programs[ix * 4 + 2] = 0xE0 | (pid >> 8);
+        programs[ix * 4 + 3] = pid & 0xFF;
+    }
+    // The CRC is not checked
+    memset(programs + APPEND_PROGRAMS * 4, 0, 4);
+
+    const uint8_t header[] = { TABLE_PAT, (uint8_t)(0xB0 | (length >> 8)), (uint8_t)(length & 0xFF),
+                               0x00, 0x01, 0xC1, 0x00, 0x01 };
+    first[0] = 0;
+    memcpy(first + 1, header, sizeof(header));
+    memcpy(first + 1 + sizeof(header), programs, APPEND_SPLIT);
+    memcpy(second, header, sizeof(header));
+    second[6] = 1;
+    memcpy(second + sizeof(header), programs + APPEND_SPLIT, dataLength - APPEND_SPLIT);
+
+    PatSection patSection;
+    double start = getTime();
+    for (uint32_t ix = 0; ix < rounds; ++ix)
+    {
+        patSection.parse(first, sizeof(header) + APPEND_SPLIT);
+        patSection.append(second, sizeof(header) + dataLength - APPEND_SPLIT);
+        checksum += patSection.getPrograms().size();
+    }
+    printResult("PatSection::parse + append", rounds, "tabls",
+                (uint64_t)rounds * (2 * sizeof(header) + dataLength), getTime() - start);
+}
+
+void benchCrc32(const uint8_t* data, uint64_t size, uint16_t sectionSize, uint32_t rounds)
+{
+    // The stream is checked as back to back sections of the given size
+    uint64_t sections = size / sectionSize;
+    char name[64];
+    snprintf(name, sizeof(name), "Crc32::calculate %u B%s", sectionSize,
+             Crc32::isAccelerated() ? " (PCLMUL)" : "");
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        const uint8_t* section = data;
+        for (uint64_t ix = 0; ix < sections; ++ix)
+        {
+            checksum += Crc32::calculate(section, sectionSize);
+            section += sectionSize;
+        }
+    }
+    printResult(name, sections * rounds, "sects", sections * rounds * sectionSize, getTime() - start);
+}
+
+void benchEitSchedule(uint32_t rounds)
+{
+    // A carousel of a week of 3 hour events per service, the CRC is not
+    // checked by pushSection()
+    uint16_t eventSize = 12 + EIT_DESCRIPTOR_SIZE;
+    uint16_t sectionSize = 14 + EIT_EVENTS * eventSize + 4;
+    std::vector<uint8_t> carousel(EIT_SERVICES * EIT_SECTIONS * sectionSize);
+    uint8_t* section = &carousel[0];
+    for (uint16_t service = 0; service < EIT_SERVICES; ++service)
+    {
+        for (uint16_t number = 0; number < EIT_SECTIONS; ++number)
+        {
+            uint16_t length = sectionSize - 3;
+            const uint8_t header[] = { TABLE_EIT_ACTUAL_SCHEDULE_START, (uint8_t)(0xF0 | (length >> 8)),
+                                       (uint8_t)(length & 0xFF), (uint8_t)(service >> 8),
+                                       (uint8_t)(service & 0xFF), 0xC1, (uint8_t)number,
+                                       EIT_SECTIONS - 1, 0x00, 0x01, 0x00, 0x01, (uint8_t)number,
+                                       TABLE_EIT_ACTUAL_SCHEDULE_START };
+            memcpy(section, header, sizeof(header));
+            uint8_t* event = section + sizeof(header);
+            for (uint16_t ix = 0; ix < EIT_EVENTS; ++ix)
+            {
+                // 2012-10-16 plus 3 hours per event
+                uint32_t hours = (number * EIT_EVENTS + ix) * 3;
+                uint16_t modifiedJulianDate = 56216 + hours / 24;
+                hours %= 24;
+                const uint8_t eventHeader[] = { (uint8_t)((number * EIT_EVENTS + ix) >> 8),
+                                                (uint8_t)(number * EIT_EVENTS + ix),
+                                                (uint8_t)(modifiedJulianDate >> 8),
+                                                (uint8_t)(modifiedJulianDate & 0xFF),
+                                                (uint8_t)(((hours / 10) << 4) | (hours % 10)), 0x00, 0x00,
+                                                0x03, 0x00, 0x00, 0x80, EIT_DESCRIPTOR_SIZE };
+                memcpy(event, eventHeader, sizeof(eventHeader));
+                memset(event + sizeof(eventHeader), ix, EIT_DESCRIPTOR_SIZE);
+                event += eventSize;
+            }
+            memset(event, 0, 4);
+            section += sectionSize;
+        }
+    }
+
+    // The first round adds the events, the next ones are the repetitions of
+    // the carousel
+    EitSchedule eitSchedule;
+    uint32_t sections = EIT_SERVICES * EIT_SECTIONS;
+    double start = getTime();
+    for (uint32_t round = 0; round < rounds; ++round)
+    {
+        section = &carousel[0];
+        for (uint32_t ix = 0; ix < sections; ++ix)
+        {
+            checksum += eitSchedule.pushSection(section, sectionSize);
+            section += sectionSize;
+        }
+    }
+    checksum += eitSchedule.getEventCount();
+    printResult("EitSchedule::pushSection", (uint64_t)rounds * sections, "sects",
+                (uint64_t)rounds * carousel.size(), getTime() - start);
+}
+
+bool benchCollectMetadata(const char* fileName, uint32_t rounds)
+{
+    // Opening the file locks to the packets and collects the PAT and PMTs
+    TsFile tsFile;
+    uint64_t packets = 0;
+    uint8_t packetSize = 0;
+    double start = getTime();
+    for (uint32_t ix = 0; ix < rounds; ++ix)
+    {
+        if (!tsFile.open(fileName) || !tsFile.isValid())
+        {
+            ERR("Unable to open the file: %s", fileName);
+            return false;
+        }
+        // Packets read until the last of the tables was found
+        uint64_t lastPacket = tsFile.getPatInfo().packetNumber;
+        const TsFile::PmtInfoList& pmtInfoList = tsFile.getPmtInfoList();
+        for (TsFile::PmtInfoList::const_iterator iy = pmtInfoList.begin();
+             iy != pmtInfoList.end(); ++iy)
+        {
+            if (iy->packetNumber > lastPacket)
+            {
+                lastPacket = iy->packetNumber;
+            }
+        }
+        packets += lastPacket + 1;
+        packetSize = tsFile.getPacketSize();
+        tsFile.close();
+    }
+    double seconds = getTime() - start;
+    MSG("%-36s %12.3f opens/s", "TsFile::open", rounds / seconds);
+    printResult("TsFile::collectMetadata", packets, "pkts",
+                packets * packetSize, seconds);
+    return true;
+}
+
+bool benchSequentialView(const char* fileName, TsFile::IoMode mode, const char* name)
+{
+    TsFile tsFile;
+    if (!tsFile.open(fileName, mode) || !tsFile.isValid())
+    {
+        ERR("Unable to open the file: %s", fileName);
+        return false;
+    }
+    if (tsFile.getIoMode() != mode)
+    {
+        MSG("%-36s not available", name);
+        return true;
+    }
+    uint64_t packets = 0;
+    double start = getTime();
+    for (TsPacket* tsPacket = tsFile.viewPacketByNumber(0); tsPacket;
+         tsPacket = tsFile.viewNextPacket())
+    {
+        checksum += tsPacket->getPid();
+        ++packets;
+    }
+    printResult(name, packets, "pkts", packets * tsFile.getPacketSize(), getTime() - start);
+    return true;
+}
+
+bool benchRandomView(const char* fileName, uint32_t lookups, uint32_t seed)
+{
+    TsFile tsFile;
+    if (!tsFile.open(fileName, TsFile::IO_MODE_MMAP) || !tsFile.isValid())
+    {
+        ERR("Unable to open the file: %s", fileName);
+        return false;
+    }
+    uint64_t packetCount = tsFile.getPacketCount();
+    uint64_t random = seed ? seed : 1;
+    double start = getTime();
+    for (uint32_t ix = 0; ix < lookups; ++ix)
+    {
+        // xorshift64, the same packets on every run
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+        TsPacket* tsPacket = tsFile.viewPacketByNumber(random % packetCount);
+        if (tsPacket)
+        {
+            checksum += tsPacket->getPid();
+        }
+    }
+    printResult("TsFile::viewPacketByNumber (random)", lookups, "pkts",
+                (uint64_t)lookups * tsFile.getPacketSize(), getTime() - start);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options) || options.showHelp)
+    {
+        printUsage(argv[0]);
+        return options.showHelp ? 0 : -1;
+    }
+
+    TsGenerator generator(options.config);
+    if (!generator.isValid())
+    {
+        ERR("Invalid stream configuration, the elementary streams must fit in the mux rate");
+        return -1;
+    }
+    uint8_t packetSize = options.config.packetSize;
+    uint64_t packets = options.streamSize / packetSize;
+    if (packets == 0)
+    {
+        ERR("The stream size is too small");
+        return -1;
+    }
+
+    if (options.outputFileName)
+    {
+        if (!generator.writeFile(options.outputFileName, packets))
+        {
+            ERR("Unable to write the file: %s", options.outputFileName);
+            return -1;
+        }
+        return 0;
+    }
+
+    uint8_t* data = new uint8_t[packets * packetSize];
+    double start = getTime();
+    generator.generate(data, packets);
+    MSG("Generated %" PRIu64 " packets of %u bytes in %.3f s",
+        packets, packetSize, getTime() - start);
+    MSG("");
+
+    bool isSuccess = true;
+    benchPacketParse(data, packets, packetSize, options.rounds);
+    benchHeaderBatch(data, packets, packetSize, options.rounds);
+    benchPcrParse(data, packets, packetSize, options.rounds);
+    benchPcrBatch(data, packets, packetSize, options.rounds);
+    benchPesAssembly(data, packets, packetSize, options.rounds);
+    benchTimestamps(data, packets, packetSize, options.rounds);
+    benchNalScan(data, packets * packetSize, options.rounds);
+    isSuccess = benchSectionParse(data, packets, packetSize, options.sectionRounds);
+    benchSectionAppend(options.sectionRounds);
+    benchCrc32(data, packets * packetSize, SECTION_SIZE_PSI_MAX, options.rounds);
+    benchCrc32(data, packets * packetSize, SECTION_SIZE_PRIVATE_MAX, options.rounds);
+    benchEitSchedule(options.rounds * 25);
+
+    // The TsFile benchmarks go through the same stream from a file
+    FILE* file = fopen(options.fileName, "wb");
+    if (file == NULL || fwrite(data, packetSize, packets, file) != packets || fclose(file) != 0)
+    {
+        ERR("Unable to write the file: %s", options.fileName);
+        delete[] data;
+        return -1;
+    }
+    delete[] data;
+
+    // The file was just written, so the file benchmarks read from the page
+    // cache and measure the parsing rather than the storage
+    isSuccess = isSuccess && benchCollectMetadata(options.fileName, 1000);
+    isSuccess = isSuccess &&
+                benchSequentialView(options.fileName, TsFile::IO_MODE_STDIO,
+                                    "TsFile::viewNextPacket (stdio)") &&
+                benchSequentialView(options.fileName, TsFile::IO_MODE_MMAP,
+                                    "TsFile::viewNextPacket (mmap)") &&
+                benchSequentialView(options.fileName, TsFile::IO_MODE_READ_AHEAD,
+                                    "TsFile::viewNextPacket (read ahead)") &&
+                benchSequentialView(options.fileName, TsFile::IO_MODE_IO_URING,
+                                    "TsFile::viewNextPacket (io_uring)");
+    isSuccess = isSuccess &&
+                benchRandomView(options.fileName, options.randomLookups, options.config.seed);
+
+    if (!options.keepFile)
+    {
+        unlink(options.fileName);
+    }
+    MSG("");
+    MSG("Checksum: %016" PRIx64, checksum);
+    return isSuccess ? 0 : -1;
+}
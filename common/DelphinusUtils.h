@@ -39,6 +39,7 @@
 #endif
 
 #include <inttypes.h>
+#include <cstring>
 
 /**
  *  \brief  This namespace contains the various types, utilities and helper
@@ -119,6 +120,21 @@ namespace DelphinusUtils
  *  \param  ... Parameters (variable arguments) for the format string
  */
     void LogOutput(uint8_t module, DelphinusLogLevel level, const char* fmt, ...);
+
+/**
+ *  \brief  Load 8 bytes of any alignment as a big endian integer.
+ *  \param  data First of the 8 bytes, the most significant one.
+ *  \return The 64-bit integer.
+ */
+    inline uint64_t loadBigEndian64(const uint8_t* data)
+    {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        value = __builtin_bswap64(value);
+#endif
+        return value;
+    }
 }
 
 
@@ -0,0 +1,201 @@
+/*
+ *  Crc32.cpp - Computes the CRC_32 of the sections as specified in the
+ *  ISO 13818-1 document
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "Crc32.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_X86
+#include <immintrin.h>
+#endif
+
+//#define DEBUG
+
+#define MODULE_CRC32 10
+#define CURRENT_MODULE MODULE_CRC32
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define CRC32_POLYNOMIAL 0x04C11DB7
+
+typedef uint32_t (*CrcFunction)(const uint8_t* data, uint32_t size, uint32_t crc);
+
+// crcTables[n][byte] is the CRC of the byte followed by n zero bytes, which
+// lets 8 bytes be processed with independent lookups
+static uint32_t crcTables[8][256];
+#ifdef CRC32_X86
+// x^n mod P for folding a 128 bit block over 128 and 512 bits, the high
+// qword is used for the upper 64 bits of the block
+static uint64_t foldConstants128[2];
+static uint64_t foldConstants512[2];
+#endif
+
+uint32_t getPowerModPolynomial(uint32_t power);
+CrcFunction initCrc32();
+uint32_t calculateTables(const uint8_t* data, uint32_t size, uint32_t crc);
+#ifdef CRC32_X86
+uint32_t calculatePclmul(const uint8_t* data, uint32_t size, uint32_t crc);
+#endif
+
+static CrcFunction calculateCrc = initCrc32();
+
+uint32_t getPowerModPolynomial(uint32_t power)
+{
+    uint32_t remainder = 1;
+    for (uint32_t ix = 0; ix < power; ++ix)
+    {
+        remainder = (remainder << 1) ^ ((remainder & 0x80000000) ? CRC32_POLYNOMIAL : 0);
+    }
+    return remainder;
+}
+
+CrcFunction initCrc32()
+{
+    for (uint32_t byte = 0; byte < 256; ++byte)
+    {
+        uint32_t crc = byte << 24;
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? CRC32_POLYNOMIAL : 0);
+        }
+        crcTables[0][byte] = crc;
+    }
+    for (uint32_t byte = 0; byte < 256; ++byte)
+    {
+        for (uint8_t table = 1; table < 8; ++table)
+        {
+            uint32_t crc = crcTables[table - 1][byte];
+            crcTables[table][byte] = (crc << 8) ^ crcTables[0][crc >> 24];
+        }
+    }
+
+#ifdef CRC32_X86
+    foldConstants128[0] = getPowerModPolynomial(128);
+    foldConstants128[1] = getPowerModPolynomial(128 + 64);
+    foldConstants512[0] = getPowerModPolynomial(512);
+    foldConstants512[1] = getPowerModPolynomial(512 + 64);
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3"))
+    {
+        MSG("Using PCLMULQDQ");
+        return calculatePclmul;
+    }
+#endif
+    return calculateTables;
+}
+
+uint32_t calculateTables(const uint8_t* data, uint32_t size, uint32_t crc)
+{
+    while (size >= 8)
+    {
+        uint32_t high = crc ^ (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                               ((uint32_t)data[2] << 8) | data[3]);
+        crc = crcTables[7][high >> 24] ^ crcTables[6][(high >> 16) & 0xFF] ^
+              crcTables[5][(high >> 8) & 0xFF] ^ crcTables[4][high & 0xFF] ^
+              crcTables[3][data[4]] ^ crcTables[2][data[5]] ^
+              crcTables[1][data[6]] ^ crcTables[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size--)
+    {
+        crc = (crc << 8) ^ crcTables[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+#ifdef CRC32_X86
+__attribute__((target("pclmul,ssse3")))
+inline __m128i foldBlock(__m128i block, __m128i constants, __m128i next)
+{
+    // block * x^n mod P, split into its upper and lower 64 bits which are
+    // multiplied by x^(n + 64) and x^n mod P
+    __m128i high = _mm_clmulepi64_si128(block, constants, 0x11);
+    __m128i low = _mm_clmulepi64_si128(block, constants, 0x00);
+    return _mm_xor_si128(next, _mm_xor_si128(high, low));
+}
+
+__attribute__((target("pclmul,ssse3")))
+uint32_t calculatePclmul(const uint8_t* data, uint32_t size, uint32_t crc)
+{
+    if (size < 64)
+    {
+        return calculateTables(data, size, crc);
+    }
+
+    // The bytes are reversed so that the first bit of the data is the most
+    // significant bit of the block, as the CRC is processed MSB first
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i fold128 = _mm_loadu_si128((const __m128i*)foldConstants128);
+    const __m128i fold512 = _mm_loadu_si128((const __m128i*)foldConstants512);
+    __m128i block0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), swap);
+    __m128i block1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), swap);
+    __m128i block2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), swap);
+    __m128i block3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), swap);
+    block0 = _mm_xor_si128(block0, _mm_set_epi32((int)crc, 0, 0, 0));
+    data += 64;
+    size -= 64;
+
+    while (size >= 64)
+    {
+        block0 = foldBlock(block0, fold512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), swap));
+        block1 = foldBlock(block1, fold512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), swap));
+        block2 = foldBlock(block2, fold512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), swap));
+        block3 = foldBlock(block3, fold512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), swap));
+        data += 64;
+        size -= 64;
+    }
+
+    block1 = foldBlock(block0, fold128, block1);
+    block2 = foldBlock(block1, fold128, block2);
+    block3 = foldBlock(block2, fold128, block3);
+    while (size >= 16)
+    {
+        block3 = foldBlock(block3, fold128, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)data), swap));
+        data += 16;
+        size -= 16;
+    }
+
+    // The CRC of the folded block is its remainder, the tables finish it
+    // along with the bytes left over
+    uint8_t folded[16];
+    _mm_storeu_si128((__m128i*)folded, _mm_shuffle_epi8(block3, swap));
+    crc = calculateTables(folded, sizeof(folded), 0);
+    return calculateTables(data, size, crc);
+}
+#endif
+
+uint32_t Crc32::calculate(const uint8_t* data, uint32_t size, uint32_t crc)
+{
+    return calculateCrc(data, size, crc);
+}
+
+bool Crc32::isAccelerated()
+{
+    return (calculateCrc != calculateTables);
+}
@@ -0,0 +1,85 @@
+/*
+ *  Crc32.h - Computes the CRC_32 of the sections as specified in the
+ *  ISO 13818-1 document
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   Crc32.h
+ *  \brief  CRC_32 of the sections.
+ *
+ *  Defines Crc32 which is used by SectionAssembler and PsiSection to verify
+ *  the CRC_32 at the end of the sections.
+ */
+
+#ifndef DELPHINUS_CRC32_H
+#define DELPHINUS_CRC32_H
+
+#include "common/DelphinusUtils.h"
+
+/**
+ *  \brief  Computes the CRC_32 used by the sections.
+ *
+ *  The CRC is the CRC-32/MPEG-2 variant, with the polynomial 0x04C11DB7
+ *  processed MSB first, an initial value of 0xFFFFFFFF and no final XOR.
+ *  Computing it over a whole section including its CRC_32 field gives 0 when
+ *  the section is not corrupted. The CRC is computed with the PCLMULQDQ
+ *  instruction, folding 64 bytes at a time, when the CPU supports it and
+ *  with slicing-by-8 tables otherwise.
+ */
+class Crc32
+{
+    public:
+        enum
+        {
+/** Initial value of the CRC. */
+            CRC32_INITIAL = 0xFFFFFFFF
+        };
+
+/**
+ *  \brief  Compute the CRC of the data.
+ *  \param  data Data to be processed.
+ *  \param  size Size of the data in bytes.
+ *  \param  crc CRC of the data preceding this data, CRC32_INITIAL at the
+ *          start of the data.
+ *  \return CRC including this data.
+ */
+        static uint32_t calculate(const uint8_t* data, uint32_t size,
+                                  uint32_t crc = CRC32_INITIAL);
+/**
+ *  \brief  Check the CRC_32 at the end of a section.
+ *  \param  section Start of the section, at the table_id.
+ *  \param  size Size of the whole section in bytes, including the CRC_32.
+ *  \return true if the CRC_32 matches the section, false otherwise.
+ */
+        static bool isSectionValid(const uint8_t* section, uint16_t size);
+/**
+ *  \brief  Check if the PCLMULQDQ implementation is in use.
+ *  \return true if the CPU supports it, false if the tables are used.
+ */
+        static bool isAccelerated();
+};
+
+inline bool Crc32::isSectionValid(const uint8_t* section, uint16_t size)
+{
+    return (size >= 4 && calculate(section, size) == 0);
+}
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ *  Descriptors.cpp - Zero-copy access to the descriptors carried in the
+ *  sections
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "Descriptors.h"
+#include <cstddef>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_DESCRIPTORS 12
+#define CURRENT_MODULE MODULE_DESCRIPTORS
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define AC3_FLAG_COMPONENT_TYPE     0x80
+#define AC3_FLAG_BSID               0x40
+#define AC3_FLAG_MAINID             0x20
+#define AC3_FLAG_ASVC               0x10
+#define AAC_FLAG_AAC_TYPE           0x80
+
+struct DescriptorType
+{
+    uint8_t tag;
+    const char* name;
+    // Size of the fixed part of the descriptor
+    uint8_t minimumLength;
+};
+
+static const DescriptorType descriptorTypes[] =
+{
+    { TAG_VIDEO_STREAM,                 "Video stream",                     1 },
+    { TAG_AUDIO_STREAM,                 "Audio stream",                     1 },
+    { TAG_HIRERACHY,                    "Hierarchy",                        4 },
+    { TAG_REGISTRATION,                 "Registration",                     4 },
+    { TAG_DATA_STREAM_ALIGNMENT,        "Data stream alignment",            1 },
+    { TAG_TARGET_BACKGROUND_GRID,       "Target background grid",           4 },
+    { TAG_VIDEO_WINDOW,                 "Video window",                     4 },
+    { TAG_CA,                           "CA",                               4 },
+    { TAG_ISO_639_LANGUAGE,             "ISO 639 language",                 0 },
+    { TAG_SYSTEM_CLOCK,                 "System clock",                     2 },
+    { TAG_MULTIPLEX_BUFFER_UTILIZATION, "Multiplex buffer utilization",     4 },
+    { TAG_COPYRIGHT,                    "Copyright",                        4 },
+    { TAG_MAXIMUM_BITRATE,              "Maximum bitrate",                  3 },
+    { TAG_PRIVATE_DATA_INDICATOR,       "Private data indicator",           4 },
+    { TAG_SMOOTHING_BUFFER,             "Smoothing buffer",                 6 },
+    { TAG_STD,                          "STD",                              1 },
+    { TAG_IBP,                          "IBP",                              2 },
+    { TAG_MPEG_4_VIDEO,                 "MPEG-4 video",                     1 },
+    { TAG_MPEG_4_AUDIO,                 "MPEG-4 audio",                     1 },
+    { TAG_IOD,                          "IOD",                              2 },
+    { TAG_SL,                           "SL",                               2 },
+    { TAG_FMC,                          "FMC",                              0 },
+    { TAG_EXTERNAL_ES_ID,               "External ES ID",                   2 },
+    { TAG_MUXCODE,                      "MuxCode",                          0 },
+    { TAG_FMX_BUFFER_SIZE,              "FmxBufferSize",                    0 },
+    { TAG_MULTIPLEX_BUFFER,             "Multiplex buffer",                 6 },
+    { TAG_NETWORK_NAME,                 "Network name",                     0 },
+    { TAG_SERVICE_LIST,                 "Service list",                     0 },
+    { TAG_STUFFING,                     "Stuffing",                         0 },
+    { TAG_SATELLITE_DELIVERY,           "Satellite delivery system",        11 },
+    { TAG_CABLE_DELIVERY,               "Cable delivery system",            11 },
+    { TAG_VBI_DATA,                     "VBI data",                         0 },
+    { TAG_VBI_TELETEXT,                 "VBI teletext",                     0 },
+    { TAG_BOUQUET,                      "Bouquet name",                     0 },
+    { TAG_SERVICE,                      "Service",                          3 },
+    { TAG_COUNTRY_AVAILABILITY,         "Country availability",             1 },
+    { TAG_LINKAGE,                      "Linkage",                          7 },
+    { TAG_NVOD,                         "NVOD reference",                   0 },
+    { TAG_TIME_SHIFTED,                 "Time shifted service",             2 },
+    { TAG_COMPONENT,                    "Component",                        6 },
+    { TAG_MOSAIC,                       "Mosaic",                           1 },
+    { TAG_STREAM_IDENTIFIER,            "Stream identifier",                1 },
+    { TAG_CA_IDENTIFIER,                "CA identifier",                    0 },
+    { TAG_CONTENT,                      "Content",                          0 },
+    { TAG_PARENTAL_RATING,              "Parental rating",                  0 },
+    { TAG_TELETEXT,                     "Teletext",                         0 },
+    { TAG_TELEPHONE,                    "Telephone",                        3 },
+    { TAG_LOCAL_TIME_OFFSET,            "Local time offset",                0 },
+    { TAG_SUBTITLING,                   "Subtitling",                       0 },
+    { TAG_TERRESTRIAL_DELIVERY_SYSTEM,  "Terrestrial delivery system",      11 },
+    { TAG_MULTILINGUAL_NEWTORK_NAME,    "Multilingual network name",        0 },
+    { TAG_MULTILINGUAL_BOUQUET_NAME,    "Multilingual bouquet name",        0 },
+    { TAG_MULTILINGUAL_SERVICE_NAME,    "Multilingual service name",        0 },
+    { TAG_MULTILINGUAL_COMPONENT,       "Multilingual component",           1 },
+    { TAG_PRIVATA_DATA_SPECIFIER,       "Private data specifier",           4 },
+    { TAG_SERVICE_MOVE,                 "Service move",                     6 },
+    { TAG_SHORT_SMOOTHING_BUFFER,       "Short smoothing buffer",           1 },
+    { TAG_FREQUENCY_LIST,               "Frequency list",                   1 },
+    { TAG_PARTIAL_TS,                   "Partial TS",                       8 },
+    { TAG_DATA_BROADCAST,               "Data broadcast",                   8 },
+    { TAG_SCRAMBLING,                   "Scrambling",                       1 },
+    { TAG_DATA_BROADCAST_ID,            "Data broadcast ID",                2 },
+    { TAG_TS,                           "Transport stream",                 0 },
+    { TAG_DSNG,                         "DSNG",                             0 },
+    { TAG_PDC,                          "PDC",                              3 },
+    { TAG_AC3,                          "AC-3",                             1 },
+    { TAG_ANCILLARY_DATA,               "Ancillary data",                   1 },
+    { TAG_CELL_LIST,                    "Cell list",                        0 },
+    { TAG_CELL_FREQUENCY_LIST,          "Cell frequency link",              0 },
+    { TAG_ANNOUNCEMENT_SUPPORT,         "Announcement support",             2 },
+    { TAG_APPLICATION_SIGNALLING,       "Application signalling",           0 },
+    { TAG_APPLICATION_FIELD,            "Adaptation field data",            1 },
+    { TAG_SERVICE_IDENTIFIER,           "Service identifier",               0 },
+    { TAG_SERVICE_AVAILABILITY,         "Service availability",             1 },
+    { TAG_DEFAULT_AUTHORITY,            "Default authority",                0 },
+    { TAG_RELATED_CONTENT,              "Related content",                  0 },
+    { TAG_TVA_ID,                       "TVA ID",                           0 },
+    { TAG_CONTENT_ID,                   "Content identifier",               0 },
+    { TAG_TIME_SLICE_FEC_IDENTIFIER,    "Time slice FEC identifier",        1 },
+    { TAG_ECM_REPETITION_RATE,          "ECM repetition rate",              4 },
+    { TAG_S2_SATELLITE_DELIVERY_SYSTEM, "S2 satellite delivery system",     1 },
+    { TAG_E_AC3,                        "Enhanced AC-3",                    1 },
+    { TAG_DTS,                          "DTS",                              5 },
+    { TAG_AAC,                          "AAC",                              1 },
+    { TAG_XAIT_LOCATION,                "XAIT location",                    0 },
+    { TAG_FTA_CONTENT_MANAGEMENT,       "FTA content management",           1 },
+    { TAG_EXTENSION,                    "Extension",                        1 }
+};
+
+// Indexed by the tag, filled in from descriptorTypes and the tag ranges
+static const char* tagNames[256];
+static uint8_t minimumLengths[256];
+
+bool initDescriptorTypes();
+
+static bool isDescriptorTypesReady = initDescriptorTypes();
+
+bool initDescriptorTypes()
+{
+    for (uint16_t tag = 0; tag < 256; ++tag)
+    {
+        if (tag >= TAG_13818_6_START && tag <= TAG_13818_6_END)
+        {
+            tagNames[tag] = "ISO 13818-6";
+        }
+        else if (tag >= TAG_13818_1_RESERVED_START && tag <= TAG_13818_1_RESERVED_END)
+        {
+            tagNames[tag] = "ISO 13818-1 Reserved";
+        }
+        else if (tag >= TAG_DVB_USER_DEFINED_START && tag <= TAG_DVB_USER_DEFINED_END)
+        {
+            tagNames[tag] = "User Private";
+        }
+        else
+        {
+            tagNames[tag] = "Unknown";
+        }
+        minimumLengths[tag] = 0;
+    }
+    for (size_t ix = 0; ix < sizeof(descriptorTypes) / sizeof(descriptorTypes[0]); ++ix)
+    {
+        tagNames[descriptorTypes[ix].tag] = descriptorTypes[ix].name;
+        minimumLengths[descriptorTypes[ix].tag] = descriptorTypes[ix].minimumLength;
+    }
+    return true;
+}
+
+DescriptorDispatcher::DescriptorDispatcher(void* handlerContext)
+    :   context(handlerContext)
+{
+    for (uint16_t tag = 0; tag < 256; ++tag)
+    {
+        handlers[tag] = NULL;
+    }
+}
+
+DescriptorDispatcher::~DescriptorDispatcher()
+{
+}
+
+uint16_t DescriptorDispatcher::dispatch(const PsiDescriptor& loop)
+{
+    uint16_t handled = 0;
+    for (DescriptorIterator ix(loop); ix.isValid(); ix.next())
+    {
+        uint8_t tag = ix.getTag();
+        Handler handler = handlers[tag];
+        if (handler && ix.getLength() >= minimumLengths[tag])
+        {
+            handler(context, tag, ix.getData(), ix.getLength());
+            ++handled;
+        }
+    }
+    return handled;
+}
+
+const char* DescriptorDispatcher::getTagStr(uint8_t tag)
+{
+    return tagNames[tag];
+}
+
+uint8_t DescriptorDispatcher::getMinimumLength(uint8_t tag)
+{
+    return minimumLengths[tag];
+}
+
+const uint8_t* Ac3Descriptor::getField(uint8_t flag)
+{
+    if (length == 0 || !(data[0] & flag))
+    {
+        return NULL;
+    }
+    // The fields present follow the flags in the order of the flags
+    uint8_t offset = 1;
+    for (uint8_t mask = AC3_FLAG_COMPONENT_TYPE; mask > flag; mask >>= 1)
+    {
+        if (data[0] & mask)
+        {
+            ++offset;
+        }
+    }
+    return (offset < length) ? data + offset : NULL;
+}
+
+bool Ac3Descriptor::getComponentType(uint8_t& componentType)
+{
+    const uint8_t* field = getField(AC3_FLAG_COMPONENT_TYPE);
+    if (field)
+    {
+        componentType = *field;
+    }
+    return (field != NULL);
+}
+
+bool Ac3Descriptor::getBsid(uint8_t& bsid)
+{
+    const uint8_t* field = getField(AC3_FLAG_BSID);
+    if (field)
+    {
+        bsid = *field;
+    }
+    return (field != NULL);
+}
+
+bool Ac3Descriptor::getMainId(uint8_t& mainId)
+{
+    const uint8_t* field = getField(AC3_FLAG_MAINID);
+    if (field)
+    {
+        mainId = *field;
+    }
+    return (field != NULL);
+}
+
+bool Ac3Descriptor::getAsvc(uint8_t& asvc)
+{
+    const uint8_t* field = getField(AC3_FLAG_ASVC);
+    if (field)
+    {
+        asvc = *field;
+    }
+    return (field != NULL);
+}
+
+bool AacDescriptor::getAacType(uint8_t& aacType)
+{
+    if (length < 3 || !(data[1] & AAC_FLAG_AAC_TYPE))
+    {
+        return false;
+    }
+    aacType = data[2];
+    return true;
+}
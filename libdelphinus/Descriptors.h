@@ -0,0 +1,839 @@
+/*
+ *  Descriptors.h - Zero-copy access to the descriptors carried in the
+ *  sections
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   Descriptors.h
+ *  \brief  Iteration over the descriptor loops and views of the common
+ *          descriptors.
+ *
+ *  Defines DescriptorIterator which walks a descriptor loop, such as the
+ *  PsiDescriptor of a PMT stream, DescriptorDispatcher which calls a handler
+ *  per descriptor tag, and typed views of the common descriptors. None of
+ *  them copy the descriptors, they read straight from the section bytes,
+ *  which must stay valid as long as they are used.
+ */
+
+#ifndef DELPHINUS_DESCRIPTORS_H
+#define DELPHINUS_DESCRIPTORS_H
+
+#include "common/DelphinusUtils.h"
+#include "MpegConstants.h"
+#include "PsiTables.h"
+
+/**
+ *  \brief  Walks the descriptors of a descriptor loop.
+ *
+ *  \code
+ *  for (DescriptorIterator ix(streamInfo.descriptor); ix.isValid(); ix.next())
+ *  {
+ *      if (ix.getTag() == MpegConstants::TAG_ISO_639_LANGUAGE)
+ *      {
+ *          Iso639LanguageDescriptor language(ix.getData(), ix.getLength());
+ *      }
+ *  }
+ *  \endcode
+ *
+ *  The iteration stops at the end of the loop, or at the first descriptor
+ *  whose length runs past the end of the loop.
+ */
+class DescriptorIterator
+{
+    private:
+        const uint8_t* current;
+        const uint8_t* end;
+
+    public:
+/**
+ *  \brief  Start at the first descriptor of a loop.
+ *  \param  loop The descriptor loop.
+ */
+        DescriptorIterator(const PsiDescriptor& loop);
+/**
+ *  \brief  Start at the first descriptor of a loop.
+ *  \param  start Start of the loop.
+ *  \param  size Size of the loop in bytes.
+ */
+        DescriptorIterator(const uint8_t* start, uint16_t size);
+
+/**
+ *  \brief  Check if the iterator is at a complete descriptor.
+ *  \return true if there is a descriptor to read, false at the end.
+ */
+        bool isValid();
+/**
+ *  \brief  Move to the next descriptor of the loop.
+ */
+        void next();
+/**
+ *  \brief  Get the descriptor_tag of the current descriptor.
+ *  \return 8-bit descriptor tag.
+ */
+        uint8_t getTag();
+/**
+ *  \brief  Get the descriptor_length of the current descriptor.
+ *  \return Size of the descriptor data in bytes.
+ */
+        uint8_t getLength();
+/**
+ *  \brief  Get the data of the current descriptor, following the
+ *          descriptor_length.
+ *  \return Start of the descriptor data.
+ */
+        const uint8_t* getData();
+};
+
+/**
+ *  \brief  Calls a handler for every descriptor of a loop, looked up by the
+ *          descriptor tag.
+ *
+ *  The handlers are kept in a table of 256 entries indexed by the tag, so
+ *  dispatching a descriptor is a single lookup whatever the number of
+ *  handlers set. The descriptors shorter than the minimum length of their
+ *  tag are skipped, so the handlers can read the fixed part of their
+ *  descriptor without checking its length.
+ */
+class DescriptorDispatcher
+{
+    public:
+/**
+ *  \brief  Handler of a descriptor.
+ *  \param  context Context passed to the dispatcher.
+ *  \param  tag Descriptor tag.
+ *  \param  data Start of the descriptor data, following the length.
+ *  \param  length Size of the descriptor data in bytes.
+ */
+        typedef void (*Handler)(void* context, uint8_t tag, const uint8_t* data, uint8_t length);
+
+    private:
+        Handler handlers[256];
+        void* context;
+
+    public:
+/**
+ *  \brief  Create a dispatcher with no handlers.
+ *  \param  handlerContext Context passed to the handlers.
+ */
+        DescriptorDispatcher(void* handlerContext);
+        ~DescriptorDispatcher();
+
+/**
+ *  \brief  Set the handler of a tag.
+ *  \param  tag Descriptor tag.
+ *  \param  handler Handler, NULL to skip the descriptors of the tag.
+ */
+        void setHandler(uint8_t tag, Handler handler);
+/**
+ *  \brief  Call the handlers of the descriptors of a loop.
+ *  \param  loop The descriptor loop.
+ *  \return Number of descriptors handled.
+ */
+        uint16_t dispatch(const PsiDescriptor& loop);
+/**
+ *  \brief  Get a string description for a descriptor tag.
+ *  \param  tag 8-bit descriptor tag.
+ *  \return Descriptive string of the tag.
+ */
+        static const char* getTagStr(uint8_t tag);
+/**
+ *  \brief  Get the smallest valid descriptor_length for a descriptor tag.
+ *  \param  tag 8-bit descriptor tag.
+ *  \return Minimum length in bytes, 0 for the tags not known.
+ */
+        static uint8_t getMinimumLength(uint8_t tag);
+};
+
+/**
+ *  \brief  View of an ISO 639 language descriptor (tag 0x0A).
+ */
+class Iso639LanguageDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        Iso639LanguageDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Get the number of languages in the descriptor.
+ *  \return Number of languages.
+ */
+        uint8_t getCount();
+/**
+ *  \brief  Get a language code.
+ *  \param  index Index of the language, less than getCount().
+ *  \return The 3 characters of the ISO 639-2 code, which are not NUL
+ *          terminated.
+ */
+        const char* getLanguage(uint8_t index);
+/**
+ *  \brief  Get the audio type of a language.
+ *  \param  index Index of the language, less than getCount().
+ *  \return 8-bit audio type, 0 for undefined.
+ */
+        uint8_t getAudioType(uint8_t index);
+};
+
+/**
+ *  \brief  View of a CA descriptor (tag 0x09).
+ */
+class CaDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        CaDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Check if the descriptor is long enough for its fields.
+ *  \return true if the fields can be read, false otherwise.
+ */
+        bool isValid();
+/**
+ *  \brief  Get the CA system ID.
+ *  \return 16-bit CA system ID.
+ */
+        uint16_t getCaSystemId();
+/**
+ *  \brief  Get the PID of the ECMs or EMMs.
+ *  \return 13-bit CA PID.
+ */
+        uint16_t getCaPid();
+/**
+ *  \brief  Get the private data bytes following the CA PID.
+ *  \return Start of the private data.
+ */
+        const uint8_t* getPrivateData();
+/**
+ *  \brief  Get the size of the private data.
+ *  \return Size of the private data in bytes.
+ */
+        uint8_t getPrivateDataSize();
+};
+
+/**
+ *  \brief  View of a registration descriptor (tag 0x05).
+ */
+class RegistrationDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        RegistrationDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Check if the descriptor is long enough for its fields.
+ *  \return true if the fields can be read, false otherwise.
+ */
+        bool isValid();
+/**
+ *  \brief  Get the format identifier, such as 'AC-3' or 'HDMV'.
+ *  \return 32-bit format identifier, the first character in the upper byte.
+ */
+        uint32_t getFormatIdentifier();
+/**
+ *  \brief  Get the additional identification info.
+ *  \return Start of the additional info.
+ */
+        const uint8_t* getAdditionalInfo();
+/**
+ *  \brief  Get the size of the additional identification info.
+ *  \return Size of the additional info in bytes.
+ */
+        uint8_t getAdditionalInfoSize();
+};
+
+/**
+ *  \brief  View of a DVB stream identifier descriptor (tag 0x52).
+ */
+class StreamIdentifierDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        StreamIdentifierDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Check if the descriptor is long enough for its fields.
+ *  \return true if the fields can be read, false otherwise.
+ */
+        bool isValid();
+/**
+ *  \brief  Get the component tag, matching the component descriptors of the
+ *          EIT.
+ *  \return 8-bit component tag.
+ */
+        uint8_t getComponentTag();
+};
+
+/**
+ *  \brief  View of a DVB service descriptor (tag 0x48).
+ */
+class ServiceDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        ServiceDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Check if the names fit within the descriptor.
+ *  \return true if the fields can be read, false otherwise.
+ */
+        bool isValid();
+/**
+ *  \brief  Get the service type.
+ *  \return 8-bit service type.
+ */
+        uint8_t getServiceType();
+/**
+ *  \brief  Get the name of the service provider.
+ *  \return Start of the name, which is not NUL terminated and may start
+ *          with a DVB character table selector.
+ */
+        const char* getProviderName();
+/**
+ *  \brief  Get the length of the name of the service provider.
+ *  \return Length of the name in bytes.
+ */
+        uint8_t getProviderNameLength();
+/**
+ *  \brief  Get the name of the service.
+ *  \return Start of the name, which is not NUL terminated and may start
+ *          with a DVB character table selector.
+ */
+        const char* getServiceName();
+/**
+ *  \brief  Get the length of the name of the service.
+ *  \return Length of the name in bytes.
+ */
+        uint8_t getServiceNameLength();
+};
+
+/**
+ *  \brief  View of a DVB AC-3 (tag 0x6A) or enhanced AC-3 (tag 0x7A)
+ *          descriptor.
+ *
+ *  Both descriptors start with the same flags for the component type, the
+ *  bsid, the mainid and the asvc fields, the enhanced AC-3 one has a few
+ *  more flags which are reported as absent for the AC-3 one.
+ */
+class Ac3Descriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+        bool isEnhanced;
+
+        const uint8_t* getField(uint8_t flag);
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  tag MpegConstants::TAG_AC3 or MpegConstants::TAG_E_AC3.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        Ac3Descriptor(uint8_t tag, const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Check if the descriptor is long enough for its flags.
+ *  \return true if the fields can be read, false otherwise.
+ */
+        bool isValid();
+/**
+ *  \brief  Check if the descriptor is the enhanced AC-3 one.
+ *  \return true for E-AC-3, false for AC-3.
+ */
+        bool isEnhancedAc3();
+/**
+ *  \brief  Get the component type.
+ *  \param  componentType Component type, set only if present.
+ *  \return true if the field is present, false otherwise.
+ */
+        bool getComponentType(uint8_t& componentType);
+/**
+ *  \brief  Get the bit stream identification.
+ *  \param  bsid Bsid, set only if present.
+ *  \return true if the field is present, false otherwise.
+ */
+        bool getBsid(uint8_t& bsid);
+/**
+ *  \brief  Get the main audio service identification.
+ *  \param  mainId Mainid, set only if present.
+ *  \return true if the field is present, false otherwise.
+ */
+        bool getMainId(uint8_t& mainId);
+/**
+ *  \brief  Get the associated service field.
+ *  \param  asvc Asvc, set only if present.
+ *  \return true if the field is present, false otherwise.
+ */
+        bool getAsvc(uint8_t& asvc);
+/**
+ *  \brief  Check the mixinfoexists flag of an enhanced AC-3 descriptor.
+ *  \return true if the stream carries mixing metadata, false otherwise.
+ */
+        bool hasMixInfo();
+};
+
+/**
+ *  \brief  View of a DVB AAC descriptor (tag 0x7C).
+ */
+class AacDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        AacDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Check if the descriptor is long enough for its fields.
+ *  \return true if the fields can be read, false otherwise.
+ */
+        bool isValid();
+/**
+ *  \brief  Get the MPEG-4 audio profile and level.
+ *  \return 8-bit profile and level.
+ */
+        uint8_t getProfileAndLevel();
+/**
+ *  \brief  Get the AAC type.
+ *  \param  aacType AAC type, set only if present.
+ *  \return true if the field is present, false otherwise.
+ */
+        bool getAacType(uint8_t& aacType);
+};
+
+/**
+ *  \brief  View of a DVB subtitling descriptor (tag 0x59).
+ */
+class SubtitlingDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        SubtitlingDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Get the number of subtitle services in the descriptor.
+ *  \return Number of subtitle services.
+ */
+        uint8_t getCount();
+/**
+ *  \brief  Get the language code of a subtitle service.
+ *  \param  index Index of the service, less than getCount().
+ *  \return The 3 characters of the ISO 639-2 code, which are not NUL
+ *          terminated.
+ */
+        const char* getLanguage(uint8_t index);
+/**
+ *  \brief  Get the subtitling type of a subtitle service.
+ *  \param  index Index of the service, less than getCount().
+ *  \return 8-bit subtitling type.
+ */
+        uint8_t getSubtitlingType(uint8_t index);
+/**
+ *  \brief  Get the composition page ID of a subtitle service.
+ *  \param  index Index of the service, less than getCount().
+ *  \return 16-bit composition page ID.
+ */
+        uint16_t getCompositionPageId(uint8_t index);
+/**
+ *  \brief  Get the ancillary page ID of a subtitle service.
+ *  \param  index Index of the service, less than getCount().
+ *  \return 16-bit ancillary page ID.
+ */
+        uint16_t getAncillaryPageId(uint8_t index);
+};
+
+/**
+ *  \brief  View of a DVB teletext (tag 0x56) or VBI teletext (tag 0x46)
+ *          descriptor.
+ */
+class TeletextDescriptor
+{
+    private:
+        const uint8_t* data;
+        uint8_t length;
+
+    public:
+/**
+ *  \brief  Create a view of the descriptor.
+ *  \param  descriptorData Start of the descriptor data, following the
+ *          length.
+ *  \param  descriptorLength Size of the descriptor data in bytes.
+ */
+        TeletextDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength);
+/**
+ *  \brief  Get the number of teletext pages in the descriptor.
+ *  \return Number of pages.
+ */
+        uint8_t getCount();
+/**
+ *  \brief  Get the language code of a page.
+ *  \param  index Index of the page, less than getCount().
+ *  \return The 3 characters of the ISO 639-2 code, which are not NUL
+ *          terminated.
+ */
+        const char* getLanguage(uint8_t index);
+/**
+ *  \brief  Get the teletext type of a page.
+ *  \param  index Index of the page, less than getCount().
+ *  \return 5-bit teletext type.
+ */
+        uint8_t getTeletextType(uint8_t index);
+/**
+ *  \brief  Get the magazine number of a page.
+ *  \param  index Index of the page, less than getCount().
+ *  \return 3-bit magazine number, 0 standing for magazine 8.
+ */
+        uint8_t getMagazineNumber(uint8_t index);
+/**
+ *  \brief  Get the page number of a page.
+ *  \param  index Index of the page, less than getCount().
+ *  \return 8-bit page number, as two BCD digits.
+ */
+        uint8_t getPageNumber(uint8_t index);
+};
+
+inline DescriptorIterator::DescriptorIterator(const PsiDescriptor& loop)
+    :   current(loop.start),
+        end(loop.start + loop.size)
+{
+}
+
+inline DescriptorIterator::DescriptorIterator(const uint8_t* start, uint16_t size)
+    :   current(start),
+        end(start + size)
+{
+}
+
+inline bool DescriptorIterator::isValid()
+{
+    return (end - current >= 2 && end - current >= 2 + current[1]);
+}
+
+inline void DescriptorIterator::next()
+{
+    current += 2 + current[1];
+}
+
+inline uint8_t DescriptorIterator::getTag()
+{
+    return current[0];
+}
+
+inline uint8_t DescriptorIterator::getLength()
+{
+    return current[1];
+}
+
+inline const uint8_t* DescriptorIterator::getData()
+{
+    return current + 2;
+}
+
+inline void DescriptorDispatcher::setHandler(uint8_t tag, Handler handler)
+{
+    handlers[tag] = handler;
+}
+
+inline Iso639LanguageDescriptor::Iso639LanguageDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline uint8_t Iso639LanguageDescriptor::getCount()
+{
+    return length / 4;
+}
+
+inline const char* Iso639LanguageDescriptor::getLanguage(uint8_t index)
+{
+    return (const char*)(data + index * 4);
+}
+
+inline uint8_t Iso639LanguageDescriptor::getAudioType(uint8_t index)
+{
+    return data[index * 4 + 3];
+}
+
+inline CaDescriptor::CaDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline bool CaDescriptor::isValid()
+{
+    return (length >= 4);
+}
+
+inline uint16_t CaDescriptor::getCaSystemId()
+{
+    return (data[0] << 8) | data[1];
+}
+
+inline uint16_t CaDescriptor::getCaPid()
+{
+    return ((data[2] & 0x1F) << 8) | data[3];
+}
+
+inline const uint8_t* CaDescriptor::getPrivateData()
+{
+    return data + 4;
+}
+
+inline uint8_t CaDescriptor::getPrivateDataSize()
+{
+    return length - 4;
+}
+
+inline RegistrationDescriptor::RegistrationDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline bool RegistrationDescriptor::isValid()
+{
+    return (length >= 4);
+}
+
+inline uint32_t RegistrationDescriptor::getFormatIdentifier()
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+inline const uint8_t* RegistrationDescriptor::getAdditionalInfo()
+{
+    return data + 4;
+}
+
+inline uint8_t RegistrationDescriptor::getAdditionalInfoSize()
+{
+    return length - 4;
+}
+
+inline StreamIdentifierDescriptor::StreamIdentifierDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline bool StreamIdentifierDescriptor::isValid()
+{
+    return (length >= 1);
+}
+
+inline uint8_t StreamIdentifierDescriptor::getComponentTag()
+{
+    return data[0];
+}
+
+inline ServiceDescriptor::ServiceDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline bool ServiceDescriptor::isValid()
+{
+    return (length >= 3 && length >= 3 + data[1] && length >= 3 + data[1] + data[2 + data[1]]);
+}
+
+inline uint8_t ServiceDescriptor::getServiceType()
+{
+    return data[0];
+}
+
+inline const char* ServiceDescriptor::getProviderName()
+{
+    return (const char*)(data + 2);
+}
+
+inline uint8_t ServiceDescriptor::getProviderNameLength()
+{
+    return data[1];
+}
+
+inline const char* ServiceDescriptor::getServiceName()
+{
+    return (const char*)(data + 3 + data[1]);
+}
+
+inline uint8_t ServiceDescriptor::getServiceNameLength()
+{
+    return data[2 + data[1]];
+}
+
+inline Ac3Descriptor::Ac3Descriptor(uint8_t tag, const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength),
+        isEnhanced(tag == MpegConstants::TAG_E_AC3)
+{
+}
+
+inline bool Ac3Descriptor::isValid()
+{
+    return (length >= 1);
+}
+
+inline bool Ac3Descriptor::isEnhancedAc3()
+{
+    return isEnhanced;
+}
+
+inline bool Ac3Descriptor::hasMixInfo()
+{
+    return (isEnhanced && (data[0] & 0x08));
+}
+
+inline AacDescriptor::AacDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline bool AacDescriptor::isValid()
+{
+    return (length >= 1);
+}
+
+inline uint8_t AacDescriptor::getProfileAndLevel()
+{
+    return data[0];
+}
+
+inline SubtitlingDescriptor::SubtitlingDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline uint8_t SubtitlingDescriptor::getCount()
+{
+    return length / 8;
+}
+
+inline const char* SubtitlingDescriptor::getLanguage(uint8_t index)
+{
+    return (const char*)(data + index * 8);
+}
+
+inline uint8_t SubtitlingDescriptor::getSubtitlingType(uint8_t index)
+{
+    return data[index * 8 + 3];
+}
+
+inline uint16_t SubtitlingDescriptor::getCompositionPageId(uint8_t index)
+{
+    return (data[index * 8 + 4] << 8) | data[index * 8 + 5];
+}
+
+inline uint16_t SubtitlingDescriptor::getAncillaryPageId(uint8_t index)
+{
+    return (data[index * 8 + 6] << 8) | data[index * 8 + 7];
+}
+
+inline TeletextDescriptor::TeletextDescriptor(const uint8_t* descriptorData, uint8_t descriptorLength)
+    :   data(descriptorData),
+        length(descriptorLength)
+{
+}
+
+inline uint8_t TeletextDescriptor::getCount()
+{
+    return length / 5;
+}
+
+inline const char* TeletextDescriptor::getLanguage(uint8_t index)
+{
+    return (const char*)(data + index * 5);
+}
+
+inline uint8_t TeletextDescriptor::getTeletextType(uint8_t index)
+{
+    return data[index * 5 + 3] >> 3;
+}
+
+inline uint8_t TeletextDescriptor::getMagazineNumber(uint8_t index)
+{
+    return data[index * 5 + 3] & 0x07;
+}
+
+inline uint8_t TeletextDescriptor::getPageNumber(uint8_t index)
+{
+    return data[index * 5 + 4];
+}
+
+#endif
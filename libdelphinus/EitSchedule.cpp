@@ -0,0 +1,486 @@
+/*
+ *  EitSchedule.cpp - Aggregation of the EIT schedule of the services
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "EitSchedule.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_EIT_SCHEDULE 14
+#define CURRENT_MODULE MODULE_EIT_SCHEDULE
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+// Header of the EIT up to the first event, and the CRC_32
+#define EIT_MIN_SIZE                18
+// Versions are 5 bits, so this never matches a received one
+#define VERSION_NONE                0xFF
+
+EitSchedule::Service::Service()
+    :   unusedBytes(0)
+{
+}
+
+EitSchedule::EitSchedule()
+    :   memoryLimit(DEFAULT_MEMORY_LIMIT),
+        memoryUsage(0),
+        unusedBytes(0),
+        eventCount(0),
+        currentTime((uint64_t) - 1),
+        storageHorizon((uint64_t) - 1),
+        repeatedSections(0),
+        droppedEvents(0)
+{
+}
+
+EitSchedule::~EitSchedule()
+{
+}
+
+void EitSchedule::clear()
+{
+    services.clear();
+    subTables.clear();
+    eitAssembler.clear();
+    timeAssembler.clear();
+    memoryUsage = 0;
+    unusedBytes = 0;
+    eventCount = 0;
+    currentTime = (uint64_t) - 1;
+    storageHorizon = (uint64_t) - 1;
+}
+
+void EitSchedule::setMemoryLimit(uint64_t bytes)
+{
+    memoryLimit = bytes;
+    if (memoryUsage > memoryLimit)
+    {
+        reduceMemory();
+    }
+}
+
+void EitSchedule::setCurrentTime(uint64_t time)
+{
+    if (time == currentTime)
+    {
+        return;
+    }
+    currentTime = time;
+    if (storageHorizon != (uint64_t) - 1)
+    {
+        // The events are being dropped for lack of memory, which the events
+        // over may give back
+        for (ServiceMap::iterator ix = services.begin(); ix != services.end(); ++ix)
+        {
+            removeEventsOver(ix->second);
+        }
+        if (memoryUsage - unusedBytes <= memoryLimit - memoryLimit / 8)
+        {
+            MSG("Storing the events after %" PRIu64 " again", storageHorizon);
+            storageHorizon = (uint64_t) - 1;
+        }
+        for (ServiceMap::iterator ix = services.begin(); ix != services.end(); ++ix)
+        {
+            if (ix->second.unusedBytes)
+            {
+                compactService(ix->second);
+            }
+        }
+    }
+}
+
+void EitSchedule::pushPacket(TsPacket* tsPacket, uint64_t packetNumber)
+{
+    uint16_t pid = tsPacket->getPid();
+    SectionAssembler* assembler = NULL;
+    if (pid == PID_EIT_CIT)
+    {
+        assembler = &eitAssembler;
+    }
+    else if (pid == PID_TDT_TOT)
+    {
+        assembler = &timeAssembler;
+    }
+    else
+    {
+        return;
+    }
+
+    assembler->pushPacket(tsPacket, packetNumber);
+    uint8_t* section = NULL;
+    uint16_t size = 0;
+    while ((section = assembler->viewNextSection(size)) != NULL)
+    {
+        pushSection(section, size);
+    }
+}
+
+EitSchedule::SectionResult EitSchedule::pushSection(uint8_t* section, uint16_t size)
+{
+    if (size < 3)
+    {
+        return SECTION_IGNORED;
+    }
+    uint8_t tableId = section[0];
+    if (tableId == TABLE_TDT || tableId == TABLE_TOT)
+    {
+        if (tableId == TABLE_TDT && tdtSection.parse(section, size))
+        {
+            setCurrentTime(tdtSection.getUtcTime());
+            return TIME_UPDATED;
+        }
+        if (tableId == TABLE_TOT && totSection.parse(section, size))
+        {
+            setCurrentTime(totSection.getUtcTime());
+            return TIME_UPDATED;
+        }
+        return SECTION_IGNORED;
+    }
+    // Only the schedule, the present/following is better read straight from
+    // its latest section
+    if (tableId < TABLE_EIT_ACTUAL_SCHEDULE_START || tableId > TABLE_EIT_OTHER_SCHEDULE_END ||
+        size < EIT_MIN_SIZE || (section[5] & 0x01) == 0)
+    {
+        return SECTION_IGNORED;
+    }
+
+    // The repetitions are told from the header, without parsing the events
+    uint64_t serviceKey = getServiceKey((section[10] << 8) | section[11], (section[8] << 8) | section[9],
+                                        (section[3] << 8) | section[4]);
+    uint8_t versionNumber = (section[5] >> 1) & 0x1F;
+    uint8_t sectionNumber = section[6];
+    uint32_t sectionBit = 1 << (sectionNumber & 0x1F);
+    std::pair<SubTableMap::iterator, bool> result =
+        subTables.insert(std::make_pair((serviceKey << 8) | tableId, SubTable()));
+    SubTable& subTable = result.first->second;
+    if (result.second)
+    {
+        subTable.versionNumber = VERSION_NONE;
+        memoryUsage += sizeof(SubTable);
+    }
+    else if (subTable.versionNumber == versionNumber &&
+             (subTable.receivedSections[sectionNumber >> 5] & sectionBit))
+    {
+        ++repeatedSections;
+        return SECTION_REPEATED;
+    }
+    if (!eitSection.parse(section, size))
+    {
+        return SECTION_IGNORED;
+    }
+
+    Service& service = services[serviceKey];
+    if (subTable.versionNumber != versionNumber)
+    {
+        if (subTable.versionNumber != VERSION_NONE)
+        {
+            MSG("Service 0x%012" PRIx64 " table_id 0x%02x version %u", serviceKey, tableId, versionNumber);
+            removeEvents(service, tableId);
+        }
+        subTable.versionNumber = versionNumber;
+        memset(subTable.receivedSections, 0, sizeof(subTable.receivedSections));
+    }
+    // A section missing some of its events is parsed again when repeated,
+    // once there is room for them
+    if (addEvents(service, tableId, sectionNumber))
+    {
+        subTable.receivedSections[sectionNumber >> 5] |= sectionBit;
+    }
+    if (memoryUsage > memoryLimit)
+    {
+        reduceMemory();
+    }
+    return SECTION_ADDED;
+}
+
+bool EitSchedule::isStartingBefore(const Event& event, uint64_t time)
+{
+    return (event.startTime < time);
+}
+
+bool EitSchedule::isStartingAfter(uint64_t time, const Event& event)
+{
+    return (time < event.startTime);
+}
+
+bool EitSchedule::addEvents(Service& service, uint8_t tableId, uint8_t sectionNumber)
+{
+    const EventList& eventList = eitSection.getEventList();
+    bool isStored = true;
+    Event event;
+    event.tableId = tableId;
+    event.sectionNumber = sectionNumber;
+    for (EventList::const_iterator ix = eventList.begin(); ix != eventList.end(); ++ix)
+    {
+        if (ix->startTime == (uint64_t) - 1 ||
+            (currentTime != (uint64_t) - 1 && ix->startTime + ix->duration <= currentTime))
+        {
+            continue;
+        }
+        if (ix->startTime >= storageHorizon)
+        {
+            ++droppedEvents;
+            isStored = false;
+            continue;
+        }
+        // The carousels mostly go forward in time, which appends the events
+        std::vector<Event>::iterator position = std::upper_bound(service.events.begin(),
+                                                                 service.events.end(),
+                                                                 ix->startTime, isStartingAfter);
+        // The events kept of a section parsed again are there already
+        std::vector<Event>::iterator stored = position;
+        while (stored != service.events.begin() && (stored - 1)->startTime == ix->startTime &&
+               ((stored - 1)->tableId != tableId || (stored - 1)->eventId != ix->eventId))
+        {
+            --stored;
+        }
+        if (stored != service.events.begin() && (stored - 1)->startTime == ix->startTime)
+        {
+            continue;
+        }
+        event.startTime = ix->startTime;
+        event.duration = ix->duration;
+        event.descriptorOffset = service.descriptors.size();
+        event.descriptorSize = ix->descriptor.size;
+        event.eventId = ix->eventId;
+        event.status = (ix->runningStatus << 1) | ix->freeCaMode;
+        service.descriptors.insert(service.descriptors.end(), ix->descriptor.start,
+                                   ix->descriptor.start + ix->descriptor.size);
+        service.events.insert(position, event);
+        memoryUsage += sizeof(Event) + event.descriptorSize;
+        ++eventCount;
+    }
+    return isStored;
+}
+
+void EitSchedule::removeEvents(Service& service, uint8_t tableId)
+{
+    std::vector<Event>::iterator output = service.events.begin();
+    for (std::vector<Event>::iterator ix = service.events.begin(); ix != service.events.end(); ++ix)
+    {
+        if (ix->tableId == tableId)
+        {
+            service.unusedBytes += ix->descriptorSize;
+            unusedBytes += ix->descriptorSize;
+            memoryUsage -= sizeof(Event);
+            --eventCount;
+        }
+        else
+        {
+            *output++ = *ix;
+        }
+    }
+    service.events.erase(output, service.events.end());
+    if (service.unusedBytes > service.descriptors.size() / 2)
+    {
+        compactService(service);
+    }
+}
+
+void EitSchedule::removeEventsOver(Service& service)
+{
+    // Only the events started by now can be over
+    std::vector<Event>::iterator end = std::lower_bound(service.events.begin(), service.events.end(),
+                                                        currentTime, isStartingBefore);
+    std::vector<Event>::iterator output = service.events.begin();
+    for (std::vector<Event>::iterator ix = service.events.begin(); ix != end; ++ix)
+    {
+        if (ix->startTime + ix->duration <= currentTime)
+        {
+            service.unusedBytes += ix->descriptorSize;
+            unusedBytes += ix->descriptorSize;
+            memoryUsage -= sizeof(Event);
+            --eventCount;
+        }
+        else
+        {
+            *output++ = *ix;
+        }
+    }
+    service.events.erase(output, end);
+}
+
+void EitSchedule::compactService(Service& service)
+{
+    std::vector<uint8_t> descriptors;
+    descriptors.reserve(service.descriptors.size() - service.unusedBytes);
+    for (std::vector<Event>::iterator ix = service.events.begin(); ix != service.events.end(); ++ix)
+    {
+        std::vector<uint8_t>::const_iterator start = service.descriptors.begin() + ix->descriptorOffset;
+        ix->descriptorOffset = descriptors.size();
+        descriptors.insert(descriptors.end(), start, start + ix->descriptorSize);
+    }
+    service.descriptors.swap(descriptors);
+    memoryUsage -= service.unusedBytes;
+    unusedBytes -= service.unusedBytes;
+    service.unusedBytes = 0;
+    // Give back the storage of the events removed too
+    std::vector<Event>(service.events).swap(service.events);
+}
+
+void EitSchedule::reduceMemory()
+{
+    // Stop under the limit, so that the next sections do not have to drop
+    // events again right away
+    uint64_t target = memoryLimit - memoryLimit / 8;
+    if (currentTime != (uint64_t) - 1)
+    {
+        for (ServiceMap::iterator ix = services.begin(); ix != services.end(); ++ix)
+        {
+            removeEventsOver(ix->second);
+        }
+    }
+    // The services on a heap by the start time of their last event, so
+    // that the event starting last across all of them is found without
+    // going through every service for every event dropped
+    std::vector< std::pair<uint64_t, uint64_t> > lastStartTimes;
+    lastStartTimes.reserve(services.size());
+    for (ServiceMap::iterator ix = services.begin(); ix != services.end(); ++ix)
+    {
+        if (!ix->second.events.empty())
+        {
+            lastStartTimes.push_back(std::make_pair(ix->second.events.back().startTime, ix->first));
+        }
+    }
+    std::make_heap(lastStartTimes.begin(), lastStartTimes.end());
+    while (memoryUsage - unusedBytes > target && !lastStartTimes.empty())
+    {
+        // Drop the event starting last across all the services
+        std::pop_heap(lastStartTimes.begin(), lastStartTimes.end());
+        ServiceMap::iterator latest = services.find(lastStartTimes.back().second);
+        lastStartTimes.pop_back();
+        Service& service = latest->second;
+        const Event& event = service.events.back();
+        if (event.startTime < storageHorizon)
+        {
+            storageHorizon = event.startTime;
+        }
+        // The section of the event is to be parsed again when repeated
+        SubTableMap::iterator subTable = subTables.find((latest->first << 8) | event.tableId);
+        if (subTable != subTables.end())
+        {
+            subTable->second.receivedSections[event.sectionNumber >> 5] &=
+                ~(1 << (event.sectionNumber & 0x1F));
+        }
+        service.unusedBytes += event.descriptorSize;
+        unusedBytes += event.descriptorSize;
+        memoryUsage -= sizeof(Event);
+        --eventCount;
+        ++droppedEvents;
+        service.events.pop_back();
+        if (!service.events.empty())
+        {
+            lastStartTimes.push_back(std::make_pair(service.events.back().startTime, latest->first));
+            std::push_heap(lastStartTimes.begin(), lastStartTimes.end());
+        }
+    }
+    MSG("Reduced the memory usage to %" PRIu64 " bytes, storing the events before %" PRIu64,
+        memoryUsage - unusedBytes, storageHorizon);
+
+    for (ServiceMap::iterator ix = services.begin(); ix != services.end();)
+    {
+        if (ix->second.unusedBytes)
+        {
+            compactService(ix->second);
+        }
+        if (ix->second.events.empty())
+        {
+            // Along with its sub tables, all the sections of which are to be
+            // parsed again
+            SubTableMap::iterator start = subTables.lower_bound(ix->first << 8);
+            SubTableMap::iterator end = subTables.upper_bound((ix->first << 8) | 0xFF);
+            memoryUsage -= std::distance(start, end) * sizeof(SubTable);
+            subTables.erase(start, end);
+            services.erase(ix++);
+        }
+        else
+        {
+            ++ix;
+        }
+    }
+}
+
+void EitSchedule::fillEventInfo(Service& service, const Event& event, EventInfo& eventInfo)
+{
+    eventInfo.eventId = event.eventId;
+    eventInfo.startTime = event.startTime;
+    eventInfo.duration = event.duration;
+    eventInfo.runningStatus = event.status >> 1;
+    eventInfo.freeCaMode = event.status & 0x01;
+    eventInfo.descriptor.start = event.descriptorSize ? &service.descriptors[event.descriptorOffset] : NULL;
+    eventInfo.descriptor.size = event.descriptorSize;
+}
+
+bool EitSchedule::findEvent(uint16_t originalNetworkId, uint16_t transportStreamId, uint16_t serviceId,
+                            uint64_t time, EventInfo& event)
+{
+    ServiceMap::iterator service = services.find(getServiceKey(originalNetworkId, transportStreamId,
+                                                               serviceId));
+    if (service == services.end())
+    {
+        return false;
+    }
+    std::vector<Event>& events = service->second.events;
+    std::vector<Event>::iterator ix = std::upper_bound(events.begin(), events.end(), time, isStartingAfter);
+    if (ix == events.begin())
+    {
+        return false;
+    }
+    --ix;
+    if (time >= ix->startTime + ix->duration)
+    {
+        return false;
+    }
+    fillEventInfo(service->second, *ix, event);
+    return true;
+}
+
+uint32_t EitSchedule::getEvents(uint16_t originalNetworkId, uint16_t transportStreamId, uint16_t serviceId,
+                                uint64_t startTime, uint64_t endTime, EventList& events)
+{
+    events.clear();
+    ServiceMap::iterator service = services.find(getServiceKey(originalNetworkId, transportStreamId,
+                                                               serviceId));
+    if (service == services.end())
+    {
+        return 0;
+    }
+    std::vector<Event>& serviceEvents = service->second.events;
+    EventInfo eventInfo;
+    for (std::vector<Event>::iterator ix = std::lower_bound(serviceEvents.begin(), serviceEvents.end(),
+                                                            startTime, isStartingBefore);
+         ix != serviceEvents.end() && ix->startTime < endTime; ++ix)
+    {
+        fillEventInfo(service->second, *ix, eventInfo);
+        events.push_back(eventInfo);
+    }
+    return events.size();
+}
@@ -0,0 +1,290 @@
+/*
+ *  EitSchedule.h - Aggregation of the EIT schedule of the services
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   EitSchedule.h
+ *  \brief  Bounded memory aggregation of the EIT schedule.
+ *
+ *  Defines EitSchedule which collects the events of the EIT schedule
+ *  carousels of all the services in a TS, within a memory limit.
+ */
+
+#ifndef DELPHINUS_EIT_SCHEDULE_H
+#define DELPHINUS_EIT_SCHEDULE_H
+
+#include <map>
+#include <vector>
+#include "Ts.h"
+#include "SectionAssembler.h"
+#include "SiTables.h"
+
+/**
+ *  \brief  Collects the events of the EIT schedule of the services.
+ *
+ *  The sections of the EIT schedule tables, of the actual and of the other
+ *  TSs, are pushed one at a time, or the packets of the EIT and TDT/TOT
+ *  PIDs are pushed and reassembled. A section already received for the
+ *  current version of its sub table is skipped without being parsed, unless
+ *  some of its events were not stored, and a new version drops the events
+ *  of the previous one. The events of a
+ *  service are kept sorted by their start time in a single array of fixed
+ *  size records, with their descriptors packed into a single buffer per
+ *  service, so the carousels are aggregated without an allocation per
+ *  event.
+ *
+ *  The time carried in the TDT and TOT, or set with setCurrentTime(), is
+ *  used to skip the events already over. When the events and the
+ *  descriptors stored exceed the memory limit, the events over are dropped
+ *  first, then the events starting last across all the services, till the
+ *  storage is back under 7/8 of the limit. The events starting after the
+ *  ones dropped are no longer stored, till the end of the events over frees
+ *  enough memory, and the next repetitions of their sections are parsed
+ *  again to store them then.
+ */
+class EitSchedule
+{
+    public:
+/**
+ *  \brief  Information about an event of the schedule.
+ */
+        typedef EitSection::EventInfo EventInfo;
+/**
+ *  \brief  A list of events.
+ */
+        typedef EitSection::EventList EventList;
+/**
+ *  \brief  Results of pushSection().
+ */
+        enum SectionResult
+        {
+/** Not an EIT schedule, TDT or TOT section, or an invalid one. */
+            SECTION_IGNORED,
+/** A repetition of a section already received. */
+            SECTION_REPEATED,
+/** The events of the section were added. */
+            SECTION_ADDED,
+/** The current time was updated from a TDT or a TOT. */
+            TIME_UPDATED
+        };
+        enum
+        {
+/** Default memory limit in bytes. */
+            DEFAULT_MEMORY_LIMIT = 32 * 1024 * 1024
+        };
+
+    private:
+        // Fixed size record of an event, the descriptors are in the buffer
+        // of the service
+        struct Event
+        {
+            uint64_t startTime;
+            uint32_t duration;
+            uint32_t descriptorOffset;
+            uint16_t descriptorSize;
+            uint16_t eventId;
+            uint8_t tableId;
+            uint8_t sectionNumber;
+            // running_status in the bits 1-3, free_CA_mode in bit 0
+            uint8_t status;
+        };
+        struct Service
+        {
+            // Sorted by the start time
+            std::vector<Event> events;
+            std::vector<uint8_t> descriptors;
+            // Bytes of the descriptors of the events removed
+            uint32_t unusedBytes;
+
+            Service();
+        };
+        struct SubTable
+        {
+            uint8_t versionNumber;
+            // One bit per section number received
+            uint32_t receivedSections[8];
+        };
+        // original_network_id in the bits 32-47, transport_stream_id in
+        // 16-31, service_id in the low 16 bits
+        typedef std::map<uint64_t, Service> ServiceMap;
+        // Key of the service shifted by 8 bits, with the table_id
+        typedef std::map<uint64_t, SubTable> SubTableMap;
+
+        ServiceMap services;
+        SubTableMap subTables;
+        SectionAssembler eitAssembler;
+        SectionAssembler timeAssembler;
+        EitSection eitSection;
+        TdtSection tdtSection;
+        TotSection totSection;
+        uint64_t memoryLimit;
+        // Bytes of the events and the descriptors stored, including the
+        // unused descriptor bytes
+        uint64_t memoryUsage;
+        uint64_t unusedBytes;
+        uint64_t eventCount;
+        uint64_t currentTime;
+        // Events starting at or after it are not stored
+        uint64_t storageHorizon;
+        uint64_t repeatedSections;
+        uint64_t droppedEvents;
+
+        static uint64_t getServiceKey(uint16_t originalNetworkId, uint16_t transportStreamId,
+                                      uint16_t serviceId);
+        static bool isStartingBefore(const Event& event, uint64_t time);
+        static bool isStartingAfter(uint64_t time, const Event& event);
+        bool addEvents(Service& service, uint8_t tableId, uint8_t sectionNumber);
+        void removeEvents(Service& service, uint8_t tableId);
+        void removeEventsOver(Service& service);
+        void compactService(Service& service);
+        void reduceMemory();
+        void fillEventInfo(Service& service, const Event& event, EventInfo& eventInfo);
+
+    public:
+        EitSchedule();
+        ~EitSchedule();
+
+/**
+ *  \brief  Forget all the events and the sections received. The memory
+ *          limit is kept.
+ */
+        void clear();
+/**
+ *  \brief  Set the limit of the memory used by the events and their
+ *          descriptors, the events are dropped right away if it is exceeded.
+ *  \param  bytes Memory limit in bytes.
+ */
+        void setMemoryLimit(uint64_t bytes);
+/**
+ *  \brief  Set the current time, which is otherwise taken from the TDT and
+ *          TOT sections pushed.
+ *  \param  time Seconds since 1970-01-01 00:00:00 UTC.
+ */
+        void setCurrentTime(uint64_t time);
+/**
+ *  \brief  Push a packet, the packets of the EIT and TDT/TOT PIDs are
+ *          reassembled into sections which are passed to pushSection(), the
+ *          other ones are skipped.
+ *  \param  tsPacket A valid TS packet.
+ *  \param  packetNumber Packet number(starts at 0) of the packet in the TS.
+ */
+        void pushPacket(TsPacket* tsPacket, uint64_t packetNumber);
+/**
+ *  \brief  Add the events of an EIT schedule section, or take the current
+ *          time from a TDT or TOT section. The other sections are ignored.
+ *  \param  section Start of the section, at the table_id. The CRC_32 of the
+ *          EIT sections is expected to be verified already.
+ *  \param  size Size of the whole section in bytes.
+ *  \return What was done with the section.
+ */
+        SectionResult pushSection(uint8_t* section, uint16_t size);
+/**
+ *  \brief  Find the event of a service at a given time.
+ *          \warning The descriptors of the event are only valid till the
+ *          next section or packet is pushed.
+ *  \param  originalNetworkId Original Network ID of the service.
+ *  \param  transportStreamId Transport Stream ID of the service.
+ *  \param  serviceId Service ID.
+ *  \param  time Seconds since 1970-01-01 00:00:00 UTC.
+ *  \param  event Filled with the event.
+ *  \return true if an event of the service covers the time, false
+ *          otherwise.
+ */
+        bool findEvent(uint16_t originalNetworkId, uint16_t transportStreamId, uint16_t serviceId,
+                       uint64_t time, EventInfo& event);
+/**
+ *  \brief  Get the events of a service starting within a time range, in the
+ *          order of their start time.
+ *          \warning The descriptors of the events are only valid till the
+ *          next section or packet is pushed.
+ *  \param  originalNetworkId Original Network ID of the service.
+ *  \param  transportStreamId Transport Stream ID of the service.
+ *  \param  serviceId Service ID.
+ *  \param  startTime Start of the range, in seconds since 1970-01-01
+ *          00:00:00 UTC.
+ *  \param  endTime End of the range, excluded.
+ *  \param  events Filled with the events, the storage is reused.
+ *  \return Number of events found.
+ */
+        uint32_t getEvents(uint16_t originalNetworkId, uint16_t transportStreamId, uint16_t serviceId,
+                           uint64_t startTime, uint64_t endTime, EventList& events);
+/**
+ *  \brief  Get the current time.
+ *  \return Seconds since 1970-01-01 00:00:00 UTC, (uint64_t) - 1 if it is
+ *          not known yet.
+ */
+        uint64_t getCurrentTime();
+/**
+ *  \brief  Get the number of events stored.
+ *  \return Number of events.
+ */
+        uint64_t getEventCount();
+/**
+ *  \brief  Get the memory used by the events and their descriptors.
+ *  \return Memory usage in bytes.
+ */
+        uint64_t getMemoryUsage();
+/**
+ *  \brief  Get the number of sections skipped as repetitions.
+ *  \return Number of repeated sections since the creation.
+ */
+        uint64_t getRepeatedSectionCount();
+/**
+ *  \brief  Get the number of events dropped or not stored to stay within
+ *          the memory limit, the events not stored being counted again at
+ *          every repetition of their section.
+ *  \return Number of events since the creation.
+ */
+        uint64_t getDroppedEventCount();
+};
+
+inline uint64_t EitSchedule::getServiceKey(uint16_t originalNetworkId, uint16_t transportStreamId,
+                                           uint16_t serviceId)
+{
+    return ((uint64_t)originalNetworkId << 32) | ((uint64_t)transportStreamId << 16) | serviceId;
+}
+
+inline uint64_t EitSchedule::getCurrentTime()
+{
+    return currentTime;
+}
+
+inline uint64_t EitSchedule::getEventCount()
+{
+    return eventCount;
+}
+
+inline uint64_t EitSchedule::getMemoryUsage()
+{
+    return memoryUsage;
+}
+
+inline uint64_t EitSchedule::getRepeatedSectionCount()
+{
+    return repeatedSections;
+}
+
+inline uint64_t EitSchedule::getDroppedEventCount()
+{
+    return droppedEvents;
+}
+
+#endif
@@ -0,0 +1,347 @@
+/*
+ *  EsExtractor.cpp - Extraction of the elementary streams of a TS to files
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "EsExtractor.h"
+#include "SyncScanner.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_ES_EXTRACTOR 19
+#define CURRENT_MODULE MODULE_ES_EXTRACTOR
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+EsExtractor::EsExtractor()
+    :   outputs(PID_NULL + 1, NULL),
+        batch(BATCH_PACKETS),
+        lostSyncPackets(0)
+{
+}
+
+EsExtractor::~EsExtractor()
+{
+    clear();
+}
+
+bool EsExtractor::addOutput(uint16_t pid, const char* fileName, OutputMode mode)
+{
+    if (pid > PID_NULL || outputs[pid] != NULL)
+    {
+        ERR("PID 0x%04x is invalid or already has an output", pid);
+        return false;
+    }
+    FILE* fileHandle = (strcmp(fileName, "-") == 0) ? stdout : fopen(fileName, "wb");
+    if (fileHandle == NULL)
+    {
+        ERR("Unable to open the output file: %s", fileName);
+        return false;
+    }
+    Output* output = new Output();
+    output->fileHandle = fileHandle;
+    output->mode = mode;
+    output->isInPes = false;
+    output->headerBytesLeft = 0;
+    output->pesBytesLeft = 0;
+    output->bytesWritten = 0;
+    output->droppedPes = 0;
+    output->slices.reserve(MAX_SLICES);
+    outputs[pid] = output;
+    pids.push_back(pid);
+    return true;
+}
+
+bool EsExtractor::clear()
+{
+    bool isClosed = true;
+    for (std::vector<uint16_t>::iterator ix = pids.begin(); ix != pids.end(); ++ix)
+    {
+        Output* output = outputs[*ix];
+        if (output->fileHandle != stdout)
+        {
+            isClosed = (fclose(output->fileHandle) == 0) && isClosed;
+        }
+        delete output;
+        outputs[*ix] = NULL;
+    }
+    pids.clear();
+    return isClosed;
+}
+
+void EsExtractor::dropPes(Output* output)
+{
+    if (output->isInPes)
+    {
+        ++output->droppedPes;
+        output->isInPes = false;
+    }
+}
+
+void EsExtractor::pushPayload(Output* output, const uint8_t* payload, uint32_t size, bool isStart)
+{
+    if (isStart)
+    {
+        if (output->isInPes && output->pesBytesLeft)
+        {
+            MSG("PES ended %u bytes short", output->pesBytesLeft);
+            ++output->droppedPes;
+        }
+        output->isInPes = false;
+        if (size < PesPacket::PES_HEADER_SIZE || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01)
+        {
+            ++output->droppedPes;
+            return;
+        }
+        uint16_t length = (payload[4] << PES_LENGTH_SHIFT) | payload[5];
+        output->pesBytesLeft = length ? PesPacket::PES_HEADER_SIZE + length : 0;
+        output->headerBytesLeft = 0;
+        if (output->mode == OUTPUT_ES)
+        {
+            output->headerBytesLeft = PesPacket::PES_HEADER_SIZE;
+            if (PesHeader::hasOptionalHeaderFields(payload[3]))
+            {
+                // The PES_header_data_length is needed in the first packet
+                if (size < PesHeader::OPTIONAL_HEADER_OFFSET)
+                {
+                    ++output->droppedPes;
+                    return;
+                }
+                output->headerBytesLeft = PesHeader::OPTIONAL_HEADER_OFFSET + payload[8];
+            }
+        }
+        output->isInPes = true;
+    }
+    else if (!output->isInPes)
+    {
+        return;
+    }
+
+    if (output->pesBytesLeft)
+    {
+        // Anything past the PES_packet_length is stuffing
+        size = std::min(size, output->pesBytesLeft);
+        output->pesBytesLeft -= size;
+        output->isInPes = (output->pesBytesLeft > 0);
+    }
+    uint32_t skipped = std::min(size, output->headerBytesLeft);
+    output->headerBytesLeft -= skipped;
+    if (size > skipped)
+    {
+        Slice slice = { payload + skipped, size - skipped };
+        output->slices.push_back(slice);
+    }
+}
+
+bool EsExtractor::flush(Output* output)
+{
+    if (output->slices.empty())
+    {
+        return true;
+    }
+#ifndef _WIN32
+    struct iovec vectors[MAX_SLICES];
+    uint32_t count = output->slices.size();
+    for (uint32_t ix = 0; ix < count; ++ix)
+    {
+        vectors[ix].iov_base = const_cast<uint8_t*>(output->slices[ix].data);
+        vectors[ix].iov_len = output->slices[ix].size;
+    }
+    output->slices.clear();
+
+    int fd = fileno(output->fileHandle);
+    struct iovec* next = vectors;
+    while (count > 0)
+    {
+        ssize_t written = writev(fd, next, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ERR("Unable to write the output: %s", strerror(errno));
+            return false;
+        }
+        output->bytesWritten += written;
+        // Resume after the bytes written by a short write
+        while (count > 0 && (size_t)written >= next->iov_len)
+        {
+            written -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count > 0)
+        {
+            next->iov_base = (uint8_t*)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+#else
+    for (std::vector<Slice>::iterator ix = output->slices.begin(); ix != output->slices.end(); ++ix)
+    {
+        if (fwrite(ix->data, 1, ix->size, output->fileHandle) != ix->size)
+        {
+            ERR("Unable to write the output");
+            output->slices.clear();
+            return false;
+        }
+        output->bytesWritten += ix->size;
+    }
+    output->slices.clear();
+#endif
+    return true;
+}
+
+bool EsExtractor::flushAll()
+{
+    bool isFlushed = true;
+    for (std::vector<uint16_t>::iterator ix = pids.begin(); ix != pids.end(); ++ix)
+    {
+        isFlushed = flush(outputs[*ix]) && isFlushed;
+    }
+    return isFlushed;
+}
+
+bool EsExtractor::extract(TsFile& tsFile)
+{
+    if (!tsFile.isValid())
+    {
+        return false;
+    }
+    for (std::vector<uint16_t>::iterator ix = pids.begin(); ix != pids.end(); ++ix)
+    {
+        outputs[*ix]->isInPes = false;
+        outputs[*ix]->continuityChecker.reset();
+        outputs[*ix]->slices.clear();
+    }
+    lostSyncPackets = 0;
+    uint8_t packetSize = tsFile.getPacketSize();
+    uint8_t headerOffset = SyncScanner::getSyncOffset(packetSize);
+    // The packets of a memory mapped file stay in place, so their payloads
+    // are only written once enough of them are gathered
+    bool isMapped = (tsFile.getIoMode() == TsFile::IO_MODE_MMAP);
+
+    uint64_t packetNumber = 0;
+    uint32_t count = 0;
+    const uint8_t* data;
+    while ((data = tsFile.viewPackets(packetNumber, count)) != NULL)
+    {
+        packetNumber += count;
+        while (count > 0)
+        {
+            uint32_t decoded = batch.decode(data, (uint64_t)count * packetSize, packetSize);
+            const uint16_t* batchPids = batch.getPids();
+            const uint8_t* continuityCounters = batch.getContinuityCounters();
+            const uint8_t* payloadUnitStartIndicators = batch.getPayloadUnitStartIndicators();
+            const uint8_t* payloadOffsets = batch.getPayloadOffsets();
+            const uint8_t* errorFlags = batch.getErrorFlags();
+            for (uint32_t ix = 0; ix < decoded; ++ix)
+            {
+                Output* output = outputs[batchPids[ix]];
+                if (errorFlags[ix] & TsHeaderBatch::ERROR_SYNC)
+                {
+                    // The PID is not known, any of the PES may miss it
+                    ++lostSyncPackets;
+                    for (std::vector<uint16_t>::iterator jx = pids.begin(); jx != pids.end(); ++jx)
+                    {
+                        dropPes(outputs[*jx]);
+                    }
+                    continue;
+                }
+                if (output == NULL)
+                {
+                    continue;
+                }
+                if (errorFlags[ix] & TsHeaderBatch::ERROR_ADAPTATION_FIELD)
+                {
+                    dropPes(output);
+                    continue;
+                }
+                const uint8_t* header = data + ix * packetSize + headerOffset;
+                bool hasPayload = (payloadOffsets[ix] < PACKET_SIZE_TS);
+                ContinuityChecker::Result continuity =
+                    output->continuityChecker.check(continuityCounters[ix], hasPayload,
+                                                    ContinuityChecker::hasDiscontinuity(header));
+                if (continuity == ContinuityChecker::CONTINUITY_NO_PAYLOAD ||
+                    continuity == ContinuityChecker::CONTINUITY_DUPLICATE)
+                {
+                    continue;
+                }
+                if (continuity == ContinuityChecker::CONTINUITY_GAP)
+                {
+                    MSG("Continuity counter of PID 0x%04x jumped to %u", batchPids[ix],
+                        continuityCounters[ix]);
+                    dropPes(output);
+                }
+                if (errorFlags[ix] & TsHeaderBatch::ERROR_TRANSPORT)
+                {
+                    dropPes(output);
+                    continue;
+                }
+
+                pushPayload(output, header + payloadOffsets[ix],
+                            PACKET_SIZE_TS - payloadOffsets[ix], payloadUnitStartIndicators[ix]);
+                if (output->slices.size() == MAX_SLICES && !flush(output))
+                {
+                    return false;
+                }
+            }
+            data += decoded * packetSize;
+            count -= decoded;
+        }
+        if (!isMapped && !flushAll())
+        {
+            return false;
+        }
+    }
+    return flushAll();
+}
+
+uint64_t EsExtractor::getBytesWritten(uint16_t pid)
+{
+    return (pid <= PID_NULL && outputs[pid]) ? outputs[pid]->bytesWritten : 0;
+}
+
+uint64_t EsExtractor::getDroppedPesCount(uint16_t pid)
+{
+    return (pid <= PID_NULL && outputs[pid]) ? outputs[pid]->droppedPes : 0;
+}
+
+uint64_t EsExtractor::getLostSyncPacketCount()
+{
+    return lostSyncPackets;
+}
@@ -0,0 +1,164 @@
+/*
+ *  EsExtractor.h - Extraction of the elementary streams of a TS to files
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   EsExtractor.h
+ *  \brief  Extraction of the elementary streams to files.
+ *
+ *  Defines EsExtractor which writes the PES or the elementary streams of
+ *  selected PIDs of a TS file to output files.
+ */
+
+#ifndef DELPHINUS_ES_EXTRACTOR_H
+#define DELPHINUS_ES_EXTRACTOR_H
+
+#include <cstdio>
+#include <vector>
+#include "TsFile.h"
+#include "TsHeaderBatch.h"
+
+/**
+ *  \brief  Writes the PES or the elementary streams of PIDs to files.
+ *
+ *  An output file is added for each PID to be extracted, and extract() then
+ *  goes through the TS file once. The payloads of the packets are written
+ *  straight from the packets viewed in place in TsFile, gathered with
+ *  writev(), so no byte is copied in user space, and in IO_MODE_MMAP the
+ *  payloads are gathered across the chunks of the file as well, so a PID
+ *  with few packets takes few system calls.
+ *
+ *  The output of a PID starts with its first packet starting a PES. The
+ *  continuity counter is followed, and the rest of a PES missing a packet
+ *  is skipped, the output resuming with the next PES. A jump signalled by
+ *  the discontinuity_indicator is not a loss. A packet which lost
+ *  its sync byte may belong to any of the PIDs, so the PES of all of them
+ *  are skipped alike.
+ */
+class EsExtractor
+{
+    public:
+/**
+ *  \brief  What is written of the PES of a PID.
+ */
+        enum OutputMode
+        {
+/** The payloads of the PES, the elementary stream. */
+            OUTPUT_ES                   = 0,
+/** The whole PES, with their headers. */
+            OUTPUT_PES                  = 1
+        };
+
+    private:
+        enum
+        {
+            BATCH_PACKETS = 4096,
+            // IOV_MAX of Linux
+            MAX_SLICES = 1024
+        };
+        // A payload to be written
+        struct Slice
+        {
+            const uint8_t* data;
+            uint32_t size;
+        };
+        struct Output
+        {
+            FILE* fileHandle;
+            OutputMode mode;
+            bool isInPes;
+            // Bytes of the PES header still to be skipped in OUTPUT_ES,
+            // when the header spans several packets
+            uint32_t headerBytesLeft;
+            // Bytes left of a PES with a PES_packet_length, 0 if unbounded
+            uint32_t pesBytesLeft;
+            ContinuityChecker continuityChecker;
+            std::vector<Slice> slices;
+            uint64_t bytesWritten;
+            uint64_t droppedPes;
+        };
+
+        // Indexed by the PID, NULL for the PIDs not extracted
+        std::vector<Output*> outputs;
+        std::vector<uint16_t> pids;
+        TsHeaderBatch batch;
+        uint64_t lostSyncPackets;
+
+        void dropPes(Output* output);
+        void pushPayload(Output* output, const uint8_t* payload, uint32_t size, bool isStart);
+        bool flush(Output* output);
+        bool flushAll();
+        // Not copyable, the outputs and their files are owned
+        EsExtractor(const EsExtractor& extractor);
+        EsExtractor& operator=(const EsExtractor& extractor);
+
+    public:
+        EsExtractor();
+        ~EsExtractor();
+
+/**
+ *  \brief  Add the output file of a PID, created or truncated.
+ *  \param  pid PID of the PES.
+ *  \param  fileName Name of the output file, - for the standard output.
+ *  \param  mode What is written of the PES.
+ *  \return true if the file was opened, false if it could not be or the
+ *          PID already has an output.
+ */
+        bool addOutput(uint16_t pid, const char* fileName, OutputMode mode);
+/**
+ *  \brief  Close all the output files.
+ *  \return true if all the data was written, false otherwise.
+ */
+        bool clear();
+/**
+ *  \brief  Write the PES of all the PIDs with an output, going through
+ *          the whole file once.
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          TsFile::viewPacket() call.
+ *  \param  tsFile An open TS file.
+ *  \return true if the whole file was extracted, false if the file is not
+ *          valid or an output could not be written.
+ */
+        bool extract(TsFile& tsFile);
+/**
+ *  \brief  Get the number of bytes written to the output of a PID.
+ *  \param  pid PID of the PES.
+ *  \return Bytes written, 0 if the PID has no output.
+ */
+        uint64_t getBytesWritten(uint16_t pid);
+/**
+ *  \brief  Get the number of PES of a PID cut short because of a lost
+ *          packet, a packet with the transport error indicator set, a packet
+ *          which lost its sync byte or an invalid PES header.
+ *  \param  pid PID of the PES.
+ *  \return Number of PES cut short, 0 if the PID has no output.
+ */
+        uint64_t getDroppedPesCount(uint16_t pid);
+/**
+ *  \brief  Get the number of packets of the last extract() call which lost
+ *          their sync byte, the rest of the PES of all the PIDs being
+ *          skipped at each of them.
+ *  \return Number of packets without the sync byte.
+ */
+        uint64_t getLostSyncPacketCount();
+};
+
+#endif
@@ -0,0 +1,560 @@
+/*
+ *  IndexFile.cpp - A sidecar file which persists the index and the metadata
+ *  of a TS file across the open() calls
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "IndexFile.h"
+#include "PidIndex.h"
+#include "PcrIndex.h"
+#include "RapIndex.h"
+#include "MpegConstants.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_INDEX_FILE 6
+#define CURRENT_MODULE MODULE_INDEX_FILE
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define ALIGN_8(x) (((x) + 7) & ~(uint64_t)7)
+
+// Layout of the index file, all the fields are in the byte order of the
+// machine which wrote the file, which is recorded in byteOrder
+static const char INDEX_MAGIC[8] = { 'D', 'L', 'P', 'H', 'I', 'D', 'X', '\0' };
+static const uint32_t INDEX_BYTE_ORDER = 0x01020304;
+
+enum IndexSectionType
+{
+    // uint64_t count, followed by count records of a uint64_t packet number
+    // and the packet data padded to 8 bytes
+    SECTION_METADATA_PACKETS    = 1,
+    // uint64_t count, followed by count IndexPidEntry, followed by the
+    // arrays of uint32_t packet numbers each padded to 8 bytes
+    SECTION_PID_INDEX           = 2,
+    // IndexPcrHeader, followed by count PcrIndex::Checkpoint
+    SECTION_PCR_INDEX           = 3,
+    // uint64_t count, followed by count RapIndex::RandomAccessPoint of all
+    // the programs
+    SECTION_RAP_INDEX           = 4
+};
+
+struct IndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    int64_t modifiedTime;
+    int64_t modifiedTimeNsec;
+    uint32_t packetSize;
+    uint32_t sectionCount;
+};
+
+struct IndexSectionEntry
+{
+    uint32_t type;
+    uint32_t reserved;
+    // Offset from the start of the index file
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct IndexPidEntry
+{
+    uint16_t pid;
+    uint16_t reserved;
+    uint32_t reserved2;
+    uint64_t count;
+    // Offset of the packet numbers from the start of the section
+    uint64_t offset;
+};
+
+struct IndexPcrHeader
+{
+    uint64_t count;
+    uint16_t pcrPid;
+    uint16_t isComplete;
+    uint32_t reserved;
+    uint64_t firstPcr;
+};
+
+static bool writeData(FILE* fileHandle, const void* data, uint64_t size);
+static bool writePadding(FILE* fileHandle, uint64_t size);
+
+static bool writeData(FILE* fileHandle, const void* data, uint64_t size)
+{
+    return (size == 0 || fwrite(data, 1, size, fileHandle) == size);
+}
+
+static bool writePadding(FILE* fileHandle, uint64_t size)
+{
+    static const uint8_t padding[8] = { 0 };
+    return writeData(fileHandle, padding, ALIGN_8(size) - size);
+}
+
+IndexFile::IndexFile()
+    :   indexData(NULL),
+        indexSize(0),
+        isMapped(false),
+        packetSize(0),
+        pidSection(NULL),
+        pidSectionSize(0),
+        pcrSection(NULL),
+        rapSection(NULL)
+{
+}
+
+IndexFile::~IndexFile()
+{
+    close();
+}
+
+bool IndexFile::getFileKey(const char* fileName, FileKey& key)
+{
+    struct stat fileStat;
+    if (stat(fileName, &fileStat) != 0)
+    {
+        return false;
+    }
+    key.fileSize = fileStat.st_size;
+    key.modifiedTime = fileStat.st_mtime;
+#if defined(__linux__)
+    key.modifiedTimeNsec = fileStat.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    key.modifiedTimeNsec = fileStat.st_mtimespec.tv_nsec;
+#else
+    key.modifiedTimeNsec = 0;
+#endif
+    return true;
+}
+
+bool IndexFile::write(const char* indexFileName, const FileKey& key, uint8_t packetSize,
+                      const StoredPacketList& metadataPackets, PidIndex* pidIndex,
+                      PcrIndex* pcrIndex, RapIndex* rapIndex)
+{
+    // Compute the layout first, the sections follow the directory
+    uint64_t packetStride = ALIGN_8((uint64_t)packetSize);
+    uint32_t sectionCount = 1 + (pidIndex != NULL) + (pcrIndex != NULL) + (rapIndex != NULL);
+    IndexSectionEntry sections[4];
+    memset(sections, 0, sizeof(sections));
+
+    sections[0].type = SECTION_METADATA_PACKETS;
+    sections[0].offset = sizeof(IndexHeader) + sectionCount * sizeof(IndexSectionEntry);
+    sections[0].size = sizeof(uint64_t) + metadataPackets.size() * (sizeof(uint64_t) + packetStride);
+    uint32_t currentSection = 1;
+
+    uint64_t pidCount = 0;
+    if (pidIndex)
+    {
+        uint64_t arraysSize = 0;
+        for (uint16_t pid = 0; pid < PidIndex::PID_COUNT; ++pid)
+        {
+            if (pidIndex->hasPid(pid))
+            {
+                ++pidCount;
+                arraysSize += ALIGN_8(pidIndex->getPacketCount(pid) * sizeof(uint32_t));
+            }
+        }
+        sections[currentSection].type = SECTION_PID_INDEX;
+        sections[currentSection].offset = sections[currentSection - 1].offset +
+                                          sections[currentSection - 1].size;
+        sections[currentSection].size = sizeof(uint64_t) + pidCount * sizeof(IndexPidEntry) +
+                                        arraysSize;
+        ++currentSection;
+    }
+
+    IndexPcrHeader pcrHeader;
+    memset(&pcrHeader, 0, sizeof(pcrHeader));
+    if (pcrIndex)
+    {
+        pcrHeader.count = pcrIndex->getCheckpoints().size();
+        pcrHeader.pcrPid = pcrIndex->getPcrPid();
+        pcrHeader.isComplete = pcrIndex->getComplete();
+        pcrHeader.firstPcr = pcrIndex->getFirstPcr();
+        sections[currentSection].type = SECTION_PCR_INDEX;
+        sections[currentSection].offset = sections[currentSection - 1].offset +
+                                          sections[currentSection - 1].size;
+        sections[currentSection].size = sizeof(IndexPcrHeader) +
+                                        pcrHeader.count * sizeof(PcrIndex::Checkpoint);
+        ++currentSection;
+    }
+
+    uint64_t rapCount = 0;
+    if (rapIndex)
+    {
+        rapCount = rapIndex->getRandomAccessPointCount();
+        sections[currentSection].type = SECTION_RAP_INDEX;
+        sections[currentSection].offset = sections[currentSection - 1].offset +
+                                          sections[currentSection - 1].size;
+        sections[currentSection].size = sizeof(uint64_t) +
+                                        rapCount * sizeof(RapIndex::RandomAccessPoint);
+    }
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.byteOrder = INDEX_BYTE_ORDER;
+    header.fileSize = key.fileSize;
+    header.modifiedTime = key.modifiedTime;
+    header.modifiedTimeNsec = key.modifiedTimeNsec;
+    header.packetSize = packetSize;
+    header.sectionCount = sectionCount;
+
+    // Write to a temporary file and rename it, so that a reader never sees
+    // a partially written index file
+    std::string tempFileName = std::string(indexFileName) + ".tmp";
+    FILE* fileHandle = fopen(tempFileName.c_str(), "wb");
+    if (fileHandle == NULL)
+    {
+        ERR("Unable to create the index file: %s", tempFileName.c_str());
+        return false;
+    }
+
+    bool isWritten = writeData(fileHandle, &header, sizeof(header)) &&
+                     writeData(fileHandle, sections, sectionCount * sizeof(IndexSectionEntry));
+
+    uint64_t count = metadataPackets.size();
+    isWritten = isWritten && writeData(fileHandle, &count, sizeof(count));
+    for (StoredPacketList::const_iterator ix = metadataPackets.begin();
+         isWritten && ix != metadataPackets.end(); ++ix)
+    {
+        isWritten = writeData(fileHandle, &ix->packetNumber, sizeof(ix->packetNumber)) &&
+                    writeData(fileHandle, ix->data, packetSize) &&
+                    writePadding(fileHandle, packetSize);
+    }
+
+    if (pidIndex)
+    {
+        isWritten = isWritten && writeData(fileHandle, &pidCount, sizeof(pidCount));
+        uint64_t arrayOffset = sizeof(uint64_t) + pidCount * sizeof(IndexPidEntry);
+        for (uint16_t pid = 0; isWritten && pid < PidIndex::PID_COUNT; ++pid)
+        {
+            if (pidIndex->hasPid(pid))
+            {
+                IndexPidEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.pid = pid;
+                entry.count = pidIndex->getPacketCount(pid);
+                entry.offset = arrayOffset;
+                arrayOffset += ALIGN_8(entry.count * sizeof(uint32_t));
+                isWritten = writeData(fileHandle, &entry, sizeof(entry));
+            }
+        }
+        for (uint16_t pid = 0; isWritten && pid < PidIndex::PID_COUNT; ++pid)
+        {
+            if (pidIndex->hasPid(pid))
+            {
+                uint64_t arraySize = pidIndex->getPacketCount(pid) * sizeof(uint32_t);
+                isWritten = writeData(fileHandle, pidIndex->getPackets(pid), arraySize) &&
+                            writePadding(fileHandle, arraySize);
+            }
+        }
+    }
+
+    if (pcrIndex)
+    {
+        isWritten = isWritten && writeData(fileHandle, &pcrHeader, sizeof(pcrHeader)) &&
+                    writeData(fileHandle, &pcrIndex->getCheckpoints()[0],
+                              pcrHeader.count * sizeof(PcrIndex::Checkpoint));
+    }
+
+    if (rapIndex)
+    {
+        isWritten = isWritten && writeData(fileHandle, &rapCount, sizeof(rapCount));
+        const std::vector<uint16_t>& programNumbers = rapIndex->getProgramNumbers();
+        for (std::vector<uint16_t>::const_iterator ix = programNumbers.begin();
+             isWritten && ix != programNumbers.end(); ++ix)
+        {
+            const RapIndex::RandomAccessPointList& points = rapIndex->getRandomAccessPoints(*ix);
+            isWritten = points.empty() ||
+                        writeData(fileHandle, &points[0],
+                                  points.size() * sizeof(RapIndex::RandomAccessPoint));
+        }
+    }
+
+    isWritten = (fclose(fileHandle) == 0) && isWritten;
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    isWritten = isWritten && (remove(indexFileName) == 0 || errno == ENOENT);
+#endif
+    if (!isWritten || rename(tempFileName.c_str(), indexFileName) != 0)
+    {
+        ERR("Unable to write the index file: %s", indexFileName);
+        remove(tempFileName.c_str());
+        return false;
+    }
+    MSG("Wrote the index file: %s", indexFileName);
+    return true;
+}
+
+bool IndexFile::open(const char* indexFileName, const FileKey& key)
+{
+    close();
+#ifndef _WIN32
+    int fd = ::open(indexFileName, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == 0 && fileStat.st_size >= (off_t)sizeof(IndexHeader) &&
+        (uint64_t)fileStat.st_size == (uint64_t)(size_t)fileStat.st_size)
+    {
+        void* mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            indexData = (uint8_t*)mapping;
+            indexSize = fileStat.st_size;
+            isMapped = true;
+        }
+    }
+    ::close(fd);
+#else
+    FILE* fileHandle = fopen(indexFileName, "rb");
+    if (fileHandle == NULL)
+    {
+        return false;
+    }
+    if (!fseeko(fileHandle, 0, SEEK_END))
+    {
+        uint64_t size = ftello(fileHandle);
+        if (size >= sizeof(IndexHeader) && !fseeko(fileHandle, 0, SEEK_SET))
+        {
+            indexData = new uint8_t[size];
+            indexSize = size;
+            if (fread(indexData, 1, size, fileHandle) != size)
+            {
+                delete[] indexData;
+                indexData = NULL;
+                indexSize = 0;
+            }
+        }
+    }
+    fclose(fileHandle);
+#endif
+    if (indexData == NULL || !validate(key))
+    {
+        MSG("Ignoring the index file: %s", indexFileName);
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool IndexFile::validate(const FileKey& key)
+{
+    // Anything read from the index file is checked against its size before
+    // being used, so that a corrupt index file cannot cause a crash
+    const IndexHeader* header = (const IndexHeader*)indexData;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) ||
+        header->version != VERSION ||
+        header->byteOrder != INDEX_BYTE_ORDER)
+    {
+        return false;
+    }
+    if (header->fileSize != key.fileSize ||
+        header->modifiedTime != key.modifiedTime ||
+        header->modifiedTimeNsec != key.modifiedTimeNsec)
+    {
+        MSG("Stale index file");
+        return false;
+    }
+    if (header->packetSize < PACKET_SIZE_TS || header->packetSize > 0xFF)
+    {
+        return false;
+    }
+    packetSize = header->packetSize;
+
+    if (header->sectionCount > (indexSize - sizeof(IndexHeader)) / sizeof(IndexSectionEntry))
+    {
+        return false;
+    }
+    const IndexSectionEntry* sections = (const IndexSectionEntry*)(indexData + sizeof(IndexHeader));
+    for (uint32_t ix = 0; ix < header->sectionCount; ++ix)
+    {
+        uint64_t offset = sections[ix].offset;
+        uint64_t size = sections[ix].size;
+        if (offset % 8 || offset > indexSize || size > indexSize - offset || size < sizeof(uint64_t))
+        {
+            return false;
+        }
+        const uint8_t* section = indexData + offset;
+        uint64_t count = *(const uint64_t*)section;
+
+        if (sections[ix].type == SECTION_METADATA_PACKETS)
+        {
+            uint64_t recordSize = sizeof(uint64_t) + ALIGN_8((uint64_t)packetSize);
+            if (count > (size - sizeof(uint64_t)) / recordSize)
+            {
+                return false;
+            }
+            metadataPackets.clear();
+            const uint8_t* record = section + sizeof(uint64_t);
+            for (uint64_t iy = 0; iy < count; ++iy)
+            {
+                StoredPacket storedPacket;
+                storedPacket.packetNumber = *(const uint64_t*)record;
+                storedPacket.data = record + sizeof(uint64_t);
+                metadataPackets.push_back(storedPacket);
+                record += recordSize;
+            }
+        }
+        else if (sections[ix].type == SECTION_PID_INDEX)
+        {
+            if (count > PidIndex::PID_COUNT ||
+                count > (size - sizeof(uint64_t)) / sizeof(IndexPidEntry))
+            {
+                return false;
+            }
+            const IndexPidEntry* entries = (const IndexPidEntry*)(section + sizeof(uint64_t));
+            for (uint64_t iy = 0; iy < count; ++iy)
+            {
+                if (entries[iy].pid >= PidIndex::PID_COUNT || entries[iy].offset % 4 ||
+                    entries[iy].offset > size ||
+                    entries[iy].count > (size - entries[iy].offset) / sizeof(uint32_t))
+                {
+                    return false;
+                }
+            }
+            pidSection = section;
+            pidSectionSize = size;
+        }
+        else if (sections[ix].type == SECTION_PCR_INDEX)
+        {
+            if (size < sizeof(IndexPcrHeader) ||
+                count > (size - sizeof(IndexPcrHeader)) / sizeof(PcrIndex::Checkpoint) ||
+                count == 0)
+            {
+                return false;
+            }
+            pcrSection = section;
+        }
+        else if (sections[ix].type == SECTION_RAP_INDEX)
+        {
+            if (count > (size - sizeof(uint64_t)) / sizeof(RapIndex::RandomAccessPoint))
+            {
+                return false;
+            }
+            rapSection = section;
+        }
+        else
+        {
+            MSG("Skipping unknown section type: %u", sections[ix].type);
+        }
+    }
+    return true;
+}
+
+void IndexFile::close()
+{
+    if (indexData)
+    {
+#ifndef _WIN32
+        if (isMapped)
+        {
+            munmap(indexData, indexSize);
+        }
+#else
+        delete[] indexData;
+#endif
+        indexData = NULL;
+        indexSize = 0;
+        isMapped = false;
+    }
+    packetSize = 0;
+    metadataPackets.clear();
+    pidSection = NULL;
+    pidSectionSize = 0;
+    pcrSection = NULL;
+    rapSection = NULL;
+}
+
+bool IndexFile::loadPidIndex(PidIndex& pidIndex)
+{
+    if (pidSection == NULL)
+    {
+        return false;
+    }
+    // The entries were validated in open()
+    pidIndex.clear();
+    uint64_t count = *(const uint64_t*)pidSection;
+    const IndexPidEntry* entries = (const IndexPidEntry*)(pidSection + sizeof(uint64_t));
+    for (uint64_t ix = 0; ix < count; ++ix)
+    {
+        pidIndex.setPackets(entries[ix].pid,
+                            (const uint32_t*)(pidSection + entries[ix].offset),
+                            entries[ix].count);
+    }
+    return true;
+}
+
+bool IndexFile::loadPcrIndex(PcrIndex& pcrIndex)
+{
+    if (pcrSection == NULL)
+    {
+        return false;
+    }
+    // The size was validated in open()
+    const IndexPcrHeader* header = (const IndexPcrHeader*)pcrSection;
+    const PcrIndex::Checkpoint* checkpoints =
+        (const PcrIndex::Checkpoint*)(pcrSection + sizeof(IndexPcrHeader));
+    pcrIndex.reset(header->pcrPid, header->firstPcr);
+    pcrIndex.mergeCheckpoints(PcrIndex::CheckpointList(checkpoints, checkpoints + header->count));
+    pcrIndex.setComplete(header->isComplete != 0);
+    return true;
+}
+
+bool IndexFile::loadRapIndex(RapIndex& rapIndex)
+{
+    if (rapSection == NULL)
+    {
+        return false;
+    }
+    // The size was validated in open()
+    uint64_t count = *(const uint64_t*)rapSection;
+    const RapIndex::RandomAccessPoint* points =
+        (const RapIndex::RandomAccessPoint*)(rapSection + sizeof(uint64_t));
+    rapIndex.clear();
+    for (uint64_t ix = 0; ix < count; ++ix)
+    {
+        rapIndex.addRandomAccessPoint(points[ix]);
+    }
+    return true;
+}
@@ -0,0 +1,215 @@
+/*
+ *  IndexFile.h - A sidecar file which persists the index and the metadata of
+ *  a TS file across the open() calls
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   IndexFile.h
+ *  \brief  Persistent index of a TS file.
+ *
+ *  Defines IndexFile which is used by TsFile to save the packet size, the
+ *  packets carrying the PAT and PMTs, the PID index and the PCR index of a
+ *  TS file next to it, so that they need not be found again by scanning the
+ *  file.
+ */
+
+#ifndef DELPHINUS_INDEX_FILE_H
+#define DELPHINUS_INDEX_FILE_H
+
+#include <cstddef>
+#include <vector>
+#include "common/DelphinusUtils.h"
+
+class PidIndex;
+class PcrIndex;
+class RapIndex;
+
+/** \cond DEV */
+/**
+ *  \brief  Reads and writes the index files.
+ *
+ *  An index file starts with a fixed header carrying a magic, the format
+ *  version, the byte order, and the size and modification time of the TS
+ *  file it was written for. The header is followed by a directory of the
+ *  sections in the file, each of which is aligned to 8 bytes so that it can
+ *  be used in place once the index file is memory mapped. Sections of an
+ *  unknown type are skipped, while any change to the layout of an existing
+ *  section needs a new format version. An index file which does not match
+ *  the version, the byte order, or the TS file is ignored.
+ */
+class IndexFile
+{
+    public:
+        enum
+        {
+            VERSION = 1
+        };
+/**
+ *  \brief  Identifies the contents of a TS file.
+ */
+        struct FileKey
+        {
+/** Size of the file in bytes. */
+            uint64_t fileSize;
+/** Modification time, seconds part. */
+            int64_t modifiedTime;
+/** Modification time, nanoseconds part, 0 if not supported. */
+            int64_t modifiedTimeNsec;
+        };
+/**
+ *  \brief  A TS packet stored in the index file.
+ */
+        struct StoredPacket
+        {
+/** Packet number(starts at 0) in the TS file. */
+            uint64_t packetNumber;
+/** Packet data, of the size of the packets in the TS file. */
+            const uint8_t* data;
+        };
+/**
+ *  \brief  A list of stored packets.
+ */
+        typedef std::vector<StoredPacket> StoredPacketList;
+
+    private:
+        uint8_t* indexData;
+        uint64_t indexSize;
+        bool isMapped;
+        uint8_t packetSize;
+        StoredPacketList metadataPackets;
+        const uint8_t* pidSection;
+        uint64_t pidSectionSize;
+        const uint8_t* pcrSection;
+        const uint8_t* rapSection;
+
+        bool validate(const FileKey& key);
+
+    public:
+        IndexFile();
+        ~IndexFile();
+
+/**
+ *  \brief  Get the key of a file.
+ *  \param  fileName Name of the file.
+ *  \param  key Key of the file.
+ *  \return true on success, false if the file could not be accessed.
+ */
+        static bool getFileKey(const char* fileName, FileKey& key);
+/**
+ *  \brief  Write an index file, replacing any existing one atomically.
+ *  \param  indexFileName Name of the index file.
+ *  \param  key Key of the TS file.
+ *  \param  packetSize Size of the packets in the TS file.
+ *  \param  metadataPackets Packets carrying the PAT and PMTs.
+ *  \param  pidIndex PID index of the TS file, NULL if not built.
+ *  \param  pcrIndex PCR index of the TS file, NULL if not built.
+ *  \param  rapIndex Random access points of the TS file, NULL if not built.
+ *  \return true if the index file was written, false otherwise.
+ */
+        static bool write(const char* indexFileName, const FileKey& key, uint8_t packetSize,
+                          const StoredPacketList& metadataPackets, PidIndex* pidIndex,
+                          PcrIndex* pcrIndex, RapIndex* rapIndex);
+/**
+ *  \brief  Open an index file if it matches the TS file.
+ *  \param  indexFileName Name of the index file.
+ *  \param  key Key of the TS file.
+ *  \return true if the index file is valid for the TS file, false otherwise.
+ */
+        bool open(const char* indexFileName, const FileKey& key);
+/**
+ *  \brief  Close the index file, invalidating all the data from it.
+ */
+        void close();
+/**
+ *  \brief  Get the size of the packets in the TS file.
+ *  \return Packet size.
+ */
+        uint8_t getPacketSize();
+/**
+ *  \brief  Get the packets carrying the PAT and PMTs.
+ *  \return List of packets, valid till close().
+ */
+        const StoredPacketList& getMetadataPackets();
+/**
+ *  \brief  Check if the index file has the PID index.
+ *  \return true if the PID index is available, false otherwise.
+ */
+        bool hasPidIndex();
+/**
+ *  \brief  Load the PID index, the packet numbers are used in place from
+ *          the index file and must not be accessed after close().
+ *  \param  pidIndex PID index to load into.
+ *  \return true on success, false if the PID index is not available.
+ */
+        bool loadPidIndex(PidIndex& pidIndex);
+/**
+ *  \brief  Check if the index file has the PCR index.
+ *  \return true if the PCR index is available, false otherwise.
+ */
+        bool hasPcrIndex();
+/**
+ *  \brief  Load the PCR index, the checkpoints are copied.
+ *  \param  pcrIndex PCR index to load into.
+ *  \return true on success, false if the PCR index is not available.
+ */
+        bool loadPcrIndex(PcrIndex& pcrIndex);
+/**
+ *  \brief  Check if the index file has the random access points.
+ *  \return true if the random access points are available, false
+ *          otherwise.
+ */
+        bool hasRapIndex();
+/**
+ *  \brief  Load the random access points, which are copied.
+ *  \param  rapIndex Index of the random access points to load into.
+ *  \return true on success, false if the random access points are not
+ *          available.
+ */
+        bool loadRapIndex(RapIndex& rapIndex);
+};
+
+inline uint8_t IndexFile::getPacketSize()
+{
+    return packetSize;
+}
+
+inline const IndexFile::StoredPacketList& IndexFile::getMetadataPackets()
+{
+    return metadataPackets;
+}
+
+inline bool IndexFile::hasPidIndex()
+{
+    return (pidSection != NULL);
+}
+
+inline bool IndexFile::hasPcrIndex()
+{
+    return (pcrSection != NULL);
+}
+
+inline bool IndexFile::hasRapIndex()
+{
+    return (rapSection != NULL);
+}
+/** \endcond DEV */
+
+#endif
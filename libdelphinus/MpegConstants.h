@@ -50,7 +50,22 @@ namespace MpegConstants
         /** 188 bytes TS Packet */
         PACKET_SIZE_TS              = 188,
         /** 192 bytes TTS Packet */
-        PACKET_SIZE_TTS             = 192
+        PACKET_SIZE_TTS             = 192,
+        /** 204 bytes TS Packet followed by 16 bytes of Reed-Solomon parity */
+        PACKET_SIZE_RS              = 204
+    };
+
+/**
+ *  \brief  Constants for the clocks in the TS.
+ */
+    enum SystemClock
+    {
+        /** Frequency of the system clock in which the PCR is expressed */
+        SYSTEM_CLOCK_FREQUENCY      = 27000000,
+        /** Frequency of the PCR base, PTS and DTS */
+        PCR_BASE_FREQUENCY          = 90000,
+        /** Number of system clock ticks in one tick of the PCR base */
+        PCR_EXTENSION_MODULO        = 300
     };
 
 /**
@@ -152,6 +167,7 @@ namespace MpegConstants
         STREAM_TYPE_14496_1_FLEXMUX_SECTIONS        = 0x13,
         STREAM_TYPE_13818_6_SYNC_DOWNLOAD_PROTOCOL  = 0x14,
         STREAM_TYPE_14496_10_VIDEO                  = 0x1b,
+        STREAM_TYPE_23008_2_VIDEO                   = 0x24,
         // Chinese standard
         STREAM_TYPE_AVS_VIDEO                       = 0x42,
         // 0x80 can also be LPCM audio
@@ -188,6 +204,21 @@ namespace MpegConstants
         STREAM_TYPE_USER_PRIVATE_END                = 0xFF
     };
 
+/**
+ *  \brief  Constants for the sizes of the sections.
+ */
+    enum SectionSize
+    {
+        /** Bytes of the section header up to and including the section_length */
+        SECTION_HEADER_SIZE         = 3,
+        /** Smallest section using the long header, with an empty body and the CRC_32 */
+        SECTION_SIZE_LONG_MIN       = 12,
+        /** Largest PSI section (PAT, CAT, PMT, TSDT) */
+        SECTION_SIZE_PSI_MAX        = 1024,
+        /** Largest private section, which includes the DVB SI tables */
+        SECTION_SIZE_PRIVATE_MAX    = 4096
+    };
+
 /**
  *  \brief  Constants for Table ID values in the section header.
  */
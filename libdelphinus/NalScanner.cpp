@@ -0,0 +1,193 @@
+/*
+ *  NalScanner.cpp - Scanning of the NAL units of H.264 and H.265 video
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "NalScanner.h"
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAL_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+//#define DEBUG
+
+#define MODULE_NAL_SCANNER 20
+#define CURRENT_MODULE MODULE_NAL_SCANNER
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define START_CODE_SIZE             3
+
+NalScanner::NalScanner(Codec nalCodec)
+    :   find(findScalar),
+        codec(nalCodec),
+        nextStartCode(NULL),
+        dataEnd(NULL)
+{
+#ifdef NAL_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        find = findAvx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        find = findSse2;
+    }
+#endif
+}
+
+NalScanner::~NalScanner()
+{
+}
+
+const uint8_t* NalScanner::findScalar(const uint8_t* data, const uint8_t* end)
+{
+    // Look at the last byte of a possible start code, and skip 3 bytes at a
+    // time while it cannot be part of any start code
+    const uint8_t* last = data + 2;
+    while (last < end)
+    {
+        if (*last > 1)
+        {
+            last += 3;
+        }
+        else if (*last == 0)
+        {
+            ++last;
+        }
+        else if (last[-1] == 0 && last[-2] == 0)
+        {
+            return last - 2;
+        }
+        else
+        {
+            last += 3;
+        }
+    }
+    return end;
+}
+
+#ifdef NAL_SCANNER_X86
+__attribute__((target("sse2")))
+const uint8_t* NalScanner::findSse2(const uint8_t* data, const uint8_t* end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const uint8_t* block = data;
+    // The zero bytes of the previous block, for a start code crossing into
+    // the current one
+    uint32_t previousZeros = 0;
+    while (end - block >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)block);
+        uint32_t zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero));
+        uint32_t ones = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, one));
+        // Bit n is set when byte n is 1 and the 2 bytes before it are 0
+        uint32_t candidates = ones & ((zeros << 1) | (previousZeros >> 15)) &
+                              ((zeros << 2) | (previousZeros >> 14));
+        if (candidates)
+        {
+            return block + __builtin_ctz(candidates) - 2;
+        }
+        previousZeros = zeros;
+        block += 16;
+    }
+    return findScalar((block == data) ? data : block - 2, end);
+}
+
+__attribute__((target("avx2")))
+const uint8_t* NalScanner::findAvx2(const uint8_t* data, const uint8_t* end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    const uint8_t* block = data;
+    uint64_t previousZeros = 0;
+    while (end - block >= 64)
+    {
+        __m256i low = _mm256_loadu_si256((const __m256i*)block);
+        __m256i high = _mm256_loadu_si256((const __m256i*)(block + 32));
+        uint64_t zeros = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, zero)) |
+                         ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, zero)) << 32);
+        uint64_t ones = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, one)) |
+                        ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, one)) << 32);
+        uint64_t candidates = ones & ((zeros << 1) | (previousZeros >> 63)) &
+                              ((zeros << 2) | (previousZeros >> 62));
+        if (candidates)
+        {
+            return block + __builtin_ctzll(candidates) - 2;
+        }
+        previousZeros = zeros;
+        block += 64;
+    }
+    return findScalar((block == data) ? data : block - 2, end);
+}
+#else
+const uint8_t* NalScanner::findSse2(const uint8_t* data, const uint8_t* end)
+{
+    return findScalar(data, end);
+}
+
+const uint8_t* NalScanner::findAvx2(const uint8_t* data, const uint8_t* end)
+{
+    return findScalar(data, end);
+}
+#endif
+
+void NalScanner::setData(const uint8_t* data, uint32_t size)
+{
+    dataEnd = data + size;
+    nextStartCode = find(data, dataEnd);
+}
+
+bool NalScanner::nextNalUnit(NalUnit& nalUnit)
+{
+    const uint8_t* header = nextStartCode + START_CODE_SIZE;
+    uint8_t headerSize = (codec == CODEC_H265) ? 2 : 1;
+    if (nextStartCode == dataEnd || dataEnd - header < headerSize)
+    {
+        nextStartCode = dataEnd;
+        return false;
+    }
+    nextStartCode = find(header, dataEnd);
+    const uint8_t* nalEnd = nextStartCode;
+    if (nalEnd != dataEnd)
+    {
+        // The zero_byte of a 4 bytes start code and the trailing_zero_8bits
+        // are not part of the NAL unit, which always ends with a non zero
+        // byte
+        while (nalEnd > header && nalEnd[-1] == 0)
+        {
+            --nalEnd;
+        }
+    }
+    nalUnit.data = header;
+    nalUnit.size = nalEnd - header;
+    nalUnit.type = (codec == CODEC_H265) ? (header[0] >> 1) & 0x3F : header[0] & 0x1F;
+    return true;
+}
@@ -0,0 +1,134 @@
+/*
+ *  NalScanner.h - Scanning of the NAL units of H.264 and H.265 video
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   NalScanner.h
+ *  \brief  Start code scanning of the H.264 and H.265 byte streams.
+ *
+ *  Defines NalScanner which finds the NAL units of the H.264 and H.265 video
+ *  carried in the PES payloads.
+ */
+
+#ifndef DELPHINUS_NAL_SCANNER_H
+#define DELPHINUS_NAL_SCANNER_H
+
+#include "common/DelphinusUtils.h"
+
+/**
+ *  \brief  Finds the NAL units in a H.264 or H.265 byte stream.
+ *
+ *  The NAL units of the byte stream follow the start code prefix 00 00 01.
+ *  The start codes are searched 32 bytes at a time using AVX2, or 16 bytes
+ *  at a time using SSE2, when the CPU supports them, with a single load and
+ *  compare per block, and the NAL units are returned in place, pointing into
+ *  the data scanned, without copying them.
+ *
+ *  Each buffer, typically the payload of a PES, is scanned on its own, so
+ *  the bytes before its first start code, which belong to a NAL unit started
+ *  in the previous buffer, are skipped, and a start code split between two
+ *  buffers is not found.
+ */
+class NalScanner
+{
+    public:
+/**
+ *  \brief  Codecs of the byte streams, which differ in the NAL unit header.
+ */
+        enum Codec
+        {
+/** H.264 / ISO 14496-10, 1 byte NAL unit header. */
+            CODEC_H264                  = 0,
+/** H.265 / ISO 23008-2, 2 bytes NAL unit header. */
+            CODEC_H265                  = 1
+        };
+/**
+ *  \brief  A NAL unit found in the data.
+ */
+        struct NalUnit
+        {
+/** First byte of the NAL unit header, following the start code. */
+            const uint8_t* data;
+/** Bytes up to the next start code, without the zero bytes before it. */
+            uint32_t size;
+/** nal_unit_type. */
+            uint8_t type;
+        };
+
+    private:
+        typedef const uint8_t* (*FindFunction)(const uint8_t* data, const uint8_t* end);
+
+        static const uint8_t* findScalar(const uint8_t* data, const uint8_t* end);
+        static const uint8_t* findSse2(const uint8_t* data, const uint8_t* end);
+        static const uint8_t* findAvx2(const uint8_t* data, const uint8_t* end);
+
+        FindFunction find;
+        Codec codec;
+        // Next start code, or the end of the data
+        const uint8_t* nextStartCode;
+        const uint8_t* dataEnd;
+
+    public:
+/**
+ *  \brief  Constructor.
+ *  \param  nalCodec Codec of the byte streams scanned.
+ */
+        NalScanner(Codec nalCodec);
+        ~NalScanner();
+
+/**
+ *  \brief  Start scanning a new buffer.
+ *  \param  data Start of the data, which must stay valid while its NAL
+ *          units are used.
+ *  \param  size Size of the data in bytes.
+ */
+        void setData(const uint8_t* data, uint32_t size);
+/**
+ *  \brief  Get the next NAL unit of the data.
+ *  \param  nalUnit Set to the NAL unit.
+ *  \return true if a NAL unit was found, false at the end of the data.
+ */
+        bool nextNalUnit(NalUnit& nalUnit);
+/**
+ *  \brief  Find the next start code prefix 00 00 01.
+ *  \param  data Start of the data.
+ *  \param  end End of the data.
+ *  \return First byte of the start code prefix, end if there is none.
+ */
+        const uint8_t* findStartCode(const uint8_t* data, const uint8_t* end);
+/**
+ *  \brief  Get the codec of the byte streams scanned.
+ *  \return Codec.
+ */
+        Codec getCodec();
+};
+
+inline const uint8_t* NalScanner::findStartCode(const uint8_t* data, const uint8_t* end)
+{
+    return find(data, end);
+}
+
+inline NalScanner::Codec NalScanner::getCodec()
+{
+    return codec;
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ *  PcrIndex.cpp - A sparse table of the PCR values at known packets of a
+ *  Transport Stream
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "PcrIndex.h"
+#include <algorithm>
+
+using namespace MpegConstants;
+
+bool compareCheckpointPacket(const PcrIndex::Checkpoint& checkpoint, uint64_t packetNumber);
+bool compareCheckpointElapsed(uint64_t elapsed, const PcrIndex::Checkpoint& checkpoint);
+bool compareCheckpoints(const PcrIndex::Checkpoint& first, const PcrIndex::Checkpoint& second);
+bool isSameCheckpoint(const PcrIndex::Checkpoint& first, const PcrIndex::Checkpoint& second);
+
+bool compareCheckpointPacket(const PcrIndex::Checkpoint& checkpoint, uint64_t packetNumber)
+{
+    return checkpoint.packetNumber < packetNumber;
+}
+
+bool compareCheckpointElapsed(uint64_t elapsed, const PcrIndex::Checkpoint& checkpoint)
+{
+    return elapsed < checkpoint.elapsed;
+}
+
+bool compareCheckpoints(const PcrIndex::Checkpoint& first, const PcrIndex::Checkpoint& second)
+{
+    return first.packetNumber < second.packetNumber;
+}
+
+bool isSameCheckpoint(const PcrIndex::Checkpoint& first, const PcrIndex::Checkpoint& second)
+{
+    return first.packetNumber == second.packetNumber;
+}
+
+PcrIndex::PcrIndex()
+    :   pcrPid(PID_NULL),
+        firstPcr(0),
+        isComplete(false)
+{
+}
+
+PcrIndex::~PcrIndex()
+{
+}
+
+void PcrIndex::reset(uint16_t pid, uint64_t pcr)
+{
+    pcrPid = pid;
+    firstPcr = pcr % PCR_WRAP_AROUND;
+    checkpoints.clear();
+    isComplete = false;
+}
+
+void PcrIndex::addCheckpoint(uint64_t packetNumber, uint64_t elapsed)
+{
+    CheckpointList::iterator position = std::lower_bound(checkpoints.begin(), checkpoints.end(),
+                                                         packetNumber, compareCheckpointPacket);
+    if (position != checkpoints.end() && position->packetNumber == packetNumber)
+    {
+        return;
+    }
+    Checkpoint checkpoint;
+    checkpoint.packetNumber = packetNumber;
+    checkpoint.elapsed = elapsed;
+    checkpoints.insert(position, checkpoint);
+}
+
+void PcrIndex::mergeCheckpoints(const CheckpointList& more)
+{
+    uint64_t middle = checkpoints.size();
+    checkpoints.insert(checkpoints.end(), more.begin(), more.end());
+    std::inplace_merge(checkpoints.begin(), checkpoints.begin() + middle, checkpoints.end(),
+                       compareCheckpoints);
+    checkpoints.erase(std::unique(checkpoints.begin(), checkpoints.end(), isSameCheckpoint),
+                      checkpoints.end());
+}
+
+bool PcrIndex::findCheckpoints(uint64_t elapsed, Checkpoint& lower, Checkpoint& upper)
+{
+    // The elapsed times increase along with the packet numbers
+    CheckpointList::iterator position = std::upper_bound(checkpoints.begin(), checkpoints.end(),
+                                                         elapsed, compareCheckpointElapsed);
+    if (position == checkpoints.begin() || position == checkpoints.end())
+    {
+        return false;
+    }
+    upper = *position;
+    lower = *(position - 1);
+    return true;
+}
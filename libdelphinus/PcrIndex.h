@@ -0,0 +1,171 @@
+/*
+ *  PcrIndex.h - A sparse table of the PCR values at known packets of a
+ *  Transport Stream
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   PcrIndex.h
+ *  \brief  Sparse PCR checkpoints of a TS file.
+ *
+ *  Defines PcrIndex which is used by TsFile to narrow down the range of
+ *  packets to be searched when seeking to a point in time.
+ */
+
+#ifndef DELPHINUS_PCR_INDEX_H
+#define DELPHINUS_PCR_INDEX_H
+
+#include <vector>
+#include "MpegConstants.h"
+
+// The PCR base is a 33-bit counter of the 90 kHz clock
+#define PCR_WRAP_AROUND                 ((uint64_t)MpegConstants::PCR_EXTENSION_MODULO << 33)
+
+/** \cond DEV */
+/**
+ *  \brief  PCR checkpoints of a single PCR PID.
+ *
+ *  PcrIndex holds the time elapsed since the first PCR of the file, in units
+ *  of the 27 MHz system clock, at a sparse set of packets carrying a PCR.
+ *  The elapsed time is computed modulo the PCR wrap around, so the PCR is
+ *  assumed to increase through the file, and the file is assumed to be
+ *  shorter than the PCR wrap around period of about 26.5 hours. Checkpoints
+ *  can be added in any order, from a full scan of the file or lazily as
+ *  they are found while searching.
+ */
+class PcrIndex
+{
+    public:
+/**
+ *  \brief  Elapsed time at a packet carrying a PCR.
+ */
+        struct Checkpoint
+        {
+/** Packet number(starts at 0) of the packet carrying the PCR. */
+            uint64_t packetNumber;
+/** Time elapsed since the first PCR in the file, in 27 MHz units. */
+            uint64_t elapsed;
+        };
+/**
+ *  \brief  A list of checkpoints, in increasing order of packet numbers.
+ */
+        typedef std::vector<Checkpoint> CheckpointList;
+
+    private:
+        uint16_t pcrPid;
+        uint64_t firstPcr;
+        CheckpointList checkpoints;
+        // Set once a checkpoint has been added for every chunk of the file
+        bool isComplete;
+
+    public:
+        PcrIndex();
+        ~PcrIndex();
+
+/**
+ *  \brief  Remove all the checkpoints and start over with a new PCR PID.
+ *  \param  pid PCR PID.
+ *  \param  pcr PCR of the first packet carrying a PCR in the file.
+ */
+        void reset(uint16_t pid, uint64_t pcr);
+/**
+ *  \brief  Add a checkpoint, ignored if there is one already at the packet.
+ *  \param  packetNumber Packet number of the packet carrying the PCR.
+ *  \param  elapsed Time elapsed since the first PCR.
+ */
+        void addCheckpoint(uint64_t packetNumber, uint64_t elapsed);
+/**
+ *  \brief  Add a list of checkpoints at once.
+ *  \param  more Checkpoints in increasing order of packet numbers.
+ */
+        void mergeCheckpoints(const CheckpointList& more);
+/**
+ *  \brief  Find the checkpoints around a point in time.
+ *  \param  elapsed Time elapsed since the first PCR.
+ *  \param  lower Last checkpoint at or before the time.
+ *  \param  upper First checkpoint after the time.
+ *  \return true if both the checkpoints exist, false otherwise.
+ */
+        bool findCheckpoints(uint64_t elapsed, Checkpoint& lower, Checkpoint& upper);
+/**
+ *  \brief  Convert a PCR to the time elapsed since the first PCR.
+ *  \param  pcr PCR in 27 MHz units.
+ *  \return Time elapsed in 27 MHz units.
+ */
+        uint64_t getElapsed(uint64_t pcr);
+/**
+ *  \brief  Get the PID whose PCR is indexed.
+ *  \return PCR PID.
+ */
+        uint16_t getPcrPid();
+/**
+ *  \brief  Get the first PCR in the file.
+ *  \return PCR in 27 MHz units.
+ */
+        uint64_t getFirstPcr();
+/**
+ *  \brief  Get all the checkpoints.
+ *  \return List of checkpoints.
+ */
+        const CheckpointList& getCheckpoints();
+/**
+ *  \brief  Check if the checkpoints cover every chunk of the file.
+ *  \return true if built by a full scan, false otherwise.
+ */
+        bool getComplete();
+/**
+ *  \brief  Mark the checkpoints as covering every chunk of the file.
+ *  \param  complete Built by a full scan or not.
+ */
+        void setComplete(bool complete);
+};
+
+inline uint64_t PcrIndex::getElapsed(uint64_t pcr)
+{
+    return (pcr + PCR_WRAP_AROUND - firstPcr) % PCR_WRAP_AROUND;
+}
+
+inline uint16_t PcrIndex::getPcrPid()
+{
+    return pcrPid;
+}
+
+inline uint64_t PcrIndex::getFirstPcr()
+{
+    return firstPcr;
+}
+
+inline const PcrIndex::CheckpointList& PcrIndex::getCheckpoints()
+{
+    return checkpoints;
+}
+
+inline bool PcrIndex::getComplete()
+{
+    return isComplete;
+}
+
+inline void PcrIndex::setComplete(bool complete)
+{
+    isComplete = complete;
+}
+/** \endcond DEV */
+
+#endif
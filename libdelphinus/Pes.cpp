@@ -22,39 +22,540 @@
  */
 
 #include <cstddef>
+#include <cstring>
+#include <algorithm>
 #include "Pes.h"
 
+//#define DEBUG
+
+#define MODULE_PES 16
+#define CURRENT_MODULE MODULE_PES
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+// Without a pool, the buffer of a PES without a length grows from this size
+#define PES_HEAP_MIN_CAPACITY 4096
+
+// Byte 6 of the optional header starts with '10'
+#define PES_MARKER_MASK                 0xC0
+#define PES_MARKER                      0x80
+// Flags in byte 7 of the optional header
+#define PES_ESCR_FLAG                   0x20
+#define PES_ES_RATE_FLAG                0x10
+#define PES_DSM_TRICK_MODE_FLAG         0x08
+#define PES_ADDITIONAL_COPY_INFO_FLAG   0x04
+#define PES_CRC_FLAG                    0x02
+#define PES_EXTENSION_FLAG              0x01
+// Flags in the first byte of the PES extension
+#define PES_PRIVATE_DATA_FLAG           0x80
+#define PES_PACK_HEADER_FIELD_FLAG      0x40
+#define PES_SEQUENCE_COUNTER_FLAG       0x20
+#define PES_PSTD_BUFFER_FLAG            0x10
+#define PES_EXTENSION_FLAG_2            0x01
+#define PES_STREAM_ID_EXTENSION_FLAG    0x80
+
+#define PES_TIMESTAMP_SIZE              5
+#define PES_ESCR_SIZE                   6
+#define PES_ES_RATE_SIZE                3
+#define PES_CRC_SIZE                    2
+#define PES_SEQUENCE_COUNTER_SIZE       2
+#define PES_PSTD_BUFFER_SIZE            2
+
+uint64_t decodeTimestamp(const uint8_t* data);
+uint64_t decodeEscr(const uint8_t* data);
+
+uint64_t decodeTimestamp(const uint8_t* data)
+{
+    // The 5 bytes of the timestamp are the low 40 bits of the 8 bytes ending
+    // with them, the 3 bytes before them being still within the header:
+    // '001x' [32..30] marker [29..15] marker [14..0] marker
+    uint64_t value = DelphinusUtils::loadBigEndian64(data + PES_TIMESTAMP_SIZE - sizeof(uint64_t));
+    return ((value >> 3) & (0x7ULL << 30)) | ((value >> 2) & (0x7FFFULL << 15)) | ((value >> 1) & 0x7FFF);
+}
+
+uint64_t decodeEscr(const uint8_t* data)
+{
+    // The low 48 bits of the 8 bytes ending with the ESCR:
+    // reserved [32..30] marker [29..15] marker [14..0] marker extension marker
+    uint64_t value = DelphinusUtils::loadBigEndian64(data + PES_ESCR_SIZE - sizeof(uint64_t));
+    uint64_t base = ((value >> 13) & (0x7ULL << 30)) | ((value >> 12) & (0x7FFFULL << 15)) |
+                    ((value >> 11) & 0x7FFF);
+    return base * 300 + ((value >> 1) & 0x1FF);
+}
+
+PesHeader::PesHeader()
+{
+    parse(NULL, 0);
+}
+
+bool PesHeader::hasOptionalHeaderFields(uint8_t streamId)
+{
+    switch (streamId)
+    {
+        case 0xBC:  // program_stream_map
+        case 0xBE:  // padding_stream
+        case 0xBF:  // private_stream_2
+        case 0xF0:  // ECM_stream
+        case 0xF1:  // EMM_stream
+        case 0xF2:  // DSMCC_stream
+        case 0xF8:  // ITU-T Rec. H.222.1 type E
+        case 0xFF:  // program_stream_directory
+            return false;
+        default:
+            return true;
+    }
+}
+
+bool PesHeader::getTimestamps(const uint8_t* data, uint32_t size, uint64_t& pts, uint64_t& dts)
+{
+    pts = (uint64_t) - 1;
+    dts = (uint64_t) - 1;
+    if (size < OPTIONAL_HEADER_OFFSET || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01 ||
+        !hasOptionalHeaderFields(data[3]) || (data[6] & PES_MARKER_MASK) != PES_MARKER)
+    {
+        return false;
+    }
+    // The forbidden value '01' is taken as no timestamps, as in parse()
+    uint8_t flags = data[7] >> 6;
+    if (!(flags & PTS_DTS_PTS_ONLY))
+    {
+        return true;
+    }
+    uint32_t timestampsEnd = OPTIONAL_HEADER_OFFSET + PES_TIMESTAMP_SIZE * (flags == PTS_DTS_BOTH ? 2 : 1);
+    if (timestampsEnd > size || timestampsEnd > (uint32_t)OPTIONAL_HEADER_OFFSET + data[8])
+    {
+        return false;
+    }
+    pts = decodeTimestamp(data + OPTIONAL_HEADER_OFFSET);
+    if (flags == PTS_DTS_BOTH)
+    {
+        dts = decodeTimestamp(data + OPTIONAL_HEADER_OFFSET + PES_TIMESTAMP_SIZE);
+    }
+    return true;
+}
+
+bool PesHeader::parse(const uint8_t* data, uint32_t size)
+{
+    streamId = 0;
+    pesPacketLength = 0;
+    hasOptionalHeader = false;
+    headerDataLength = 0;
+    payloadOffset = 0;
+    scramblingControl = 0;
+    priority = false;
+    dataAlignmentIndicator = false;
+    copyright = false;
+    originalOrCopy = false;
+    ptsDtsFlags = PTS_DTS_NONE;
+    pts = (uint64_t) - 1;
+    dts = (uint64_t) - 1;
+    escr = (uint64_t) - 1;
+    esRate = 0;
+    hasTrickMode = false;
+    trickMode = 0;
+    hasAdditionalCopyInfo = false;
+    additionalCopyInfo = 0;
+    hasPreviousPesCrc = false;
+    previousPesCrc = 0;
+    privateData = NULL;
+    packHeader = NULL;
+    packHeaderLength = 0;
+    hasSequenceCounter = false;
+    sequenceCounter = 0;
+    mpeg1Mpeg2Identifier = false;
+    originalStuffLength = 0;
+    hasPstdBuffer = false;
+    pstdBufferScale = false;
+    pstdBufferSize = 0;
+    hasStreamIdExtension = false;
+    streamIdExtension = 0;
+
+    if (size < PesPacket::PES_HEADER_SIZE || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01)
+    {
+        return false;
+    }
+    streamId = data[3];
+    pesPacketLength = (data[4] << PES_LENGTH_SHIFT) | data[5];
+    payloadOffset = PesPacket::PES_HEADER_SIZE;
+    if (!hasOptionalHeaderFields(streamId))
+    {
+        return true;
+    }
+    if (size < OPTIONAL_HEADER_OFFSET || (data[6] & PES_MARKER_MASK) != PES_MARKER)
+    {
+        return false;
+    }
+    hasOptionalHeader = true;
+    headerDataLength = data[8];
+    payloadOffset = OPTIONAL_HEADER_OFFSET + headerDataLength;
+    if (payloadOffset > size)
+    {
+        return false;
+    }
+    scramblingControl = (data[6] >> 4) & 0x03;
+    priority = data[6] & 0x08;
+    dataAlignmentIndicator = data[6] & 0x04;
+    copyright = data[6] & 0x02;
+    originalOrCopy = data[6] & 0x01;
+    ptsDtsFlags = data[7] >> 6;
+
+    // Every field is checked against the end of the header, the stuffing
+    // bytes being whatever is left of it
+    const uint8_t* field = data + OPTIONAL_HEADER_OFFSET;
+    const uint8_t* end = data + payloadOffset;
+    if (ptsDtsFlags & PTS_DTS_PTS_ONLY)
+    {
+        if (end - field < PES_TIMESTAMP_SIZE)
+        {
+            return false;
+        }
+        pts = decodeTimestamp(field);
+        field += PES_TIMESTAMP_SIZE;
+        if (ptsDtsFlags == PTS_DTS_BOTH)
+        {
+            if (end - field < PES_TIMESTAMP_SIZE)
+            {
+                return false;
+            }
+            dts = decodeTimestamp(field);
+            field += PES_TIMESTAMP_SIZE;
+        }
+    }
+    if (data[7] & PES_ESCR_FLAG)
+    {
+        if (end - field < PES_ESCR_SIZE)
+        {
+            return false;
+        }
+        escr = decodeEscr(field);
+        field += PES_ESCR_SIZE;
+    }
+    if (data[7] & PES_ES_RATE_FLAG)
+    {
+        if (end - field < PES_ES_RATE_SIZE)
+        {
+            return false;
+        }
+        esRate = ((field[0] & 0x7F) << 15) | (field[1] << 7) | (field[2] >> 1);
+        field += PES_ES_RATE_SIZE;
+    }
+    if (data[7] & PES_DSM_TRICK_MODE_FLAG)
+    {
+        if (end - field < 1)
+        {
+            return false;
+        }
+        hasTrickMode = true;
+        trickMode = field[0];
+        ++field;
+    }
+    if (data[7] & PES_ADDITIONAL_COPY_INFO_FLAG)
+    {
+        if (end - field < 1)
+        {
+            return false;
+        }
+        hasAdditionalCopyInfo = true;
+        additionalCopyInfo = field[0] & 0x7F;
+        ++field;
+    }
+    if (data[7] & PES_CRC_FLAG)
+    {
+        if (end - field < PES_CRC_SIZE)
+        {
+            return false;
+        }
+        hasPreviousPesCrc = true;
+        previousPesCrc = (field[0] << 8) | field[1];
+        field += PES_CRC_SIZE;
+    }
+    if (!(data[7] & PES_EXTENSION_FLAG))
+    {
+        return true;
+    }
+
+    if (end - field < 1)
+    {
+        return false;
+    }
+    uint8_t extensionFlags = *field++;
+    if (extensionFlags & PES_PRIVATE_DATA_FLAG)
+    {
+        if (end - field < PRIVATE_DATA_SIZE)
+        {
+            return false;
+        }
+        privateData = field;
+        field += PRIVATE_DATA_SIZE;
+    }
+    if (extensionFlags & PES_PACK_HEADER_FIELD_FLAG)
+    {
+        if (end - field < 1 || end - field - 1 < field[0])
+        {
+            return false;
+        }
+        packHeaderLength = field[0];
+        packHeader = field + 1;
+        field += 1 + packHeaderLength;
+    }
+    if (extensionFlags & PES_SEQUENCE_COUNTER_FLAG)
+    {
+        if (end - field < PES_SEQUENCE_COUNTER_SIZE)
+        {
+            return false;
+        }
+        hasSequenceCounter = true;
+        sequenceCounter = field[0] & 0x7F;
+        mpeg1Mpeg2Identifier = field[1] & 0x40;
+        originalStuffLength = field[1] & 0x3F;
+        field += PES_SEQUENCE_COUNTER_SIZE;
+    }
+    if (extensionFlags & PES_PSTD_BUFFER_FLAG)
+    {
+        if (end - field < PES_PSTD_BUFFER_SIZE)
+        {
+            return false;
+        }
+        hasPstdBuffer = true;
+        pstdBufferScale = field[0] & 0x20;
+        pstdBufferSize = ((field[0] & 0x1F) << 8) | field[1];
+        field += PES_PSTD_BUFFER_SIZE;
+    }
+    if (extensionFlags & PES_EXTENSION_FLAG_2)
+    {
+        // PES_extension_field_length, then the stream_id_extension unless
+        // the stream_id_extension_flag is set
+        if (end - field < 1 || end - field - 1 < (field[0] & 0x7F))
+        {
+            return false;
+        }
+        if ((field[0] & 0x7F) && !(field[1] & PES_STREAM_ID_EXTENSION_FLAG))
+        {
+            hasStreamIdExtension = true;
+            streamIdExtension = field[1] & 0x7F;
+        }
+    }
+    return true;
+}
+
+PesBufferPool::PesBufferPool()
+    :   maxFreeBuffers(DEFAULT_FREE_BUFFERS),
+        allocations(0),
+        reuses(0)
+{
+}
+
+PesBufferPool::~PesBufferPool()
+{
+    setMaxFreeBuffers(0);
+}
+
+uint8_t PesBufferPool::getClass(uint32_t size)
+{
+    uint8_t shift = MIN_CLASS_SHIFT;
+    while (shift <= MAX_CLASS_SHIFT && (1U << shift) < size)
+    {
+        ++shift;
+    }
+    return shift - MIN_CLASS_SHIFT;
+}
+
+uint8_t* PesBufferPool::acquire(uint32_t size, uint32_t& capacity)
+{
+    uint8_t sizeClass = getClass(size);
+    if (sizeClass >= CLASS_COUNT)
+    {
+        ERR("PES buffer of %u bytes is too large", size);
+        return NULL;
+    }
+    capacity = 1U << (sizeClass + MIN_CLASS_SHIFT);
+    std::vector<uint8_t*>& buffers = freeBuffers[sizeClass];
+    if (buffers.empty())
+    {
+        ++allocations;
+        return new uint8_t[capacity];
+    }
+    ++reuses;
+    uint8_t* buffer = buffers.back();
+    buffers.pop_back();
+    return buffer;
+}
+
+void PesBufferPool::release(uint8_t* buffer, uint32_t capacity)
+{
+    std::vector<uint8_t*>& buffers = freeBuffers[getClass(capacity)];
+    if (buffers.size() < maxFreeBuffers)
+    {
+        buffers.push_back(buffer);
+    }
+    else
+    {
+        delete[] buffer;
+    }
+}
+
+void PesBufferPool::setMaxFreeBuffers(uint32_t count)
+{
+    maxFreeBuffers = count;
+    for (uint8_t ix = 0; ix < CLASS_COUNT; ++ix)
+    {
+        while (freeBuffers[ix].size() > maxFreeBuffers)
+        {
+            delete[] freeBuffers[ix].back();
+            freeBuffers[ix].pop_back();
+        }
+    }
+}
+
 PesPacket::PesPacket()
     :   isPes(false),
-        start(NULL)
+        isEnded(false),
+        start(NULL),
+        size(0),
+        capacity(0),
+        pool(NULL)
 {
 }
 
 PesPacket::~PesPacket()
 {
-    clear();
+    releaseBuffer();
 }
 
-void PesPacket::clear()
+void PesPacket::releaseBuffer()
 {
     if (start)
     {
-//        delete start;
+        if (pool)
+        {
+            pool->release(start, capacity);
+        }
+        else
+        {
+            delete[] start;
+        }
         start = NULL;
+        capacity = 0;
     }
-    isPes = false;
 }
 
-void PesPacket::appendPartialPes(uint8_t* data)
+void PesPacket::clear()
 {
-    (void)data;
+    releaseBuffer();
+    isPes = false;
+    isEnded = false;
+    size = 0;
 }
 
-void PesPacket::parse(uint8_t* data)
+void PesPacket::setBufferPool(PesBufferPool* bufferPool)
 {
     clear();
-    start = data;
-    //FIXME
+    pool = bufferPool;
+}
+
+bool PesPacket::growBuffer(uint32_t neededSize)
+{
+    if (neededSize <= capacity)
+    {
+        return true;
+    }
+    uint8_t* buffer = NULL;
+    uint32_t bufferCapacity = neededSize;
+    if (pool)
+    {
+        buffer = pool->acquire(neededSize, bufferCapacity);
+        if (buffer == NULL)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        buffer = new uint8_t[bufferCapacity];
+    }
+    // The bytes assembled so far are kept
+    if (size)
+    {
+        memcpy(buffer, start, size);
+    }
+    releaseBuffer();
+    start = buffer;
+    capacity = bufferCapacity;
+    return true;
+}
+
+bool PesPacket::reserve(uint32_t reservedSize)
+{
+    isPes = false;
+    isEnded = false;
+    size = 0;
+    return growBuffer(reservedSize);
+}
+
+bool PesPacket::parse(const uint8_t* data, uint32_t dataSize)
+{
+    isPes = false;
+    isEnded = false;
+    size = 0;
+    if (dataSize < PES_HEADER_SIZE || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01)
+    {
+        return false;
+    }
+    uint16_t length = (data[4] << PES_LENGTH_SHIFT) | data[5];
+    uint32_t neededSize = length ? (uint32_t)PES_HEADER_SIZE + length : dataSize;
+    if (!growBuffer(length ? neededSize : std::max(neededSize, (uint32_t)PES_HEAP_MIN_CAPACITY)))
+    {
+        return false;
+    }
+    size = std::min(dataSize, neededSize);
+    memcpy(start, data, size);
     isPes = true;
+    return true;
+}
+
+bool PesPacket::appendPartialPes(const uint8_t* data, uint32_t dataSize)
+{
+    if (!isPes || isEnded)
+    {
+        return false;
+    }
+    uint16_t length = getLength();
+    if (length)
+    {
+        // Anything past the length is stuffing
+        dataSize = std::min(dataSize, (uint32_t)PES_HEADER_SIZE + length - size);
+    }
+    else if (size + dataSize > capacity && !growBuffer(std::max(size + dataSize, capacity * 2)))
+    {
+        return false;
+    }
+    memcpy(start + size, data, dataSize);
+    size += dataSize;
+    return true;
 }
 
+void PesPacket::finish()
+{
+    isEnded = isPes;
+}
+
+void PesPacket::swap(PesPacket& pesPacket)
+{
+    std::swap(isPes, pesPacket.isPes);
+    std::swap(isEnded, pesPacket.isEnded);
+    std::swap(start, pesPacket.start);
+    std::swap(size, pesPacket.size);
+    std::swap(capacity, pesPacket.capacity);
+    std::swap(pool, pesPacket.pool);
+}
+
+bool PesPacket::getHeader(PesHeader& header)
+{
+    return isPes && header.parse(start, size);
+}
@@ -31,21 +31,241 @@
 
 #ifndef DELPHINUS_PES_H
 #define DELPHINUS_PES_H
+#include <vector>
 #include "common/DelphinusUtils.h"
 
+/**
+ *  \brief  Recycles the buffers of the PES packets.
+ *
+ *  The buffers come in size classes of powers of two, from 4 KB to 16 MB. A
+ *  buffer released goes back to the free list of its class, up to a number
+ *  of free buffers per class, and the next buffer acquired of that class
+ *  reuses it instead of allocating a new one. The pool is not thread safe.
+ */
+class PesBufferPool
+{
+    public:
+        enum
+        {
+/** log2 of the smallest buffer. */
+            MIN_CLASS_SHIFT = 12,
+/** log2 of the largest buffer. */
+            MAX_CLASS_SHIFT = 24,
+/** Default number of free buffers kept per class. */
+            DEFAULT_FREE_BUFFERS = 8
+        };
+
+    private:
+        enum
+        {
+            CLASS_COUNT = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1
+        };
+
+        std::vector<uint8_t*> freeBuffers[CLASS_COUNT];
+        uint32_t maxFreeBuffers;
+        uint64_t allocations;
+        uint64_t reuses;
+
+        static uint8_t getClass(uint32_t size);
+
+    public:
+        PesBufferPool();
+        ~PesBufferPool();
+
+/**
+ *  \brief  Get a buffer from the pool.
+ *  \param  size Minimum size of the buffer in bytes.
+ *  \param  capacity Set to the size of the buffer, to be passed back to
+ *          release().
+ *  \return The buffer, NULL if the size exceeds the largest class.
+ */
+        uint8_t* acquire(uint32_t size, uint32_t& capacity);
+/**
+ *  \brief  Give a buffer back to the pool.
+ *  \param  buffer A buffer returned by acquire().
+ *  \param  capacity Capacity returned by acquire() for the buffer.
+ */
+        void release(uint8_t* buffer, uint32_t capacity);
+/**
+ *  \brief  Set the number of free buffers kept per class, the buffers
+ *          released beyond it are freed.
+ *  \param  count Number of free buffers per class.
+ */
+        void setMaxFreeBuffers(uint32_t count);
+/**
+ *  \brief  Get the number of buffers allocated.
+ *  \return Number of allocations since the creation.
+ */
+        uint64_t getAllocationCount();
+/**
+ *  \brief  Get the number of buffers acquired which reused a free buffer.
+ *  \return Number of reuses since the creation.
+ */
+        uint64_t getReuseCount();
+};
+
+/**
+ *  \brief  The fields of a PES header, including the optional header.
+ *
+ *  parse() decodes the header at the start of a PES. The fields absent from
+ *  the header are left at (uint64_t) - 1 for the clocks, at 0 or false
+ *  otherwise, and the private data and the pack header point into the data
+ *  parsed, which must stay valid as long as they are used. The 33-bit
+ *  timestamps are each decoded from a single 64-bit load without any
+ *  branches.
+ */
+struct PesHeader
+{
+    enum
+    {
+/** PTS_DTS_flags of a header with neither a PTS nor a DTS. */
+        PTS_DTS_NONE = 0,
+/** PTS_DTS_flags of a header with a PTS only. */
+        PTS_DTS_PTS_ONLY = 2,
+/** PTS_DTS_flags of a header with both a PTS and a DTS. */
+        PTS_DTS_BOTH = 3,
+/** Bytes up to the end of the PES_header_data_length. */
+        OPTIONAL_HEADER_OFFSET = 9,
+/** Bytes of the PES_private_data. */
+        PRIVATE_DATA_SIZE = 16
+    };
+
+/** Stream ID. */
+    uint8_t streamId;
+/** PES_packet_length, 0 if unbounded. */
+    uint16_t pesPacketLength;
+/** The stream carries the optional header, the flags and the
+ *  PES_header_data_length after the PES_packet_length. */
+    bool hasOptionalHeader;
+/** PES_header_data_length. */
+    uint8_t headerDataLength;
+/** Offset of the first byte of the payload from the start code prefix. */
+    uint32_t payloadOffset;
+
+/** 2-bit PES_scrambling_control. */
+    uint8_t scramblingControl;
+/** PES_priority. */
+    bool priority;
+/** data_alignment_indicator. */
+    bool dataAlignmentIndicator;
+/** copyright. */
+    bool copyright;
+/** original_or_copy. */
+    bool originalOrCopy;
+/** 2-bit PTS_DTS_flags. */
+    uint8_t ptsDtsFlags;
+
+/** 33-bit PTS in 90 kHz units. */
+    uint64_t pts;
+/** 33-bit DTS in 90 kHz units. */
+    uint64_t dts;
+/** ESCR in 27 MHz units, base * 300 + extension. */
+    uint64_t escr;
+/** 22-bit ES_rate in units of 50 bytes/second. */
+    uint32_t esRate;
+/** The header carries the DSM trick mode. */
+    bool hasTrickMode;
+/** The trick_mode_control and its fields, as a byte. */
+    uint8_t trickMode;
+/** The header carries the additional_copy_info. */
+    bool hasAdditionalCopyInfo;
+/** 7-bit additional_copy_info. */
+    uint8_t additionalCopyInfo;
+/** The header carries the previous_PES_packet_CRC. */
+    bool hasPreviousPesCrc;
+/** previous_PES_packet_CRC. */
+    uint16_t previousPesCrc;
+
+/** PES_private_data of PRIVATE_DATA_SIZE bytes, NULL if absent. */
+    const uint8_t* privateData;
+/** pack_header, NULL if absent. */
+    const uint8_t* packHeader;
+/** Bytes of the pack_header. */
+    uint8_t packHeaderLength;
+/** The header carries the program_packet_sequence_counter. */
+    bool hasSequenceCounter;
+/** 7-bit program_packet_sequence_counter. */
+    uint8_t sequenceCounter;
+/** MPEG1_MPEG2_identifier. */
+    bool mpeg1Mpeg2Identifier;
+/** 6-bit original_stuff_length. */
+    uint8_t originalStuffLength;
+/** The header carries the P-STD buffer size. */
+    bool hasPstdBuffer;
+/** P-STD_buffer_scale. */
+    bool pstdBufferScale;
+/** 13-bit P-STD_buffer_size. */
+    uint16_t pstdBufferSize;
+/** The header carries the stream_id_extension. */
+    bool hasStreamIdExtension;
+/** 7-bit stream_id_extension. */
+    uint8_t streamIdExtension;
+
+    PesHeader();
+
+/**
+ *  \brief  Parse the header at the start of a PES.
+ *  \param  data Start of the PES, at the start code prefix.
+ *  \param  size Bytes available, the whole header must be within them.
+ *  \return true if the data starts with a valid header, false otherwise.
+ */
+    bool parse(const uint8_t* data, uint32_t size);
+/**
+ *  \brief  Decode only the PTS and the DTS at the start of a PES, cheaper
+ *          than parse() when nothing else is needed. The header of a PES
+ *          starting in a packet with the transport_scrambling_control set
+ *          is scrambled as well, so such packets are not to be decoded.
+ *  \param  data Start of the PES, at the start code prefix.
+ *  \param  size Bytes available.
+ *  \param  pts Set to the 33-bit PTS, (uint64_t) - 1 if absent.
+ *  \param  dts Set to the 33-bit DTS, (uint64_t) - 1 if absent.
+ *  \return true if the data starts with a valid header with the timestamps
+ *          it signals within the data, false otherwise.
+ */
+    static bool getTimestamps(const uint8_t* data, uint32_t size, uint64_t& pts, uint64_t& dts);
+/**
+ *  \brief  Determine if the PES of a stream carry the optional header.
+ *  \param  streamId Stream ID.
+ *  \return false for the program_stream_map, padding_stream,
+ *          private_stream_2, ECM, EMM, DSMCC_stream, H.222.1 type E and
+ *          program_stream_directory, true otherwise.
+ */
+    static bool hasOptionalHeaderFields(uint8_t streamId);
+};
+
 /**
  *  \brief  PesPacket represents a single PES
  *
  *  PesPacket provides the means to access the various fields in the PES
- *  header as well as the payload.
+ *  header as well as the payload. The bytes of the PES are copied into a
+ *  buffer owned by the PesPacket, taken from a PesBufferPool when one is
+ *  set, so a PES spanning several TS packets is assembled in one place.
  */
 class PesPacket
 {
     private:
         bool isPes;
+        // A PES without a length was ended by the start of the next one
+        bool isEnded;
         uint8_t* start;
+        uint32_t size;
+        uint32_t capacity;
+        PesBufferPool* pool;
+
+        void releaseBuffer();
+        bool growBuffer(uint32_t neededSize);
+        // Not copyable, the buffer is owned
+        PesPacket(const PesPacket& pesPacket);
+        PesPacket& operator=(const PesPacket& pesPacket);
 
     public:
+        enum
+        {
+/** Bytes of the start code prefix, the stream_id and the
+ *  PES_packet_length. */
+            PES_HEADER_SIZE = 6
+        };
+
         PesPacket();
         ~PesPacket();
 
@@ -54,27 +274,56 @@ class PesPacket
  *          dealloacted if it was allocated earlier for storing the data.
  */
         void clear();
-        // Always call parse to start the PES parsing
-        // It creates new memory for the parsed data and copies
-        // it if it seems to be PES
+/**
+ *  \brief  Set the pool the buffers are taken from. The buffer currently
+ *          held is released first.
+ *  \param  bufferPool The pool, not owned, NULL to allocate the buffers on
+ *          the heap.
+ */
+        void setBufferPool(PesBufferPool* bufferPool);
+/**
+ *  \brief  Make sure the buffer can hold a PES of a given size, so that a
+ *          PES without a length does not have to grow its buffer several
+ *          times. The PES is cleared.
+ *  \param  reservedSize Size in bytes.
+ *  \return true if the buffer could be allocated, false otherwise.
+ */
+        bool reserve(uint32_t reservedSize);
 /**
  *  \brief  Start parsing a new PES. Verifies if it is the start of a valid
- *          PES, allocates memory on the heap based on the PES length field,
- *          and copies the bytes from data to the newly allocated memory
- *          region, so the data gets persisted into a separate memory region.
- *          This method should be used when a new PES needs to be parsed and
- *          even if the complete PES is not available immediately. If memory
- *          was previously allocated for the data in the PesPacket handle it
- *          would be deallocated first before allocating memory based on the
- *          current PES length.
+ *          PES and copies the bytes from data into the buffer of the
+ *          PesPacket, allocating the buffer based on the PES length field,
+ *          so the data gets persisted into a separate memory region. The
+ *          buffer is reused if it is large enough already. This method
+ *          should be used when a new PES needs to be parsed and even if the
+ *          complete PES is not available immediately. The bytes past the
+ *          PES length are ignored.
+ *  \param  data Start of the PES.
+ *  \param  dataSize Bytes available, at least PES_HEADER_SIZE.
+ *  \return true if the data starts a valid PES, false otherwise.
  */
-        void parse(uint8_t* data);
+        bool parse(const uint8_t* data, uint32_t dataSize);
 /**
  *  \brief  Append the subsequent bytes of the PES to an existing partial PES
  *          which the PesPacket handle currently represents. appendPartialPes()
- *          should be called only after parse().
+ *          should be called only after parse(). The bytes past the PES
+ *          length are ignored.
+ *  \param  data The next bytes of the PES.
+ *  \param  dataSize Number of bytes.
+ *  \return true if the bytes were appended, false if the PES is not valid or
+ *          the buffer could not grow.
+ */
+        bool appendPartialPes(const uint8_t* data, uint32_t dataSize);
+/**
+ *  \brief  Mark a PES without a length as complete, once the start of the
+ *          next PES of the stream has been seen.
+ */
+        void finish();
+/**
+ *  \brief  Exchange the PES and the buffer with another PesPacket.
+ *  \param  pesPacket The other PesPacket.
  */
-        void appendPartialPes(uint8_t* data);
+        void swap(PesPacket& pesPacket);
 /**
  *  \brief  Determine if it is a valid complete/partial PES. To check if the
  *          PES is complete use isComplete() instead.
@@ -84,12 +333,22 @@ class PesPacket
 /**
  *  \brief  Determine if it is a complete PES. To check the validity of a
  *          complete/partial PES use isValid() instead.
- *  \return Valid complete/partial PES.
+ *  \return Valid complete PES.
  */
         bool isComplete();
+/**
+ *  \brief  Get the bytes of the PES assembled so far.
+ *  \return Start of the PES, at the start code prefix.
+ */
+        const uint8_t* getData();
+/**
+ *  \brief  Get the number of bytes of the PES assembled so far.
+ *  \return Size in bytes, including the header.
+ */
+        uint32_t getSize();
 /**
  *  \brief  Get the length field in the PES header.
- *  \return Length field in the PES header.
+ *  \return Length field in the PES header, 0 if unbounded.
  */
         uint16_t getLength();
 /**
@@ -102,11 +361,18 @@ class PesPacket
  *  \return Stream ID field in the PES header.
  */
         uint8_t getStreamId();
+/**
+ *  \brief  Decode the header of the PES, which must have been assembled up
+ *          to the end of its optional header.
+ *  \param  header Set to the fields of the header, pointing into the PES.
+ *  \return true if the header is valid, false otherwise.
+ */
+        bool getHeader(PesHeader& header);
 };
 
 #define PES_START_CODE_SHIFT_0          16
 #define PES_START_CODE_SHIFT_1          8
-#define PES_LENGTH_SHIFT                8              
+#define PES_LENGTH_SHIFT                8
 
 #define PES_GET_START_CODE(x)           ((x->byte0 << PES_START_CODE_SHIFT_0) |\
                                          (x->byte1 << PES_START_CODE_SHIFT_1) |\
@@ -117,11 +383,36 @@ class PesPacket
 
 #define PES_HEADER_START ((DelphinusUtils::ByteField*)(start))
 
+inline uint64_t PesBufferPool::getAllocationCount()
+{
+    return allocations;
+}
+
+inline uint64_t PesBufferPool::getReuseCount()
+{
+    return reuses;
+}
+
 inline bool PesPacket::isValid()
 {
     return isPes;
 }
 
+inline bool PesPacket::isComplete()
+{
+    return isPes && (isEnded || (getLength() && size == (uint32_t)PES_HEADER_SIZE + getLength()));
+}
+
+inline const uint8_t* PesPacket::getData()
+{
+    return start;
+}
+
+inline uint32_t PesPacket::getSize()
+{
+    return size;
+}
+
 inline uint16_t PesPacket::getLength()
 {
     return PES_GET_LENGTH(PES_HEADER_START);
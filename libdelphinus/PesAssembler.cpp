@@ -0,0 +1,175 @@
+/*
+ *  PesAssembler.cpp - Reassembly of the PES packets of a PID
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "PesAssembler.h"
+#include <cstddef>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_PES_ASSEMBLER 17
+#define CURRENT_MODULE MODULE_PES_ASSEMBLER
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+PesAssembler::PesAssembler(PesBufferPool* bufferPool)
+    :   completedCount(0),
+        nextCompleted(0),
+        isInPes(false),
+        pesPacketNumber((uint64_t) - 1),
+        viewedPacketNumber((uint64_t) - 1),
+        unboundedSize(0),
+        droppedPes(0)
+{
+    pesPacket.setBufferPool(bufferPool);
+    for (uint8_t ix = 0; ix < MAX_COMPLETED_PES; ++ix)
+    {
+        completedPes[ix].setBufferPool(bufferPool);
+        completedPacketNumbers[ix] = (uint64_t) - 1;
+    }
+}
+
+PesAssembler::~PesAssembler()
+{
+}
+
+void PesAssembler::clear()
+{
+    dropPes();
+    for (uint8_t ix = 0; ix < completedCount; ++ix)
+    {
+        completedPes[ix].clear();
+    }
+    completedCount = 0;
+    nextCompleted = 0;
+    continuityChecker.reset();
+}
+
+void PesAssembler::dropPes()
+{
+    if (isInPes)
+    {
+        MSG("Dropping the PES started in packet %" PRIu64, pesPacketNumber);
+        ++droppedPes;
+        isInPes = false;
+    }
+    pesPacket.clear();
+}
+
+void PesAssembler::completePes()
+{
+    pesPacket.finish();
+    if (pesPacket.getLength() == 0)
+    {
+        unboundedSize = pesPacket.getSize();
+    }
+    // The completed slot was cleared by pushPacket(), so the PES in progress
+    // is left without a buffer
+    completedPes[completedCount].swap(pesPacket);
+    completedPacketNumbers[completedCount] = pesPacketNumber;
+    ++completedCount;
+    isInPes = false;
+}
+
+void PesAssembler::pushPacket(TsPacket* tsPacket, uint64_t packetNumber)
+{
+    // The buffers of the PES completed by the previous packet go back to
+    // the pool
+    for (uint8_t ix = 0; ix < completedCount; ++ix)
+    {
+        completedPes[ix].clear();
+    }
+    completedCount = 0;
+    nextCompleted = 0;
+
+    // At a signalled discontinuity the PES goes on, an unbounded one being
+    // completed by the next one starting as usual
+    ContinuityChecker::Result continuity = continuityChecker.check(tsPacket);
+    if (continuity == ContinuityChecker::CONTINUITY_NO_PAYLOAD ||
+        continuity == ContinuityChecker::CONTINUITY_DUPLICATE)
+    {
+        return;
+    }
+    if (continuity == ContinuityChecker::CONTINUITY_GAP)
+    {
+        MSG("Continuity counter jumped to %u", tsPacket->getContinuityCounter());
+        dropPes();
+    }
+    if (tsPacket->getTransportErrorIndicator())
+    {
+        dropPes();
+        return;
+    }
+
+    const uint8_t* payload = tsPacket->getPayload();
+    uint8_t payloadSize = tsPacket->getPayloadSize();
+    if (tsPacket->getPayloadUnitStartIndicator())
+    {
+        if (isInPes)
+        {
+            if (pesPacket.getLength() == 0)
+            {
+                completePes();
+            }
+            else
+            {
+                MSG("PES of %u bytes ended after %u bytes", PesPacket::PES_HEADER_SIZE + pesPacket.getLength(),
+                    pesPacket.getSize());
+                dropPes();
+            }
+        }
+        // A PES without a length is likely to be as large as the previous
+        // one of the stream
+        if (payloadSize >= PesPacket::PES_HEADER_SIZE && payload[4] == 0 && payload[5] == 0)
+        {
+            pesPacket.reserve(unboundedSize);
+        }
+        isInPes = pesPacket.parse(payload, payloadSize);
+        pesPacketNumber = packetNumber;
+    }
+    else if (isInPes && !pesPacket.appendPartialPes(payload, payloadSize))
+    {
+        dropPes();
+    }
+
+    if (isInPes && pesPacket.isComplete())
+    {
+        completePes();
+    }
+}
+
+PesPacket* PesAssembler::viewNextPes()
+{
+    if (nextCompleted >= completedCount)
+    {
+        return NULL;
+    }
+    viewedPacketNumber = completedPacketNumbers[nextCompleted];
+    return &completedPes[nextCompleted++];
+}
@@ -0,0 +1,138 @@
+/*
+ *  PesAssembler.h - Reassembly of the PES packets of a PID
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   PesAssembler.h
+ *  \brief  Reassembly of the PES packets spanning several TS packets.
+ *
+ *  Defines PesAssembler which reassembles the PES packets carried in the TS
+ *  packets of a single PID.
+ */
+
+#ifndef DELPHINUS_PES_ASSEMBLER_H
+#define DELPHINUS_PES_ASSEMBLER_H
+
+#include "Ts.h"
+#include "Pes.h"
+
+/**
+ *  \brief  Reassembles the PES packets of a single PID.
+ *
+ *  The packets of one PID are pushed one at a time with pushPacket(), and
+ *  the PES packets completed by each packet are then viewed one by one with
+ *  viewNextPes(). A PES starts in a packet with the payload_unit_start
+ *  indicator set. A PES with a PES_packet_length is complete as soon as
+ *  its last byte arrives, and a PES without one, as the video PES may be,
+ *  is complete when the next PES starts. The continuity counter is
+ *  followed, so a PES missing a packet is dropped instead of being returned
+ *  with a hole in it, and the assembly resumes from the next packet
+ *  starting a PES. A jump signalled by the discontinuity_indicator, as at
+ *  a splice, is not a loss.
+ *
+ *  The buffers of the PES come from a PesBufferPool and go back to it once
+ *  the PES has been viewed, and the buffer of a PES without a length is
+ *  reserved at the size of the previous one, so the steady state of a
+ *  stream neither allocates nor grows the buffers.
+ */
+class PesAssembler
+{
+    private:
+        enum
+        {
+            // A packet ends at most the PES in progress and a short one
+            // starting in it
+            MAX_COMPLETED_PES = 2
+        };
+
+        PesPacket pesPacket;
+        PesPacket completedPes[MAX_COMPLETED_PES];
+        uint64_t completedPacketNumbers[MAX_COMPLETED_PES];
+        uint8_t completedCount;
+        uint8_t nextCompleted;
+        bool isInPes;
+        uint64_t pesPacketNumber;
+        uint64_t viewedPacketNumber;
+        // Size of the last PES without a length
+        uint32_t unboundedSize;
+        uint64_t droppedPes;
+        ContinuityChecker continuityChecker;
+
+        void completePes();
+        void dropPes();
+
+    public:
+/**
+ *  \brief  Constructor.
+ *  \param  bufferPool Pool of the buffers of the PES, not owned, NULL to
+ *          allocate the buffers on the heap.
+ */
+        PesAssembler(PesBufferPool* bufferPool);
+        ~PesAssembler();
+
+/**
+ *  \brief  Drop the PES in progress and forget the continuity counter, to
+ *          start over from the next packet starting a PES.
+ */
+        void clear();
+/**
+ *  \brief  Push the next packet of the PID. The PES completed by the
+ *          previous packet which have not been viewed yet are skipped.
+ *  \param  tsPacket A valid TS packet of the PID.
+ *  \param  packetNumber Packet number(starts at 0) of the packet in the TS,
+ *          returned by getPesPacketNumber() for the PES starting in this
+ *          packet.
+ */
+        void pushPacket(TsPacket* tsPacket, uint64_t packetNumber);
+/**
+ *  \brief  View the next PES completed by the last packet pushed.
+ *          \warning The PES is only valid till the next call to
+ *          pushPacket() or clear(). It may be swapped out with
+ *          PesPacket::swap() to keep it longer.
+ *  \return The PES, NULL if the packet completed no more PES.
+ */
+        PesPacket* viewNextPes();
+/**
+ *  \brief  Get the number of the packet which the last PES viewed started
+ *          in.
+ *  \return Packet number passed to pushPacket().
+ */
+        uint64_t getPesPacketNumber();
+/**
+ *  \brief  Get the number of PES dropped because of a lost packet, a
+ *          packet with the transport error indicator set, a PES shorter than
+ *          its PES_packet_length or a PES too large for the buffers.
+ *  \return Number of PES dropped since the creation.
+ */
+        uint64_t getDroppedPesCount();
+};
+
+inline uint64_t PesAssembler::getPesPacketNumber()
+{
+    return viewedPacketNumber;
+}
+
+inline uint64_t PesAssembler::getDroppedPesCount()
+{
+    return droppedPes;
+}
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ *  PidIndex.cpp - An index of the packet numbers of every PID present in a
+ *  Transport Stream
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "PidIndex.h"
+#include <algorithm>
+#include <cstring>
+
+PidIndex::PidIndex()
+    :   totalPackets(0),
+        hintPid(PID_COUNT),
+        hintPosition(0)
+{
+    memset(pidBitmap, 0, sizeof(pidBitmap));
+    memset(packetLists, 0, sizeof(packetLists));
+    memset(packetArrays, 0, sizeof(packetArrays));
+    memset(packetCounts, 0, sizeof(packetCounts));
+}
+
+PidIndex::~PidIndex()
+{
+    clear();
+}
+
+void PidIndex::clear()
+{
+    for (uint16_t pid = 0; pid < PID_COUNT; ++pid)
+    {
+        if (packetLists[pid])
+        {
+            delete packetLists[pid];
+            packetLists[pid] = NULL;
+        }
+    }
+    memset(pidBitmap, 0, sizeof(pidBitmap));
+    memset(packetArrays, 0, sizeof(packetArrays));
+    memset(packetCounts, 0, sizeof(packetCounts));
+    totalPackets = 0;
+    hintPid = PID_COUNT;
+    hintPosition = 0;
+}
+
+void PidIndex::finalize()
+{
+    for (uint16_t pid = 0; pid < PID_COUNT; ++pid)
+    {
+        if (packetLists[pid])
+        {
+            // Swap with a copy, which only reserves the size needed
+            PacketList(*packetLists[pid]).swap(*packetLists[pid]);
+            packetArrays[pid] = &(*packetLists[pid])[0];
+            packetCounts[pid] = packetLists[pid]->size();
+        }
+    }
+}
+
+void PidIndex::setPackets(uint16_t pid, const uint32_t* packets, uint64_t count)
+{
+    if (pid >= PID_COUNT || count == 0)
+    {
+        return;
+    }
+    if (!hasPid(pid))
+    {
+        pidBitmap[pid >> 6] |= (uint64_t)1 << (pid & 0x3F);
+    }
+    totalPackets += count - packetCounts[pid];
+    packetArrays[pid] = packets;
+    packetCounts[pid] = count;
+    if (hintPid == pid)
+    {
+        hintPid = PID_COUNT;
+    }
+}
+
+uint64_t PidIndex::findNextPacket(uint16_t pid, uint64_t packetNumber)
+{
+    if (!hasPid(pid) || packetCounts[pid] == 0)
+    {
+        return (uint64_t) - 1;
+    }
+    const uint32_t* packets = packetArrays[pid];
+    uint64_t count = packetCounts[pid];
+    uint64_t position = 0;
+    if (packetNumber != (uint64_t) - 1)
+    {
+        if (packetNumber >= packets[count - 1])
+        {
+            return (uint64_t) - 1;
+        }
+        if (pid == hintPid && packets[hintPosition] == packetNumber)
+        {
+            // Iterating over the PID, the next entry is the one we want
+            position = hintPosition + 1;
+        }
+        else
+        {
+            // The search is in the range of a uint32_t from here on
+            position = std::upper_bound(packets, packets + count,
+                                        (uint32_t)packetNumber) - packets;
+        }
+    }
+    hintPid = pid;
+    hintPosition = position;
+    return packets[position];
+}
@@ -0,0 +1,174 @@
+/*
+ *  PidIndex.h - An index of the packet numbers of every PID present in a
+ *  Transport Stream
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   PidIndex.h
+ *  \brief  Per-PID lists of packet numbers.
+ *
+ *  Defines PidIndex which is used by TsFile to jump directly between the
+ *  packets of a single PID.
+ */
+
+#ifndef DELPHINUS_PID_INDEX_H
+#define DELPHINUS_PID_INDEX_H
+
+#include <cstddef>
+#include <vector>
+#include "common/DelphinusUtils.h"
+
+/** \cond DEV */
+/**
+ *  \brief  Packet numbers of the packets of each PID, in increasing order.
+ *
+ *  PidIndex is filled in a single pass over the file through addPacket(),
+ *  followed by a call to finalize(). A bitmap with one bit per PID tells
+ *  whether a PID is present at all, and the packet numbers of each PID
+ *  present are stored in a compact array of 32-bit entries, which covers
+ *  files of up to 2^32 packets. The arrays can also be provided from outside
+ *  using setPackets(), e.g. from a memory mapped index file, in which case
+ *  they are used in place without copying.
+ */
+class PidIndex
+{
+    public:
+        enum
+        {
+            PID_COUNT = 8192,
+            BITMAP_WORDS = PID_COUNT / 64
+        };
+
+    private:
+        typedef std::vector<uint32_t> PacketList;
+
+        // One bit per PID, set once the PID has at least one packet
+        uint64_t pidBitmap[BITMAP_WORDS];
+        // Allocated on demand while adding the packets
+        PacketList* packetLists[PID_COUNT];
+        // Packet numbers of each PID, either from packetLists or provided
+        // from outside
+        const uint32_t* packetArrays[PID_COUNT];
+        uint64_t packetCounts[PID_COUNT];
+        uint64_t totalPackets;
+        // Position in the array of the packet last returned by
+        // findNextPacket(), to avoid searching when iterating over a PID
+        uint16_t hintPid;
+        uint64_t hintPosition;
+
+    public:
+        PidIndex();
+        ~PidIndex();
+
+/**
+ *  \brief  Remove all the packets from the index.
+ */
+        void clear();
+/**
+ *  \brief  Add a packet to the index, the packet numbers must be added in
+ *          increasing order.
+ *  \param  pid PID of the packet.
+ *  \param  packetNumber Packet number from the beginning of the file.
+ */
+        void addPacket(uint16_t pid, uint32_t packetNumber);
+/**
+ *  \brief  Make the packets added so far available for the lookups, and
+ *          release the memory reserved for growing the lists.
+ */
+        void finalize();
+/**
+ *  \brief  Use an array of packet numbers stored outside the index for a
+ *          PID. The array must stay valid till the index is cleared.
+ *  \param  pid PID of the packets.
+ *  \param  packets Packet numbers in increasing order.
+ *  \param  count Number of packets in the array.
+ */
+        void setPackets(uint16_t pid, const uint32_t* packets, uint64_t count);
+/**
+ *  \brief  Check if there is at least one packet of the PID.
+ *  \param  pid PID to look for.
+ *  \return true if the PID is present, false otherwise.
+ */
+        bool hasPid(uint16_t pid);
+/**
+ *  \brief  Get the number of packets of the PID.
+ *  \param  pid PID to look for.
+ *  \return Number of packets.
+ */
+        uint64_t getPacketCount(uint16_t pid);
+/**
+ *  \brief  Get the total number of packets in the index.
+ *  \return Number of packets.
+ */
+        uint64_t getTotalPackets();
+/**
+ *  \brief  Get the packet numbers of the PID.
+ *  \param  pid PID to look for.
+ *  \return Array of getPacketCount() packet numbers, NULL if the PID is not
+ *          present.
+ */
+        const uint32_t* getPackets(uint16_t pid);
+/**
+ *  \brief  Find the first packet of the PID after a given packet.
+ *  \param  pid PID to look for.
+ *  \param  packetNumber Packet number to start after, (uint64_t) - 1 to
+ *          start at the beginning of the file.
+ *  \return Packet number of the packet found, (uint64_t) - 1 if there are
+ *          no more packets of the PID.
+ */
+        uint64_t findNextPacket(uint16_t pid, uint64_t packetNumber);
+};
+
+inline void PidIndex::addPacket(uint16_t pid, uint32_t packetNumber)
+{
+    PacketList* packetList = packetLists[pid];
+    if (packetList == NULL)
+    {
+        packetList = new PacketList();
+        packetLists[pid] = packetList;
+        pidBitmap[pid >> 6] |= (uint64_t)1 << (pid & 0x3F);
+    }
+    packetList->push_back(packetNumber);
+    ++totalPackets;
+}
+
+inline bool PidIndex::hasPid(uint16_t pid)
+{
+    return pid < PID_COUNT && (pidBitmap[pid >> 6] & ((uint64_t)1 << (pid & 0x3F)));
+}
+
+inline uint64_t PidIndex::getPacketCount(uint16_t pid)
+{
+    return hasPid(pid) ? packetCounts[pid] : 0;
+}
+
+inline uint64_t PidIndex::getTotalPackets()
+{
+    return totalPackets;
+}
+
+inline const uint32_t* PidIndex::getPackets(uint16_t pid)
+{
+    return hasPid(pid) ? packetArrays[pid] : NULL;
+}
+/** \endcond DEV */
+
+#endif
@@ -22,6 +22,7 @@
  */
 
 #include "PsiTables.h"
+#include "Crc32.h"
 #include <cstddef>
 #include <cassert>
 #include <cstring>
@@ -53,9 +54,15 @@ bool PsiSection::parse(uint8_t* data)
             PSI_GET_LENGTH(PSI_HEADER_START) < 0x3FD);
 }
 
+bool PsiSection::isCrcValid()
+{
+    return Crc32::isSectionValid(start, 3 + PSI_GET_LENGTH(PSI_HEADER_START));
+}
+
 PsiSectionCommon::PsiSectionCommon()
     :   isComplete(false),
         start(NULL),
+        bufferSize(0),
         sectionLength(0),
         tableIdExtension(0),
         validSize(0),
@@ -66,23 +73,22 @@ PsiSectionCommon::PsiSectionCommon()
 }
 
 PsiSectionCommon::~PsiSectionCommon()
-{
-    clear();
-}
-
-void PsiSectionCommon::clear()
 {
     if (start)
     {
         delete[] start;
         start = NULL;
     }
+}
+
+void PsiSectionCommon::clear()
+{
     isComplete = false;
     sectionLength = 0;
     validSize = 0;
 }
 
-void PsiSectionCommon::parse(uint8_t* data, uint16_t size, uint8_t tableId)
+void PsiSectionCommon::copySection(uint8_t* data, uint16_t size, uint8_t tableId)
 {
     clear();
     // Dont include the pointer field
@@ -97,14 +103,24 @@ void PsiSectionCommon::parse(uint8_t* data, uint16_t size, uint8_t tableId)
     lastSection = PSI_GET_LAST_SECTION_NUMBER(((ByteField*)data));
 
     assert(PSI_GET_TABLE_ID(((ByteField*)data)) == tableId);
-    assert(currentSection == 0);
 
-    start = new uint8_t[sectionLength];
+    if (sectionLength > bufferSize)
+    {
+        delete[] start;
+        start = new uint8_t[sectionLength];
+        bufferSize = sectionLength;
+    }
     // Copy the minimum of the available data size and the section length,
     // since there is no use copying padding bytes 0xFF
     uint16_t copyingSize = GET_LESS(size - 8, sectionLength);
     memcpy(start, data + 8, copyingSize);
     validSize = copyingSize;
+}
+
+void PsiSectionCommon::parse(uint8_t* data, uint16_t size, uint8_t tableId)
+{
+    copySection(data, size, tableId);
+    assert(currentSection == 0);
 
     if (lastSection == currentSection)
     {
@@ -114,6 +130,18 @@ void PsiSectionCommon::parse(uint8_t* data, uint16_t size, uint8_t tableId)
     }
 }
 
+void PsiSectionCommon::parseSection(uint8_t* data, uint16_t size, uint8_t tableId)
+{
+    copySection(data, size, tableId);
+
+    // The section is complete on its own, whatever its section number
+    if (sectionLength == validSize)
+    {
+        isComplete = true;
+        onComplete();
+    }
+}
+
 void PsiSectionCommon::append(uint8_t* data, uint16_t size, uint8_t tableId)
 {
     // Verify that the section is already not complete
@@ -143,12 +171,20 @@ void PatSection::onComplete()
     // Parsing the program info from the section
     uint8_t* data = start;
     uint16_t remainingData = sectionLength;
+    // Every program takes 4 bytes, so the list is allocated at most once
     programList.clear();
+    programList.reserve(sectionLength / 4);
+    networkPid = PID_NULL;
     ProgramInfo info;
     while (remainingData > 4)
     {
         info.programNumber = PAT_GET_PROG_NUMBER(((ByteField*)data));
         info.pmtPid = PAT_GET_PID(((ByteField*)data));
+        if (info.programNumber == 0)
+        {
+            // Program number 0 points to the NIT instead of a PMT
+            networkPid = info.pmtPid;
+        }
         programList.push_back(info);
         data += 4;
         remainingData -= 4;
@@ -175,7 +211,9 @@ void PmtSection::onComplete()
     // Parse the Stream info
     uint8_t* data = start + 4 + programInfoDescriptor.size;
     uint16_t remainingData = sectionLength - 4 - programInfoDescriptor.size;
+    // Every stream takes at least 5 bytes
     streamList.clear();
+    streamList.reserve(remainingData / 5);
     StreamInfo info;
     while (remainingData > 4)
     {
@@ -248,6 +286,8 @@ const char* PmtSection::getStreamTypeStr(uint8_t streamType)
             return "ISO/IEC 13818-6 Synchronized Download Protocol";
         case STREAM_TYPE_14496_10_VIDEO:
             return "H.264 Video";
+        case STREAM_TYPE_23008_2_VIDEO:
+            return "H.265 Video";
         case STREAM_TYPE_AVS_VIDEO:
             return "AVS Video";
         case STREAM_TYPE_DC_II_VIDEO:
@@ -334,15 +374,25 @@ void TsdtSection::onComplete()
 
 void NitSection::onComplete()
 {
+    // The loop lengths are checked against the section, without the CRC_32
+    uint16_t remainingData = sectionLength - 4;
     networkDescriptor.start = start + 2;
     networkDescriptor.size = NIT_GET_NW_DESCRIPTOR_LENGTH(((ByteField*)start));
+    tsInfoList.clear();
+    if (sectionLength < 8 || 4 + networkDescriptor.size > remainingData)
+    {
+        networkDescriptor.size = 0;
+        return;
+    }
+    remainingData -= 4 + networkDescriptor.size;
     uint8_t * data = start + 2 + networkDescriptor.size;
-    uint16_t tsLoopLength = NIT_GET_NW_DESCRIPTOR_LENGTH(((ByteField*)data));
+    uint16_t tsLoopLength = GET_LESS(NIT_GET_TS_LOOP_LENGTH(((ByteField*)data)), remainingData);
     data += 2;
     TsInfo tsInfo;
 
-    tsInfoList.clear();
-    while (tsLoopLength > 0)
+    // Every TS takes at least 6 bytes
+    tsInfoList.reserve(tsLoopLength / 6);
+    while (tsLoopLength >= 6 && 6 + NIT_GET_TS_DESCRIPTOR_LENGTH(((ByteField*)data)) <= tsLoopLength)
     {
         tsInfo.transportStreamId = NIT_GET_TSID(((ByteField*)data));
         tsInfo.originalNetworkId = NIT_GET_ORIG_NWID(((ByteField*)data));
@@ -33,7 +33,7 @@
 #ifndef DELPHINUS_PSI_TABLES_H
 #define DELPHINUS_PSI_TABLES_H
 
-#include <list>
+#include <vector>
 #include "common/DelphinusUtils.h"
 #include "MpegConstants.h"
 
@@ -136,6 +136,13 @@ class PsiSection
  *  \return Address of the start of the data.
  */
         uint8_t* getData();
+/**
+ *  \brief  Check the CRC_32 at the end of the section.
+ *          \note The whole section must follow the pointer field, so this is
+ *          only meaningful for the sections complete within the data parsed.
+ *  \return true if the CRC_32 matches the section, false otherwise.
+ */
+        bool isCrcValid();
 
         friend class PsiSectionCommon;
 };
@@ -153,6 +160,8 @@ class PsiSectionCommon
         bool isComplete;
 /** Start of the section data. */
         uint8_t* start;
+/** Size of the buffer at start, which is kept for the next parse. */
+        uint16_t bufferSize;
 /** Length of the section excluding the section header bytes. */
         uint16_t sectionLength;
 /** Table ID Extension */
@@ -166,6 +175,9 @@ class PsiSectionCommon
 
         PsiSectionCommon();
         virtual ~PsiSectionCommon();
+        // The buffer is owned, the sections are not copyable
+        PsiSectionCommon(const PsiSectionCommon&);
+        PsiSectionCommon& operator=(const PsiSectionCommon&);
 /**
  *  \brief  The function to be called when parsing the section is successfull.
  */
@@ -180,6 +192,16 @@ class PsiSectionCommon
  *  \param  tableId The Table ID to be checked against in the section header.
  */
         void parse(uint8_t* data, uint16_t size, uint8_t tableId);
+/**
+ *  \brief  Parse the given data as one whole section with the given tableId,
+ *          of a table whose sections each carry whole loops and can be
+ *          parsed one at a time.
+ *  \param  data Start of the data to parse.
+ *  \param  size The size of the section data, which has to hold the whole
+ *          section.
+ *  \param  tableId The Table ID to be checked against in the section header.
+ */
+        void parseSection(uint8_t* data, uint16_t size, uint8_t tableId);
 /**
  *  \brief  Parse and append the given data as the subsequent section with
  *          the given tableId.
@@ -191,9 +213,13 @@ class PsiSectionCommon
  */
         void append(uint8_t* data, uint16_t size, uint8_t tableId);
 
+    private:
+        void copySection(uint8_t* data, uint16_t size, uint8_t tableId);
+
     public:
 /**
- *  \brief  Clear the section handle.
+ *  \brief  Clear the section handle. The buffer is kept, so parsing a
+ *          section no larger than the ones parsed before does not allocate.
  */
         void clear();
 /**
@@ -225,7 +251,7 @@ class PatSection : public PsiSectionCommon
  *  \brief  List of all programs, typically to represent the information
  *          extracted from the PAT.
  */
-        typedef std::list<ProgramInfo> ProgramList;
+        typedef std::vector<ProgramInfo> ProgramList;
 
     private:
         ProgramList programList;
@@ -245,6 +271,13 @@ class PatSection : public PsiSectionCommon
  *          data for the table continues in.
  */
         void parse(uint8_t* data, uint16_t size);
+/**
+ *  \brief  Parse the given data as one whole section of the PAT, whatever
+ *          its section number.
+ *  \param  data Start of the data to parse.
+ *  \param  size The size of the section data.
+ */
+        void parseSection(uint8_t* data, uint16_t size);
 /**
  *  \brief  Parse and append the given data as the subsequent PAT section.
  *  \param  data Start of the data to parse.
@@ -279,7 +312,6 @@ class PatSection : public PsiSectionCommon
 class CatSection : public PsiSectionCommon
 {
     private:
-        uint8_t* start;
         PsiDescriptor descriptor;
 
         void onComplete();
@@ -295,6 +327,13 @@ class CatSection : public PsiSectionCommon
  *          data for the table continues in.
  */
         void parse(uint8_t* data, uint16_t size);
+/**
+ *  \brief  Parse the given data as one whole section of the CAT, whatever
+ *          its section number.
+ *  \param  data Start of the data to parse.
+ *  \param  size The size of the section data.
+ */
+        void parseSection(uint8_t* data, uint16_t size);
 /**
  *  \brief  Parse and append the given data as the subsequent CAT section.
  *  \param  data Start of the data to parse.
@@ -335,7 +374,7 @@ class PmtSection : public PsiSectionCommon
  *  \brief  Represents the information about a set of streams typically to
  *          represent the entire PMT's stream list.
  */
-        typedef std::list<StreamInfo> StreamList;
+        typedef std::vector<StreamInfo> StreamList;
 
     private:
         uint16_t pcrPid;
@@ -401,7 +440,6 @@ class PmtSection : public PsiSectionCommon
 class TsdtSection : public PsiSectionCommon
 {
     private:
-        uint8_t* start;
         PsiDescriptor descriptor;
 
         void onComplete();
@@ -433,9 +471,10 @@ class TsdtSection : public PsiSectionCommon
 };
 
 /**
- *  \brief  Represents a TSDT section.
+ *  \brief  Represents a NIT section.
  *
- *  TsdtSection represents a TSDT section and is used for parsing the TSDT.
+ *  NitSection represents a section of the NIT of the actual network and is
+ *  used for parsing the NIT.
  */
 class NitSection : public PsiSectionCommon
 {
@@ -456,10 +495,9 @@ class NitSection : public PsiSectionCommon
  *  \brief  A list of information about multiple Transport Streams, typically
  *          gathered from the NIT section.
  */
-        typedef std::list<TsInfo> TsInfoList;
+        typedef std::vector<TsInfo> TsInfoList;
 
     private:
-        uint8_t* start;
         PsiDescriptor networkDescriptor;
         TsInfoList tsInfoList;
 
@@ -469,7 +507,7 @@ class NitSection : public PsiSectionCommon
         NitSection();
         ~NitSection();
 /**
- *  \brief  Parse the given data as the start of a PAT section.
+ *  \brief  Parse the given data as the start of a NIT section.
  *  \param  data Start of the data to parse.
  *  \param  size The maximum size of the data that should be parsed.
  *          Useful when there are subsequent sections in which the
@@ -477,7 +515,14 @@ class NitSection : public PsiSectionCommon
  */
         void parse(uint8_t* data, uint16_t size);
 /**
- *  \brief  Parse and append the given data as the subsequent PAT section.
+ *  \brief  Parse the given data as one whole section of the NIT, whatever
+ *          its section number.
+ *  \param  data Start of the data to parse.
+ *  \param  size The size of the section data.
+ */
+        void parseSection(uint8_t* data, uint16_t size);
+/**
+ *  \brief  Parse and append the given data as the subsequent NIT section.
  *  \param  data Start of the data to parse.
  *  \param  size The maximum size of the data that should be parsed.
  *          Useful when there are subsequent sections in which the
@@ -627,6 +672,11 @@ inline void PatSection::parse(uint8_t* data, uint16_t size)
     this->PsiSectionCommon::parse(data, size, MpegConstants::TABLE_PAT);
 }
 
+inline void PatSection::parseSection(uint8_t* data, uint16_t size)
+{
+    this->PsiSectionCommon::parseSection(data, size, MpegConstants::TABLE_PAT);
+}
+
 inline void PatSection::append(uint8_t* data, uint16_t size)
 {
     this->PsiSectionCommon::append(data, size, MpegConstants::TABLE_PAT);
@@ -682,6 +732,11 @@ inline void CatSection::parse(uint8_t* data, uint16_t size)
     this->PsiSectionCommon::parse(data, size, MpegConstants::TABLE_CAT);
 }
 
+inline void CatSection::parseSection(uint8_t* data, uint16_t size)
+{
+    this->PsiSectionCommon::parseSection(data, size, MpegConstants::TABLE_CAT);
+}
+
 inline void CatSection::append(uint8_t* data, uint16_t size)
 {
     this->PsiSectionCommon::append(data, size, MpegConstants::TABLE_CAT);
@@ -707,6 +762,21 @@ inline const PsiDescriptor& TsdtSection::getDescriptor()
     return descriptor;
 }
 
+inline void NitSection::parse(uint8_t* data, uint16_t size)
+{
+    this->PsiSectionCommon::parse(data, size, MpegConstants::TABLE_NETWORK_INFO_ACTUAL);
+}
+
+inline void NitSection::parseSection(uint8_t* data, uint16_t size)
+{
+    this->PsiSectionCommon::parseSection(data, size, MpegConstants::TABLE_NETWORK_INFO_ACTUAL);
+}
+
+inline void NitSection::append(uint8_t* data, uint16_t size)
+{
+    this->PsiSectionCommon::append(data, size, MpegConstants::TABLE_NETWORK_INFO_ACTUAL);
+}
+
 inline uint16_t NitSection::getNetworkId()
 {
     return tableIdExtension;
@@ -0,0 +1,530 @@
+/*
+ *  RapIndex.cpp - Index of the random access points of the programs of a TS
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "RapIndex.h"
+#include "Pes.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_RAP_INDEX 21
+#define CURRENT_MODULE MODULE_RAP_INDEX
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define START_CODE_SIZE                 3
+
+// Start codes of MPEG-1 / MPEG-2 video
+#define MPEG2_PICTURE_START_CODE        0x00
+#define MPEG2_SEQUENCE_HEADER_CODE      0xB3
+#define MPEG2_PICTURE_TYPE_I            1
+
+#define H264_NAL_SLICE                  1
+#define H264_NAL_SLICE_PARTITION_A      2
+#define H264_NAL_SLICE_PARTITION_C      4
+#define H264_NAL_IDR_SLICE              5
+#define H264_NAL_SPS                    7
+#define H264_NAL_AUD                    9
+
+#define H265_NAL_VCL_END                31
+#define H265_NAL_IRAP_START             16
+#define H265_NAL_IRAP_END               21
+#define H265_NAL_SPS                    33
+#define H265_NAL_AUD                    35
+
+bool readExpGolomb(uint32_t bits, uint8_t availableBits, uint8_t& position, uint32_t& value);
+bool readH264SliceType(const uint8_t* data, const uint8_t* end, uint32_t& firstMb,
+                       uint32_t& sliceType);
+bool isBeforePoint(uint64_t packetNumber, const RapIndex::RandomAccessPoint& point);
+
+bool readExpGolomb(uint32_t bits, uint8_t availableBits, uint8_t& position, uint32_t& value)
+{
+    uint32_t window = bits << position;
+    if (position >= 32 || window == 0)
+    {
+        return false;
+    }
+    uint8_t length = 2 * __builtin_clz(window) + 1;
+    if (length > availableBits - position)
+    {
+        return false;
+    }
+    value = (window >> (32 - length)) - 1;
+    position += length;
+    return true;
+}
+
+bool readH264SliceType(const uint8_t* data, const uint8_t* end, uint32_t& firstMb,
+                       uint32_t& sliceType)
+{
+    // first_mb_in_slice and slice_type fit in 32 bits for any picture size.
+    // The emulation prevention bytes are not removed, the slice header of the
+    // first slice of a picture starts with first_mb_in_slice 0, a 1 bit,
+    // which keeps the first bytes from looking like a start code
+    uint32_t bits = 0;
+    uint8_t availableBytes = (end - data < 4) ? end - data : 4;
+    for (uint8_t ix = 0; ix < 4; ++ix)
+    {
+        bits = (bits << 8) | (ix < availableBytes ? data[ix] : 0);
+    }
+    uint8_t position = 0;
+    return readExpGolomb(bits, availableBytes * 8, position, firstMb) &&
+           readExpGolomb(bits, availableBytes * 8, position, sliceType);
+}
+
+bool isBeforePoint(uint64_t packetNumber, const RapIndex::RandomAccessPoint& point)
+{
+    return packetNumber < point.packetNumber;
+}
+
+RapIndex::RapIndex()
+    :   pidRoles(PID_NULL + 1, 0),
+        scanner(NalScanner::CODEC_H264)
+{
+}
+
+RapIndex::~RapIndex()
+{
+    clear();
+}
+
+RapIndex::InspectResult RapIndex::inspectMpeg2(const uint8_t* data, const uint8_t* end,
+                                               uint8_t& flags)
+{
+    if (end - data < 1)
+    {
+        return INSPECT_MORE_DATA;
+    }
+    if (data[0] == MPEG2_SEQUENCE_HEADER_CODE)
+    {
+        flags |= RAP_FLAG_SEQUENCE_HEADER;
+        return INSPECT_NEXT;
+    }
+    if (data[0] != MPEG2_PICTURE_START_CODE)
+    {
+        return INSPECT_NEXT;
+    }
+    // 10 bits of temporal_reference, followed by 3 bits of
+    // picture_coding_type
+    if (end - data < 3)
+    {
+        return INSPECT_MORE_DATA;
+    }
+    if (((data[2] >> 3) & 0x07) == MPEG2_PICTURE_TYPE_I)
+    {
+        flags |= RAP_FLAG_I_FRAME;
+    }
+    return INSPECT_DONE;
+}
+
+RapIndex::InspectResult RapIndex::inspectH264(const uint8_t* data, const uint8_t* end,
+                                              uint8_t& flags)
+{
+    if (end - data < 2)
+    {
+        return INSPECT_MORE_DATA;
+    }
+    uint8_t type = data[0] & 0x1F;
+    if (type == H264_NAL_IDR_SLICE)
+    {
+        flags |= RAP_FLAG_IDR;
+        return INSPECT_DONE;
+    }
+    if (type == H264_NAL_SLICE || type == H264_NAL_SLICE_PARTITION_A)
+    {
+        uint32_t firstMb;
+        uint32_t sliceType;
+        if (!readH264SliceType(data + 1, end, firstMb, sliceType))
+        {
+            return (end - data < 5) ? INSPECT_MORE_DATA : INSPECT_DONE;
+        }
+        // I and SI slices, starting a picture, whose type is taken from its
+        // first slice
+        if (firstMb == 0 && (sliceType % 5 == 2 || sliceType % 5 == 4))
+        {
+            flags |= RAP_FLAG_I_FRAME;
+        }
+        return INSPECT_DONE;
+    }
+    if (type > H264_NAL_SLICE_PARTITION_A && type <= H264_NAL_SLICE_PARTITION_C)
+    {
+        return INSPECT_DONE;
+    }
+    if (type == H264_NAL_SPS)
+    {
+        flags |= RAP_FLAG_SEQUENCE_HEADER;
+    }
+    else if (type == H264_NAL_AUD)
+    {
+        // primary_pic_type 0, 3 and 5 carry I and SI slices only
+        uint8_t pictureType = data[1] >> 5;
+        if (pictureType == 0 || pictureType == 3 || pictureType == 5)
+        {
+            flags |= RAP_FLAG_I_FRAME;
+        }
+    }
+    return INSPECT_NEXT;
+}
+
+RapIndex::InspectResult RapIndex::inspectH265(const uint8_t* data, const uint8_t* end,
+                                              uint8_t& flags)
+{
+    if (end - data < 3)
+    {
+        return INSPECT_MORE_DATA;
+    }
+    uint8_t type = (data[0] >> 1) & 0x3F;
+    if (type <= H265_NAL_VCL_END)
+    {
+        // The slice type of the other pictures depends on the PPS
+        if (type >= H265_NAL_IRAP_START && type <= H265_NAL_IRAP_END)
+        {
+            flags |= RAP_FLAG_IDR;
+        }
+        return INSPECT_DONE;
+    }
+    if (type == H265_NAL_SPS)
+    {
+        flags |= RAP_FLAG_SEQUENCE_HEADER;
+    }
+    else if (type == H265_NAL_AUD && (data[2] >> 5) == 0)
+    {
+        // pic_type 0 carries I slices only
+        flags |= RAP_FLAG_I_FRAME;
+    }
+    return INSPECT_NEXT;
+}
+
+RapIndex::Program* RapIndex::findProgram(uint16_t programNumber)
+{
+    for (std::vector<Program*>::iterator ix = programs.begin(); ix != programs.end(); ++ix)
+    {
+        if ((*ix)->programNumber == programNumber)
+        {
+            return *ix;
+        }
+    }
+    return NULL;
+}
+
+RapIndex::Program* RapIndex::createProgram(uint16_t programNumber)
+{
+    Program* program = new Program();
+    program->programNumber = programNumber;
+    program->videoPid = PID_NULL;
+    program->pcrPid = PID_NULL;
+    program->codec = CODEC_NONE;
+    program->pcr = (uint64_t) - 1;
+    program->isInPes = false;
+    memset(&program->current, 0, sizeof(program->current));
+    program->headerBytesLeft = 0;
+    program->headSize = 0;
+    program->scanOffset = 0;
+    programs.push_back(program);
+    programNumbers.push_back(programNumber);
+    return program;
+}
+
+bool RapIndex::addProgram(const TsMetadata::PmtInfo& pmtInfo)
+{
+    VideoCodec codec = CODEC_NONE;
+    uint16_t videoPid = PID_NULL;
+    for (PmtSection::StreamList::const_iterator ix = pmtInfo.streamList.begin();
+         codec == CODEC_NONE && ix != pmtInfo.streamList.end(); ++ix)
+    {
+        videoPid = ix->pid;
+        switch (ix->streamType)
+        {
+            case STREAM_TYPE_11172_VIDEO:
+            case STREAM_TYPE_13818_2_VIDEO:
+                codec = CODEC_MPEG2;
+                break;
+            case STREAM_TYPE_14496_10_VIDEO:
+                codec = CODEC_H264;
+                break;
+            case STREAM_TYPE_23008_2_VIDEO:
+                codec = CODEC_H265;
+                break;
+            default:
+                break;
+        }
+    }
+    if (codec == CODEC_NONE || videoPid >= PID_NULL)
+    {
+        MSG("No video stream in program %u", pmtInfo.programNumber);
+        return false;
+    }
+
+    Program* program = findProgram(pmtInfo.programNumber);
+    if (program == NULL)
+    {
+        program = createProgram(pmtInfo.programNumber);
+    }
+    else if (program->videoPid != PID_NULL)
+    {
+        ERR("Program %u was already added", pmtInfo.programNumber);
+        return false;
+    }
+    program->videoPid = videoPid;
+    program->pcrPid = pmtInfo.pcrPid;
+    program->codec = codec;
+    pidRoles[videoPid] |= PID_ROLE_VIDEO;
+    if (program->pcrPid < PID_NULL)
+    {
+        pidRoles[program->pcrPid] |= PID_ROLE_PCR;
+    }
+    MSG("Program %u: video PID 0x%04x, PCR PID 0x%04x", program->programNumber, videoPid,
+        program->pcrPid);
+    return true;
+}
+
+void RapIndex::pushPacket(TsPacket* tsPacket, uint64_t packetNumber)
+{
+    uint16_t pid = tsPacket->getPid();
+    if (pidRoles[pid] == 0)
+    {
+        return;
+    }
+    AdaptationField adaptationField;
+    bool hasAdaptationField = tsPacket->hasAdaptationField() &&
+                              !tsPacket->getTransportErrorIndicator();
+    if (hasAdaptationField)
+    {
+        adaptationField.parse(tsPacket->getAdaptationField());
+    }
+    for (std::vector<Program*>::iterator ix = programs.begin(); ix != programs.end(); ++ix)
+    {
+        Program* program = *ix;
+        // The PCR of a packet is at or before any PES it starts
+        if (program->pcrPid == pid && hasAdaptationField && adaptationField.hasPcr())
+        {
+            program->pcr = adaptationField.getPcr();
+        }
+        if (program->videoPid == pid)
+        {
+            pushVideoPacket(program, tsPacket, packetNumber,
+                            hasAdaptationField && adaptationField.getRandomAccessIndicator());
+        }
+    }
+}
+
+void RapIndex::pushVideoPacket(Program* program, TsPacket* tsPacket, uint64_t packetNumber,
+                               bool isRandomAccess)
+{
+    ContinuityChecker::Result continuity = program->continuityChecker.check(tsPacket);
+    if (continuity == ContinuityChecker::CONTINUITY_NO_PAYLOAD ||
+        continuity == ContinuityChecker::CONTINUITY_DUPLICATE)
+    {
+        return;
+    }
+    if (continuity == ContinuityChecker::CONTINUITY_GAP)
+    {
+        // Go with what was gathered of the head so far
+        finishPes(program);
+    }
+    if (tsPacket->getTransportErrorIndicator())
+    {
+        finishPes(program);
+        return;
+    }
+    if (tsPacket->getPayloadUnitStartIndicator())
+    {
+        finishPes(program);
+        startPes(program, tsPacket, packetNumber, isRandomAccess);
+    }
+    else if (program->isInPes)
+    {
+        appendHead(program, tsPacket->getPayload(), tsPacket->getPayloadSize());
+    }
+}
+
+void RapIndex::startPes(Program* program, TsPacket* tsPacket, uint64_t packetNumber,
+                        bool isRandomAccess)
+{
+    RandomAccessPoint& point = program->current;
+    point.packetNumber = packetNumber;
+    point.pcr = program->pcr;
+    point.pts = (uint64_t) - 1;
+    point.programNumber = program->programNumber;
+    point.pid = program->videoPid;
+    point.flags = isRandomAccess ? RAP_FLAG_RANDOM_ACCESS_INDICATOR : 0;
+    program->isInPes = true;
+    program->headerBytesLeft = 0;
+    program->headSize = 0;
+    program->scanOffset = 0;
+
+    const uint8_t* payload = tsPacket->getPayload();
+    uint8_t payloadSize = tsPacket->getPayloadSize();
+    uint64_t dts;
+    if (tsPacket->getTransportScramblingControl() ||
+        !PesHeader::getTimestamps(payload, payloadSize, point.pts, dts))
+    {
+        point.pts = (uint64_t) - 1;
+        finishPes(program);
+        return;
+    }
+    uint32_t headerSize = PesHeader::OPTIONAL_HEADER_OFFSET + payload[8];
+    if (headerSize >= payloadSize)
+    {
+        program->headerBytesLeft = headerSize - payloadSize;
+        return;
+    }
+    appendHead(program, payload + headerSize, payloadSize - headerSize);
+}
+
+void RapIndex::appendHead(Program* program, const uint8_t* data, uint32_t size)
+{
+    uint32_t skipped = std::min(size, program->headerBytesLeft);
+    program->headerBytesLeft -= skipped;
+    size = std::min(size - skipped, (uint32_t)HEAD_SIZE - program->headSize);
+    if (size == 0)
+    {
+        return;
+    }
+    memcpy(program->head + program->headSize, data + skipped, size);
+    program->headSize += size;
+    if (scanHead(program) || program->headSize == HEAD_SIZE)
+    {
+        finishPes(program);
+    }
+}
+
+bool RapIndex::scanHead(Program* program)
+{
+    const uint8_t* end = program->head + program->headSize;
+    const uint8_t* startCode = scanner.findStartCode(program->head + program->scanOffset, end);
+    while (startCode != end)
+    {
+        const uint8_t* data = startCode + START_CODE_SIZE;
+        InspectResult result;
+        switch (program->codec)
+        {
+            case CODEC_MPEG2:
+                result = inspectMpeg2(data, end, program->current.flags);
+                break;
+            case CODEC_H264:
+                result = inspectH264(data, end, program->current.flags);
+                break;
+            default:
+                result = inspectH265(data, end, program->current.flags);
+                break;
+        }
+        if (result == INSPECT_DONE)
+        {
+            return true;
+        }
+        if (result == INSPECT_MORE_DATA)
+        {
+            program->scanOffset = startCode - program->head;
+            return false;
+        }
+        startCode = scanner.findStartCode(data, end);
+    }
+    // A start code may be split with the next packet
+    program->scanOffset = (program->headSize > START_CODE_SIZE - 1) ?
+                          program->headSize - (START_CODE_SIZE - 1) : 0;
+    return false;
+}
+
+void RapIndex::finishPes(Program* program)
+{
+    if (!program->isInPes)
+    {
+        return;
+    }
+    program->isInPes = false;
+    if (program->current.flags & (RAP_FLAG_RANDOM_ACCESS_INDICATOR | RAP_FLAG_IDR | RAP_FLAG_I_FRAME))
+    {
+        MSG("Random access point of program %u in packet %" PRIu64 ", flags: 0x%02x",
+            program->programNumber, program->current.packetNumber, program->current.flags);
+        program->points.push_back(program->current);
+    }
+}
+
+void RapIndex::finalize()
+{
+    for (std::vector<Program*>::iterator ix = programs.begin(); ix != programs.end(); ++ix)
+    {
+        finishPes(*ix);
+    }
+}
+
+void RapIndex::addRandomAccessPoint(const RandomAccessPoint& point)
+{
+    Program* program = findProgram(point.programNumber);
+    if (program == NULL)
+    {
+        program = createProgram(point.programNumber);
+    }
+    program->points.push_back(point);
+}
+
+void RapIndex::clear()
+{
+    for (std::vector<Program*>::iterator ix = programs.begin(); ix != programs.end(); ++ix)
+    {
+        delete *ix;
+    }
+    programs.clear();
+    programNumbers.clear();
+    std::fill(pidRoles.begin(), pidRoles.end(), 0);
+}
+
+const RapIndex::RandomAccessPointList& RapIndex::getRandomAccessPoints(uint16_t programNumber)
+{
+    Program* program = findProgram(programNumber);
+    return program ? program->points : noPoints;
+}
+
+uint64_t RapIndex::getRandomAccessPointCount()
+{
+    uint64_t count = 0;
+    for (std::vector<Program*>::iterator ix = programs.begin(); ix != programs.end(); ++ix)
+    {
+        count += (*ix)->points.size();
+    }
+    return count;
+}
+
+bool RapIndex::findRandomAccessPoint(uint16_t programNumber, uint64_t packetNumber,
+                                     RandomAccessPoint& point)
+{
+    const RandomAccessPointList& points = getRandomAccessPoints(programNumber);
+    RandomAccessPointList::const_iterator after = std::upper_bound(points.begin(), points.end(),
+                                                                   packetNumber, isBeforePoint);
+    if (after == points.begin())
+    {
+        return false;
+    }
+    point = *(after - 1);
+    return true;
+}
@@ -0,0 +1,255 @@
+/*
+ *  RapIndex.h - Index of the random access points of the programs of a TS
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   RapIndex.h
+ *  \brief  Random access points of the programs of a TS.
+ *
+ *  Defines RapIndex which records the packets where the decoding of the
+ *  video of each program can start, to seek to the nearest key frame.
+ */
+
+#ifndef DELPHINUS_RAP_INDEX_H
+#define DELPHINUS_RAP_INDEX_H
+
+#include <vector>
+#include "Ts.h"
+#include "TsMetadata.h"
+#include "NalScanner.h"
+
+/**
+ *  \brief  Records the random access points of the video of the programs.
+ *
+ *  The programs are added from their PMT with addProgram(), which picks the
+ *  first MPEG-1, MPEG-2, H.264 or H.265 video stream of the program, and the
+ *  packets of the TS are then pushed with pushPacket() as they are scanned.
+ *  Only the packets of the video PIDs and of the PCR PIDs are looked at, the
+ *  others cost the lookup of their PID.
+ *
+ *  A PES of the video starts a random access point when the packet starting
+ *  it has the random_access_indicator set in its adaptation field, or when
+ *  the start of its payload, up to its first picture, holds an IDR picture,
+ *  an I picture or an access unit delimiter announcing I slices only. Only
+ *  the first bytes of each PES are gathered to find its pictures, the rest
+ *  of the PES is skipped. The random_access_indicator is the only one used
+ *  for the scrambled PES.
+ *
+ *  The random access points of each program are kept in the order of the
+ *  packets, a GOP running from each of them to the next.
+ */
+class RapIndex
+{
+    public:
+/**
+ *  \brief  What was found at a random access point.
+ */
+        enum RapFlags
+        {
+/** The random_access_indicator is set in the packet starting the PES. */
+            RAP_FLAG_RANDOM_ACCESS_INDICATOR    = 0x01,
+/** The PES starts an IDR picture of H.264, or an IRAP picture (IDR, CRA or
+ *  BLA) of H.265. */
+            RAP_FLAG_IDR                        = 0x02,
+/** The PES starts an I picture, which is not an IDR picture. */
+            RAP_FLAG_I_FRAME                    = 0x04,
+/** The PES carries a sequence header of MPEG-1 / MPEG-2 video, or a
+ *  sequence parameter set of H.264 / H.265, before its first picture. */
+            RAP_FLAG_SEQUENCE_HEADER            = 0x08
+        };
+/**
+ *  \brief  A random access point of a program.
+ */
+        struct RandomAccessPoint
+        {
+/** Packet number(starts at 0) of the packet starting the PES. */
+            uint64_t packetNumber;
+/** Last PCR of the program at or before the packet in 27 MHz units,
+ *  (uint64_t) - 1 if there was none yet. */
+            uint64_t pcr;
+/** 33-bit PTS of the PES in 90 kHz units, (uint64_t) - 1 if the PES has no
+ *  PTS or is scrambled. */
+            uint64_t pts;
+/** Program number of the program. */
+            uint16_t programNumber;
+/** PID of the video. */
+            uint16_t pid;
+/** RapFlags found at the point. */
+            uint8_t flags;
+/** Padding, always 0. */
+            uint8_t reserved[3];
+        };
+/**
+ *  \brief  A list of random access points, in increasing order of packet
+ *          numbers.
+ */
+        typedef std::vector<RandomAccessPoint> RandomAccessPointList;
+
+    private:
+        enum
+        {
+            // Bytes of the payload of a PES gathered to find its first
+            // picture, enough for the parameter sets and the SEI before it
+            HEAD_SIZE = 2048,
+            PID_ROLE_VIDEO = 0x01,
+            PID_ROLE_PCR = 0x02
+        };
+        enum VideoCodec
+        {
+            CODEC_NONE,
+            CODEC_MPEG2,
+            CODEC_H264,
+            CODEC_H265
+        };
+        enum InspectResult
+        {
+            // The picture was found, the PES is done with
+            INSPECT_DONE,
+            // Not a picture, go on with the next start code
+            INSPECT_NEXT,
+            // The start code needs more bytes of the PES
+            INSPECT_MORE_DATA
+        };
+        struct Program
+        {
+            uint16_t programNumber;
+            // PID_NULL for the programs only loaded
+            uint16_t videoPid;
+            uint16_t pcrPid;
+            VideoCodec codec;
+            ContinuityChecker continuityChecker;
+            uint64_t pcr;
+            RandomAccessPointList points;
+            // The PES whose head is being gathered
+            bool isInPes;
+            RandomAccessPoint current;
+            // Bytes of the PES header still to be skipped, when the header
+            // spans several packets
+            uint32_t headerBytesLeft;
+            uint32_t headSize;
+            // Where the next start code is searched from in the head
+            uint32_t scanOffset;
+            uint8_t head[HEAD_SIZE];
+        };
+
+        std::vector<Program*> programs;
+        std::vector<uint16_t> programNumbers;
+        // PID_ROLE_* of every PID
+        std::vector<uint8_t> pidRoles;
+        NalScanner scanner;
+        RandomAccessPointList noPoints;
+
+        static InspectResult inspectMpeg2(const uint8_t* data, const uint8_t* end, uint8_t& flags);
+        static InspectResult inspectH264(const uint8_t* data, const uint8_t* end, uint8_t& flags);
+        static InspectResult inspectH265(const uint8_t* data, const uint8_t* end, uint8_t& flags);
+        Program* findProgram(uint16_t programNumber);
+        Program* createProgram(uint16_t programNumber);
+        void pushVideoPacket(Program* program, TsPacket* tsPacket, uint64_t packetNumber,
+                             bool isRandomAccess);
+        void startPes(Program* program, TsPacket* tsPacket, uint64_t packetNumber,
+                      bool isRandomAccess);
+        void appendHead(Program* program, const uint8_t* data, uint32_t size);
+        bool scanHead(Program* program);
+        void finishPes(Program* program);
+        // Not copyable, the programs are owned
+        RapIndex(const RapIndex& rapIndex);
+        RapIndex& operator=(const RapIndex& rapIndex);
+
+    public:
+        RapIndex();
+        ~RapIndex();
+
+/**
+ *  \brief  Add a program whose random access points are to be recorded.
+ *  \param  pmtInfo PMT of the program.
+ *  \return true if the program has a supported video stream, false
+ *          otherwise.
+ */
+        bool addProgram(const TsMetadata::PmtInfo& pmtInfo);
+/**
+ *  \brief  Push the next packet of the TS.
+ *  \param  tsPacket A valid TS packet.
+ *  \param  packetNumber Packet number(starts at 0) of the packet in the TS.
+ */
+        void pushPacket(TsPacket* tsPacket, uint64_t packetNumber);
+/**
+ *  \brief  Check if the packets of a PID are looked at by pushPacket(), to
+ *          skip pushing the others.
+ *  \param  pid The PID.
+ *  \return true for the video PIDs and the PCR PIDs of the programs added.
+ */
+        bool isIndexedPid(uint16_t pid);
+/**
+ *  \brief  Record the PES whose head is still being gathered, at the end of
+ *          the TS.
+ */
+        void finalize();
+/**
+ *  \brief  Add a random access point recorded before, such as from an index
+ *          file. The points of a program must be added in increasing order
+ *          of packet numbers.
+ *  \param  point The random access point.
+ */
+        void addRandomAccessPoint(const RandomAccessPoint& point);
+/**
+ *  \brief  Forget all the programs and their random access points.
+ */
+        void clear();
+/**
+ *  \brief  Get the programs with random access points or added.
+ *  \return The program numbers in the order they were added.
+ */
+        const std::vector<uint16_t>& getProgramNumbers();
+/**
+ *  \brief  Get the random access points of a program.
+ *  \param  programNumber Program number of the program.
+ *  \return The random access points in the order of the packets.
+ */
+        const RandomAccessPointList& getRandomAccessPoints(uint16_t programNumber);
+/**
+ *  \brief  Get the number of random access points of all the programs.
+ *  \return Number of random access points.
+ */
+        uint64_t getRandomAccessPointCount();
+/**
+ *  \brief  Find the last random access point of a program at or before a
+ *          packet.
+ *  \param  programNumber Program number of the program.
+ *  \param  packetNumber Packet number(starts at 0) of the packet.
+ *  \param  point Set to the random access point.
+ *  \return true if found, false if the program has no random access point
+ *          at or before the packet.
+ */
+        bool findRandomAccessPoint(uint16_t programNumber, uint64_t packetNumber,
+                                   RandomAccessPoint& point);
+};
+
+inline bool RapIndex::isIndexedPid(uint16_t pid)
+{
+    return (pid <= MpegConstants::PID_NULL) && pidRoles[pid];
+}
+
+inline const std::vector<uint16_t>& RapIndex::getProgramNumbers()
+{
+    return programNumbers;
+}
+
+#endif
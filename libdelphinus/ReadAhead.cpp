@@ -0,0 +1,251 @@
+/*
+ *  ReadAhead.cpp - A background reader which keeps the subsequent chunks of a
+ *  file ready in a set of rotating buffers
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "ReadAhead.h"
+#include <cassert>
+
+//#define DEBUG
+
+#define MODULE_READ_AHEAD 2
+#define CURRENT_MODULE MODULE_READ_AHEAD
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+ReadAhead::ReadAhead()
+    :   fileHandle(NULL),
+        fileSize(0),
+        chunkSize(0),
+        slots(NULL),
+        numSlots(0),
+        consumeSlot(0),
+        isHoldingSlot(false),
+        nextOffset(0),
+        isProducerWaiting(false),
+        isConsumerWaiting(false),
+        isRestartRequested(false),
+        isStopRequested(false),
+        restartOffset(0)
+{
+}
+
+ReadAhead::~ReadAhead()
+{
+    stop();
+}
+
+bool ReadAhead::start(const char* fileName, uint64_t size, uint64_t chunk, uint8_t buffers)
+{
+    stop();
+    assert(buffers >= 2);
+    fileHandle = fopen(fileName, "rb");
+    if (fileHandle == NULL)
+    {
+        return false;
+    }
+    fileSize = size;
+    chunkSize = chunk;
+    numSlots = buffers;
+    slots = new Slot[numSlots];
+    for (uint8_t ix = 0; ix < numSlots; ++ix)
+    {
+        slots[ix].data = new uint8_t[chunkSize];
+        slots[ix].offset = 0;
+        slots[ix].size = 0;
+        slots[ix].state.store(SLOT_FREE);
+    }
+    consumeSlot = 0;
+    isHoldingSlot = false;
+    nextOffset = 0;
+    restartOffset = 0;
+    isRestartRequested.store(false);
+    isStopRequested.store(false);
+    producer = std::thread(&ReadAhead::produce, this);
+    return true;
+}
+
+void ReadAhead::stop()
+{
+    if (producer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isStopRequested.store(true);
+            producerCondition.notify_one();
+        }
+        producer.join();
+    }
+    if (slots)
+    {
+        for (uint8_t ix = 0; ix < numSlots; ++ix)
+        {
+            delete[] slots[ix].data;
+        }
+        delete[] slots;
+        slots = NULL;
+        numSlots = 0;
+    }
+    if (fileHandle)
+    {
+        fclose(fileHandle);
+        fileHandle = NULL;
+    }
+}
+
+void ReadAhead::wakeProducer()
+{
+    // Only pay for the lock when the producer is actually asleep
+    if (isProducerWaiting.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        producerCondition.notify_one();
+    }
+}
+
+void ReadAhead::wakeConsumer()
+{
+    if (isConsumerWaiting.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        consumerCondition.notify_one();
+    }
+}
+
+void ReadAhead::produce()
+{
+    uint8_t fillSlot = 0;
+    uint64_t fillOffset = 0;
+
+    while (!isStopRequested.load())
+    {
+        if (isRestartRequested.load())
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // The consumer is blocked in restart(), none of the slots are
+            // in use by it anymore
+            for (uint8_t ix = 0; ix < numSlots; ++ix)
+            {
+                slots[ix].state.store(SLOT_FREE);
+            }
+            fillSlot = 0;
+            fillOffset = restartOffset;
+            isRestartRequested.store(false);
+            consumerCondition.notify_one();
+            continue;
+        }
+
+        Slot& slot = slots[fillSlot];
+        if (fillOffset >= fileSize || slot.state.load() != SLOT_FREE)
+        {
+            // Either everything has been read or all the buffers are full,
+            // sleep till the consumer frees a buffer or seeks elsewhere
+            std::unique_lock<std::mutex> lock(mutex);
+            isProducerWaiting.store(true);
+            while (!isStopRequested.load() && !isRestartRequested.load() &&
+                   (fillOffset >= fileSize || slot.state.load() != SLOT_FREE))
+            {
+                producerCondition.wait(lock);
+            }
+            isProducerWaiting.store(false);
+            continue;
+        }
+
+        slot.size = 0;
+        if (!fseeko(fileHandle, fillOffset, SEEK_SET))
+        {
+            slot.size = fread(slot.data, 1, chunkSize, fileHandle);
+        }
+        else
+        {
+            ERR("Unable to seek to offset: %" PRIu64, fillOffset);
+        }
+        slot.offset = fillOffset;
+        MSG("Read ahead offset: %" PRIu64 " size: %" PRIu64, fillOffset, slot.size);
+        slot.state.store(SLOT_READY);
+        wakeConsumer();
+
+        fillSlot = (fillSlot + 1) % numSlots;
+        fillOffset += chunkSize;
+    }
+}
+
+void ReadAhead::restart(uint64_t offset)
+{
+    MSG("Restarting read ahead from offset: %" PRIu64, offset);
+    std::unique_lock<std::mutex> lock(mutex);
+    restartOffset = offset;
+    isRestartRequested.store(true);
+    producerCondition.notify_one();
+    isConsumerWaiting.store(true);
+    while (isRestartRequested.load())
+    {
+        consumerCondition.wait(lock);
+    }
+    isConsumerWaiting.store(false);
+    consumeSlot = 0;
+}
+
+uint8_t* ReadAhead::fetch(uint64_t offset, uint64_t& validSize)
+{
+    if (isHoldingSlot)
+    {
+        // Hand the current buffer back to the producer
+        slots[consumeSlot].state.store(SLOT_FREE);
+        consumeSlot = (consumeSlot + 1) % numSlots;
+        isHoldingSlot = false;
+        wakeProducer();
+    }
+    if (offset >= fileSize)
+    {
+        validSize = 0;
+        return NULL;
+    }
+    if (offset != nextOffset)
+    {
+        restart(offset);
+    }
+
+    Slot& slot = slots[consumeSlot];
+    if (slot.state.load() != SLOT_READY)
+    {
+        // The producer is lagging behind, wait for it
+        std::unique_lock<std::mutex> lock(mutex);
+        isConsumerWaiting.store(true);
+        while (slot.state.load() != SLOT_READY)
+        {
+            consumerCondition.wait(lock);
+        }
+        isConsumerWaiting.store(false);
+    }
+    assert(slot.offset == offset);
+
+    isHoldingSlot = true;
+    nextOffset = offset + chunkSize;
+    validSize = slot.size;
+    return slot.data;
+}
@@ -0,0 +1,128 @@
+/*
+ *  ReadAhead.h - A background reader which keeps the subsequent chunks of a
+ *  file ready in a set of rotating buffers
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   ReadAhead.h
+ *  \brief  Background read-ahead of a file into rotating buffers.
+ *
+ *  Defines ReadAhead which is used by TsFile in TsFile::IO_MODE_READ_AHEAD to
+ *  overlap the disk reads with the parsing of the packets.
+ */
+
+#ifndef DELPHINUS_READ_AHEAD_H
+#define DELPHINUS_READ_AHEAD_H
+
+#include <cstdio>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "common/DelphinusUtils.h"
+
+/** \cond DEV */
+/**
+ *  \brief  Reads a file sequentially in a producer thread.
+ *
+ *  ReadAhead runs a producer thread which reads the file chunk by chunk into
+ *  a ring of buffers, staying up to (number of buffers - 1) chunks ahead of
+ *  the consumer. The buffers are handed over to the consumer through an
+ *  atomic state per buffer, so no lock is taken as long as the producer
+ *  keeps up. The locks and condition variables are only used when one side
+ *  has to sleep, or when the consumer seeks away from the sequential offset.
+ */
+class ReadAhead
+{
+    private:
+        enum SlotState
+        {
+            SLOT_FREE = 0,
+            SLOT_READY = 1
+        };
+
+        struct Slot
+        {
+            uint8_t* data;
+            uint64_t offset;
+            uint64_t size;
+            std::atomic<uint8_t> state;
+        };
+
+        FILE* fileHandle;
+        uint64_t fileSize;
+        uint64_t chunkSize;
+        Slot* slots;
+        uint8_t numSlots;
+        std::thread producer;
+
+        // Consumer side state, only accessed from fetch()
+        uint8_t consumeSlot;
+        bool isHoldingSlot;
+        uint64_t nextOffset;
+
+        std::mutex mutex;
+        std::condition_variable producerCondition;
+        std::condition_variable consumerCondition;
+        std::atomic<bool> isProducerWaiting;
+        std::atomic<bool> isConsumerWaiting;
+        std::atomic<bool> isRestartRequested;
+        std::atomic<bool> isStopRequested;
+        // Protected by mutex
+        uint64_t restartOffset;
+
+        void produce();
+        void restart(uint64_t offset);
+        void wakeProducer();
+        void wakeConsumer();
+
+    public:
+        ReadAhead();
+        ~ReadAhead();
+
+/**
+ *  \brief  Open the file and start the producer thread.
+ *  \param  fileName Name of the file to read, opened separately from the
+ *          consumer's handle so that both have their own file position.
+ *  \param  size Size of the file in bytes.
+ *  \param  chunk Size of each of the chunks in bytes.
+ *  \param  buffers Number of rotating buffers, at least 2.
+ *  \return true if the producer thread was started, false otherwise.
+ */
+        bool start(const char* fileName, uint64_t size, uint64_t chunk, uint8_t buffers);
+/**
+ *  \brief  Stop the producer thread and release the buffers.
+ */
+        void stop();
+/**
+ *  \brief  Get the chunk starting at the given offset, blocking only if the
+ *          producer has not read it yet. The chunk previously returned is
+ *          handed back to the producer and must not be accessed anymore.
+ *  \param  offset File offset of the chunk, the chunks being read one after
+ *          the other are the chunk size apart.
+ *  \param  validSize Number of valid bytes in the returned chunk.
+ *  \return Start of the chunk, NULL if the offset is beyond the file size.
+ */
+        uint8_t* fetch(uint64_t offset, uint64_t& validSize);
+};
+/** \endcond DEV */
+
+#endif
@@ -0,0 +1,276 @@
+/*
+ *  SectionAssembler.cpp - Reassembles the sections carried in the TS packets
+ *  of a PID
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "SectionAssembler.h"
+#include "Crc32.h"
+#include <cstring>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_SECTION_ASSEMBLER 9
+#define CURRENT_MODULE MODULE_SECTION_ASSEMBLER
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define GET_LESS(x, y) ((x) < (y) ? (x) : (y))
+
+// The table ID of the stuffing following the last section in a payload
+#define SECTION_STUFFING_BYTE 0xFF
+
+SectionAssembler::SectionAssembler()
+    :   sectionSize(0),
+        expectedSize(0),
+        isInSection(false),
+        isSectionReady(false),
+        isCarriedOver(false),
+        isHeadChecked(false),
+        isSkipping(false),
+        filter(NULL),
+        filteredSections(0),
+        sectionPacketNumber((uint64_t) - 1),
+        droppedSections(0),
+        crcErrors(0),
+        data(NULL),
+        dataSize(0),
+        position(0),
+        newSectionOffset(0),
+        canStartSection(false),
+        packetNumber(0)
+{
+}
+
+SectionAssembler::~SectionAssembler()
+{
+}
+
+void SectionAssembler::clear()
+{
+    dropSection();
+    isSectionReady = false;
+    continuityChecker.reset();
+    data = NULL;
+}
+
+void SectionAssembler::dropSection()
+{
+    if (isInSection && !isSectionReady && !isSkipping)
+    {
+        MSG("Dropping the section started in packet %" PRIu64, sectionPacketNumber);
+        ++droppedSections;
+    }
+    isInSection = false;
+    isCarriedOver = false;
+    isHeadChecked = false;
+    isSkipping = false;
+    sectionSize = 0;
+    expectedSize = 0;
+}
+
+void SectionAssembler::setFilter(Filter* sectionFilter)
+{
+    filter = sectionFilter;
+}
+
+void SectionAssembler::pushPacket(TsPacket* tsPacket, uint64_t number)
+{
+    // Skip the sections not viewed from the previous packet, so that the
+    // section carried over into this packet is the right one
+    uint16_t size;
+    while (viewNextSection(size))
+    {
+    }
+
+    data = NULL;
+    ContinuityChecker::Result continuity = continuityChecker.check(tsPacket);
+    if (continuity == ContinuityChecker::CONTINUITY_NO_PAYLOAD ||
+        continuity == ContinuityChecker::CONTINUITY_DUPLICATE)
+    {
+        return;
+    }
+    if (continuity == ContinuityChecker::CONTINUITY_GAP)
+    {
+        MSG("Continuity counter jumped to %u", tsPacket->getContinuityCounter());
+        dropSection();
+    }
+    if (tsPacket->getTransportErrorIndicator())
+    {
+        dropSection();
+        return;
+    }
+
+    data = tsPacket->getPayload();
+    dataSize = tsPacket->getPayloadSize();
+    packetNumber = number;
+    isCarriedOver = isInSection;
+    canStartSection = tsPacket->getPayloadUnitStartIndicator();
+    if (canStartSection)
+    {
+        // The pointer_field gives the offset of the first section starting
+        // in this packet, the bytes before it end the section in progress
+        position = 1;
+        newSectionOffset = 1 + data[0];
+        if (newSectionOffset > dataSize)
+        {
+            dropSection();
+            data = NULL;
+        }
+    }
+    else
+    {
+        if (!isInSection)
+        {
+            // Waiting for a packet starting a section
+            data = NULL;
+        }
+        position = 0;
+        newSectionOffset = dataSize;
+    }
+}
+
+bool SectionAssembler::appendBytes(uint8_t end)
+{
+    while (position < end)
+    {
+        uint16_t neededSize = (expectedSize ? expectedSize : (uint16_t)SECTION_HEADER_SIZE) - sectionSize;
+        if (filter && expectedSize && !isHeadChecked)
+        {
+            // Stop at the head of the section for the filter
+            neededSize = GET_LESS(expectedSize, (uint16_t)FILTER_HEAD_SIZE) - sectionSize;
+        }
+        uint16_t copyingSize = GET_LESS(neededSize, (uint16_t)(end - position));
+        if (!isSkipping)
+        {
+            memcpy(&buffer[1 + sectionSize], data + position, copyingSize);
+        }
+        sectionSize += copyingSize;
+        position += copyingSize;
+        if (expectedSize == 0 && sectionSize == SECTION_HEADER_SIZE)
+        {
+            expectedSize = SECTION_HEADER_SIZE + (((buffer[2] & 0x0F) << 8) | buffer[3]);
+            if (expectedSize > SECTION_SIZE_PRIVATE_MAX)
+            {
+                // The section boundaries cannot be trusted for the rest of
+                // the packet
+                ERR("Invalid section length: %u", expectedSize - SECTION_HEADER_SIZE);
+                dropSection();
+                data = NULL;
+                return false;
+            }
+        }
+        if (filter && expectedSize && !isHeadChecked &&
+            sectionSize == GET_LESS(expectedSize, (uint16_t)FILTER_HEAD_SIZE))
+        {
+            isHeadChecked = true;
+            isSkipping = !filter->isWanted(&buffer[1], sectionSize);
+        }
+        if (sectionSize == expectedSize)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t* SectionAssembler::viewNextSection(uint16_t& size)
+{
+    if (isSectionReady)
+    {
+        // Done with the section returned by the last call
+        dropSection();
+        isSectionReady = false;
+    }
+    while (data)
+    {
+        if (isInSection)
+        {
+            if (appendBytes(isCarriedOver ? newSectionOffset : dataSize))
+            {
+                if (!isCarriedOver)
+                {
+                    // The next section follows right after this one
+                    newSectionOffset = position;
+                }
+                isCarriedOver = false;
+                if (isSkipping)
+                {
+                    ++filteredSections;
+                    isInSection = false;
+                    dropSection();
+                    continue;
+                }
+                if ((buffer[2] & 0x80) && !Crc32::isSectionValid(&buffer[1], sectionSize))
+                {
+                    // The sections with the long header end with a CRC_32
+                    MSG("CRC_32 mismatch in the section started in packet %" PRIu64, sectionPacketNumber);
+                    ++crcErrors;
+                    dropSection();
+                    continue;
+                }
+                isSectionReady = true;
+                size = sectionSize;
+                return &buffer[1];
+            }
+            if (data == NULL)
+            {
+                break;
+            }
+            if (isCarriedOver && newSectionOffset < dataSize)
+            {
+                // A new section starts before the one in progress is complete
+                dropSection();
+            }
+            else
+            {
+                // The section continues in the next packet
+                data = NULL;
+                break;
+            }
+        }
+
+        position = newSectionOffset;
+        if (!canStartSection || position >= dataSize || data[position] == SECTION_STUFFING_BYTE)
+        {
+            data = NULL;
+            break;
+        }
+        if (buffer.empty())
+        {
+            buffer.resize(1 + SECTION_SIZE_PRIVATE_MAX, 0);
+        }
+        isInSection = true;
+        isHeadChecked = false;
+        isSkipping = false;
+        sectionSize = 0;
+        expectedSize = 0;
+        sectionPacketNumber = packetNumber;
+    }
+    return NULL;
+}
@@ -0,0 +1,201 @@
+/*
+ *  SectionAssembler.h - Reassembles the sections carried in the TS packets
+ *  of a PID
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   SectionAssembler.h
+ *  \brief  Section reassembly from the TS packets of a PID.
+ *
+ *  Defines SectionAssembler, which turns the payloads of the TS packets of a
+ *  PID into complete sections.
+ */
+
+#ifndef DELPHINUS_SECTION_ASSEMBLER_H
+#define DELPHINUS_SECTION_ASSEMBLER_H
+
+#include <vector>
+#include "Ts.h"
+
+/**
+ *  \brief  Reassembles the sections of a single PID.
+ *
+ *  The packets of one PID are pushed one at a time with pushPacket(), and
+ *  the sections completed by each packet are then viewed one by one with
+ *  viewNextSection(). A section may span any number of packets, and a packet
+ *  may end one section and carry several more, the pointer_field of the
+ *  packets starting a section tells where the first new section starts.
+ *  The continuity counter is followed, so a section missing a packet is
+ *  dropped instead of being returned with a hole in it, and the assembly
+ *  resumes from the next packet starting a section. The sections using the
+ *  long header are only returned when their CRC_32 matches. The sections are
+ *  copied into a single buffer which is reused for every section of the PID.
+ *  With a Filter set, the rest of a section whose first bytes the filter
+ *  rejects is skipped without being copied or having its CRC_32 checked.
+ */
+class SectionAssembler
+{
+    public:
+        enum
+        {
+/** Bytes of a section passed to Filter::isWanted(), the table_id, the
+ *  section_length and the 15 bytes following it. */
+            FILTER_HEAD_SIZE = 18
+        };
+/**
+ *  \brief  Decides from the first bytes of each section whether the
+ *          section is wanted.
+ */
+        class Filter
+        {
+            public:
+                virtual ~Filter() {}
+/**
+ *  \brief  Called once the first bytes of a section have been assembled,
+ *          before the rest of the section is copied.
+ *  \param  head Start of the section, at the table_id.
+ *  \param  size Bytes available, FILTER_HEAD_SIZE or the size of the whole
+ *          section if it is shorter.
+ *  \return true to assemble the section, false to skip it.
+ */
+                virtual bool isWanted(const uint8_t* head, uint16_t size) = 0;
+        };
+
+    private:
+        // Byte 0 is a zero pointer_field, the section being assembled
+        // follows it
+        std::vector<uint8_t> buffer;
+        // Bytes of the section assembled so far, and its total size once
+        // the section_length has been seen
+        uint16_t sectionSize;
+        uint16_t expectedSize;
+        // A section has been started and not completed yet
+        bool isInSection;
+        // The section in the buffer was returned by viewNextSection()
+        bool isSectionReady;
+        // The section in progress was started by an earlier packet
+        bool isCarriedOver;
+        // The head of the section in progress went through the filter, and
+        // whether the filter rejected it
+        bool isHeadChecked;
+        bool isSkipping;
+        Filter* filter;
+        uint64_t filteredSections;
+        uint64_t sectionPacketNumber;
+        uint64_t droppedSections;
+        uint64_t crcErrors;
+        ContinuityChecker continuityChecker;
+
+        // Payload of the packet being split into sections
+        const uint8_t* data;
+        uint8_t dataSize;
+        uint8_t position;
+        // Offset in the payload where the new sections start
+        uint8_t newSectionOffset;
+        bool canStartSection;
+        uint64_t packetNumber;
+
+        bool appendBytes(uint8_t end);
+        void dropSection();
+
+    public:
+        SectionAssembler();
+        ~SectionAssembler();
+
+/**
+ *  \brief  Drop the section in progress and forget the continuity counter,
+ *          to start over from the next packet starting a section.
+ */
+        void clear();
+/**
+ *  \brief  Push the next packet of the PID. The sections of the previous
+ *          packet which have not been viewed yet are skipped.
+ *  \param  tsPacket A valid TS packet of the PID.
+ *  \param  packetNumber Packet number(starts at 0) of the packet in the TS,
+ *          returned by getSectionPacketNumber() for the sections starting
+ *          in this packet.
+ */
+        void pushPacket(TsPacket* tsPacket, uint64_t packetNumber);
+/**
+ *  \brief  Set the filter deciding which sections are assembled, from the
+ *          next section started.
+ *  \param  sectionFilter The filter, NULL to assemble all the sections. It
+ *          is not owned and must stay valid while it is set.
+ */
+        void setFilter(Filter* sectionFilter);
+/**
+ *  \brief  View the next section completed by the last packet pushed.
+ *          \warning The section is only valid till the next call to
+ *          viewNextSection(), pushPacket() or clear(). The byte before the
+ *          section is always 0, so the section less one byte can be parsed
+ *          as the payload of a packet starting with a zero pointer_field.
+ *  \param  size Size of the section in bytes, including the header and the
+ *          CRC_32.
+ *  \return Start of the section, NULL if the packet has no more sections.
+ */
+        uint8_t* viewNextSection(uint16_t& size);
+/**
+ *  \brief  Get the number of the packet which the last section viewed
+ *          started in.
+ *  \return Packet number passed to pushPacket().
+ */
+        uint64_t getSectionPacketNumber();
+/**
+ *  \brief  Get the number of sections dropped because of a lost packet, a
+ *          packet with the transport error indicator set, an invalid
+ *          section_length or a CRC_32 mismatch.
+ *  \return Number of sections dropped since the creation.
+ */
+        uint64_t getDroppedSectionCount();
+/**
+ *  \brief  Get the number of sections dropped because of a CRC_32 mismatch.
+ *  \return Number of sections with a CRC_32 mismatch since the creation.
+ */
+        uint64_t getCrcErrorCount();
+/**
+ *  \brief  Get the number of sections skipped because the filter rejected
+ *          them.
+ *  \return Number of sections skipped since the creation.
+ */
+        uint64_t getFilteredSectionCount();
+};
+
+inline uint64_t SectionAssembler::getSectionPacketNumber()
+{
+    return sectionPacketNumber;
+}
+
+inline uint64_t SectionAssembler::getDroppedSectionCount()
+{
+    return droppedSections;
+}
+
+inline uint64_t SectionAssembler::getCrcErrorCount()
+{
+    return crcErrors;
+}
+
+inline uint64_t SectionAssembler::getFilteredSectionCount()
+{
+    return filteredSections;
+}
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ *  SectionDemux.cpp - Demultiplexing of the sections through value/mask/mode
+ *  filters
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "SectionDemux.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SECTION_DEMUX_X86
+#include <immintrin.h>
+#endif
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_SECTION_DEMUX 15
+#define CURRENT_MODULE MODULE_SECTION_DEMUX
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+SectionDemux::Filter::Filter()
+{
+    memset(value, 0, sizeof(value));
+    memset(mask, 0, sizeof(mask));
+    memset(mode, 0, sizeof(mode));
+}
+
+SectionDemux::PidFilter::PidFilter(MatchFunction matchFunction)
+    :   matchCount(0),
+        match(matchFunction)
+{
+}
+
+SectionDemux::PidFilter::~PidFilter()
+{
+}
+
+bool SectionDemux::PidFilter::isWanted(const uint8_t* head, uint16_t size)
+{
+    uint8_t shortHead[SectionAssembler::FILTER_HEAD_SIZE];
+    if (size < SectionAssembler::FILTER_HEAD_SIZE)
+    {
+        // The bytes past the end of a short section are compared as 0
+        memset(shortHead, 0, sizeof(shortHead));
+        memcpy(shortHead, head, size);
+        head = shortHead;
+    }
+    matchCount = match(head, &filters[0], filters.size(), &matches[0]);
+    return (matchCount > 0);
+}
+
+SectionDemux::PreparedFilter SectionDemux::prepareFilter(const Filter& filter)
+{
+    PreparedFilter prepared;
+    prepared.hasNotEqual = false;
+    for (uint8_t ix = 0; ix < FILTER_SIZE; ++ix)
+    {
+        prepared.value[ix] = filter.value[ix] & filter.mask[ix];
+        prepared.equalMask[ix] = filter.mask[ix] & ~filter.mode[ix];
+        prepared.notEqualMask[ix] = filter.mask[ix] & filter.mode[ix];
+        prepared.hasNotEqual = prepared.hasNotEqual || prepared.notEqualMask[ix];
+    }
+    prepared.id = 0;
+    return prepared;
+}
+
+uint32_t SectionDemux::matchScalar(const uint8_t* head, const PreparedFilter* filters, uint32_t count,
+                                   uint32_t* matches)
+{
+    // The filters skip the section_length
+    uint8_t packedHead[FILTER_SIZE];
+    packedHead[0] = head[0];
+    memcpy(packedHead + 1, head + 3, FILTER_SIZE - 1);
+
+    uint32_t matchCount = 0;
+    for (uint32_t filter = 0; filter < count; ++filter)
+    {
+        uint8_t equalDifference = 0;
+        uint8_t notEqualDifference = 0;
+        for (uint8_t ix = 0; ix < FILTER_SIZE; ++ix)
+        {
+            uint8_t difference = packedHead[ix] ^ filters[filter].value[ix];
+            equalDifference |= difference & filters[filter].equalMask[ix];
+            notEqualDifference |= difference & filters[filter].notEqualMask[ix];
+        }
+        if (equalDifference == 0 && (!filters[filter].hasNotEqual || notEqualDifference))
+        {
+            matches[matchCount++] = filters[filter].id;
+        }
+    }
+    return matchCount;
+}
+
+#ifdef SECTION_DEMUX_X86
+__attribute__((target("sse2")))
+uint32_t SectionDemux::matchSse2(const uint8_t* head, const PreparedFilter* filters, uint32_t count,
+                                 uint32_t* matches)
+{
+    // Bytes 2-17 of the section, with the table_id in place of the low byte
+    // of the section_length
+    __m128i packedHead = _mm_loadu_si128((const __m128i*)(head + 2));
+    packedHead = _mm_or_si128(_mm_and_si128(packedHead, _mm_set_epi32(-1, -1, -1, (int)0xFFFFFF00)),
+                              _mm_cvtsi32_si128(head[0]));
+    const __m128i zero = _mm_setzero_si128();
+
+    uint32_t matchCount = 0;
+    for (uint32_t filter = 0; filter < count; ++filter)
+    {
+        __m128i difference = _mm_xor_si128(packedHead, _mm_loadu_si128((const __m128i*)filters[filter].value));
+        __m128i equalDifference = _mm_and_si128(difference,
+                                                _mm_loadu_si128((const __m128i*)filters[filter].equalMask));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(equalDifference, zero)) != 0xFFFF)
+        {
+            continue;
+        }
+        if (filters[filter].hasNotEqual)
+        {
+            __m128i notEqualDifference =
+                _mm_and_si128(difference, _mm_loadu_si128((const __m128i*)filters[filter].notEqualMask));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(notEqualDifference, zero)) == 0xFFFF)
+            {
+                continue;
+            }
+        }
+        matches[matchCount++] = filters[filter].id;
+    }
+    return matchCount;
+}
+#endif
+
+SectionDemux::SectionDemux()
+    :   pidFilters(PID_NULL + 1, NULL),
+        nextFilterId(1),
+        match(matchScalar),
+        currentPid(NULL),
+        section(NULL),
+        sectionSize(0),
+        nextMatch(0)
+{
+#ifdef SECTION_DEMUX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        match = matchSse2;
+    }
+#endif
+}
+
+SectionDemux::~SectionDemux()
+{
+    clear();
+}
+
+uint32_t SectionDemux::addFilter(uint16_t pid, const Filter& filter)
+{
+    if (pid > PID_NULL)
+    {
+        ERR("Invalid PID: 0x%04x", pid);
+        return 0;
+    }
+    PidFilter*& pidFilter = pidFilters[pid];
+    if (pidFilter == NULL)
+    {
+        pidFilter = new PidFilter(match);
+        pidFilter->assembler.setFilter(pidFilter);
+    }
+    PreparedFilter prepared = prepareFilter(filter);
+    prepared.id = nextFilterId++;
+    pidFilter->filters.push_back(prepared);
+    pidFilter->matches.resize(pidFilter->filters.size());
+    filterPids[prepared.id] = pid;
+    MSG("Added filter %u to PID 0x%04x", prepared.id, pid);
+    return prepared.id;
+}
+
+bool SectionDemux::removeFilter(uint32_t filterId)
+{
+    FilterPidMap::iterator filterPid = filterPids.find(filterId);
+    if (filterPid == filterPids.end())
+    {
+        return false;
+    }
+    uint16_t pid = filterPid->second;
+    filterPids.erase(filterPid);
+
+    PidFilter* pidFilter = pidFilters[pid];
+    if (pidFilter->filters.size() == 1)
+    {
+        if (currentPid == pidFilter)
+        {
+            currentPid = NULL;
+            section = NULL;
+        }
+        delete pidFilter;
+        pidFilters[pid] = NULL;
+        return true;
+    }
+    for (std::vector<PreparedFilter>::iterator ix = pidFilter->filters.begin(); ix != pidFilter->filters.end(); ++ix)
+    {
+        if (ix->id == filterId)
+        {
+            pidFilter->filters.erase(ix);
+            break;
+        }
+    }
+    // The section in progress may have matched the filter
+    pidFilter->matchCount = std::remove(pidFilter->matches.begin(),
+                                        pidFilter->matches.begin() + pidFilter->matchCount, filterId) -
+                            pidFilter->matches.begin();
+    pidFilter->matches.resize(pidFilter->filters.size());
+    if (currentPid == pidFilter)
+    {
+        section = NULL;
+    }
+    return true;
+}
+
+void SectionDemux::clear()
+{
+    for (std::vector<PidFilter*>::iterator ix = pidFilters.begin(); ix != pidFilters.end(); ++ix)
+    {
+        delete *ix;
+        *ix = NULL;
+    }
+    filterPids.clear();
+    currentPid = NULL;
+    section = NULL;
+}
+
+void SectionDemux::pushPacket(TsPacket* tsPacket, uint64_t packetNumber)
+{
+    currentPid = pidFilters[tsPacket->getPid()];
+    section = NULL;
+    nextMatch = 0;
+    if (currentPid)
+    {
+        currentPid->assembler.pushPacket(tsPacket, packetNumber);
+    }
+}
+
+uint8_t* SectionDemux::viewNextSection(uint16_t& size, uint32_t& filterId)
+{
+    if (currentPid == NULL)
+    {
+        return NULL;
+    }
+    while (true)
+    {
+        if (section && nextMatch < currentPid->matchCount)
+        {
+            size = sectionSize;
+            filterId = currentPid->matches[nextMatch++];
+            return section;
+        }
+        section = currentPid->assembler.viewNextSection(sectionSize);
+        nextMatch = 0;
+        if (section == NULL)
+        {
+            return NULL;
+        }
+    }
+}
+
+uint64_t SectionDemux::getSectionPacketNumber()
+{
+    return currentPid ? currentPid->assembler.getSectionPacketNumber() : (uint64_t) - 1;
+}
+
+uint64_t SectionDemux::getFilteredSectionCount(uint16_t pid)
+{
+    if (pid > PID_NULL || pidFilters[pid] == NULL)
+    {
+        return 0;
+    }
+    return pidFilters[pid]->assembler.getFilteredSectionCount();
+}
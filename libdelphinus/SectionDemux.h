@@ -0,0 +1,196 @@
+/*
+ *  SectionDemux.h - Demultiplexing of the sections through value/mask/mode
+ *  filters
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   SectionDemux.h
+ *  \brief  Section filters in the style of the DVB demux filters.
+ *
+ *  Defines SectionDemux which returns the sections of the PIDs matching the
+ *  filters registered against them.
+ */
+
+#ifndef DELPHINUS_SECTION_DEMUX_H
+#define DELPHINUS_SECTION_DEMUX_H
+
+#include <map>
+#include <vector>
+#include "Ts.h"
+#include "SectionAssembler.h"
+
+/**
+ *  \brief  Returns the sections matching value/mask/mode filters.
+ *
+ *  Filters of up to 16 bytes are registered against a PID, as with the
+ *  section filters of a DVB demux. Byte 0 of a filter is compared with the
+ *  table_id, and bytes 1-15 with the 15 bytes following the section_length,
+ *  the table_id_extension in bytes 1-2, the version_number and
+ *  current_next_indicator in byte 3, the section_number in byte 4 and so on.
+ *  The bits cleared in the mask are not compared. The bits set in the mask
+ *  and cleared in the mode must be equal to the value, and if any bit is set
+ *  in both the mask and the mode, at least one of those bits must differ
+ *  from the value.
+ *
+ *  The packets of all the PIDs are pushed with pushPacket(), and the
+ *  packets of the PIDs without filters are skipped right away. All the
+ *  filters of a PID are evaluated with SSE2 against the first bytes of each
+ *  section as soon as they are assembled, and the rest of a section which
+ *  matches no filter is skipped without being copied or having its CRC_32
+ *  checked.
+ */
+class SectionDemux
+{
+    public:
+        enum
+        {
+/** Bytes compared by a filter. */
+            FILTER_SIZE = 16
+        };
+/**
+ *  \brief  A section filter, all zero by default which matches every
+ *          section.
+ */
+        struct Filter
+        {
+/** Values of the bits compared. */
+            uint8_t value[FILTER_SIZE];
+/** Bits compared. */
+            uint8_t mask[FILTER_SIZE];
+/** Bits which must differ from the value, at least one of them. */
+            uint8_t mode[FILTER_SIZE];
+
+            Filter();
+        };
+
+    private:
+        // A filter as evaluated, the masks of the bits which must be equal
+        // and of the bits which must differ
+        struct PreparedFilter
+        {
+            uint8_t value[FILTER_SIZE];
+            uint8_t equalMask[FILTER_SIZE];
+            uint8_t notEqualMask[FILTER_SIZE];
+            bool hasNotEqual;
+            uint32_t id;
+        };
+        typedef uint32_t (*MatchFunction)(const uint8_t* head, const PreparedFilter* filters,
+                                          uint32_t count, uint32_t* matches);
+
+        // The sections and the filters of a PID
+        class PidFilter : public SectionAssembler::Filter
+        {
+            public:
+                SectionAssembler assembler;
+                std::vector<PreparedFilter> filters;
+                // Filter IDs matching the section in progress
+                std::vector<uint32_t> matches;
+                uint32_t matchCount;
+                MatchFunction match;
+
+                PidFilter(MatchFunction matchFunction);
+                ~PidFilter();
+                bool isWanted(const uint8_t* head, uint16_t size);
+        };
+        // Filter ID to its PID
+        typedef std::map<uint32_t, uint16_t> FilterPidMap;
+
+        static PreparedFilter prepareFilter(const Filter& filter);
+        static uint32_t matchScalar(const uint8_t* head, const PreparedFilter* filters, uint32_t count,
+                                    uint32_t* matches);
+        static uint32_t matchSse2(const uint8_t* head, const PreparedFilter* filters, uint32_t count,
+                                  uint32_t* matches);
+
+        // Indexed by the PID, NULL for the PIDs without filters
+        std::vector<PidFilter*> pidFilters;
+        FilterPidMap filterPids;
+        uint32_t nextFilterId;
+        MatchFunction match;
+        // PID of the last packet pushed, its section being returned and the
+        // next of the filters it matched to be returned
+        PidFilter* currentPid;
+        uint8_t* section;
+        uint16_t sectionSize;
+        uint32_t nextMatch;
+
+        // Not copyable, the filters of the PIDs are owned
+        SectionDemux(const SectionDemux& sectionDemux);
+        SectionDemux& operator=(const SectionDemux& sectionDemux);
+
+    public:
+        SectionDemux();
+        ~SectionDemux();
+
+/**
+ *  \brief  Register a filter against a PID.
+ *  \param  pid PID of the sections.
+ *  \param  filter The filter.
+ *  \return ID of the filter, 0 if the PID is invalid.
+ */
+        uint32_t addFilter(uint16_t pid, const Filter& filter);
+/**
+ *  \brief  Remove a filter. The sections of its PID are no longer
+ *          assembled once the PID has no filters left.
+ *  \param  filterId ID returned by addFilter().
+ *  \return true if the filter was removed, false if there is no such
+ *          filter.
+ */
+        bool removeFilter(uint32_t filterId);
+/**
+ *  \brief  Remove all the filters.
+ */
+        void clear();
+/**
+ *  \brief  Push the next packet of the TS. The sections of the previous
+ *          packet which have not been viewed yet are skipped.
+ *  \param  tsPacket A valid TS packet.
+ *  \param  packetNumber Packet number(starts at 0) of the packet in the TS.
+ */
+        void pushPacket(TsPacket* tsPacket, uint64_t packetNumber);
+/**
+ *  \brief  View the next section matching a filter completed by the last
+ *          packet pushed. A section matching several filters is returned
+ *          once for each of them.
+ *          \warning The section is only valid till the next call to
+ *          viewNextSection(), pushPacket(), removeFilter() or clear().
+ *  \param  size Size of the section in bytes, including the header and the
+ *          CRC_32.
+ *  \param  filterId ID of the filter matched.
+ *  \return Start of the section, NULL if the packet has no more sections.
+ */
+        uint8_t* viewNextSection(uint16_t& size, uint32_t& filterId);
+/**
+ *  \brief  Get the number of the packet which the last section viewed
+ *          started in.
+ *  \return Packet number passed to pushPacket().
+ */
+        uint64_t getSectionPacketNumber();
+/**
+ *  \brief  Get the number of sections of a PID skipped because they
+ *          matched no filter.
+ *  \param  pid PID of the sections.
+ *  \return Number of sections skipped since the first filter of the PID
+ *          was added.
+ */
+        uint64_t getFilteredSectionCount(uint16_t pid);
+};
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ *  SiTables.cpp - Parsing of the DVB Service Information tables
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "SiTables.h"
+#include "Crc32.h"
+#include <cstddef>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_SI_TABLES 13
+#define CURRENT_MODULE MODULE_SI_TABLES
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define SI_HEADER_SIZE              8
+#define SI_CRC_SIZE                 4
+// Modified Julian Date of 1970-01-01
+#define MJD_UNIX_EPOCH              40587
+#define SECONDS_PER_DAY             86400
+
+#define SI_GET_LENGTH(x)            ((((x)[1] & 0x0F) << 8) | (x)[2])
+#define SI_GET_LOOP_LENGTH(x)       ((((x)[0] & 0x0F) << 8) | (x)[1])
+
+// original_network_id, reserved_future_use
+#define SDT_SERVICES_OFFSET         11
+// service_id, EIT flags, running_status, free_CA_mode, descriptors_loop_length
+#define SDT_SERVICE_HEADER_SIZE     5
+// transport_stream_id, original_network_id, segment_last_section_number,
+// last_table_id
+#define EIT_EVENTS_OFFSET           14
+// event_id, start_time, duration, running_status, free_CA_mode,
+// descriptors_loop_length
+#define EIT_EVENT_HEADER_SIZE       12
+// UTC_time
+#define TDT_SECTION_LENGTH          5
+// UTC_time, descriptors_loop_length
+#define TOT_DESCRIPTORS_OFFSET      10
+
+uint8_t decodeBcd(uint8_t value);
+
+uint8_t decodeBcd(uint8_t value)
+{
+    return (value >> 4) * 10 + (value & 0x0F);
+}
+
+SiSection::SiSection()
+    :   tableId(0xFF),
+        tableIdExtension(0),
+        versionNumber(0),
+        currentNextIndicator(false),
+        sectionNumber(0),
+        lastSectionNumber(0),
+        sectionSize(0)
+{
+}
+
+SiSection::~SiSection()
+{
+}
+
+bool SiSection::parseHeader(const uint8_t* section, uint16_t size, uint16_t minimumSize)
+{
+    // The SI tables set the private_indicator, so only the
+    // section_syntax_indicator is checked
+    if (size < SI_HEADER_SIZE + SI_CRC_SIZE || !(section[1] & 0x80))
+    {
+        return false;
+    }
+    sectionSize = 3 + SI_GET_LENGTH(section);
+    if (sectionSize < minimumSize || sectionSize > size)
+    {
+        return false;
+    }
+    tableId = section[0];
+    tableIdExtension = (section[3] << 8) | section[4];
+    versionNumber = (section[5] >> 1) & 0x1F;
+    currentNextIndicator = section[5] & 0x01;
+    sectionNumber = section[6];
+    lastSectionNumber = section[7];
+    return true;
+}
+
+uint64_t SiSection::getUtcTime(const uint8_t* data)
+{
+    if ((data[0] & data[1] & data[2] & data[3] & data[4]) == 0xFF)
+    {
+        return (uint64_t) - 1;
+    }
+    uint32_t modifiedJulianDate = (data[0] << 8) | data[1];
+    // Dates before 1970 are not expected in a broadcast
+    uint64_t days = (modifiedJulianDate > MJD_UNIX_EPOCH) ? modifiedJulianDate - MJD_UNIX_EPOCH : 0;
+    return days * SECONDS_PER_DAY + getDuration(data + 2);
+}
+
+uint32_t SiSection::getDuration(const uint8_t* data)
+{
+    return decodeBcd(data[0]) * 3600 + decodeBcd(data[1]) * 60 + decodeBcd(data[2]);
+}
+
+SdtSection::SdtSection()
+    :   originalNetworkId(0)
+{
+}
+
+SdtSection::~SdtSection()
+{
+}
+
+bool SdtSection::parse(uint8_t* section, uint16_t size)
+{
+    serviceList.clear();
+    if (!parseHeader(section, size, SDT_SERVICES_OFFSET + SI_CRC_SIZE) ||
+        (tableId != TABLE_SERVICE_DESCRIPTION_ACTUAL && tableId != TABLE_SERVICE_DESCRIPTION_OTHER))
+    {
+        return false;
+    }
+    originalNetworkId = (section[8] << 8) | section[9];
+
+    uint8_t* data = section + SDT_SERVICES_OFFSET;
+    uint16_t remainingData = sectionSize - SDT_SERVICES_OFFSET - SI_CRC_SIZE;
+    // Every service takes at least 5 bytes, so the list is allocated at
+    // most once
+    serviceList.reserve(remainingData / SDT_SERVICE_HEADER_SIZE);
+    ServiceInfo info;
+    while (remainingData >= SDT_SERVICE_HEADER_SIZE)
+    {
+        info.serviceId = (data[0] << 8) | data[1];
+        info.eitScheduleFlag = (data[2] >> 1) & 0x01;
+        info.eitPresentFollowingFlag = data[2] & 0x01;
+        info.runningStatus = data[3] >> 5;
+        info.freeCaMode = (data[3] >> 4) & 0x01;
+        info.descriptor.size = SI_GET_LOOP_LENGTH(data + 3);
+        info.descriptor.start = data + SDT_SERVICE_HEADER_SIZE;
+        if (SDT_SERVICE_HEADER_SIZE + info.descriptor.size > remainingData)
+        {
+            MSG("Service 0x%04x runs past the section", info.serviceId);
+            serviceList.clear();
+            return false;
+        }
+        serviceList.push_back(info);
+        data += SDT_SERVICE_HEADER_SIZE + info.descriptor.size;
+        remainingData -= SDT_SERVICE_HEADER_SIZE + info.descriptor.size;
+    }
+    return true;
+}
+
+EitSection::EitSection()
+    :   transportStreamId(0),
+        originalNetworkId(0),
+        segmentLastSectionNumber(0),
+        lastTableId(0)
+{
+}
+
+EitSection::~EitSection()
+{
+}
+
+bool EitSection::parse(uint8_t* section, uint16_t size)
+{
+    eventList.clear();
+    if (!parseHeader(section, size, EIT_EVENTS_OFFSET + SI_CRC_SIZE) ||
+        tableId < TABLE_EIT_ACTUAL_PRESENT_FOLLOWING || tableId > TABLE_EIT_OTHER_SCHEDULE_END)
+    {
+        return false;
+    }
+    transportStreamId = (section[8] << 8) | section[9];
+    originalNetworkId = (section[10] << 8) | section[11];
+    segmentLastSectionNumber = section[12];
+    lastTableId = section[13];
+
+    uint8_t* data = section + EIT_EVENTS_OFFSET;
+    uint16_t remainingData = sectionSize - EIT_EVENTS_OFFSET - SI_CRC_SIZE;
+    // Every event takes at least 12 bytes
+    eventList.reserve(remainingData / EIT_EVENT_HEADER_SIZE);
+    EventInfo info;
+    while (remainingData >= EIT_EVENT_HEADER_SIZE)
+    {
+        info.eventId = (data[0] << 8) | data[1];
+        info.startTime = getUtcTime(data + 2);
+        info.duration = getDuration(data + 7);
+        info.runningStatus = data[10] >> 5;
+        info.freeCaMode = (data[10] >> 4) & 0x01;
+        info.descriptor.size = SI_GET_LOOP_LENGTH(data + 10);
+        info.descriptor.start = data + EIT_EVENT_HEADER_SIZE;
+        if (EIT_EVENT_HEADER_SIZE + info.descriptor.size > remainingData)
+        {
+            MSG("Event 0x%04x runs past the section", info.eventId);
+            eventList.clear();
+            return false;
+        }
+        eventList.push_back(info);
+        data += EIT_EVENT_HEADER_SIZE + info.descriptor.size;
+        remainingData -= EIT_EVENT_HEADER_SIZE + info.descriptor.size;
+    }
+    return true;
+}
+
+TdtSection::TdtSection()
+    :   utcTime((uint64_t) - 1)
+{
+}
+
+TdtSection::~TdtSection()
+{
+}
+
+bool TdtSection::parse(const uint8_t* section, uint16_t size)
+{
+    if (size < 3 + TDT_SECTION_LENGTH || section[0] != TABLE_TDT ||
+        SI_GET_LENGTH(section) != TDT_SECTION_LENGTH)
+    {
+        return false;
+    }
+    utcTime = SiSection::getUtcTime(section + 3);
+    return true;
+}
+
+TotSection::TotSection()
+    :   utcTime((uint64_t) - 1)
+{
+    descriptor.start = NULL;
+    descriptor.size = 0;
+}
+
+TotSection::~TotSection()
+{
+}
+
+bool TotSection::parse(uint8_t* section, uint16_t size)
+{
+    if (size < TOT_DESCRIPTORS_OFFSET + SI_CRC_SIZE || section[0] != TABLE_TOT)
+    {
+        return false;
+    }
+    uint16_t sectionSize = 3 + SI_GET_LENGTH(section);
+    if (sectionSize < TOT_DESCRIPTORS_OFFSET + SI_CRC_SIZE || sectionSize > size ||
+        !Crc32::isSectionValid(section, sectionSize))
+    {
+        return false;
+    }
+    uint16_t descriptorSize = SI_GET_LOOP_LENGTH(section + 8);
+    if (TOT_DESCRIPTORS_OFFSET + descriptorSize + SI_CRC_SIZE > sectionSize)
+    {
+        return false;
+    }
+    utcTime = SiSection::getUtcTime(section + 3);
+    descriptor.start = section + TOT_DESCRIPTORS_OFFSET;
+    descriptor.size = descriptorSize;
+    return true;
+}
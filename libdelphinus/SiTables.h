@@ -0,0 +1,421 @@
+/*
+ *  SiTables.h - Parsing of the DVB Service Information tables
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   SiTables.h
+ *  \brief  Parsing of the SDT, EIT, TDT and TOT.
+ *
+ *  Contains the parsers of the DVB Service Information (SI) sections. Unlike
+ *  the PSI tables, every section of the SI tables is complete on its own, so
+ *  the parsers read a single whole section, such as the ones returned by
+ *  SectionAssembler, in place. The descriptors point into the section, which
+ *  must stay valid as long as they are used.
+ */
+
+#ifndef DELPHINUS_SI_TABLES_H
+#define DELPHINUS_SI_TABLES_H
+
+#include <vector>
+#include "common/DelphinusUtils.h"
+#include "MpegConstants.h"
+#include "PsiTables.h"
+
+/**
+ *  \brief  Common header of the SI sections using the long header.
+ */
+class SiSection
+{
+    protected:
+        uint8_t tableId;
+        uint16_t tableIdExtension;
+        uint8_t versionNumber;
+        bool currentNextIndicator;
+        uint8_t sectionNumber;
+        uint8_t lastSectionNumber;
+        // Size of the whole section including the CRC_32
+        uint16_t sectionSize;
+
+/**
+ *  \brief  Parse the long header of a section.
+ *  \param  section Start of the section, at the table_id.
+ *  \param  size Size of the data available.
+ *  \param  minimumSize Size of the smallest valid section of the table,
+ *          including the CRC_32.
+ *  \return true if the header is valid and the section fits in the data,
+ *          false otherwise.
+ */
+        bool parseHeader(const uint8_t* section, uint16_t size, uint16_t minimumSize);
+
+    public:
+        SiSection();
+        ~SiSection();
+
+/**
+ *  \brief  Decode a 40 bit UTC time, the Modified Julian Date followed by
+ *          the hours, minutes and seconds in BCD.
+ *  \param  data Start of the 5 bytes of the time.
+ *  \return Seconds since 1970-01-01 00:00:00 UTC, (uint64_t) - 1 if the time
+ *          is undefined.
+ */
+        static uint64_t getUtcTime(const uint8_t* data);
+/**
+ *  \brief  Decode a 24 bit duration, the hours, minutes and seconds in BCD.
+ *  \param  data Start of the 3 bytes of the duration.
+ *  \return Duration in seconds.
+ */
+        static uint32_t getDuration(const uint8_t* data);
+
+/**
+ *  \brief  Get the Table ID of the section.
+ *  \return 8-bit Table ID.
+ */
+        uint8_t getTableId();
+/**
+ *  \brief  Get the Table ID Extension of the section.
+ *  \return 16-bit Table ID Extension.
+ */
+        uint16_t getTableIdExtension();
+/**
+ *  \brief  Get the Version number of the section.
+ *  \return 5-bit Version number.
+ */
+        uint8_t getVersionNumber();
+/**
+ *  \brief  Get the Current Next indicator of the section.
+ *  \return true if the section is currently applicable, false if it is
+ *          the next one to be applicable.
+ */
+        bool getCurrentNextIndicator();
+/**
+ *  \brief  Get the Section number.
+ *  \return 8-bit Section number.
+ */
+        uint8_t getSectionNumber();
+/**
+ *  \brief  Get the Last section number.
+ *  \return 8-bit Last section number.
+ */
+        uint8_t getLastSectionNumber();
+};
+
+/**
+ *  \brief  Represents a SDT section.
+ *
+ *  SdtSection parses a section of the SDT of the actual or of another TS.
+ */
+class SdtSection : public SiSection
+{
+    public:
+/**
+ *  \brief  Information about a service of the SDT.
+ */
+        struct ServiceInfo
+        {
+/** Service ID, the program number of the service. */
+            uint16_t serviceId;
+/** The EIT schedule of the service is in the TS. */
+            bool eitScheduleFlag;
+/** The EIT present/following of the service is in the TS. */
+            bool eitPresentFollowingFlag;
+/** 3-bit Running status. */
+            uint8_t runningStatus;
+/** Some of the streams of the service are scrambled. */
+            bool freeCaMode;
+/** Descriptors of the service. */
+            PsiDescriptor descriptor;
+        };
+/**
+ *  \brief  The services of a SDT section.
+ */
+        typedef std::vector<ServiceInfo> ServiceList;
+
+    private:
+        uint16_t originalNetworkId;
+        ServiceList serviceList;
+
+    public:
+        SdtSection();
+        ~SdtSection();
+
+/**
+ *  \brief  Parse a whole SDT section.
+ *  \param  section Start of the section, at the table_id.
+ *  \param  size Size of the data available, at least the size of the
+ *          section.
+ *  \return true if the section is a valid SDT section, false otherwise.
+ */
+        bool parse(uint8_t* section, uint16_t size);
+
+/**
+ *  \brief  Get the Transport Stream ID the SDT describes.
+ *  \return 16-bit Transport Stream ID.
+ */
+        uint16_t getTransportStreamId();
+/**
+ *  \brief  Get the Original Network ID the SDT describes.
+ *  \return 16-bit Original Network ID.
+ */
+        uint16_t getOriginalNetworkId();
+/**
+ *  \brief  Get the services of the section.
+ *  \return Services of the section.
+ */
+        const ServiceList& getServiceList();
+};
+
+/**
+ *  \brief  Represents an EIT section.
+ *
+ *  EitSection parses a section of the EIT present/following or schedule,
+ *  of the actual or of another TS.
+ */
+class EitSection : public SiSection
+{
+    public:
+/**
+ *  \brief  Information about an event of the EIT.
+ */
+        struct EventInfo
+        {
+/** Event ID, unique within the service. */
+            uint16_t eventId;
+/** Start time in seconds since 1970-01-01 00:00:00 UTC, (uint64_t) - 1 if
+ *  undefined. */
+            uint64_t startTime;
+/** Duration in seconds. */
+            uint32_t duration;
+/** 3-bit Running status. */
+            uint8_t runningStatus;
+/** Some of the streams of the event are scrambled. */
+            bool freeCaMode;
+/** Descriptors of the event. */
+            PsiDescriptor descriptor;
+        };
+/**
+ *  \brief  The events of an EIT section.
+ */
+        typedef std::vector<EventInfo> EventList;
+
+    private:
+        uint16_t transportStreamId;
+        uint16_t originalNetworkId;
+        uint8_t segmentLastSectionNumber;
+        uint8_t lastTableId;
+        EventList eventList;
+
+    public:
+        EitSection();
+        ~EitSection();
+
+/**
+ *  \brief  Parse a whole EIT section.
+ *  \param  section Start of the section, at the table_id.
+ *  \param  size Size of the data available, at least the size of the
+ *          section.
+ *  \return true if the section is a valid EIT section, false otherwise.
+ */
+        bool parse(uint8_t* section, uint16_t size);
+
+/**
+ *  \brief  Get the Service ID the EIT describes.
+ *  \return 16-bit Service ID.
+ */
+        uint16_t getServiceId();
+/**
+ *  \brief  Get the Transport Stream ID of the service.
+ *  \return 16-bit Transport Stream ID.
+ */
+        uint16_t getTransportStreamId();
+/**
+ *  \brief  Get the Original Network ID of the service.
+ *  \return 16-bit Original Network ID.
+ */
+        uint16_t getOriginalNetworkId();
+/**
+ *  \brief  Get the number of the last section of the segment of the
+ *          section.
+ *  \return 8-bit Segment last section number.
+ */
+        uint8_t getSegmentLastSectionNumber();
+/**
+ *  \brief  Get the last Table ID used by the EIT of the service.
+ *  \return 8-bit Last table ID.
+ */
+        uint8_t getLastTableId();
+/**
+ *  \brief  Get the events of the section.
+ *  \return Events of the section.
+ */
+        const EventList& getEventList();
+};
+
+/**
+ *  \brief  Represents the TDT.
+ */
+class TdtSection
+{
+    private:
+        uint64_t utcTime;
+
+    public:
+        TdtSection();
+        ~TdtSection();
+
+/**
+ *  \brief  Parse a TDT section.
+ *  \param  section Start of the section, at the table_id.
+ *  \param  size Size of the data available.
+ *  \return true if the section is a valid TDT section, false otherwise.
+ */
+        bool parse(const uint8_t* section, uint16_t size);
+/**
+ *  \brief  Get the current UTC time carried in the TDT.
+ *  \return Seconds since 1970-01-01 00:00:00 UTC.
+ */
+        uint64_t getUtcTime();
+};
+
+/**
+ *  \brief  Represents the TOT.
+ */
+class TotSection
+{
+    private:
+        uint64_t utcTime;
+        PsiDescriptor descriptor;
+
+    public:
+        TotSection();
+        ~TotSection();
+
+/**
+ *  \brief  Parse a TOT section. The CRC_32 is verified, as the TOT uses the
+ *          short header which SectionAssembler does not check.
+ *  \param  section Start of the section, at the table_id.
+ *  \param  size Size of the data available.
+ *  \return true if the section is a valid TOT section, false otherwise.
+ */
+        bool parse(uint8_t* section, uint16_t size);
+/**
+ *  \brief  Get the current UTC time carried in the TOT.
+ *  \return Seconds since 1970-01-01 00:00:00 UTC.
+ */
+        uint64_t getUtcTime();
+/**
+ *  \brief  Get the descriptors of the TOT, typically the local time offset
+ *          descriptors.
+ *  \return Descriptors of the TOT.
+ */
+        const PsiDescriptor& getDescriptor();
+};
+
+inline uint8_t SiSection::getTableId()
+{
+    return tableId;
+}
+
+inline uint16_t SiSection::getTableIdExtension()
+{
+    return tableIdExtension;
+}
+
+inline uint8_t SiSection::getVersionNumber()
+{
+    return versionNumber;
+}
+
+inline bool SiSection::getCurrentNextIndicator()
+{
+    return currentNextIndicator;
+}
+
+inline uint8_t SiSection::getSectionNumber()
+{
+    return sectionNumber;
+}
+
+inline uint8_t SiSection::getLastSectionNumber()
+{
+    return lastSectionNumber;
+}
+
+inline uint16_t SdtSection::getTransportStreamId()
+{
+    return tableIdExtension;
+}
+
+inline uint16_t SdtSection::getOriginalNetworkId()
+{
+    return originalNetworkId;
+}
+
+inline const SdtSection::ServiceList& SdtSection::getServiceList()
+{
+    return serviceList;
+}
+
+inline uint16_t EitSection::getServiceId()
+{
+    return tableIdExtension;
+}
+
+inline uint16_t EitSection::getTransportStreamId()
+{
+    return transportStreamId;
+}
+
+inline uint16_t EitSection::getOriginalNetworkId()
+{
+    return originalNetworkId;
+}
+
+inline uint8_t EitSection::getSegmentLastSectionNumber()
+{
+    return segmentLastSectionNumber;
+}
+
+inline uint8_t EitSection::getLastTableId()
+{
+    return lastTableId;
+}
+
+inline const EitSection::EventList& EitSection::getEventList()
+{
+    return eventList;
+}
+
+inline uint64_t TdtSection::getUtcTime()
+{
+    return utcTime;
+}
+
+inline uint64_t TotSection::getUtcTime()
+{
+    return utcTime;
+}
+
+inline const PsiDescriptor& TotSection::getDescriptor()
+{
+    return descriptor;
+}
+
+#endif
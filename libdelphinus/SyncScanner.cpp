@@ -0,0 +1,287 @@
+/*
+ *  SyncScanner.cpp - Locates the TS packet boundaries in a buffer using the
+ *  sync bytes
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "SyncScanner.h"
+#include "Ts.h"
+#include <cassert>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SYNC_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_SYNC_SCANNER 7
+#define CURRENT_MODULE MODULE_SYNC_SCANNER
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define GET_LESS(x, y) ((x) < (y) ? (x) : (y))
+
+// Number of words of the bitmap built at a time, 4 KB of data
+#define BITMAP_BLOCK_WORDS 64
+
+static const uint8_t supportedPacketSizes[] =
+{
+    PACKET_SIZE_TS,
+    PACKET_SIZE_TTS,
+    PACKET_SIZE_RS
+};
+
+uint64_t getSyncWord(const uint8_t* data);
+void buildWordsScalar(const uint8_t* data, uint64_t words, uint64_t* bitmap);
+#ifdef SYNC_SCANNER_X86
+void buildWordsSse2(const uint8_t* data, uint64_t words, uint64_t* bitmap);
+void buildWordsAvx2(const uint8_t* data, uint64_t words, uint64_t* bitmap);
+#endif
+
+uint64_t getSyncWord(const uint8_t* data)
+{
+    uint64_t word = 0;
+    for (uint8_t ix = 0; ix < 64; ++ix)
+    {
+        word |= (uint64_t)(data[ix] == TS_SYNC_BYTE) << ix;
+    }
+    return word;
+}
+
+void buildWordsScalar(const uint8_t* data, uint64_t words, uint64_t* bitmap)
+{
+    for (uint64_t ix = 0; ix < words; ++ix)
+    {
+        bitmap[ix] = getSyncWord(data);
+        data += 64;
+    }
+}
+
+#ifdef SYNC_SCANNER_X86
+__attribute__((target("sse2")))
+void buildWordsSse2(const uint8_t* data, uint64_t words, uint64_t* bitmap)
+{
+    const __m128i sync = _mm_set1_epi8(TS_SYNC_BYTE);
+    for (uint64_t ix = 0; ix < words; ++ix)
+    {
+        uint64_t word = 0;
+        for (uint8_t part = 0; part < 4; ++part)
+        {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(data + part * 16));
+            word |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, sync)) << (part * 16);
+        }
+        bitmap[ix] = word;
+        data += 64;
+    }
+}
+
+__attribute__((target("avx2")))
+void buildWordsAvx2(const uint8_t* data, uint64_t words, uint64_t* bitmap)
+{
+    const __m256i sync = _mm256_set1_epi8(TS_SYNC_BYTE);
+    for (uint64_t ix = 0; ix < words; ++ix)
+    {
+        __m256i low = _mm256_loadu_si256((const __m256i*)data);
+        __m256i high = _mm256_loadu_si256((const __m256i*)(data + 32));
+        uint32_t lowMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(low, sync));
+        uint32_t highMask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(high, sync));
+        bitmap[ix] = ((uint64_t)highMask << 32) | lowMask;
+        data += 64;
+    }
+}
+#endif
+
+SyncScanner::SyncScanner()
+    :   builtWords(0),
+        buildWords(buildWordsScalar)
+{
+#ifdef SYNC_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        buildWords = buildWordsAvx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        buildWords = buildWordsSse2;
+    }
+#endif
+}
+
+SyncScanner::~SyncScanner()
+{
+}
+
+void SyncScanner::buildBitmap(const uint8_t* data, uint64_t size, uint64_t lastWord)
+{
+    uint64_t fullWords = size / 64;
+    while (builtWords <= lastWord && builtWords < fullWords)
+    {
+        uint64_t words = fullWords - builtWords;
+        if (words > BITMAP_BLOCK_WORDS)
+        {
+            words = BITMAP_BLOCK_WORDS;
+        }
+        buildWords(data + builtWords * 64, words, &bitmap[builtWords]);
+        builtWords += words;
+    }
+    if (builtWords <= lastWord && builtWords == fullWords && size % 64)
+    {
+        // Partial word at the end of the data
+        uint64_t word = 0;
+        for (uint64_t ix = fullWords * 64; ix < size; ++ix)
+        {
+            word |= (uint64_t)(data[ix] == TS_SYNC_BYTE) << (ix % 64);
+        }
+        bitmap[builtWords++] = word;
+    }
+}
+
+inline uint64_t SyncScanner::getBits(uint64_t position)
+{
+    // 64 bits of the bitmap starting at any bit position, the bitmap has a
+    // zero word past the end of the data for the last partial read
+    uint64_t word = position / 64;
+    uint8_t shift = position % 64;
+    if (shift == 0)
+    {
+        return bitmap[word];
+    }
+    return (bitmap[word] >> shift) | (bitmap[word + 1] << (64 - shift));
+}
+
+bool SyncScanner::scan(const uint8_t* data, uint64_t size, uint8_t lockPackets,
+                       const uint8_t* packetSizes, uint8_t sizeCount,
+                       uint64_t& packetOffset, uint8_t& packetSize)
+{
+    assert(lockPackets > 0);
+    uint64_t words = (size + 63) / 64;
+    // Two zero words past the end, so that the reads of the bits of the
+    // positions beyond the data never go out of the bitmap
+    bitmap.resize(words + 2);
+    bitmap[words] = 0;
+    bitmap[words + 1] = 0;
+    builtWords = 0;
+
+    // Last position of the first sync byte which leaves room for all the
+    // packets needed for the lock, for each of the packet sizes
+    uint64_t lastSync[sizeof(supportedPacketSizes)];
+    bool isPossible[sizeof(supportedPacketSizes)];
+    for (uint8_t ix = 0; ix < sizeCount; ++ix)
+    {
+        uint64_t lockSize = (uint64_t)lockPackets * packetSizes[ix];
+        uint8_t syncOffset = getSyncOffset(packetSizes[ix]);
+        isPossible[ix] = (size + syncOffset >= lockSize);
+        lastSync[ix] = isPossible[ix] ? size + syncOffset - lockSize : 0;
+    }
+
+    for (uint64_t word = 0; word < words; ++word)
+    {
+        uint64_t firstPosition = word * 64;
+        uint64_t bestOffset = (uint64_t) - 1;
+        bool isChecked = false;
+        for (uint8_t ix = 0; ix < sizeCount; ++ix)
+        {
+            if (!isPossible[ix] || firstPosition > lastSync[ix])
+            {
+                continue;
+            }
+            isChecked = true;
+            uint64_t stride = packetSizes[ix];
+            uint64_t lastWord = (firstPosition + (lockPackets - 1) * stride + 63) / 64;
+            buildBitmap(data, size, GET_LESS(lastWord, words - 1));
+
+            // Bit n of candidates stays set only if every packet of the lock
+            // starting at firstPosition + n has its sync byte
+            uint64_t candidates = (uint64_t) - 1;
+            for (uint8_t packet = 0; packet < lockPackets && candidates; ++packet)
+            {
+                candidates &= getBits(firstPosition + packet * stride);
+            }
+            uint8_t syncOffset = getSyncOffset(packetSizes[ix]);
+            if (firstPosition < syncOffset)
+            {
+                // The packet would start before the data
+                candidates &= (uint64_t) - 1 << (syncOffset - firstPosition);
+            }
+            if (lastSync[ix] - firstPosition < 63)
+            {
+                candidates &= ((uint64_t)1 << (lastSync[ix] - firstPosition + 1)) - 1;
+            }
+            if (candidates)
+            {
+                uint64_t offset = firstPosition + __builtin_ctzll(candidates) - syncOffset;
+                if (offset < bestOffset)
+                {
+                    bestOffset = offset;
+                    packetSize = packetSizes[ix];
+                }
+            }
+        }
+        if (bestOffset != (uint64_t) - 1)
+        {
+            MSG("Locked to %u bytes packets at offset: %" PRIu64, packetSize, bestOffset);
+            packetOffset = bestOffset;
+            return true;
+        }
+        if (!isChecked)
+        {
+            // No room left for a lock of any of the packet sizes
+            break;
+        }
+    }
+    return false;
+}
+
+bool SyncScanner::findLock(const uint8_t* data, uint64_t size, uint8_t lockPackets,
+                           uint8_t packetSize, uint64_t& packetOffset)
+{
+    uint8_t foundSize;
+    return scan(data, size, lockPackets, &packetSize, 1, packetOffset, foundSize);
+}
+
+bool SyncScanner::findLockWithSize(const uint8_t* data, uint64_t size, uint8_t lockPackets,
+                                   uint8_t& packetSize, uint64_t& packetOffset)
+{
+    return scan(data, size, lockPackets, supportedPacketSizes, sizeof(supportedPacketSizes),
+                packetOffset, packetSize);
+}
+
+uint64_t SyncScanner::findSyncLoss(const uint8_t* data, uint64_t size, uint8_t packetSize)
+{
+    // Only one byte per packet is touched, the loop is bound by the memory
+    // bandwidth already
+    uint64_t offset = 0;
+    const uint8_t* sync = data + getSyncOffset(packetSize);
+    while (offset + packetSize <= size && sync[offset] == TS_SYNC_BYTE)
+    {
+        offset += packetSize;
+    }
+    return offset;
+}
@@ -0,0 +1,139 @@
+/*
+ *  SyncScanner.h - Locates the TS packet boundaries in a buffer using the
+ *  sync bytes
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   SyncScanner.h
+ *  \brief  Sync byte based packet lock.
+ *
+ *  Defines SyncScanner which is used by TsFile and TsStream to find the
+ *  packet size and the first packet of a TS, and by TsStream to find where
+ *  the packets resume after a damaged region.
+ */
+
+#ifndef DELPHINUS_SYNC_SCANNER_H
+#define DELPHINUS_SYNC_SCANNER_H
+
+#include <vector>
+#include "common/DelphinusUtils.h"
+#include "MpegConstants.h"
+
+/**
+ *  \brief  Finds the packet boundaries of a TS from its sync bytes.
+ *
+ *  SyncScanner marks every 0x47 byte of a buffer in a bitmap, using SSE2 or
+ *  AVX2 when the CPU supports them, and then tests 64 candidate positions
+ *  at a time for sync bytes repeating at the stride of the 188, 192 and 204
+ *  bytes packets. A position is locked only when the sync bytes of a given
+ *  number of consecutive packets are all present, so stray 0x47 bytes in
+ *  garbage or in the payloads are not mistaken for packet boundaries.
+ */
+class SyncScanner
+{
+    public:
+/**
+ *  \brief  A range of bytes of the TS which is not part of any packet.
+ */
+        struct LostSyncRegion
+        {
+/** Offset of the first byte of the region. */
+            uint64_t start;
+/** Offset of the first packet following the region. */
+            uint64_t end;
+        };
+/**
+ *  \brief  A list of lost sync regions, in increasing order of offsets.
+ */
+        typedef std::vector<LostSyncRegion> LostSyncRegionList;
+
+    private:
+        typedef void (*BitmapFunction)(const uint8_t* data, uint64_t words, uint64_t* bitmap);
+
+        // One bit for every byte of the buffer being scanned, set for 0x47
+        std::vector<uint64_t> bitmap;
+        // Number of words of the bitmap built so far, built on demand so
+        // that an early lock does not pay for scanning the whole buffer
+        uint64_t builtWords;
+        BitmapFunction buildWords;
+
+        void buildBitmap(const uint8_t* data, uint64_t size, uint64_t lastWord);
+        uint64_t getBits(uint64_t position);
+        bool scan(const uint8_t* data, uint64_t size, uint8_t lockPackets,
+                  const uint8_t* packetSizes, uint8_t sizeCount,
+                  uint64_t& packetOffset, uint8_t& packetSize);
+
+    public:
+        SyncScanner();
+        ~SyncScanner();
+
+/**
+ *  \brief  Find the first packet of a known packet size, followed by
+ *          enough packets to confirm the lock.
+ *  \param  data Data to be scanned.
+ *  \param  size Size of the data in bytes.
+ *  \param  lockPackets Number of consecutive packets, all of which must be
+ *          complete within the data and carry the sync byte.
+ *  \param  packetSize Size of the packets.
+ *  \param  packetOffset Set to the offset of the first packet within the
+ *          data.
+ *  \return true if the packets were locked, false otherwise.
+ */
+        bool findLock(const uint8_t* data, uint64_t size, uint8_t lockPackets,
+                      uint8_t packetSize, uint64_t& packetOffset);
+/**
+ *  \brief  Find the first packet of any of the supported packet sizes,
+ *          followed by enough packets to confirm the lock, along with the
+ *          packet size.
+ *  \param  data Data to be scanned.
+ *  \param  size Size of the data in bytes.
+ *  \param  lockPackets Number of consecutive packets, all of which must be
+ *          complete within the data and carry the sync byte.
+ *  \param  packetSize Set to the size of the packets locked to.
+ *  \param  packetOffset Set to the offset of the first packet within the
+ *          data.
+ *  \return true if the packets were locked, false otherwise.
+ */
+        bool findLockWithSize(const uint8_t* data, uint64_t size, uint8_t lockPackets,
+                              uint8_t& packetSize, uint64_t& packetOffset);
+/**
+ *  \brief  Check the sync bytes of the packets following a lock.
+ *  \param  data Data starting at a packet.
+ *  \param  size Size of the data in bytes.
+ *  \param  packetSize Size of the packets.
+ *  \return Offset of the first packet missing the sync byte, or of the
+ *          first incomplete packet if none of them is missing it.
+ */
+        static uint64_t findSyncLoss(const uint8_t* data, uint64_t size, uint8_t packetSize);
+/**
+ *  \brief  Get the offset of the sync byte within a packet.
+ *  \param  packetSize Size of the packets.
+ *  \return 4 for the TTS packets, 0 otherwise.
+ */
+        static uint8_t getSyncOffset(uint8_t packetSize);
+};
+
+inline uint8_t SyncScanner::getSyncOffset(uint8_t packetSize)
+{
+    return (packetSize == MpegConstants::PACKET_SIZE_TTS) ? 4 : 0;
+}
+
+#endif
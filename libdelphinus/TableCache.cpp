@@ -0,0 +1,153 @@
+/*
+ *  TableCache.cpp - Keeps the latest version of the tables carried in the
+ *  sections of a TS
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TableCache.h"
+#include "PsiTables.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace MpegConstants;
+using namespace DelphinusUtils;
+
+//#define DEBUG
+
+#define MODULE_TABLE_CACHE 11
+#define CURRENT_MODULE MODULE_TABLE_CACHE
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+TableCache::TableCache()
+    :   repeatedSections(0)
+{
+}
+
+TableCache::~TableCache()
+{
+}
+
+void TableCache::clear()
+{
+    tables.clear();
+}
+
+void TableCache::erasePid(uint16_t pid)
+{
+    tables.erase(tables.lower_bound(getKey(pid, 0, 0)), tables.upper_bound(getKey(pid, 0xFF, 0xFFFF)));
+}
+
+TableCache::SectionResult TableCache::pushSection(uint16_t pid, const uint8_t* section, uint16_t size,
+                                                  uint64_t packetNumber)
+{
+    const ByteField* header = (const ByteField*)section;
+    if (size < SECTION_SIZE_LONG_MIN || PSI_GET_SSI(header) == 0 || PSI_GET_CURR_NEXT(header) == 0)
+    {
+        return SECTION_IGNORED;
+    }
+    uint8_t tableId = PSI_GET_TABLE_ID(header);
+    uint16_t tableIdExtension = PSI_GET_TABLE_ID_EXTN(header);
+    uint8_t versionNumber = PSI_GET_VERSION(header);
+    uint8_t sectionNumber = PSI_GET_SECTION_NUMBER(header);
+    uint8_t lastSectionNumber = PSI_GET_LAST_SECTION_NUMBER(header);
+    if (sectionNumber > lastSectionNumber)
+    {
+        return SECTION_IGNORED;
+    }
+
+    Table& table = tables[getKey(pid, tableId, tableIdExtension)];
+    bool isNewVersion = true;
+    if (!table.sections.empty() && table.versionNumber == versionNumber &&
+        table.lastSectionNumber == lastSectionNumber)
+    {
+        isNewVersion = false;
+        const std::vector<uint8_t>& cached = table.sections[sectionNumber];
+        if (!cached.empty())
+        {
+            // The CRC_32 stands for the whole section
+            if (cached.size() == size && memcmp(&cached[size - 4], section + size - 4, 4) == 0)
+            {
+                ++repeatedSections;
+                return SECTION_REPEATED;
+            }
+            MSG("PID: 0x%04x table_id: 0x%02x changed without a new version", pid, tableId);
+            isNewVersion = true;
+        }
+    }
+
+    if (isNewVersion)
+    {
+        MSG("PID: 0x%04x table_id: 0x%02x extension: 0x%04x version: %u",
+            pid, tableId, tableIdExtension, versionNumber);
+        table.pid = pid;
+        table.tableId = tableId;
+        table.tableIdExtension = tableIdExtension;
+        table.versionNumber = versionNumber;
+        table.lastSectionNumber = lastSectionNumber;
+        table.sectionCount = 0;
+        table.firstPacketNumber = packetNumber;
+        // The sections of the earlier version keep their memory for the
+        // sections of this one
+        for (std::vector<std::vector<uint8_t> >::iterator ix = table.sections.begin();
+             ix != table.sections.end(); ++ix)
+        {
+            ix->clear();
+        }
+        table.sections.resize(lastSectionNumber + 1);
+    }
+    table.sections[sectionNumber].assign(section, section + size);
+    table.packetNumber = packetNumber;
+    if (++table.sectionCount <= lastSectionNumber)
+    {
+        return SECTION_ADDED;
+    }
+
+    // A listener may remove itself while being called
+    std::vector<Listener*> currentListeners(listeners);
+    for (std::vector<Listener*>::iterator ix = currentListeners.begin();
+         ix != currentListeners.end(); ++ix)
+    {
+        (*ix)->onTableUpdated(table);
+    }
+    return TABLE_UPDATED;
+}
+
+const TableCache::Table* TableCache::getTable(uint16_t pid, uint8_t tableId, uint16_t tableIdExtension)
+{
+    TableMap::const_iterator table = tables.find(getKey(pid, tableId, tableIdExtension));
+    return (table == tables.end()) ? NULL : &table->second;
+}
+
+void TableCache::addListener(Listener* listener)
+{
+    listeners.push_back(listener);
+}
+
+void TableCache::removeListener(Listener* listener)
+{
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), listener), listeners.end());
+}
@@ -0,0 +1,190 @@
+/*
+ *  TableCache.h - Keeps the latest version of the tables carried in the
+ *  sections of a TS
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   TableCache.h
+ *  \brief  Version tracking of the tables.
+ *
+ *  Defines TableCache which is used by TsMetadata to tell the new versions
+ *  of the PAT and the PMTs from their repetitions.
+ */
+
+#ifndef DELPHINUS_TABLE_CACHE_H
+#define DELPHINUS_TABLE_CACHE_H
+
+#include <map>
+#include <vector>
+#include "common/DelphinusUtils.h"
+#include "MpegConstants.h"
+
+/**
+ *  \brief  Caches the sections of the tables and reports their changes.
+ *
+ *  The tables are identified by the PID, the table_id and the
+ *  table_id_extension of their sections. A section is compared with the
+ *  cached one using the version_number, the section_number and the
+ *  last_section_number, and its CRC_32 which catches the multiplexers
+ *  changing a table without changing its version, so the repetitions of an
+ *  unchanged table are skipped without being copied or parsed. Once every
+ *  section of a new version has been received the listeners are told about
+ *  the table. Only the sections with the long header and the
+ *  current_next_indicator set are cached.
+ */
+class TableCache
+{
+    public:
+/**
+ *  \brief  The sections of a version of a table.
+ */
+        struct Table
+        {
+/** PID carrying the table. */
+            uint16_t pid;
+/** Table ID of the sections. */
+            uint8_t tableId;
+/** Table ID Extension of the sections. */
+            uint16_t tableIdExtension;
+/** Version number of the sections. */
+            uint8_t versionNumber;
+/** Section number of the last section of the table. */
+            uint8_t lastSectionNumber;
+/** Number of the sections received so far. */
+            uint16_t sectionCount;
+/** Packet number(starts at 0) in the TS where the first section received of
+ *  this version started. */
+            uint64_t firstPacketNumber;
+/** Packet number(starts at 0) in the TS where the last section received
+ *  started. */
+            uint64_t packetNumber;
+/** The whole sections including the header and the CRC_32, indexed by the
+ *  section number, empty for the sections not received yet. */
+            std::vector< std::vector<uint8_t> > sections;
+        };
+
+/**
+ *  \brief  Receives the new versions of the tables.
+ */
+        class Listener
+        {
+            public:
+                virtual ~Listener() {}
+/**
+ *  \brief  Called once all the sections of a new version of a table have
+ *          been received.
+ *          \warning The table is only valid during the call.
+ *  \param  table The complete table.
+ */
+                virtual void onTableUpdated(const Table& table) = 0;
+        };
+
+/**
+ *  \brief  Results of pushSection().
+ */
+        enum SectionResult
+        {
+/** Not cached, the section is too short, uses the short header or has the
+ *  current_next_indicator cleared. */
+            SECTION_IGNORED,
+/** A repetition of a section already cached. */
+            SECTION_REPEATED,
+/** A new section cached, the table is still missing sections. */
+            SECTION_ADDED,
+/** The section completed a new version of the table. */
+            TABLE_UPDATED
+        };
+
+    private:
+        // PID in the bits 24-39, table_id in 16-23, table_id_extension in
+        // the low 16 bits
+        typedef std::map<uint64_t, Table> TableMap;
+
+        TableMap tables;
+        std::vector<Listener*> listeners;
+        uint64_t repeatedSections;
+
+        static uint64_t getKey(uint16_t pid, uint8_t tableId, uint16_t tableIdExtension);
+
+    public:
+        TableCache();
+        ~TableCache();
+
+/**
+ *  \brief  Forget all the tables cached. The listeners are kept.
+ */
+        void clear();
+/**
+ *  \brief  Forget the tables carried in a PID, so that the next version
+ *          received is reported even if it is the same as the cached one.
+ *  \param  pid PID of the tables.
+ */
+        void erasePid(uint16_t pid);
+/**
+ *  \brief  Cache a section and report the table if the section completed
+ *          a new version of it.
+ *  \param  pid PID carrying the section.
+ *  \param  section Start of the section, at the table_id.
+ *  \param  size Size of the whole section in bytes, including the CRC_32.
+ *          The CRC_32 itself is expected to be verified already.
+ *  \param  packetNumber Packet number(starts at 0) of the packet the
+ *          section started in.
+ *  \return What was done with the section.
+ */
+        SectionResult pushSection(uint16_t pid, const uint8_t* section, uint16_t size,
+                                  uint64_t packetNumber);
+/**
+ *  \brief  Get the latest version of a table.
+ *  \param  pid PID carrying the table.
+ *  \param  tableId Table ID of the sections.
+ *  \param  tableIdExtension Table ID Extension of the sections.
+ *  \return The table, which may still be missing sections, NULL if none of
+ *          its sections was received.
+ */
+        const Table* getTable(uint16_t pid, uint8_t tableId, uint16_t tableIdExtension);
+/**
+ *  \brief  Register a listener for the new versions of the tables.
+ *  \param  listener The listener, which must stay valid till it is removed.
+ */
+        void addListener(Listener* listener);
+/**
+ *  \brief  Unregister a listener.
+ *  \param  listener The listener passed to addListener().
+ */
+        void removeListener(Listener* listener);
+/**
+ *  \brief  Get the number of sections skipped as repetitions.
+ *  \return Number of repeated sections since the creation.
+ */
+        uint64_t getRepeatedSectionCount();
+};
+
+inline uint64_t TableCache::getKey(uint16_t pid, uint8_t tableId, uint16_t tableIdExtension)
+{
+    return ((uint64_t)pid << 24) | ((uint64_t)tableId << 16) | tableIdExtension;
+}
+
+inline uint64_t TableCache::getRepeatedSectionCount()
+{
+    return repeatedSections;
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ *  TimestampRecorder.cpp - Recording of the PTS and the DTS of the PES of
+ *  every PID
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TimestampRecorder.h"
+#include <cstddef>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_TIMESTAMP_RECORDER 18
+#define CURRENT_MODULE MODULE_TIMESTAMP_RECORDER
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+TimestampRecorder::TimestampRecorder()
+    :   records(PID_NULL + 1, NULL),
+        invalidHeaders(0)
+{
+}
+
+TimestampRecorder::~TimestampRecorder()
+{
+    clear();
+}
+
+bool TimestampRecorder::pushPacket(TsPacket* tsPacket, uint64_t packetNumber)
+{
+    if (!tsPacket->getPayloadUnitStartIndicator() || !tsPacket->hasPayload() ||
+        tsPacket->getTransportErrorIndicator() || tsPacket->getTransportScramblingControl() ||
+        tsPacket->getPayloadOffset() >= tsPacket->getPacketSize())
+    {
+        return false;
+    }
+    const uint8_t* payload = tsPacket->getPayload();
+    uint8_t payloadSize = tsPacket->getPayloadSize();
+    // The sections start with the pointer_field and the table_id, and the
+    // byte after them has its reserved bits set, so they never look like the
+    // start code prefix
+    if (payloadSize < 3 || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01)
+    {
+        return false;
+    }
+
+    Timestamp timestamp;
+    if (!PesHeader::getTimestamps(payload, payloadSize, timestamp.pts, timestamp.dts))
+    {
+        MSG("Invalid PES header in packet %" PRIu64, packetNumber);
+        ++invalidHeaders;
+        return false;
+    }
+    if (timestamp.pts == (uint64_t) - 1)
+    {
+        return false;
+    }
+    timestamp.packetNumber = packetNumber;
+
+    uint16_t pid = tsPacket->getPid();
+    PidRecord*& record = records[pid];
+    if (record == NULL)
+    {
+        MSG("First timestamp of PID 0x%04x in packet %" PRIu64, pid, packetNumber);
+        record = new PidRecord();
+        pids.push_back(pid);
+    }
+    record->timestamps.push_back(timestamp);
+    record->last = timestamp;
+    return true;
+}
+
+const TimestampRecorder::TimestampList& TimestampRecorder::getTimestamps(uint16_t pid)
+{
+    if (pid > PID_NULL || records[pid] == NULL)
+    {
+        return noTimestamps;
+    }
+    return records[pid]->timestamps;
+}
+
+bool TimestampRecorder::getLastTimestamp(uint16_t pid, Timestamp& timestamp)
+{
+    if (pid > PID_NULL || records[pid] == NULL)
+    {
+        return false;
+    }
+    timestamp = records[pid]->last;
+    return true;
+}
+
+void TimestampRecorder::clearTimestamps()
+{
+    for (std::vector<uint16_t>::iterator ix = pids.begin(); ix != pids.end(); ++ix)
+    {
+        records[*ix]->timestamps.clear();
+    }
+}
+
+void TimestampRecorder::clear()
+{
+    for (std::vector<uint16_t>::iterator ix = pids.begin(); ix != pids.end(); ++ix)
+    {
+        delete records[*ix];
+        records[*ix] = NULL;
+    }
+    pids.clear();
+}
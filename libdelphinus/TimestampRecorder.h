@@ -0,0 +1,141 @@
+/*
+ *  TimestampRecorder.h - Recording of the PTS and the DTS of the PES of
+ *  every PID
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   TimestampRecorder.h
+ *  \brief  Recording of the timestamps of the PES.
+ *
+ *  Defines TimestampRecorder which records the PTS and the DTS of every PES
+ *  of every PID of a TS.
+ */
+
+#ifndef DELPHINUS_TIMESTAMP_RECORDER_H
+#define DELPHINUS_TIMESTAMP_RECORDER_H
+
+#include <vector>
+#include "Ts.h"
+#include "Pes.h"
+
+/**
+ *  \brief  Records the PTS and the DTS of the PES of every PID.
+ *
+ *  The packets of all the PIDs are pushed with pushPacket(). The timestamps
+ *  are decoded straight from the packets starting a PES, without assembling
+ *  the PES, so the packets continuing a PES cost no more than the lookup of
+ *  their PID. The timestamps recorded are kept per PID in the order of the
+ *  packets, to be read with getTimestamps() and then dropped with
+ *  clearTimestamps() as the stream goes on, which keeps the memory of the
+ *  lists for the next timestamps.
+ */
+class TimestampRecorder
+{
+    public:
+/**
+ *  \brief  The timestamps of a PES.
+ */
+        struct Timestamp
+        {
+/** Packet number(starts at 0) of the packet starting the PES. */
+            uint64_t packetNumber;
+/** 33-bit PTS in 90 kHz units. */
+            uint64_t pts;
+/** 33-bit DTS in 90 kHz units, (uint64_t) - 1 if the PES has no DTS. */
+            uint64_t dts;
+        };
+        typedef std::vector<Timestamp> TimestampList;
+
+    private:
+        struct PidRecord
+        {
+            TimestampList timestamps;
+            Timestamp last;
+        };
+
+        // Indexed by the PID, NULL for the PIDs without timestamps yet
+        std::vector<PidRecord*> records;
+        std::vector<uint16_t> pids;
+        uint64_t invalidHeaders;
+        TimestampList noTimestamps;
+
+        // Not copyable, the records of the PIDs are owned
+        TimestampRecorder(const TimestampRecorder& recorder);
+        TimestampRecorder& operator=(const TimestampRecorder& recorder);
+
+    public:
+        TimestampRecorder();
+        ~TimestampRecorder();
+
+/**
+ *  \brief  Push the next packet of the TS.
+ *  \param  tsPacket A valid TS packet.
+ *  \param  packetNumber Packet number(starts at 0) of the packet in the TS.
+ *  \return true if the packet starts a PES with a PTS, false otherwise.
+ */
+        bool pushPacket(TsPacket* tsPacket, uint64_t packetNumber);
+/**
+ *  \brief  Get the PIDs whose PES have carried timestamps.
+ *  \return The PIDs in the order their first timestamp was recorded.
+ */
+        const std::vector<uint16_t>& getPids();
+/**
+ *  \brief  Get the timestamps of a PID recorded since the last call to
+ *          clearTimestamps().
+ *  \param  pid The PID.
+ *  \return The timestamps in the order of the packets.
+ */
+        const TimestampList& getTimestamps(uint16_t pid);
+/**
+ *  \brief  Get the last timestamps recorded for a PID, which are kept by
+ *          clearTimestamps().
+ *  \param  pid The PID.
+ *  \param  timestamp Set to the last timestamps.
+ *  \return true if the PID has timestamps, false otherwise.
+ */
+        bool getLastTimestamp(uint16_t pid, Timestamp& timestamp);
+/**
+ *  \brief  Drop the timestamps read with getTimestamps().
+ */
+        void clearTimestamps();
+/**
+ *  \brief  Forget all the PIDs and their timestamps.
+ */
+        void clear();
+/**
+ *  \brief  Get the number of packets starting a PES whose header was
+ *          invalid or did not fit in the packet.
+ *  \return Number of headers skipped since the creation.
+ */
+        uint64_t getInvalidHeaderCount();
+};
+
+inline const std::vector<uint16_t>& TimestampRecorder::getPids()
+{
+    return pids;
+}
+
+inline uint64_t TimestampRecorder::getInvalidHeaderCount()
+{
+    return invalidHeaders;
+}
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ *  TrickPlayWriter.cpp - Writing of the I-frame only trick play TS of a program
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TrickPlayWriter.h"
+#include "SyncScanner.h"
+#include "Crc32.h"
+#include <cstddef>
+#include <cstring>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_TRICK_PLAY_WRITER 22
+#define CURRENT_MODULE MODULE_TRICK_PLAY_WRITER
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define GET_LESS(x, y) ((x) < (y) ? (x) : (y))
+
+#define TS_HEADER_SIZE                  4
+#define TS_PUSI_FLAG                    0x40
+#define TS_PAYLOAD_FLAG                 0x10
+#define TS_ADAPTATION_FIELD_FLAG        0x20
+#define PSI_CRC_SIZE                    4
+
+void writeSectionPacket(uint8_t* packet, uint16_t pid, uint8_t* section, uint16_t size);
+
+void writeSectionPacket(uint8_t* packet, uint16_t pid, uint8_t* section, uint16_t size)
+{
+    uint32_t crc = Crc32::calculate(section, size);
+    section[size] = crc >> 24;
+    section[size + 1] = (crc >> 16) & 0xFF;
+    section[size + 2] = (crc >> 8) & 0xFF;
+    section[size + 3] = crc & 0xFF;
+
+    // The continuity counter is filled in when the packet is written
+    packet[0] = TS_SYNC_BYTE;
+    packet[1] = TS_PUSI_FLAG | (pid >> 8);
+    packet[2] = pid & 0xFF;
+    packet[3] = TS_PAYLOAD_FLAG;
+    // pointer_field
+    packet[4] = 0;
+    memcpy(packet + TS_HEADER_SIZE + 1, section, size + PSI_CRC_SIZE);
+    memset(packet + TS_HEADER_SIZE + 1 + size + PSI_CRC_SIZE, 0xFF,
+           PACKET_SIZE_TS - TS_HEADER_SIZE - 1 - size - PSI_CRC_SIZE);
+}
+
+TrickPlayWriter::TrickPlayWriter()
+    :   fileHandle(NULL),
+        patContinuityCounter(0),
+        pmtContinuityCounter(0),
+        videoContinuityCounter(0),
+        frames(0),
+        bytesRead(0),
+        bytesWritten(0)
+{
+    memset(patPacket, 0, sizeof(patPacket));
+    memset(pmtPacket, 0, sizeof(pmtPacket));
+}
+
+TrickPlayWriter::~TrickPlayWriter()
+{
+}
+
+void TrickPlayWriter::buildTables(uint16_t transportStreamId, const TsMetadata::PmtInfo& pmtInfo,
+                                  uint16_t videoPid, uint8_t streamType)
+{
+    uint8_t section[PACKET_SIZE_TS];
+    // Section header and a single program
+    uint16_t length = 5 + 4 + PSI_CRC_SIZE;
+    section[0] = TABLE_PAT;
+    section[1] = 0xB0 | (length >> 8);
+    section[2] = length & 0xFF;
+    section[3] = transportStreamId >> 8;
+    section[4] = transportStreamId & 0xFF;
+    // Version 0, current
+    section[5] = 0xC1;
+    section[6] = 0;
+    section[7] = 0;
+    section[8] = pmtInfo.programNumber >> 8;
+    section[9] = pmtInfo.programNumber & 0xFF;
+    section[10] = 0xE0 | (pmtInfo.pmtPid >> 8);
+    section[11] = pmtInfo.pmtPid & 0xFF;
+    writeSectionPacket(patPacket, PID_PAT, section, 12);
+
+    // The PCR of the program is kept only when the video carries it
+    uint16_t pcrPid = (pmtInfo.pcrPid == videoPid) ? videoPid : (uint16_t)PID_NULL;
+    length = 9 + 5 + PSI_CRC_SIZE;
+    section[0] = TABLE_PMT;
+    section[1] = 0xB0 | (length >> 8);
+    section[2] = length & 0xFF;
+    section[3] = pmtInfo.programNumber >> 8;
+    section[4] = pmtInfo.programNumber & 0xFF;
+    section[5] = 0xC1;
+    section[6] = 0;
+    section[7] = 0;
+    section[8] = 0xE0 | (pcrPid >> 8);
+    section[9] = pcrPid & 0xFF;
+    // No program info descriptors
+    section[10] = 0xF0;
+    section[11] = 0x00;
+    // The video stream, without its descriptors
+    section[12] = streamType;
+    section[13] = 0xE0 | (videoPid >> 8);
+    section[14] = videoPid & 0xFF;
+    section[15] = 0xF0;
+    section[16] = 0x00;
+    writeSectionPacket(pmtPacket, pmtInfo.pmtPid, section, 17);
+}
+
+void TrickPlayWriter::pushPacket(const uint8_t* packet, bool isFrameStart)
+{
+    if (isFrameStart && !((packet[3] & TS_ADAPTATION_FIELD_FLAG) && packet[4] > 0))
+    {
+        // The adaptation field cannot grow without moving the payload, so
+        // the discontinuity goes in a packet of its own, without a payload
+        // and so with the continuity counter of the previous packet
+        outputBuffer.resize(outputBuffer.size() + PACKET_SIZE_TS, 0xFF);
+        uint8_t* stuffing = &outputBuffer[outputBuffer.size() - PACKET_SIZE_TS];
+        stuffing[0] = TS_SYNC_BYTE;
+        stuffing[1] = packet[1] & 0x1F;
+        stuffing[2] = packet[2];
+        stuffing[3] = TS_ADAPTATION_FIELD_FLAG | ((videoContinuityCounter - 1) & TS_CC_MASK);
+        stuffing[4] = PACKET_SIZE_TS - TS_HEADER_SIZE - 1;
+        stuffing[5] = AF_DI_MASK;
+    }
+    outputBuffer.insert(outputBuffer.end(), packet, packet + PACKET_SIZE_TS);
+    uint8_t* copied = &outputBuffer[outputBuffer.size() - PACKET_SIZE_TS];
+    // The continuity counter only advances in the packets with a payload
+    if (copied[3] & TS_PAYLOAD_FLAG)
+    {
+        copied[3] = (copied[3] & ~TS_CC_MASK) | videoContinuityCounter;
+        videoContinuityCounter = (videoContinuityCounter + 1) & TS_CC_MASK;
+    }
+    else
+    {
+        copied[3] = (copied[3] & ~TS_CC_MASK) | ((videoContinuityCounter - 1) & TS_CC_MASK);
+    }
+    if (isFrameStart && (copied[3] & TS_ADAPTATION_FIELD_FLAG) && copied[4] > 0)
+    {
+        copied[5] |= AF_DI_MASK;
+    }
+}
+
+bool TrickPlayWriter::writeFrame(TsFile& tsFile, uint16_t videoPid, uint64_t packetNumber,
+                                 uint64_t endPacket)
+{
+    outputBuffer.clear();
+    patPacket[3] = (patPacket[3] & ~TS_CC_MASK) | patContinuityCounter;
+    pmtPacket[3] = (pmtPacket[3] & ~TS_CC_MASK) | pmtContinuityCounter;
+    patContinuityCounter = (patContinuityCounter + 1) & TS_CC_MASK;
+    pmtContinuityCounter = (pmtContinuityCounter + 1) & TS_CC_MASK;
+    outputBuffer.insert(outputBuffer.end(), patPacket, patPacket + PACKET_SIZE_TS);
+    outputBuffer.insert(outputBuffer.end(), pmtPacket, pmtPacket + PACKET_SIZE_TS);
+
+    uint8_t packetSize = tsFile.getPacketSize();
+    uint8_t headerOffset = SyncScanner::getSyncOffset(packetSize);
+    bool isInFrame = false;
+    bool isFrameEnded = false;
+    ContinuityChecker continuityChecker;
+    while (!isFrameEnded && packetNumber < endPacket)
+    {
+        uint32_t count = tsFile.readPackets(packetNumber,
+                                            GET_LESS(endPacket - packetNumber, (uint64_t)READ_PACKETS),
+                                            &readBuffer[0]);
+        if (count == 0)
+        {
+            break;
+        }
+        bytesRead += (uint64_t)count * packetSize;
+        packetNumber += count;
+        uint8_t* packet = &readBuffer[headerOffset];
+        for (uint32_t ix = 0; !isFrameEnded && ix < count; ++ix, packet += packetSize)
+        {
+            DelphinusUtils::ByteField* header = (DelphinusUtils::ByteField*)packet;
+            if (TS_GET_SYNC_BYTE(header) != TS_SYNC_BYTE || TS_GET_PID(header) != videoPid)
+            {
+                continue;
+            }
+            bool hasPayload = TS_GET_AFC(header) & 0x01;
+            if (TS_GET_PUSI(header) && hasPayload)
+            {
+                // The next PES of the video ends the frame
+                isFrameEnded = isInFrame;
+                isInFrame = !isInFrame;
+            }
+            if (!isInFrame)
+            {
+                continue;
+            }
+            if (continuityChecker.check(TS_GET_CC(header), hasPayload,
+                                        ContinuityChecker::hasDiscontinuity(packet)) ==
+                ContinuityChecker::CONTINUITY_DUPLICATE)
+            {
+                continue;
+            }
+            pushPacket(packet, outputBuffer.size() == 2 * PACKET_SIZE_TS);
+        }
+    }
+    if (outputBuffer.size() == 2 * PACKET_SIZE_TS)
+    {
+        return true;
+    }
+
+    ++frames;
+    if (fwrite(&outputBuffer[0], 1, outputBuffer.size(), fileHandle) != outputBuffer.size())
+    {
+        ERR("Unable to write the output");
+        return false;
+    }
+    bytesWritten += outputBuffer.size();
+    return true;
+}
+
+bool TrickPlayWriter::write(TsFile& tsFile, uint16_t programNumber, const char* fileName,
+                            uint32_t step)
+{
+    frames = 0;
+    bytesRead = 0;
+    bytesWritten = 0;
+    if (!tsFile.isValid())
+    {
+        return false;
+    }
+    if (!tsFile.hasRapIndex() && !tsFile.buildRapIndex())
+    {
+        ERR("No video to find the random access points of");
+        return false;
+    }
+    const RapIndex::RandomAccessPointList& points = tsFile.getRandomAccessPoints(programNumber);
+    const TsMetadata::PmtInfo* pmtInfo = NULL;
+    const TsFile::PmtInfoList& pmtInfoList = tsFile.getPmtInfoList();
+    for (TsFile::PmtInfoList::const_iterator ix = pmtInfoList.begin(); ix != pmtInfoList.end(); ++ix)
+    {
+        if (ix->programNumber == programNumber)
+        {
+            pmtInfo = &(*ix);
+            break;
+        }
+    }
+    if (points.empty() || pmtInfo == NULL)
+    {
+        ERR("No random access points in program %u", programNumber);
+        return false;
+    }
+    uint16_t videoPid = points.front().pid;
+    uint8_t streamType = 0;
+    for (PmtSection::StreamList::const_iterator ix = pmtInfo->streamList.begin();
+         ix != pmtInfo->streamList.end(); ++ix)
+    {
+        if (ix->pid == videoPid)
+        {
+            streamType = ix->streamType;
+            break;
+        }
+    }
+    buildTables(tsFile.getPatInfo().transportStreamId, *pmtInfo, videoPid, streamType);
+
+    fileHandle = (strcmp(fileName, "-") == 0) ? stdout : fopen(fileName, "wb");
+    if (fileHandle == NULL)
+    {
+        ERR("Unable to open the output file: %s", fileName);
+        return false;
+    }
+    readBuffer.resize(READ_PACKETS * tsFile.getPacketSize());
+    patContinuityCounter = 0;
+    pmtContinuityCounter = 0;
+    videoContinuityCounter = 0;
+    if (step == 0)
+    {
+        step = 1;
+    }
+
+    bool isWritten = true;
+    for (uint64_t ix = 0; isWritten && ix < points.size(); ix += step)
+    {
+        // A frame never runs into the next random access point
+        uint64_t endPacket = (ix + 1 < points.size()) ? points[ix + 1].packetNumber :
+                                                        tsFile.getPacketCount();
+        isWritten = writeFrame(tsFile, videoPid, points[ix].packetNumber, endPacket);
+    }
+    MSG("Wrote %" PRIu64 " frames, read %" PRIu64 " bytes", frames, bytesRead);
+
+    if (fileHandle == stdout)
+    {
+        isWritten = (fflush(fileHandle) == 0) && isWritten;
+    }
+    else
+    {
+        isWritten = (fclose(fileHandle) == 0) && isWritten;
+    }
+    fileHandle = NULL;
+    return isWritten;
+}
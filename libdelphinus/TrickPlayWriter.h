@@ -0,0 +1,137 @@
+/*
+ *  TrickPlayWriter.h - Writing of the I-frame only trick play TS of a program
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   TrickPlayWriter.h
+ *  \brief  Writing of the I-frame only TS of a program.
+ *
+ *  Defines TrickPlayWriter which writes a TS carrying only the key frames of
+ *  the video of a program, for the fast forward and rewind playback.
+ */
+
+#ifndef DELPHINUS_TRICK_PLAY_WRITER_H
+#define DELPHINUS_TRICK_PLAY_WRITER_H
+
+#include <cstdio>
+#include <vector>
+#include "TsFile.h"
+
+/**
+ *  \brief  Writes the key frames of the video of a program to a TS file.
+ *
+ *  The PES of the video starting at the random access points of the program
+ *  are copied, in 188 bytes packets, each of them preceded by a PAT and a
+ *  PMT listing the video only, so the output can be played from any frame.
+ *  The continuity counters of the packets are renumbered, and the
+ *  discontinuity_indicator is set in the adaptation field of the first
+ *  packet of each frame, as the PCR and the timestamps jump. A frame whose
+ *  first packet has no room for the flag is preceded by a packet carrying
+ *  only an adaptation field with the flag set.
+ *
+ *  Only the packets from each random access point up to the start of the
+ *  next PES of the video are read, with one positional read per
+ *  READ_PACKETS packets, so that the rest of the file is not read at all.
+ *  The random access points are taken from the index file when it has them,
+ *  and are otherwise found by reading through the whole file once.
+ */
+class TrickPlayWriter
+{
+    private:
+        enum
+        {
+            // Packets read at a time while looking for the end of a frame
+            READ_PACKETS = 128
+        };
+
+        FILE* fileHandle;
+        std::vector<uint8_t> readBuffer;
+        std::vector<uint8_t> outputBuffer;
+        // The PAT and the PMT, followed by each frame
+        uint8_t patPacket[MpegConstants::PACKET_SIZE_TS];
+        uint8_t pmtPacket[MpegConstants::PACKET_SIZE_TS];
+        uint8_t patContinuityCounter;
+        uint8_t pmtContinuityCounter;
+        uint8_t videoContinuityCounter;
+        uint64_t frames;
+        uint64_t bytesRead;
+        uint64_t bytesWritten;
+
+        void buildTables(uint16_t transportStreamId, const TsMetadata::PmtInfo& pmtInfo,
+                         uint16_t videoPid, uint8_t streamType);
+        void pushPacket(const uint8_t* packet, bool isFrameStart);
+        bool writeFrame(TsFile& tsFile, uint16_t videoPid, uint64_t packetNumber,
+                        uint64_t endPacket);
+
+    public:
+        TrickPlayWriter();
+        ~TrickPlayWriter();
+
+/**
+ *  \brief  Write the key frames of the video of a program to a file,
+ *          created or truncated.
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          TsFile::viewPacket() call, when the random access points have to
+ *          be found.
+ *  \param  tsFile An open TS file.
+ *  \param  programNumber Program number of the program.
+ *  \param  fileName Name of the output file, - for the standard output.
+ *  \param  step Write every step-th random access point only, for the
+ *          faster speeds.
+ *  \return true if the key frames were written, false if the program has
+ *          no random access points or the output could not be written.
+ */
+        bool write(TsFile& tsFile, uint16_t programNumber, const char* fileName,
+                   uint32_t step = 1);
+/**
+ *  \brief  Get the number of frames written by the last write().
+ *  \return Number of frames.
+ */
+        uint64_t getFrameCount();
+/**
+ *  \brief  Get the number of bytes of the TS file read by the last write(),
+ *          not counting the bytes read to find the random access points.
+ *  \return Bytes read.
+ */
+        uint64_t getBytesRead();
+/**
+ *  \brief  Get the number of bytes written by the last write().
+ *  \return Bytes written.
+ */
+        uint64_t getBytesWritten();
+};
+
+inline uint64_t TrickPlayWriter::getFrameCount()
+{
+    return frames;
+}
+
+inline uint64_t TrickPlayWriter::getBytesRead()
+{
+    return bytesRead;
+}
+
+inline uint64_t TrickPlayWriter::getBytesWritten()
+{
+    return bytesWritten;
+}
+
+#endif
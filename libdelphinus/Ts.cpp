@@ -22,6 +22,7 @@
  */
 
 #include "Ts.h"
+#include "SyncScanner.h"
 #include <cstdio>
 
 using namespace MpegConstants;
@@ -91,7 +92,7 @@ bool TsPacket::parse(uint8_t* data, uint64_t size)
             startOffset = 4;
             if (getSyncByte() != 0x47)
             {
-                ERR("Unable to find the sync byte 0x47!");
+                MSG("Unable to find the sync byte 0x47!");
                 isValid = false;
             }
             else
@@ -117,12 +118,14 @@ bool TsPacket::parse(uint8_t* data, uint64_t size)
         }
         if (hasPayload())
         {
-            if (adaptationFieldLength == 0)
+            if (adaptationFieldOffset == 0)
             {
                 payloadOffset = startOffset + 4;
             }
             else
             {
+                // The adaptation_field_length byte precedes the payload even
+                // when the adaptation field is empty
                 payloadOffset = adaptationFieldOffset + adaptationFieldLength + 1;
             }
         }
@@ -149,3 +152,254 @@ TsPacket* TsPacket::copy()
     }
 }
 
+
+void readClockReference(const uint8_t* data, uint64_t& base, uint16_t& extn);
+uint64_t decodePcr(uint64_t value);
+
+void readClockReference(const uint8_t* data, uint64_t& base, uint16_t& extn)
+{
+    // The low 48 bits of the 8 bytes ending with the clock reference, the 2
+    // bytes before it being still within the adaptation field:
+    // 33 bits of base, 6 reserved bits, 9 bits of extension
+    uint64_t value = DelphinusUtils::loadBigEndian64(data + AF_PCR_SIZE - sizeof(uint64_t));
+    base = (value >> 15) & 0x1FFFFFFFFULL;
+    extn = value & 0x1FF;
+}
+
+uint64_t decodePcr(uint64_t value)
+{
+    return ((value >> 15) & 0x1FFFFFFFFULL) * PCR_EXTENSION_MODULO + (value & 0x1FF);
+}
+
+void AdaptationField::parse(uint8_t* data)
+{
+    start = data;
+    length = *data;
+    pcrStart = NULL;
+    opcrStart = NULL;
+    spliceCountdownStart = NULL;
+    privateDataStart = NULL;
+    adaptationFieldExtensionStart = NULL;
+
+    if (length == 0 || length > AF_MAX_LENGTH)
+    {
+        // Either only stuffing, or an invalid length which would run past
+        // the end of the TS packet
+        if (length > AF_MAX_LENGTH)
+        {
+            ERR("Invalid adaptation field length: %u", length);
+            length = 0;
+        }
+        return;
+    }
+
+    // Only the optional fields which fit within the length are considered
+    uint8_t flags = data[1];
+    uint8_t* current = data + 2;
+    uint8_t* end = data + 1 + length;
+    if (flags & AF_PCR_FLAG_MASK)
+    {
+        pcrStart = (current + AF_PCR_SIZE <= end) ? current : NULL;
+        current += AF_PCR_SIZE;
+    }
+    if (flags & AF_OPCR_FLAG_MASK)
+    {
+        opcrStart = (current + AF_PCR_SIZE <= end) ? current : NULL;
+        current += AF_PCR_SIZE;
+    }
+    if (flags & AF_SPF_MASK)
+    {
+        spliceCountdownStart = (current + 1 <= end) ? current : NULL;
+        current += 1;
+    }
+    if (flags & AF_TPDF_MASK)
+    {
+        if (current + 1 <= end && current + 1 + *current <= end)
+        {
+            privateDataStart = current;
+            current += 1 + *current;
+        }
+        else
+        {
+            current = end;
+        }
+    }
+    if (flags & AF_AFEF_MASK)
+    {
+        adaptationFieldExtensionStart = (current + 1 <= end && current + 1 + *current <= end) ?
+                                        current : NULL;
+    }
+}
+
+void AdaptationField::getPcr(uint64_t& pcrBase, uint16_t& pcrExtn)
+{
+    if (pcrStart)
+    {
+        readClockReference(pcrStart, pcrBase, pcrExtn);
+    }
+    else
+    {
+        pcrBase = 0;
+        pcrExtn = 0;
+    }
+}
+
+uint64_t AdaptationField::getPcr()
+{
+    if (!pcrStart)
+    {
+        return 0;
+    }
+    return decodePcr(DelphinusUtils::loadBigEndian64(pcrStart + AF_PCR_SIZE - sizeof(uint64_t)));
+}
+
+void AdaptationField::getOpcr(uint64_t& opcrBase, uint16_t& opcrExtn)
+{
+    if (opcrStart)
+    {
+        readClockReference(opcrStart, opcrBase, opcrExtn);
+    }
+    else
+    {
+        opcrBase = 0;
+        opcrExtn = 0;
+    }
+}
+
+int8_t AdaptationField::getSpliceCountdown()
+{
+    return spliceCountdownStart ? (int8_t)*spliceCountdownStart : 0;
+}
+
+void AdaptationField::getPrivateData(uint8_t*& data, uint8_t& size)
+{
+    if (privateDataStart)
+    {
+        data = privateDataStart + 1;
+        size = *privateDataStart;
+    }
+    else
+    {
+        data = NULL;
+        size = 0;
+    }
+}
+
+bool AdaptationField::readPcr(const uint8_t* header, uint64_t& pcr)
+{
+    // adaptation_field_length, the flags and the 6 bytes of the PCR
+    uint64_t value = DelphinusUtils::loadBigEndian64(header + 4);
+    uint8_t adaptationFieldLength = value >> 56;
+    if (header[0] != TS_SYNC_BYTE || !(header[3] & 0x20) ||
+        adaptationFieldLength < 1 + AF_PCR_SIZE || adaptationFieldLength > AF_MAX_LENGTH ||
+        !((value >> 48) & AF_PCR_FLAG_MASK))
+    {
+        return false;
+    }
+    pcr = decodePcr(value);
+    return true;
+}
+
+uint32_t AdaptationField::findPcrs(const uint8_t* data, uint32_t packets, uint8_t packetSize,
+                                   uint16_t pid, uint32_t* packetIndices, uint64_t* pcrs)
+{
+    const uint8_t* header = data + SyncScanner::getSyncOffset(packetSize);
+    uint32_t isAnyPid = (pid == PID_NULL);
+    uint32_t count = 0;
+    for (uint32_t ix = 0; ix < packets; ++ix, header += packetSize)
+    {
+        uint64_t value = DelphinusUtils::loadBigEndian64(header + 4);
+        uint32_t packetPid = ((header[1] & TS_PID_HIGH_MASK) << TS_PID_HIGH_SHIFT) | header[2];
+        // The length is from 7 to AF_MAX_LENGTH, checked with one unsigned
+        // comparison
+        uint32_t adaptationFieldLength = value >> 56;
+        uint32_t hasPcr = (header[0] == TS_SYNC_BYTE) &
+                          ((header[3] >> 5) & 0x01) &
+                          (adaptationFieldLength - (1 + AF_PCR_SIZE) <= AF_MAX_LENGTH - (1 + AF_PCR_SIZE)) &
+                          ((uint32_t)(value >> 52) & 0x01) &
+                          ((packetPid == pid) | isAnyPid);
+        // Always stored, and kept only by counting it
+        packetIndices[count] = ix;
+        pcrs[count] = decodePcr(value);
+        count += hasPcr;
+    }
+    return count;
+}
+
+void AdaptationFieldExtension::parse(uint8_t* data)
+{
+    start = data;
+    length = *data;
+    ltwStart = NULL;
+    piecewiseRateStart = NULL;
+    seamlessSpliceStart = NULL;
+
+    if (length == 0)
+    {
+        return;
+    }
+
+    // Only the optional fields which fit within the length are considered
+    uint8_t flags = data[1];
+    uint8_t* current = data + 2;
+    uint8_t* end = data + 1 + length;
+    if (flags & AFE_LTW_FLAG_MASK)
+    {
+        ltwStart = (current + AFE_LTW_SIZE <= end) ? current : NULL;
+        current += AFE_LTW_SIZE;
+    }
+    if (flags & AFE_PRF_MASK)
+    {
+        piecewiseRateStart = (current + AFE_PIECEWISE_RATE_SIZE <= end) ? current : NULL;
+        current += AFE_PIECEWISE_RATE_SIZE;
+    }
+    if (flags & AFE_SSF_MASK)
+    {
+        seamlessSpliceStart = (current + AFE_SEAMLESS_SPLICE_SIZE <= end) ? current : NULL;
+    }
+}
+
+void AdaptationFieldExtension::getLtw(bool& isValid, uint16_t& offset)
+{
+    if (ltwStart)
+    {
+        isValid = ltwStart[0] >> 7;
+        offset = ((ltwStart[0] & 0x7F) << 8) | ltwStart[1];
+    }
+    else
+    {
+        isValid = false;
+        offset = 0;
+    }
+}
+
+uint32_t AdaptationFieldExtension::getPiecewiseRate()
+{
+    if (piecewiseRateStart)
+    {
+        // 2 reserved bits, 22 bits of rate
+        return ((piecewiseRateStart[0] & 0x3F) << 16) | (piecewiseRateStart[1] << 8) |
+               piecewiseRateStart[2];
+    }
+    return 0;
+}
+
+void AdaptationFieldExtension::getSeamlessSpliceInfo(uint8_t& spliceType, uint64_t& dtsNextAu)
+{
+    if (seamlessSpliceStart)
+    {
+        // The low 40 bits of the 8 bytes ending with the field, the 3 bytes
+        // before it being still within the adaptation field:
+        // splice_type [32..30] marker [29..15] marker [14..0] marker
+        uint64_t value = DelphinusUtils::loadBigEndian64(seamlessSpliceStart + AFE_SEAMLESS_SPLICE_SIZE -
+                                                         sizeof(uint64_t));
+        spliceType = seamlessSpliceStart[0] >> 4;
+        dtsNextAu = ((value >> 3) & (0x7ULL << 30)) | ((value >> 2) & (0x7FFFULL << 15)) |
+                    ((value >> 1) & 0x7FFF);
+    }
+    else
+    {
+        spliceType = 0;
+        dtsNextAu = 0;
+    }
+}
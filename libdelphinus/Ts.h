@@ -32,6 +32,7 @@
 #ifndef DELPHINUS_TS_H
 #define DELPHINUS_TS_H
 
+#include <cstddef>
 #include "common/DelphinusUtils.h"
 #include "MpegConstants.h"
 
@@ -178,14 +179,42 @@ class AdaptationField
         bool getRandomAccessIndicator();
         bool getEsPriorityIndicator();
         bool hasPcr();
-        void getPcr(uint64_t& pcrBase, uint8_t pcrExtn);
+        void getPcr(uint64_t& pcrBase, uint16_t& pcrExtn);
+        uint64_t getPcr();
         bool hasOpcr();
-        void getOpcr(uint64_t& opcrBase, uint8_t opcrExtn);
+        void getOpcr(uint64_t& opcrBase, uint16_t& opcrExtn);
         bool hasSpliceCountdown();
         int8_t getSpliceCountdown();
         bool hasTransportPrivateData();
-        void getPrivateData(uint8_t*& privateDataStart, uint8_t& length);
+        void getPrivateData(uint8_t*& data, uint8_t& size);
         uint8_t* getAdaptationFieldExtension();
+
+/**
+ *  \brief  Read the PCR of a TS packet without parsing its adaptation field.
+ *          The adaptation_field_length, the flags and the PCR are taken from
+ *          a single unaligned load of the 8 bytes following the TS header.
+ *  \param  header Start of the TS header of a whole packet.
+ *  \param  pcr Set to the PCR in 27 MHz units, when the packet has one.
+ *  \return true if the packet has a PCR, false otherwise.
+ */
+        static bool readPcr(const uint8_t* header, uint64_t& pcr);
+/**
+ *  \brief  Find the PCRs of the packets in a buffer. The packets are checked
+ *          without branching on their contents, so the time taken does not
+ *          depend on how many of them carry a PCR.
+ *  \param  data Start of the first packet.
+ *  \param  packets Number of whole packets in the buffer.
+ *  \param  packetSize Size of the packets, 188, 192 or 204.
+ *  \param  pid PID whose PCRs are wanted, PID_NULL for any PID as the null
+ *          packets never carry a PCR.
+ *  \param  packetIndices Set to the index(starts at 0) in the buffer of each
+ *          packet with a PCR, room for packets entries is needed.
+ *  \param  pcrs Set to the PCR in 27 MHz units of each of those packets,
+ *          room for packets entries is needed.
+ *  \return Number of PCRs found.
+ */
+        static uint32_t findPcrs(const uint8_t* data, uint32_t packets, uint8_t packetSize,
+                                 uint16_t pid, uint32_t* packetIndices, uint64_t* pcrs);
 };
 
 /**
@@ -217,6 +246,73 @@ class AdaptationFieldExtension
 };
 /** \endcond DEV */
 
+/**
+ *  \brief  ContinuityChecker follows the continuity counter of the packets
+ *          of a PID.
+ *
+ *  The continuity counter only advances in the packets with a payload, and a
+ *  packet may be sent twice in a row. A packet with the
+ *  discontinuity_indicator set in its adaptation field, as at a splice, may
+ *  carry any continuity counter, and the packets following it go on from
+ *  there, so the counter is taken over without reporting a gap.
+ */
+class ContinuityChecker
+{
+    public:
+/**
+ *  \brief  Results of check().
+ */
+        enum Result
+        {
+/** The packet follows on from the previous one, or is the first one. */
+            CONTINUITY_NEW,
+/** A repetition of the previous packet, to be skipped. */
+            CONTINUITY_DUPLICATE,
+/** Packets were lost before this one, which still follows on. */
+            CONTINUITY_GAP,
+/** No payload, the continuity counter does not advance. */
+            CONTINUITY_NO_PAYLOAD
+        };
+
+    private:
+        enum
+        {
+            COUNTER_NONE = 0xFF
+        };
+        uint8_t counter;
+
+    public:
+        ContinuityChecker();
+
+/**
+ *  \brief  Check a packet against the previous one of its PID.
+ *  \param  continuityCounter Continuity counter of the packet.
+ *  \param  hasPayload Whether the packet has any payload.
+ *  \param  isDiscontinuity Whether the discontinuity_indicator is set.
+ *  \return How the packet follows the previous one.
+ */
+        Result check(uint8_t continuityCounter, bool hasPayload, bool isDiscontinuity);
+/**
+ *  \brief  Check a parsed packet against the previous one of its PID.
+ *  \param  tsPacket A valid TS packet.
+ *  \return How the packet follows the previous one.
+ */
+        Result check(TsPacket* tsPacket);
+/**
+ *  \brief  Forget the previous packet, the next one is taken as is.
+ */
+        void reset();
+/**
+ *  \brief  Read the discontinuity_indicator of a packet without parsing it.
+ *  \param  header Start of the TS header of a whole packet.
+ *  \return true if the packet has an adaptation field with the
+ *          discontinuity_indicator set, false otherwise.
+ */
+        static bool hasDiscontinuity(const uint8_t* header);
+};
+
+
+#define TS_SYNC_BYTE                    0x47
 
 #define TS_TEI_MASK                     0x80
 #define TS_TEI_SHIFT                    7
@@ -243,6 +339,34 @@ class AdaptationFieldExtension
 
 #define TS_HEADER_START                 ((DelphinusUtils::ByteField*)(start + startOffset))
 
+#define AF_MAX_LENGTH                   183
+#define AF_DI_MASK                      0x80
+#define AF_DI_SHIFT                     7
+#define AF_RAI_MASK                     0x40
+#define AF_RAI_SHIFT                    6
+#define AF_ESPI_MASK                    0x20
+#define AF_ESPI_SHIFT                   5
+#define AF_PCR_FLAG_MASK                0x10
+#define AF_OPCR_FLAG_MASK               0x08
+#define AF_SPF_MASK                     0x04
+#define AF_TPDF_MASK                    0x02
+#define AF_AFEF_MASK                    0x01
+#define AF_PCR_SIZE                     6
+#define AF_SPLICE_COUNTDOWN_SIZE        1
+
+#define AFE_LTW_FLAG_MASK               0x80
+#define AFE_PRF_MASK                    0x40
+#define AFE_SSF_MASK                    0x20
+#define AFE_LTW_SIZE                    2
+#define AFE_PIECEWISE_RATE_SIZE         3
+#define AFE_SEAMLESS_SPLICE_SIZE        5
+
+#define AF_GET_DI(x)                    ((x->byte1 & AF_DI_MASK) >> AF_DI_SHIFT)
+#define AF_GET_RAI(x)                   ((x->byte1 & AF_RAI_MASK) >> AF_RAI_SHIFT)
+#define AF_GET_ESPI(x)                  ((x->byte1 & AF_ESPI_MASK) >> AF_ESPI_SHIFT)
+
+#define AF_START                        ((DelphinusUtils::ByteField*)(start))
+
 inline uint8_t* TsPacket::getStart()
 {
     return start;
@@ -322,4 +446,131 @@ inline uint8_t TsPacket::getPayloadSize()
 {
     return packetSize - payloadOffset;
 }
+
+inline uint8_t* AdaptationField::getStart()
+{
+    return start;
+}
+
+inline uint8_t AdaptationField::getLength()
+{
+    return length;
+}
+
+inline bool AdaptationField::getDiscontinuityIndicator()
+{
+    return (length > 0) && AF_GET_DI(AF_START);
+}
+
+inline bool AdaptationField::getRandomAccessIndicator()
+{
+    return (length > 0) && AF_GET_RAI(AF_START);
+}
+
+inline bool AdaptationField::getEsPriorityIndicator()
+{
+    return (length > 0) && AF_GET_ESPI(AF_START);
+}
+
+inline bool AdaptationField::hasPcr()
+{
+    return (pcrStart != NULL);
+}
+
+inline bool AdaptationField::hasOpcr()
+{
+    return (opcrStart != NULL);
+}
+
+inline bool AdaptationField::hasSpliceCountdown()
+{
+    return (spliceCountdownStart != NULL);
+}
+
+inline bool AdaptationField::hasTransportPrivateData()
+{
+    return (privateDataStart != NULL);
+}
+
+inline uint8_t* AdaptationField::getAdaptationFieldExtension()
+{
+    return adaptationFieldExtensionStart;
+}
+
+inline uint8_t* AdaptationFieldExtension::getStart()
+{
+    return start;
+}
+
+inline uint8_t AdaptationFieldExtension::getLength()
+{
+    return length;
+}
+
+inline bool AdaptationFieldExtension::hasLtw()
+{
+    return (ltwStart != NULL);
+}
+
+inline bool AdaptationFieldExtension::hasPiecewiseRate()
+{
+    return (piecewiseRateStart != NULL);
+}
+
+inline bool AdaptationFieldExtension::hasSeamlessSplice()
+{
+    return (seamlessSpliceStart != NULL);
+}
+
+inline ContinuityChecker::ContinuityChecker()
+    :   counter(COUNTER_NONE)
+{
+}
+
+inline ContinuityChecker::Result ContinuityChecker::check(uint8_t continuityCounter, bool hasPayload,
+                                                         bool isDiscontinuity)
+{
+    if (isDiscontinuity)
+    {
+        // Without a payload, the counter of the next packet is not known
+        counter = hasPayload ? continuityCounter : (uint8_t)COUNTER_NONE;
+        return hasPayload ? CONTINUITY_NEW : CONTINUITY_NO_PAYLOAD;
+    }
+    if (!hasPayload)
+    {
+        return CONTINUITY_NO_PAYLOAD;
+    }
+    if (counter == COUNTER_NONE)
+    {
+        counter = continuityCounter;
+        return CONTINUITY_NEW;
+    }
+    if (continuityCounter == counter)
+    {
+        return CONTINUITY_DUPLICATE;
+    }
+    bool isGap = (continuityCounter != ((counter + 1) & TS_CC_MASK));
+    counter = continuityCounter;
+    return isGap ? CONTINUITY_GAP : CONTINUITY_NEW;
+}
+
+inline ContinuityChecker::Result ContinuityChecker::check(TsPacket* tsPacket)
+{
+    const uint8_t* adaptationField = tsPacket->getAdaptationField();
+    return check(tsPacket->getContinuityCounter(),
+                 tsPacket->hasPayload() && tsPacket->getPayloadOffset() < tsPacket->getPacketSize(),
+                 tsPacket->hasAdaptationField() && adaptationField[0] > 0 &&
+                 (adaptationField[1] & AF_DI_MASK));
+}
+
+inline void ContinuityChecker::reset()
+{
+    counter = COUNTER_NONE;
+}
+
+inline bool ContinuityChecker::hasDiscontinuity(const uint8_t* header)
+{
+    return (header[3] & (0x02 << TS_AFC_SHIFT)) && header[4] > 0 && header[4] <= AF_MAX_LENGTH &&
+           (header[5] & AF_DI_MASK);
+}
 #endif
@@ -21,9 +21,20 @@
  */
 
 #include "TsFile.h"
+#include "ReadAhead.h"
+#include "UringReader.h"
+#include "PidIndex.h"
+#include "PcrIndex.h"
+#include "IndexFile.h"
+#include "TsHeaderBatch.h"
 #include <cassert>
-#include <list>
-#include <set>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 using namespace MpegConstants;
 
@@ -40,6 +51,8 @@ using namespace MpegConstants;
 
 #define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
 
+#define GET_LESS(x, y) ((x) < (y) ? (x) : (y))
+
 uint64_t readFile(uint8_t* buffer, FILE* fileHandle, uint64_t size);
 
 uint64_t readFile(uint8_t* buffer, FILE* fileHandle, uint64_t size)
@@ -58,15 +71,82 @@ uint64_t readFile(uint8_t* buffer, FILE* fileHandle, uint64_t size)
     return readSize;
 }
 
+bool TsFile::mapFile()
+{
+#ifndef _WIN32
+    if (fileSize == 0 || fileSize != (uint64_t)(size_t)fileSize)
+    {
+        // Nothing to map, or the file does not fit in the address space
+        return false;
+    }
+    void* mapping = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fileno(fileHandle), 0);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    mappedFile = (uint8_t*)mapping;
+    // The hints are best effort, ignore any failures
+    madvise(mappedFile, fileSize, MADV_SEQUENTIAL);
+    madvise(mappedFile, GET_LESS(fileSize, (uint64_t)BUFFER_SIZE), MADV_WILLNEED);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void TsFile::unmapFile()
+{
+#ifndef _WIN32
+    if (mappedFile)
+    {
+        munmap(mappedFile, fileSize);
+        mappedFile = NULL;
+    }
+#endif
+}
+
 void TsFile::readFromOffset(uint64_t offset)
 {
-    assert(offset % BUFFER_SIZE == 0);
+    // The chunks start at the packets of the sync segments, or anywhere
+    // while locking to the packets again
+    assert(offset >= dataOffset);
     if (currentFileOffset != offset)
     {
         MSG("Gonna read from offset: %lu", offset);
-        if (!fseeko(fileHandle, offset, SEEK_SET))
+        if (ioMode == IO_MODE_MMAP)
+        {
+            // Just slide the window over the mapped file, no copy involved
+            bufferStart = mappedFile + GET_LESS(offset, fileSize);
+            validBufferSize = (offset < fileSize) ? GET_LESS(chunkSize, fileSize - offset) : 0;
+            currentFileOffset = offset;
+            isEof = (validBufferSize == 0);
+#ifndef _WIN32
+            if (offset + chunkSize < fileSize)
+            {
+                // Let the kernel start paging in the next window already,
+                // madvise() needs a page aligned start
+                uint64_t adviseOffset = (offset + chunkSize) & ~(uint64_t)4095;
+                madvise(mappedFile + adviseOffset,
+                        GET_LESS(chunkSize, fileSize - adviseOffset), MADV_WILLNEED);
+            }
+#endif
+        }
+        else if (ioMode == IO_MODE_READ_AHEAD ||
+                 (ioMode == IO_MODE_IO_URING && (!uringReader->usesDirectIo() || offset % 4096 == 0)))
         {
-            validBufferSize = readFile(buffer, fileHandle, BUFFER_SIZE);
+            uint8_t* data = (ioMode == IO_MODE_READ_AHEAD) ?
+                            readAhead->fetch(offset, validBufferSize) :
+                            uringReader->fetch(offset, validBufferSize);
+            bufferStart = data ? data : buffer;
+            currentFileOffset = offset;
+            isEof = (validBufferSize == 0);
+        }
+        else if (!fseeko(fileHandle, offset, SEEK_SET))
+        {
+            // Also reads the chunks O_DIRECT cannot, past a lost sync region
+            // ending at an unaligned offset
+            bufferStart = buffer;
+            validBufferSize = readFile(buffer, fileHandle, chunkSize);
             currentFileOffset = offset;
             //FIXME: Handle the EOF case
             isEof = (validBufferSize == 0);
@@ -83,170 +163,329 @@ void TsFile::readFromOffset(uint64_t offset)
     }
 }
 
-void TsFile::validate()
+uint64_t TsFile::findSegment(uint64_t packetNumber)
 {
-    readFromOffset(0);
-    TsPacket tsPacket;
-    uint64_t bufferOffset = 0;
-    packetSize = 0;
-    isTsFile = false;
+    // Index of the last segment starting at or before the packet
+    uint64_t low = 0;
+    uint64_t high = syncSegments.size();
+    while (high - low > 1)
+    {
+        uint64_t middle = (low + high) / 2;
+        if (syncSegments[middle].packetNumber <= packetNumber)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+uint64_t TsFile::getSegmentEnd(uint64_t segment)
+{
+    return (segment + 1 < syncSegments.size()) ? syncSegments[segment + 1].packetNumber :
+                                                 getPacketCount();
+}
+
+uint64_t TsFile::getPacketOffset(uint64_t packetNumber)
+{
+    const SyncSegment& segment = syncSegments[findSegment(packetNumber)];
+    return segment.offset + (packetNumber - segment.packetNumber) * packetSize;
+}
+
+void TsFile::checkSync(uint64_t endOffset)
+{
+    endOffset = GET_LESS(endOffset, fileSize);
+    while (checkedOffset < endOffset)
+    {
+        // The checked part always ends at a packet of the last segment
+        const SyncSegment& segment = syncSegments.back();
+        uint64_t bufferOffset = (checkedOffset - segment.offset) % chunkSize;
+        readFromOffset(checkedOffset - bufferOffset);
+        if (bufferOffset + packetSize > validBufferSize)
+        {
+            // Only a part of a packet is left at the end of the file
+            checkedOffset = fileSize;
+            break;
+        }
+        uint64_t size = validBufferSize - bufferOffset;
+        uint64_t lossOffset = SyncScanner::findSyncLoss(bufferStart + bufferOffset, size, packetSize);
+        checkedOffset += lossOffset;
+        if (lossOffset + packetSize <= size)
+        {
+            resync(checkedOffset);
+        }
+    }
+}
+
+void TsFile::resync(uint64_t lostOffset)
+{
+    const SyncSegment& segment = syncSegments.back();
+    uint64_t packetNumber = segment.packetNumber + (lostOffset - segment.offset) / packetSize;
+    uint64_t segmentOffset = segment.offset;
 
-    // Validate VALID_PACKETS number of TS packets
-    if (!tsPacket.parse(buffer + bufferOffset, validBufferSize - bufferOffset))
+    // Lock to the packets again like validate(), from the packet which lost
+    // the sync onwards
+    uint64_t lockOffset = fileSize;
+    uint64_t offset = lostOffset;
+    uint64_t overlap = VALID_PACKETS * packetSize;
+    while (offset < fileSize)
     {
+        readFromOffset(offset);
+        uint8_t lockPackets = GET_LESS((uint64_t)VALID_PACKETS, validBufferSize / packetSize);
+        uint64_t packetOffset;
+        if (lockPackets > 0 &&
+            syncScanner.findLock(bufferStart, validBufferSize, lockPackets, packetSize, packetOffset))
+        {
+            lockOffset = offset + packetOffset;
+            break;
+        }
+        if (offset + validBufferSize >= fileSize || validBufferSize <= overlap)
+        {
+            break;
+        }
+        // The packets locked to must be complete within the chunk, so the
+        // next chunk overlaps the end of this one
+        offset += validBufferSize - overlap;
+    }
+    MSG("Lost sync from: %" PRIu64 " to: %" PRIu64, lostOffset, lockOffset);
+    LostSyncRegion region;
+    region.start = lostOffset;
+    region.end = lockOffset;
+    lostSyncRegions.push_back(region);
+    checkedOffset = lockOffset;
+
+    if (lockOffset < fileSize && (lockOffset - segmentOffset) % packetSize == 0)
+    {
+        // Only the sync bytes of some packets were damaged, the packets
+        // following them keep their packet numbers
         return;
     }
+    // The packets from here on, none if the rest of the file is garbage
+    SyncSegment next;
+    next.packetNumber = packetNumber;
+    next.offset = lockOffset;
+    syncSegments.push_back(next);
+}
 
-    packetSize = tsPacket.getPacketSize();
-    uint64_t maxValidBufferOffset = VALID_PACKETS * packetSize;
-    assert (maxValidBufferOffset <= BUFFER_SIZE);
-    bufferOffset += packetSize;
+bool TsFile::verifyPackets(const uint8_t* data, uint64_t offset, uint64_t count)
+{
+    uint64_t endOffset = offset + count * packetSize;
+    if (endOffset <= checkedOffset)
+    {
+        return true;
+    }
+    // The packets right after the checked part move it along
+    uint64_t startOffset = (offset < checkedOffset) ? checkedOffset : offset;
+    uint64_t lossOffset = startOffset + SyncScanner::findSyncLoss(data + (startOffset - offset),
+                                                                  endOffset - startOffset, packetSize);
+    if (startOffset == checkedOffset)
+    {
+        checkedOffset = lossOffset;
+    }
+    if (lossOffset == endOffset)
+    {
+        return true;
+    }
+    // The packets from here on may not be where they were assumed to be,
+    // check the file up to the packet which lost the sync
+    checkSync(lossOffset + packetSize);
+    return false;
+}
 
-    while (bufferOffset < maxValidBufferOffset)
+uint8_t* TsFile::findPackets(uint64_t packetNumber, uint64_t maxCount, uint64_t& count)
+{
+    count = 0;
+    if (!isTsFile)
     {
-        if (!tsPacket.parse(buffer + bufferOffset, validBufferSize - bufferOffset))
+        return NULL;
+    }
+    while (true)
+    {
+        uint64_t segment = findSegment(packetNumber);
+        uint64_t segmentEnd = getSegmentEnd(segment);
+        if (packetNumber >= segmentEnd)
+        {
+            return NULL;
+        }
+        // The chunks of each segment start at its first packet, so that no
+        // packet spans two chunks
+        uint64_t segmentOffset = syncSegments[segment].offset;
+        uint64_t offset = segmentOffset + (packetNumber - syncSegments[segment].packetNumber) * packetSize;
+        uint64_t bufferOffset = (offset - segmentOffset) % chunkSize;
+        readFromOffset(offset - bufferOffset);
+        if (bufferOffset + packetSize > validBufferSize)
+        {
+            return NULL;
+        }
+        count = GET_LESS((validBufferSize - bufferOffset) / packetSize,
+                         GET_LESS(segmentEnd - packetNumber, maxCount));
+        uint8_t* data = bufferStart + bufferOffset;
+        if (verifyPackets(data, offset, count))
         {
-            return;
+            return data;
         }
-        bufferOffset += packetSize;
+        count = 0;
     }
+}
+
+void TsFile::validate()
+{
+    syncSegments.clear();
+    lostSyncRegions.clear();
+    checkedOffset = 0;
+    dataOffset = 0;
+    chunkSize = BUFFER_SIZE;
+    packetSize = 0;
+    headerOffset = 0;
+    isTsFile = false;
+    readFromOffset(0);
+
+    // Lock to VALID_PACKETS number of TS packets within the first chunk, a
+    // short file is accepted as long as all of its packets are in sync
+    uint8_t lockPackets = GET_LESS((uint64_t)VALID_PACKETS, validBufferSize / PACKET_SIZE_TS);
+    uint64_t packetOffset;
+    if (lockPackets == 0 ||
+        !syncScanner.findLockWithSize(bufferStart, validBufferSize, lockPackets, packetSize, packetOffset))
+    {
+        packetSize = 0;
+        return;
+    }
+
+    headerOffset = SyncScanner::getSyncOffset(packetSize);
+    if (packetOffset != 0 || BUFFER_SIZE % packetSize != 0)
+    {
+        // The chunks no longer start at the same offsets, drop the one read
+        MSG("First packet at offset: %" PRIu64 " packet size: %u", packetOffset, packetSize);
+        dataOffset = packetOffset;
+        chunkSize = (BUFFER_SIZE / packetSize) * packetSize;
+        currentFileOffset = (uint64_t) - 1;
+        validBufferSize = 0;
+    }
+    SyncSegment first;
+    first.packetNumber = 0;
+    first.offset = dataOffset;
+    syncSegments.push_back(first);
+    checkedOffset = dataOffset;
     isTsFile = true;
 }
 
 void TsFile::collectMetadata()
 {
-    // Approach - Using section header's table ID based filtering (more efficient)
-    // Start from packet 0
-    // If all PIDs in PAT and PMT found and PID not in already found list:
-    //      Check for sections when PUSI = 1
-    //      If it is a section - check for Table IDs 0x00 and 0x02
-    //      Then parse it - add PID to found list
-    //
-    std::set<uint16_t> pidsToFind;
-    std::set<uint16_t> foundPids;
-    patInfo.programList.clear();
-    pmtInfoList.clear();
-
-    uint64_t lastFileOffset = 0;
-    readFromOffset(lastFileOffset);
+    metadata.clear();
+    if (!isTsFile)
+    {
+        return;
+    }
 
     TsPacket tsPacket;
-    pidsToFind.insert(PID_PAT);
-
-    while(!isEof && pidsToFind.size() > 0)
+    // With the tracking the tables are followed till the end of the file
+    bool isTracking = metadata.isTrackingEnabled();
+    bool isComplete = false;
+    uint64_t packetNumber = 0;
+    uint64_t count;
+    uint8_t* data;
+    while (!isComplete && (data = findPackets(packetNumber, (uint64_t) - 1, count)) != NULL)
     {
-        uint8_t* data = buffer;
-        uint64_t packetCount = 0;
-        uint64_t maxPackets = validBufferSize / packetSize;
-        uint64_t remainingData = validBufferSize;
-
-        while (pidsToFind.size() > 0 && packetCount < maxPackets)
+        for (uint64_t ix = 0; !isComplete && ix < count; ++ix)
         {
-//            MSG("Parsing packet: %lu", packetCount);
-            if (!tsPacket.parse(data, remainingData))
+            // Skip the packets damaged beyond the sync byte
+            if (tsPacket.parse(data, packetSize))
             {
-                ERR("Invalid TS packet");
-                assert(false);
+                isComplete = metadata.parsePacket(&tsPacket, packetNumber + ix) && !isTracking;
             }
-            uint16_t pid = tsPacket.getPid();
-            // PID is not NULL
-            // PID is not in the already found list (FIXME: When sections are split ??)
-            // Packet has payload and PUSI set to 1
-            if (pid != PID_NULL && foundPids.find(pid) == foundPids.end() &&
-                    tsPacket.hasPayload() && tsPacket.getPayloadUnitStartIndicator())
-            {
-                PesPacket pesPacket;
-                pesPacket.parse(tsPacket.getPayload());
-                if (pesPacket.getStartCodePrefix() != 0x000001)
-                {
-                    // If it is not a PES packet, it must be a section
-                    PsiSection psiSection;
-                    if (psiSection.parse(tsPacket.getPayload()))
-                    {
-                        MSG("Parsing Packet with a PSI Section PID: 0x%04x", pid);
-                        // If it is a section, check the TableId
-                        // The only ones we're interested in are PAT and PMT
-                        if (psiSection.getTableId() == TABLE_PAT)
-                        {
-                            MSG("Found PAT");
-                            PatSection patSection;
-                            patSection.parse(tsPacket.getPayload(),
-                                             tsPacket.getPacketSize() -
-                                             psiSection.getDataOffset());
-                            if (patSection.isCompleteSection())
-                            {
-                                MSG("complete PAT");
-                                const PatSection::ProgramList& programList = patSection.getPrograms();
-                                patInfo.programList = programList;
-                                patInfo.packetNumber = (currentFileOffset / BUFFER_SIZE) + packetCount;
-                                patInfo.transportStreamId = patSection.getTransportStreamId();
-                                foundPids.insert(pid);
-                                pidsToFind.erase(pid);
-                                for (PatSection::ProgramList::const_iterator ix = programList.begin();
-                                     ix != programList.end(); ++ix)
-                                {
-                                    pidsToFind.insert(ix->pmtPid);
-                                }
-                            }
-                        }
-                        else if (psiSection.getTableId() == TABLE_PMT)
-                        {
-                            MSG("Found PMT");
-                            PmtSection pmtSection;
-                            pmtSection.parse(tsPacket.getPayload(),
-                                    tsPacket.getPacketSize() -
-                                    psiSection.getDataOffset());
-                            if (pmtSection.isCompleteSection())
-                            {
-                                MSG("complete PMT");
-                                const PmtSection::StreamList& streamList = pmtSection.getStreamList();
-                                PmtInfo pmtInfo;
-                                pmtInfo.packetNumber = (currentFileOffset / BUFFER_SIZE) + packetCount;
-                                pmtInfo.pmtPid = pid;
-                                pmtInfo.programNumber = pmtSection.getProgramNumber();
-                                pmtInfo.pcrPid = pmtSection.getPcrPid();
-                                pmtInfo.streamList = streamList;
-                                pmtInfoList.push_back(pmtInfo);
-                                foundPids.insert(pid);
-                                pidsToFind.erase(pid);
-                            }
-                        }
-                    }
-                }
-            }
-            packetCount += 1;
             data += packetSize;
-            remainingData -= packetSize;
         }
-        if (pidsToFind.size() > 0)
+        packetNumber += count;
+    }
+    metadata.dropOptionalTables();
+}
+
+bool TsFile::loadIndexFile()
+{
+    IndexFile::FileKey key;
+    if (!isTsFile || !IndexFile::getFileKey(openedFileName.c_str(), key) ||
+        key.fileSize != fileSize)
+    {
+        return false;
+    }
+    std::string indexFileName = openedFileName + ".idx";
+    indexFile = new IndexFile();
+    if (!indexFile->open(indexFileName.c_str(), key) ||
+        indexFile->getPacketSize() != packetSize)
+    {
+        delete indexFile;
+        indexFile = NULL;
+        return false;
+    }
+
+    // Replay the packets which carried the tables
+    metadata.clear();
+    TsPacket tsPacket;
+    const IndexFile::StoredPacketList& storedPackets = indexFile->getMetadataPackets();
+    for (IndexFile::StoredPacketList::const_iterator ix = storedPackets.begin();
+         ix != storedPackets.end(); ++ix)
+    {
+        if (tsPacket.parse(const_cast<uint8_t*>(ix->data), packetSize))
         {
-            // We have either reached the end of the buffer and need to read
-            // the next bytes of the file into the buffer (or)
-            // we have reached the EOF - FIXME
-            if (!isEof)
-            {
-                lastFileOffset += BUFFER_SIZE;
-                readFromOffset(lastFileOffset);
-            }
+            metadata.parsePacket(&tsPacket, ix->packetNumber);
         }
     }
+    // Only the tables found when writing the index file were stored
+    metadata.dropOptionalTables();
+    if (indexFile->hasPidIndex())
+    {
+        pidIndex = new PidIndex();
+        indexFile->loadPidIndex(*pidIndex);
+    }
+    if (indexFile->hasPcrIndex())
+    {
+        pcrIndex = new PcrIndex();
+        indexFile->loadPcrIndex(*pcrIndex);
+    }
+    if (indexFile->hasRapIndex())
+    {
+        rapIndex = new RapIndex();
+        indexFile->loadRapIndex(*rapIndex);
+    }
+    MSG("Loaded the index file: %s", indexFileName.c_str());
+    return true;
 }
 
 TsFile::TsFile()
     :   
         buffer(NULL),
+        bufferStart(NULL),
+        mappedFile(NULL),
+        readAhead(NULL),
+        uringReader(NULL),
+        pidIndex(NULL),
+        pcrIndex(NULL),
+        rapIndex(NULL),
+        pcrPid(PID_NULL),
+        indexFile(NULL),
         fileHandle(NULL),
         viewPacket(NULL),
+        ioMode(IO_MODE_STDIO),
+        queueDepth(DEFAULT_QUEUE_DEPTH),
+        isDirectIo(false),
         fileSize(0),
         validBufferSize(0),
         currentFileOffset((uint64_t) - 1),
-        lastPacketOffset((uint64_t) - 1),
+        dataOffset(0),
+        chunkSize(BUFFER_SIZE),
+        lastPacketNumber((uint64_t) - 1),
         packetSize(0),
+        headerOffset(0),
         isTsFile(false),
-        isEof(true)
+        isEof(true),
+        checkedOffset(0)
 {
     buffer = new uint8_t[BUFFER_SIZE];
     assert(buffer != NULL);
+    bufferStart = buffer;
     viewPacket = new TsPacket();
     assert(viewPacket != NULL);
 }
@@ -266,7 +505,7 @@ TsFile::~TsFile()
     }
 }
 
-bool TsFile::open(const char* fileName)
+bool TsFile::open(const char* fileName, IoMode mode)
 {
     close();
     fileHandle = fopen(fileName, "rb");
@@ -274,14 +513,70 @@ bool TsFile::open(const char* fileName)
     {
         return false;
     }
+    openedFileName = fileName;
     fseeko(fileHandle, 0, SEEK_END);
     fileSize = ftello(fileHandle);
     fseeko(fileHandle, 0, SEEK_SET);
-    lastPacketOffset = (uint64_t) - 1;
+    lastPacketNumber = (uint64_t) - 1;
     isEof = (fileSize == 0);
 
+    ioMode = IO_MODE_STDIO;
+    if (mode == IO_MODE_MMAP)
+    {
+        if (mapFile())
+        {
+            ioMode = IO_MODE_MMAP;
+        }
+        else
+        {
+            MSG("Unable to mmap the file, falling back to stdio");
+        }
+    }
+
     validate();
-    collectMetadata();
+
+    // The chunk size and offsets are known only after the validation, the
+    // asynchronous backends start reading from the first chunk from here
+    if (mode == IO_MODE_READ_AHEAD)
+    {
+        readAhead = new ReadAhead();
+        if (readAhead->start(fileName, fileSize, chunkSize, queueDepth))
+        {
+            ioMode = IO_MODE_READ_AHEAD;
+        }
+        else
+        {
+            MSG("Unable to start the read ahead, falling back to stdio");
+            delete readAhead;
+            readAhead = NULL;
+        }
+    }
+    else if (mode == IO_MODE_IO_URING)
+    {
+        uringReader = new UringReader();
+        // O_DIRECT needs the chunks to start at aligned offsets
+        if (uringReader->start(fileName, fileSize, chunkSize, queueDepth,
+                               isDirectIo && dataOffset % 4096 == 0))
+        {
+            ioMode = IO_MODE_IO_URING;
+        }
+        else
+        {
+            MSG("io_uring is not available, falling back to stdio");
+            delete uringReader;
+            uringReader = NULL;
+        }
+    }
+    if (ioMode == IO_MODE_READ_AHEAD || ioMode == IO_MODE_IO_URING)
+    {
+        // The first chunk was read through stdio
+        currentFileOffset = (uint64_t) - 1;
+    }
+
+    if (!loadIndexFile())
+    {
+        collectMetadata();
+    }
 
     return true;
 }
@@ -290,14 +585,54 @@ void TsFile::close()
 {
     if (fileHandle)
     {
+        unmapFile();
+        if (readAhead)
+        {
+            delete readAhead;
+            readAhead = NULL;
+        }
+        if (uringReader)
+        {
+            delete uringReader;
+            uringReader = NULL;
+        }
+        if (pidIndex)
+        {
+            delete pidIndex;
+            pidIndex = NULL;
+        }
+        if (pcrIndex)
+        {
+            delete pcrIndex;
+            pcrIndex = NULL;
+        }
+        if (rapIndex)
+        {
+            delete rapIndex;
+            rapIndex = NULL;
+        }
+        if (indexFile)
+        {
+            delete indexFile;
+            indexFile = NULL;
+        }
+        openedFileName.clear();
+        bufferStart = buffer;
+        ioMode = IO_MODE_STDIO;
         fclose(fileHandle);
         fileHandle = NULL;
         fileSize = 0;
         validBufferSize = 0;
         packetSize = 0;
+        headerOffset = 0;
+        dataOffset = 0;
+        chunkSize = BUFFER_SIZE;
         currentFileOffset = (uint64_t) - 1;
-        lastPacketOffset = (uint64_t) - 1;
+        lastPacketNumber = (uint64_t) - 1;
         isEof = true;
+        syncSegments.clear();
+        lostSyncRegions.clear();
+        checkedOffset = 0;
     }
 }
 
@@ -308,74 +643,668 @@ bool TsFile::isValid()
 
 TsPacket* TsFile::viewPacketByNumber(uint64_t packetNumber)
 {
-    uint64_t packetOffset = packetNumber * packetSize;
-    uint64_t bufferOffset = packetOffset % BUFFER_SIZE;
-    if (packetOffset >= fileSize)
+    uint64_t count;
+    uint8_t* data = findPackets(packetNumber, 1, count);
+    if (data == NULL)
     {
-        // invalid packet number - exceeds file size
         return NULL;
     }
-    if (currentFileOffset > packetOffset ||
-        currentFileOffset + BUFFER_SIZE < packetOffset)
+    viewPacket->parse(data, packetSize);
+    lastPacketNumber = packetNumber;
+    return viewPacket;
+}
+
+TsPacket* TsFile::viewNextPacket()
+{
+    return viewPacketByNumber((lastPacketNumber == (uint64_t) - 1) ? 0 : lastPacketNumber + 1);
+}
+
+TsPacket* TsFile::viewPreviousPacket()
+{
+    if (lastPacketNumber == (uint64_t) - 1 || lastPacketNumber == 0)
     {
-        readFromOffset(packetOffset - bufferOffset);
+        // Nothing before the first packet
+        return NULL;
     }
+    return viewPacketByNumber(lastPacketNumber - 1);
+}
 
-    MSG("Returning packet %lu from buffer offset: %lu", packetNumber, bufferOffset);
-    viewPacket->parse(buffer + bufferOffset, validBufferSize - bufferOffset);
-    lastPacketOffset = packetOffset;
-    return viewPacket;
+TsPacket* TsFile::viewPacketByPid(uint16_t pid)
+{
+    if (!isTsFile)
+    {
+        return NULL;
+    }
+    if (pidIndex)
+    {
+        uint64_t packetNumber = pidIndex->findNextPacket(pid, lastPacketNumber);
+        return (packetNumber != (uint64_t) - 1) ? viewPacketByNumber(packetNumber) : NULL;
+    }
+
+    // No index, check only the PID in the header of the subsequent packets
+    // and parse just the one which matches
+    uint64_t packetNumber = (lastPacketNumber == (uint64_t) - 1) ? 0 : lastPacketNumber + 1;
+    uint64_t count;
+    uint8_t* data;
+    while ((data = findPackets(packetNumber, (uint64_t) - 1, count)) != NULL)
+    {
+        for (uint64_t ix = 0; ix < count; ++ix)
+        {
+            DelphinusUtils::ByteField* header = (DelphinusUtils::ByteField*)(data + headerOffset);
+            if (TS_GET_SYNC_BYTE(header) == TS_SYNC_BYTE && TS_GET_PID(header) == pid)
+            {
+                return viewPacketByNumber(packetNumber + ix);
+            }
+            data += packetSize;
+        }
+        packetNumber += count;
+    }
+    return NULL;
 }
 
-TsPacket* TsFile::viewNextPacket()
+bool TsFile::buildPidIndex()
 {
-    uint64_t packetOffset = (uint64_t) - 1;
-    if (lastPacketOffset == (uint64_t) - 1)
+    if (!isTsFile)
+    {
+        return false;
+    }
+    if (getPacketCount() > (uint32_t) - 1)
+    {
+        ERR("Too many packets to build the PID index");
+        return false;
+    }
+    if (pidIndex)
+    {
+        pidIndex->clear();
+    }
+    else
+    {
+        pidIndex = new PidIndex();
+    }
+
+    // Only the packets of the video and PCR PIDs are parsed for the random
+    // access points
+    bool hasVideo = startRapIndex();
+    TsPacket tsPacket;
+
+    uint64_t packetNumber = 0;
+    uint64_t count;
+    uint8_t* packets;
+    while ((packets = findPackets(packetNumber, (uint64_t) - 1, count)) != NULL)
     {
-        packetOffset = 0;
+        uint8_t* data = packets + headerOffset;
+        for (uint64_t ix = 0; ix < count; ++ix)
+        {
+            DelphinusUtils::ByteField* header = (DelphinusUtils::ByteField*)data;
+            if (TS_GET_SYNC_BYTE(header) == TS_SYNC_BYTE)
+            {
+                uint16_t pid = TS_GET_PID(header);
+                pidIndex->addPacket(pid, (uint32_t)(packetNumber + ix));
+                if (hasVideo && rapIndex->isIndexedPid(pid) && tsPacket.parse(data, PACKET_SIZE_TS))
+                {
+                    rapIndex->pushPacket(&tsPacket, packetNumber + ix);
+                }
+            }
+            data += packetSize;
+        }
+        packetNumber += count;
     }
-    else if (lastPacketOffset + packetSize >= fileSize)
+    pidIndex->finalize();
+    if (hasVideo)
+    {
+        rapIndex->finalize();
+    }
+    MSG("Indexed %" PRIu64 " packets", pidIndex->getTotalPackets());
+    return true;
+}
+
+bool TsFile::startRapIndex()
+{
+    if (rapIndex)
+    {
+        rapIndex->clear();
+    }
+    else
+    {
+        rapIndex = new RapIndex();
+    }
+    bool hasVideo = false;
+    const PmtInfoList& pmtInfoList = metadata.getPmtInfoList();
+    for (PmtInfoList::const_iterator ix = pmtInfoList.begin(); ix != pmtInfoList.end(); ++ix)
+    {
+        hasVideo = rapIndex->addProgram(*ix) || hasVideo;
+    }
+    if (!hasVideo)
+    {
+        MSG("No video stream to index the random access points of");
+        delete rapIndex;
+        rapIndex = NULL;
+    }
+    return hasVideo;
+}
+
+bool TsFile::buildRapIndex()
+{
+    if (!isTsFile || !startRapIndex())
+    {
+        return false;
+    }
+
+    TsPacket tsPacket;
+    uint64_t packetNumber = 0;
+    uint64_t count;
+    uint8_t* packets;
+    while ((packets = findPackets(packetNumber, (uint64_t) - 1, count)) != NULL)
+    {
+        uint8_t* data = packets + headerOffset;
+        for (uint64_t ix = 0; ix < count; ++ix)
+        {
+            DelphinusUtils::ByteField* header = (DelphinusUtils::ByteField*)data;
+            if (TS_GET_SYNC_BYTE(header) == TS_SYNC_BYTE &&
+                rapIndex->isIndexedPid(TS_GET_PID(header)) && tsPacket.parse(data, PACKET_SIZE_TS))
+            {
+                rapIndex->pushPacket(&tsPacket, packetNumber + ix);
+            }
+            data += packetSize;
+        }
+        packetNumber += count;
+    }
+    rapIndex->finalize();
+    MSG("Indexed %" PRIu64 " random access points", rapIndex->getRandomAccessPointCount());
+    return true;
+}
+
+const RapIndex::RandomAccessPointList& TsFile::getRandomAccessPoints(uint16_t programNumber)
+{
+    static const RapIndex::RandomAccessPointList noPoints;
+    return rapIndex ? rapIndex->getRandomAccessPoints(programNumber) : noPoints;
+}
+
+TsPacket* TsFile::seekToRandomAccessPoint(uint16_t programNumber, uint64_t packetNumber)
+{
+    if (!rapIndex && !buildRapIndex())
     {
-        // reached EOF
         return NULL;
     }
-    
-    packetOffset = lastPacketOffset + packetSize;
-    uint64_t bufferOffset = packetOffset % BUFFER_SIZE;
-    if (bufferOffset == 0)
+    RapIndex::RandomAccessPoint point;
+    if (!rapIndex->findRandomAccessPoint(programNumber, packetNumber, point))
     {
-        // We do not have this packet in the buffer yet
-        readFromOffset(packetOffset);
+        return NULL;
     }
-    MSG("Returning packet from buffer offset: %lu", bufferOffset);
-    viewPacket->parse(buffer + bufferOffset, validBufferSize - bufferOffset);
-    lastPacketOffset = packetOffset;
-    return viewPacket;
+    return viewPacketByNumber(point.packetNumber);
 }
 
-TsPacket* TsFile::viewPreviousPacket()
+uint32_t TsFile::decodeHeaders(uint64_t packetNumber, TsHeaderBatch& batch)
+{
+    uint64_t count;
+    uint8_t* data = findPackets(packetNumber, batch.getCapacity(), count);
+    if (data == NULL)
+    {
+        return 0;
+    }
+    return batch.decode(data, count * packetSize, packetSize);
+}
+
+const uint8_t* TsFile::viewPackets(uint64_t packetNumber, uint32_t& count)
+{
+    uint64_t found;
+    uint8_t* data = findPackets(packetNumber, (uint32_t) - 1, found);
+    count = found;
+    return data;
+}
+
+uint32_t TsFile::readPackets(uint64_t packetNumber, uint32_t count, uint8_t* data)
+{
+    if (!isTsFile)
+    {
+        return 0;
+    }
+    while (true)
+    {
+        uint64_t segment = findSegment(packetNumber);
+        uint64_t segmentEnd = getSegmentEnd(segment);
+        if (packetNumber >= segmentEnd)
+        {
+            return 0;
+        }
+        // The packets read never span a lost sync region
+        count = GET_LESS((uint64_t)count, segmentEnd - packetNumber);
+        uint64_t offset = getPacketOffset(packetNumber);
+        uint64_t size = (uint64_t)count * packetSize;
+        uint64_t readSize = 0;
+#ifndef _WIN32
+        // A positional read leaves the chunk being viewed and the position
+        // of the file alone
+        int fd = fileno(fileHandle);
+        while (readSize < size)
+        {
+            ssize_t bytes = pread(fd, data + readSize, size - readSize, offset + readSize);
+            if (bytes < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes <= 0)
+            {
+                break;
+            }
+            readSize += bytes;
+        }
+#else
+        // The chunks are always read after seeking, moving the position is
+        // fine
+        if (!fseeko(fileHandle, offset, SEEK_SET))
+        {
+            readSize = readFile(data, fileHandle, size);
+        }
+#endif
+        uint64_t packets = readSize / packetSize;
+        if (verifyPackets(data, offset, packets))
+        {
+            return packets;
+        }
+    }
+}
+
+bool TsFile::findLostSyncRegions(LostSyncRegionList& regions)
 {
-    uint64_t packetOffset = (uint64_t) - 1;
-    if (lastPacketOffset == (uint64_t) - 1)
+    regions.clear();
+    if (!isTsFile)
     {
-        packetOffset = 0;
+        return false;
+    }
+    checkSync(fileSize);
+    if (dataOffset > 0)
+    {
+        LostSyncRegion region;
+        region.start = 0;
+        region.end = dataOffset;
+        regions.push_back(region);
+    }
+    regions.insert(regions.end(), lostSyncRegions.begin(), lostSyncRegions.end());
+    return true;
+}
+
+uint64_t TsFile::getPidPacketCount(uint16_t pid)
+{
+    return pidIndex ? pidIndex->getPacketCount(pid) : 0;
+}
+
+bool TsFile::writeIndexFile()
+{
+    IndexFile::FileKey key;
+    if (!isTsFile || !IndexFile::getFileKey(openedFileName.c_str(), key))
+    {
+        return false;
+    }
+    if (!pidIndex)
+    {
+        // The index file is still useful without the PID index, for files
+        // with too many packets to be indexed
+        buildPidIndex();
+    }
+    // Fails only if there are no PCRs, which is fine too
+    buildPcrIndex();
+    if (!rapIndex)
+    {
+        // Fails only if there is no video, which is fine too
+        buildRapIndex();
+    }
+
+    // Copy the packets which carry the tables, as the view is only
+    // valid till the next packet is viewed. The tables spanning several
+    // packets need all the packets of their PID up to the last one.
+    std::vector<uint64_t> packetNumbers;
+    std::vector<uint8_t> packetData;
+    const PatInfo& patInfo = metadata.getPatInfo();
+    if (patInfo.packetNumber != (uint64_t) - 1 &&
+        !copyTablePackets(PID_PAT, patInfo.packetNumber, patInfo.lastPacketNumber,
+                          packetNumbers, packetData))
+    {
+        return false;
     }
-    else if (lastPacketOffset - packetSize >= fileSize)
+    const PmtInfoList& pmtInfoList = metadata.getPmtInfoList();
+    for (PmtInfoList::const_iterator ix = pmtInfoList.begin(); ix != pmtInfoList.end(); ++ix)
+    {
+        if (!copyTablePackets(ix->pmtPid, ix->packetNumber, ix->lastPacketNumber,
+                              packetNumbers, packetData))
+        {
+            return false;
+        }
+    }
+    const CatInfo& catInfo = metadata.getCatInfo();
+    if (catInfo.packetNumber != (uint64_t) - 1 &&
+        !copyTablePackets(PID_CAT, catInfo.packetNumber, catInfo.lastPacketNumber,
+                          packetNumbers, packetData))
+    {
+        return false;
+    }
+    const TsdtInfo& tsdtInfo = metadata.getTsdtInfo();
+    if (tsdtInfo.packetNumber != (uint64_t) - 1 &&
+        !copyTablePackets(PID_TSDT, tsdtInfo.packetNumber, tsdtInfo.lastPacketNumber,
+                          packetNumbers, packetData))
+    {
+        return false;
+    }
+    const NitInfo& nitInfo = metadata.getNitInfo();
+    if (nitInfo.packetNumber != (uint64_t) - 1 &&
+        !copyTablePackets(nitInfo.pid, nitInfo.packetNumber, nitInfo.lastPacketNumber,
+                          packetNumbers, packetData))
+    {
+        return false;
+    }
+    IndexFile::StoredPacketList storedPackets;
+    for (uint64_t ix = 0; ix < packetNumbers.size(); ++ix)
+    {
+        IndexFile::StoredPacket storedPacket;
+        storedPacket.packetNumber = packetNumbers[ix];
+        storedPacket.data = &packetData[ix * packetSize];
+        storedPackets.push_back(storedPacket);
+    }
+
+    std::string indexFileName = openedFileName + ".idx";
+    return IndexFile::write(indexFileName.c_str(), key, packetSize, storedPackets, pidIndex,
+                            (pcrIndex && pcrIndex->getCheckpoints().size()) ? pcrIndex : NULL,
+                            rapIndex);
+}
+
+bool TsFile::copyTablePackets(uint16_t pid, uint64_t firstPacket, uint64_t lastPacket,
+                              std::vector<uint64_t>& packetNumbers, std::vector<uint8_t>& packetData)
+{
+    uint64_t packetNumber = firstPacket;
+    TsPacket* tsPacket = viewPacketByNumber(firstPacket);
+    while (tsPacket)
+    {
+        packetNumbers.push_back(packetNumber);
+        packetData.insert(packetData.end(), tsPacket->getStart(), tsPacket->getStart() + packetSize);
+        if (packetNumber >= lastPacket)
+        {
+            return true;
+        }
+        tsPacket = viewPacketByPid(pid);
+        packetNumber = lastPacketNumber;
+    }
+    return false;
+}
+
+uint8_t* TsFile::getPacketHeader(uint64_t packetNumber)
+{
+    uint64_t count;
+    uint8_t* data = findPackets(packetNumber, 1, count);
+    return data ? data + headerOffset : NULL;
+}
+
+bool TsFile::findPcrPacket(uint64_t fromPacket, uint64_t toPacket,
+                           uint64_t& packetNumber, uint64_t& pcr)
+{
+    // PID_NULL stands for any PID, as null packets never carry a PCR
+    uint16_t pid = pcrIndex->getPcrPid();
+    toPacket = GET_LESS(toPacket, getPacketCount());
+    if (pidIndex && pid != PID_NULL)
+    {
+        // Jump over the packets of the other PIDs
+        uint64_t next = pidIndex->findNextPacket(pid, (fromPacket == 0) ? (uint64_t) - 1 : fromPacket - 1);
+        while (next != (uint64_t) - 1 && next < toPacket)
+        {
+            uint8_t* header = getPacketHeader(next);
+            if (header && AdaptationField::readPcr(header, pcr))
+            {
+                packetNumber = next;
+                return true;
+            }
+            next = pidIndex->findNextPacket(pid, next);
+        }
+        return false;
+    }
+
+    uint64_t nextPacket = fromPacket;
+    uint64_t count;
+    uint8_t* data;
+    while (nextPacket < toPacket && (data = findPackets(nextPacket, toPacket - nextPacket, count)) != NULL)
+    {
+        for (uint64_t ix = 0; ix < count; ++ix)
+        {
+            uint8_t* header = data + headerOffset;
+            if ((pid == PID_NULL || TS_GET_PID(((DelphinusUtils::ByteField*)header)) == pid) &&
+                AdaptationField::readPcr(header, pcr))
+            {
+                packetNumber = nextPacket + ix;
+                return true;
+            }
+            data += packetSize;
+        }
+        nextPacket += count;
+    }
+    return false;
+}
+
+bool TsFile::findLastPcrPacket(uint64_t& packetNumber, uint64_t& pcr)
+{
+    // Look through the file backwards, one chunk at a time
+    uint64_t chunkPackets = chunkSize / packetSize;
+    uint64_t windowEnd = getPacketCount();
+    while (windowEnd > 0)
+    {
+        // Fewer packets once a lost sync region is found on the way
+        windowEnd = GET_LESS(windowEnd, getPacketCount());
+        uint64_t windowStart = (windowEnd > chunkPackets) ? windowEnd - chunkPackets : 0;
+        uint64_t nextPacket = windowStart;
+        uint64_t foundPacket;
+        uint64_t foundPcr;
+        bool isFound = false;
+        while (findPcrPacket(nextPacket, windowEnd, foundPacket, foundPcr))
+        {
+            packetNumber = foundPacket;
+            pcr = foundPcr;
+            isFound = true;
+            nextPacket = foundPacket + 1;
+        }
+        if (isFound)
+        {
+            return true;
+        }
+        windowEnd = windowStart;
+    }
+    return false;
+}
+
+bool TsFile::initPcrIndex()
+{
+    if (!isTsFile)
+    {
+        return false;
+    }
+    if (pcrIndex && (!pcrIndex->getCheckpoints().empty() || pcrIndex->getComplete()))
+    {
+        // A complete index without checkpoints was left by a search of the
+        // whole file which found no PCR
+        return !pcrIndex->getCheckpoints().empty();
+    }
+
+    uint16_t pid = pcrPid;
+    const PmtInfoList& pmtInfoList = metadata.getPmtInfoList();
+    if (pid == PID_NULL && !pmtInfoList.empty())
+    {
+        pid = pmtInfoList.front().pcrPid;
+    }
+    if (!pcrIndex)
+    {
+        pcrIndex = new PcrIndex();
+    }
+
+    uint64_t firstPacket;
+    uint64_t firstPcr;
+    pcrIndex->reset(pid, 0);
+    if (!findPcrPacket(0, getPacketCount(), firstPacket, firstPcr))
+    {
+        MSG("No PCR found on PID: 0x%04x", pid);
+        // Not searched again until the PCR PID changes
+        pcrIndex->setComplete(true);
+        return false;
+    }
+    if (pid == PID_NULL)
+    {
+        // Without a PMT, use the first PID found carrying a PCR
+        pid = TS_GET_PID(((DelphinusUtils::ByteField*)getPacketHeader(firstPacket)));
+    }
+    pcrIndex->reset(pid, firstPcr);
+    pcrIndex->addCheckpoint(firstPacket, 0);
+
+    uint64_t lastPacket;
+    uint64_t lastPcr;
+    if (findLastPcrPacket(lastPacket, lastPcr))
+    {
+        pcrIndex->addCheckpoint(lastPacket, pcrIndex->getElapsed(lastPcr));
+    }
+    return true;
+}
+
+TsPacket* TsFile::seekToElapsed(uint64_t elapsed)
+{
+    const PcrIndex::CheckpointList& checkpoints = pcrIndex->getCheckpoints();
+    if (elapsed <= checkpoints.front().elapsed)
+    {
+        return viewPacketByNumber(checkpoints.front().packetNumber);
+    }
+    if (elapsed >= checkpoints.back().elapsed)
+    {
+        return viewPacketByNumber(checkpoints.back().packetNumber);
+    }
+
+    PcrIndex::Checkpoint lower;
+    PcrIndex::Checkpoint upper;
+    if (!pcrIndex->findCheckpoints(elapsed, lower, upper))
     {
-        // This case wont be hit - if we do then detonate
-        assert(false);
         return NULL;
     }
-    
-    packetOffset = lastPacketOffset - packetSize;
-    uint64_t bufferOffset = packetOffset % BUFFER_SIZE;
-    if (bufferOffset == (uint64_t)(BUFFER_SIZE - packetSize))
+
+    // Narrow down the range by interpolating between the PCRs around the
+    // time, alternating with bisection so that an uneven bitrate cannot keep
+    // the guesses stuck at one end of the range
+    uint64_t linearPackets = chunkSize / packetSize;
+    bool isBisecting = false;
+    while (upper.packetNumber - lower.packetNumber > linearPackets)
     {
-        // We do not have this packet in the buffer yet
-        readFromOffset(packetOffset - bufferOffset);
+        uint64_t range = upper.packetNumber - lower.packetNumber;
+        uint64_t guess;
+        if (isBisecting || upper.elapsed <= lower.elapsed)
+        {
+            guess = lower.packetNumber + range / 2;
+        }
+        else
+        {
+            guess = lower.packetNumber + (uint64_t)((double)(elapsed - lower.elapsed) * range /
+                                                    (upper.elapsed - lower.elapsed));
+        }
+        if (guess <= lower.packetNumber)
+        {
+            guess = lower.packetNumber + 1;
+        }
+        else if (guess >= upper.packetNumber)
+        {
+            guess = upper.packetNumber - 1;
+        }
+        isBisecting = !isBisecting;
+
+        uint64_t packetNumber;
+        uint64_t pcr;
+        if (findPcrPacket(guess, upper.packetNumber, packetNumber, pcr))
+        {
+            uint64_t foundElapsed = pcrIndex->getElapsed(pcr);
+            pcrIndex->addCheckpoint(packetNumber, foundElapsed);
+            PcrIndex::Checkpoint& bound = (foundElapsed <= elapsed) ? lower : upper;
+            bound.packetNumber = packetNumber;
+            bound.elapsed = foundElapsed;
+        }
+        else
+        {
+            // No PCR from the guess onwards, the time lies before the guess
+            upper.packetNumber = guess;
+        }
     }
-    viewPacket->parse(buffer + bufferOffset, validBufferSize - bufferOffset);
-    lastPacketOffset = packetOffset;
-    return viewPacket;
+
+    // Walk over the PCRs in the remaining range
+    uint64_t result = lower.packetNumber;
+    uint64_t packetNumber;
+    uint64_t pcr;
+    while (findPcrPacket(result + 1, upper.packetNumber, packetNumber, pcr) &&
+           pcrIndex->getElapsed(pcr) <= elapsed)
+    {
+        result = packetNumber;
+    }
+    return viewPacketByNumber(result);
+}
+
+TsPacket* TsFile::seekToPcr(uint64_t pcr)
+{
+    if (!initPcrIndex())
+    {
+        return NULL;
+    }
+    uint64_t elapsed = pcrIndex->getElapsed(pcr % PCR_WRAP_AROUND);
+    uint64_t lastElapsed = pcrIndex->getCheckpoints().back().elapsed;
+    if (elapsed > lastElapsed + (PCR_WRAP_AROUND - lastElapsed) / 2)
+    {
+        // Closer to the first PCR going backwards, i.e. before the file
+        elapsed = 0;
+    }
+    return seekToElapsed(elapsed);
+}
+
+TsPacket* TsFile::seekToTime(double seconds)
+{
+    if (!initPcrIndex())
+    {
+        return NULL;
+    }
+    uint64_t elapsed = (seconds > 0) ? (uint64_t)(seconds * SYSTEM_CLOCK_FREQUENCY) : 0;
+    return seekToElapsed(elapsed);
+}
+
+double TsFile::getDuration()
+{
+    if (!initPcrIndex())
+    {
+        return 0;
+    }
+    return (double)pcrIndex->getCheckpoints().back().elapsed / SYSTEM_CLOCK_FREQUENCY;
+}
+
+bool TsFile::buildPcrIndex()
+{
+    if (!initPcrIndex())
+    {
+        return false;
+    }
+    if (pcrIndex->getComplete())
+    {
+        return true;
+    }
+
+    // First PCR of every chunk, collected separately and merged at once
+    PcrIndex::CheckpointList checkpoints;
+    uint64_t maxPackets = getPacketCount();
+    uint64_t chunkPackets = chunkSize / packetSize;
+    for (uint64_t chunkStart = 0; chunkStart < maxPackets; chunkStart += chunkPackets)
+    {
+        PcrIndex::Checkpoint checkpoint;
+        uint64_t pcr;
+        if (findPcrPacket(chunkStart, chunkStart + chunkPackets, checkpoint.packetNumber, pcr))
+        {
+            checkpoint.elapsed = pcrIndex->getElapsed(pcr);
+            checkpoints.push_back(checkpoint);
+        }
+    }
+    pcrIndex->mergeCheckpoints(checkpoints);
+    pcrIndex->setComplete(true);
+    return true;
 }
 
+void TsFile::setPcrPid(uint16_t pid)
+{
+    if (pid != pcrPid && pcrIndex)
+    {
+        delete pcrIndex;
+        pcrIndex = NULL;
+    }
+    pcrPid = pid;
+}
@@ -32,9 +32,21 @@
 #ifndef DELPHINUS_TSFILE_H
 #define DELPHINUS_TSFILE_H
 #include <cstdio>
+#include <string>
+#include <vector>
 #include "Ts.h"
 #include "Pes.h"
 #include "PsiTables.h"
+#include "TsMetadata.h"
+#include "SyncScanner.h"
+#include "RapIndex.h"
+
+class ReadAhead;
+class UringReader;
+class PidIndex;
+class PcrIndex;
+class IndexFile;
+class TsHeaderBatch;
 
 /**
  *  \brief  A file abstraction to handle raw TS files.
@@ -43,6 +55,20 @@
  *  provides the ability to access the TS file as individual TS packets. It
  *  also parses the PAT, PMT and other standard tables present in the TS and
  *  populates the metadata on opening the file.
+ *
+ *  The packet size and the first packet are found by locking to the sync
+ *  bytes at the start of the file, so files with 188, 192 or 204 bytes
+ *  packets and files cut in the middle of a packet are handled. The packets
+ *  are numbered from the first packet found. When a packet which should
+ *  start at the end of the previous one does not carry the sync byte, the
+ *  packets are locked again from there, skipping the bytes which are not
+ *  part of any packet, so that the numbering goes on over the corrupted
+ *  parts of the file.
+ *
+ *  The sync bytes are checked as the packets are read, and the packets
+ *  beyond the part of the file checked so far are assumed to follow on. Only
+ *  when one of them turns out to have lost the sync, the file is checked in
+ *  one pass up to it, so a clean file is never read more than required.
  */
 class TsFile
 {
@@ -50,46 +76,100 @@ class TsFile
 /**
  *  \brief  PAT information.
  */
-        struct PatInfo
-        {
-/** Packet number(starts at 0) in the TS file where the PAT was located. */
-            uint64_t packetNumber;
-/** Transport Stream ID mentioned in the PAT. */
-            uint16_t transportStreamId;
-/** List of all the programs mentioned in the PAT. */
-            PatSection::ProgramList programList;
-        };
+        typedef TsMetadata::PatInfo PatInfo;
 /**
  *  \brief  PMT information.
  */
-        struct PmtInfo
-        {
-/** Packet number(starts at 0) in the TS file where the PMT was located. */
-            uint64_t packetNumber;
-/** PMT PID. */
-            uint16_t pmtPid;
-/** Program number mentioned in the PMT. */
-            uint16_t programNumber;
-/** PCR PID of the program mentioned in the PMT. */
-            uint16_t pcrPid;
-/** List of all the streams mentioned in the PMT. */
-            PmtSection::StreamList streamList;
-        };
+        typedef TsMetadata::PmtInfo PmtInfo;
 /**
  *  \brief  A list of PMTs.
  */
-        typedef std::list<PmtInfo> PmtInfoList;
+        typedef TsMetadata::PmtInfoList PmtInfoList;
+/**
+ *  \brief  CAT information.
+ */
+        typedef TsMetadata::CatInfo CatInfo;
+/**
+ *  \brief  TSDT information.
+ */
+        typedef TsMetadata::TsdtInfo TsdtInfo;
+/**
+ *  \brief  NIT information.
+ */
+        typedef TsMetadata::NitInfo NitInfo;
+/**
+ *  \brief  A range of bytes of the file which is not part of any packet.
+ */
+        typedef SyncScanner::LostSyncRegion LostSyncRegion;
+/**
+ *  \brief  A list of lost sync regions.
+ */
+        typedef SyncScanner::LostSyncRegionList LostSyncRegionList;
+/**
+ *  \brief  Backends which can be used for reading the TS file.
+ */
+        enum IoMode
+        {
+/** Read the file in chunks through stdio into a private buffer. */
+            IO_MODE_STDIO               = 0,
+/** Memory map the whole file and view the packets in place. */
+            IO_MODE_MMAP                = 1,
+/** Read the subsequent chunks in a background thread while the current
+ *  chunk is being parsed. */
+            IO_MODE_READ_AHEAD          = 2,
+/** Keep several chunk reads in flight using io_uring, on Linux only. */
+            IO_MODE_IO_URING            = 3
+        };
 
     private:
         enum
         {
             // LCM of 188, 192 and 4096
             BUFFER_SIZE = 577536,
-            VALID_PACKETS = 10
+            VALID_PACKETS = 10,
+            DEFAULT_QUEUE_DEPTH = 4
         };
+        // A run of packets following each other, from its packet number on
+        // till the packet number of the next one
+        struct SyncSegment
+        {
+            uint64_t packetNumber;
+            uint64_t offset;
+        };
+        typedef std::vector<SyncSegment> SyncSegmentList;
+
         uint8_t* buffer;
+        // Start of the data currently available for viewing, either buffer
+        // or a window into the memory mapped file
+        uint8_t* bufferStart;
+        // Start of the memory mapped file in IO_MODE_MMAP
+        uint8_t* mappedFile;
+        // Background reader in IO_MODE_READ_AHEAD
+        ReadAhead* readAhead;
+        // Asynchronous reader in IO_MODE_IO_URING
+        UringReader* uringReader;
+        // Packet numbers of each PID, built on demand by buildPidIndex()
+        // or loaded from the index file
+        PidIndex* pidIndex;
+        // PCR checkpoints, filled lazily by the time based seeks
+        PcrIndex* pcrIndex;
+        // Random access points of the programs, built along with the PID
+        // index or by buildRapIndex(), or loaded from the index file
+        RapIndex* rapIndex;
+        // PID whose PCR is used for the time based seeks, PID_NULL to pick
+        // the PCR PID of the first program
+        uint16_t pcrPid;
+        // Index file found next to the TS file, when it matches the TS file
+        IndexFile* indexFile;
+        // Name of the file passed to open()
+        std::string openedFileName;
         FILE* fileHandle;
         TsPacket* viewPacket;
+        IoMode ioMode;
+        // Number of chunks kept in flight by the asynchronous IO modes
+        uint8_t queueDepth;
+        // Use O_DIRECT in IO_MODE_IO_URING
+        bool isDirectIo;
 
         // File size in bytes
         uint64_t fileSize;
@@ -97,24 +177,56 @@ class TsFile
         uint64_t validBufferSize;
         // Current offset within the file for the start of the buffer
         uint64_t currentFileOffset;
-        // File offset for the last packet fetched using any of the
+        // File offset of the first packet, the chunks are read from here on
+        uint64_t dataOffset;
+        // Size of the chunks read, the largest multiple of the packet size
+        // which fits in the buffer
+        uint64_t chunkSize;
+        // Packet number of the last packet fetched using any of the
         // viewPacket() calls
-        uint64_t lastPacketOffset;
+        uint64_t lastPacketNumber;
         // Size of the packets of the current TS
         uint8_t packetSize;
+        // Offset of the TS header within the packets
+        uint8_t headerOffset;
         // Indicated a valid TS file
         bool isTsFile;
         // Indicates EOF
         bool isEof;
 
-        // PAT info
-        PatInfo patInfo;
-        // PMT info
-        PmtInfoList pmtInfoList;
+        // The packets found so far, the first segment starting at dataOffset
+        // and the last one running till the end of the file
+        SyncSegmentList syncSegments;
+        // The sync bytes of the packets before this offset were checked
+        uint64_t checkedOffset;
+        LostSyncRegionList lostSyncRegions;
+        SyncScanner syncScanner;
 
+        // PAT, PMT info
+        TsMetadata metadata;
+
+        bool mapFile();
+        void unmapFile();
         void readFromOffset(uint64_t offset);
+        uint64_t findSegment(uint64_t packetNumber);
+        uint64_t getSegmentEnd(uint64_t segment);
+        uint64_t getPacketOffset(uint64_t packetNumber);
+        void checkSync(uint64_t endOffset);
+        void resync(uint64_t lostOffset);
+        bool verifyPackets(const uint8_t* data, uint64_t offset, uint64_t count);
+        uint8_t* findPackets(uint64_t packetNumber, uint64_t maxCount, uint64_t& count);
         void validate();
         void collectMetadata();
+        bool loadIndexFile();
+        bool startRapIndex();
+        bool copyTablePackets(uint16_t pid, uint64_t firstPacket, uint64_t lastPacket,
+                              std::vector<uint64_t>& packetNumbers, std::vector<uint8_t>& packetData);
+        uint8_t* getPacketHeader(uint64_t packetNumber);
+        bool findPcrPacket(uint64_t fromPacket, uint64_t toPacket,
+                           uint64_t& packetNumber, uint64_t& pcr);
+        bool findLastPcrPacket(uint64_t& packetNumber, uint64_t& pcr);
+        bool initPcrIndex();
+        TsPacket* seekToElapsed(uint64_t elapsed);
 
     public:
         TsFile();
@@ -122,12 +234,17 @@ class TsFile
 
 /**
  *  \brief  Opens a given file. To check if it is a valid TS file make use of
- *          isValid() instead.
+ *          isValid() instead. If an index file written by writeIndexFile()
+ *          is found next to the file, and the file has not been modified
+ *          since, the metadata and the PID index are loaded from it instead
+ *          of scanning the file.
  *  \param  fileName The filename can be absolute or relative and is passed
  *          as-is to fopen.
+ *  \param  mode The backend to be used for reading the file. If the backend
+ *          cannot be used for the file, TsFile falls back to IO_MODE_STDIO.
  *  \return true if file was opened successfully, false otherwise.
  */
-        bool open(const char* fileName);
+        bool open(const char* fileName, IoMode mode = IO_MODE_STDIO);
 /**
  *  \brief  Close the file currently opened by the TsFile handle.
  */
@@ -148,8 +265,151 @@ class TsFile
  *  \return TsPacket handle of the packet number on success, NULL otherwise.
  */
         TsPacket* viewPacketByNumber(uint64_t packetNumber);
-//      FIXME: add this functionality later
-//        TsPacket* viewPacketByPid(uint16_t pid);
+/**
+ *  \brief  View the next TS packet of a given PID with the reference being
+ *          the packet number in the last call to any of the viewPacket()
+ *          calls, or the beginning of the file if no packet was viewed yet.
+ *          Jumps directly to the packet when the PID index has been built
+ *          using buildPidIndex(), looks at the header of every subsequent
+ *          packet otherwise.
+ *          \warning The validity of the TsPacket handle is only till the
+ *          next call to viewNextPacket(), viewPreviousPacket(), or
+ *          viewPacketByNumber() or any other seek operations in TsFile.
+ *          \warning To persist the TsPacket by allocating memory on the heap
+ *          use the TsPacket::copy() method.
+ *  \param  pid PID of the packet.
+ *  \return TsPacket handle for the next packet of the PID, NULL otherwise.
+ */
+        TsPacket* viewPacketByPid(uint16_t pid);
+/**
+ *  \brief  Build the PID index, a list of the packet numbers of every PID,
+ *          by reading through the whole file once. The index is used by
+ *          viewPacketByPid() and released on close(). The random access
+ *          points of the programs are indexed in the same pass, as done by
+ *          buildRapIndex().
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          viewPacket() call.
+ *  \return true if the index was built, false if the file is not a valid
+ *          TS file or has more than 2^32 packets.
+ */
+        bool buildPidIndex();
+/**
+ *  \brief  Build the index of the random access points of the video of the
+ *          programs in the PMTs, by reading through the whole file once.
+ *          The index is used by seekToRandomAccessPoint() and released on
+ *          close().
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          viewPacket() call.
+ *  \return true if the index was built, false if the file is not a valid
+ *          TS file or none of its programs has a video stream.
+ */
+        bool buildRapIndex();
+/**
+ *  \brief  Check if the index of the random access points has been built.
+ *  \return true if the index is available, false otherwise.
+ */
+        bool hasRapIndex();
+/**
+ *  \brief  Get the random access points of a program, a GOP running from
+ *          each of them to the next.
+ *  \param  programNumber Program number of the program.
+ *  \return The random access points in the order of the packets, empty if
+ *          the index has not been built.
+ */
+        const RapIndex::RandomAccessPointList& getRandomAccessPoints(uint16_t programNumber);
+/**
+ *  \brief  View the packet starting the last random access point of a
+ *          program at or before a packet, to start decoding the video from
+ *          the nearest key frame. The index of the random access points is
+ *          built first if required.
+ *          \warning The validity of the TsPacket handle is only till the
+ *          next call to viewNextPacket(), viewPreviousPacket(), or
+ *          viewPacketByNumber() or any other seek operations in TsFile.
+ *  \param  programNumber Program number of the program.
+ *  \param  packetNumber Packet number(starts at 0) of the packet.
+ *  \return TsPacket handle of the packet on success, NULL if the program
+ *          has no random access point at or before the packet.
+ */
+        TsPacket* seekToRandomAccessPoint(uint16_t programNumber, uint64_t packetNumber);
+/**
+ *  \brief  Decode the headers of a run of packets into a batch, as many as
+ *          fit in the batch and in the chunk holding the first packet. Call
+ *          again from the packet following the last one decoded to go
+ *          through the file.
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          viewPacket() call.
+ *  \param  packetNumber Packet number of the first packet.
+ *  \param  batch Batch to decode into.
+ *  \return Number of packets decoded, 0 past the last packet.
+ */
+        uint32_t decodeHeaders(uint64_t packetNumber, TsHeaderBatch& batch);
+/**
+ *  \brief  View a run of packets in place, as many as the chunk holding the
+ *          first packet has from it onwards, without copying them. Call
+ *          again from the packet following the run to go through the file.
+ *          \warning The packets are only valid till the next call to any of
+ *          the viewPacket() calls or any other seek operations in TsFile,
+ *          except in IO_MODE_MMAP where they stay valid till close().
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          viewPacket() call.
+ *  \param  packetNumber Packet number of the first packet.
+ *  \param  count Set to the number of packets in the run.
+ *  \return Start of the first packet, including the timestamp of the TTS
+ *          packets, NULL past the last packet.
+ */
+        const uint8_t* viewPackets(uint64_t packetNumber, uint32_t& count);
+/**
+ *  \brief  Read a run of packets into a buffer with a single positional
+ *          read, bypassing the chunks. Reading a few packets spread over the
+ *          file this way does not read the whole chunks holding them.
+ *  \param  packetNumber Packet number of the first packet.
+ *  \param  count Number of packets to read.
+ *  \param  data Buffer of at least count times the packet size bytes, the
+ *          packets include the timestamp of the TTS packets.
+ *  \return Number of packets read, fewer than count past the last packet,
+ *          at a lost sync region or on a read error.
+ */
+        uint32_t readPackets(uint64_t packetNumber, uint32_t count, uint8_t* data);
+/**
+ *  \brief  Find the regions of the file which are not part of any packet,
+ *          by checking the sync bytes of all the packets. The bytes before
+ *          the first packet are reported as the first region, and the
+ *          packets with a damaged sync byte, which are still numbered, as
+ *          regions too.
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          viewPacket() call.
+ *  \param  regions List of lost sync regions, empty for a clean file.
+ *  \return true if the whole file was checked, false if the file is not a
+ *          valid TS file.
+ */
+        bool findLostSyncRegions(LostSyncRegionList& regions);
+/**
+ *  \brief  Write the index file for the currently opened file, named as the
+ *          file with the suffix ".idx". It carries the packet size, the PAT
+ *          and PMTs, the PID index, the PCR index and the index of the
+ *          random access points, which are built first if required.
+ *          The index file is ignored by open() once the file is modified.
+ *          \warning Invalidates the TsPacket handle returned by the last
+ *          viewPacket() call.
+ *  \return true if the index file was written, false otherwise.
+ */
+        bool writeIndexFile();
+/**
+ *  \brief  Check if the metadata was loaded from the index file by open().
+ *  \return true if the index file is used, false otherwise.
+ */
+        bool hasIndexFile();
+/**
+ *  \brief  Check if the PID index has been built.
+ *  \return true if the PID index is available, false otherwise.
+ */
+        bool hasPidIndex();
+/**
+ *  \brief  Get the number of packets of a PID from the PID index.
+ *  \param  pid PID of the packets.
+ *  \return Number of packets, 0 if the PID index has not been built.
+ */
+        uint64_t getPidPacketCount(uint16_t pid);
 /**
  *  \brief  View the next TS packet with the reference being the packet
  *          number in the last call to viewPacketByNumber() /
@@ -175,6 +435,21 @@ class TsFile
  */
         TsPacket* viewPreviousPacket();
 
+/**
+ *  \brief  Keep following the tables once they are found, so that open()
+ *          parses the whole file and the info returned by getPatInfo() and
+ *          the others is the last version of the tables. The setting is kept
+ *          across the calls to open(), and the metadata loaded from the
+ *          index file only has the tables stored in it.
+ *  \param  isEnabled Follow the tables or stop once they are all found.
+ */
+        void setTableTracking(bool isEnabled);
+/**
+ *  \brief  Get the cache of the tables seen so far, to register listeners
+ *          for their new versions before calling open().
+ *  \return Table cache.
+ */
+        TableCache& getTableCache();
 /**
  *  \brief  Get the PAT info populated when opening the file.
  *  \return PAT Info.
@@ -185,8 +460,72 @@ class TsFile
  *  \return List of PMT Info(s).
  */
         const PmtInfoList& getPmtInfoList();
-// FIXME: Implement it later
-//        bool seek(uint64_t offset);
+/**
+ *  \brief  Get the CAT info populated when opening the file.
+ *  \return CAT Info, with a packet number of (uint64_t) - 1 if the file has
+ *          no CAT.
+ */
+        const CatInfo& getCatInfo();
+/**
+ *  \brief  Get the TSDT info populated when opening the file.
+ *  \return TSDT Info, with a packet number of (uint64_t) - 1 if the file has
+ *          no TSDT.
+ */
+        const TsdtInfo& getTsdtInfo();
+/**
+ *  \brief  Get the NIT info populated when opening the file.
+ *  \return NIT Info, with a packet number of (uint64_t) - 1 if the file has
+ *          no NIT.
+ */
+        const NitInfo& getNitInfo();
+/**
+ *  \brief  View the last packet carrying a PCR at or before a given PCR, on
+ *          the PCR PID. The search interpolates between the PCRs already
+ *          known, starting with the first and the last PCR in the file, and
+ *          remembers the PCRs it comes across to speed up the later seeks.
+ *          The PCR is assumed to increase through the file.
+ *          \warning The validity of the TsPacket handle is only till the
+ *          next call to viewNextPacket(), viewPreviousPacket(), or
+ *          viewPacketByNumber() or any other seek operations in TsFile.
+ *  \param  pcr PCR in units of the 27 MHz system clock (base * 300 +
+ *          extension). A PCR outside the range of the file seeks to the
+ *          first or the last packet carrying a PCR.
+ *  \return TsPacket handle of the packet on success, NULL if there is no
+ *          PCR in the file.
+ */
+        TsPacket* seekToPcr(uint64_t pcr);
+/**
+ *  \brief  View the last packet carrying a PCR at or before a given time on
+ *          the PCR PID, the same as seekToPcr().
+ *          \warning The validity of the TsPacket handle is only till the
+ *          next call to viewNextPacket(), viewPreviousPacket(), or
+ *          viewPacketByNumber() or any other seek operations in TsFile.
+ *  \param  seconds Time elapsed since the first PCR in the file.
+ *  \return TsPacket handle of the packet on success, NULL if there is no
+ *          PCR in the file.
+ */
+        TsPacket* seekToTime(double seconds);
+/**
+ *  \brief  Get the time between the first and the last PCR in the file.
+ *  \return Duration in seconds, 0 if there is no PCR in the file. A file
+ *          without PCR is only searched once until the PCR PID changes.
+ */
+        double getDuration();
+/**
+ *  \brief  Build the PCR index, one PCR checkpoint for every chunk of
+ *          the file, by reading through the whole file once, or only the
+ *          packets of the PCR PID if the PID index has been built. The time
+ *          based seeks work without it as well, but are faster with it.
+ *  \return true if the index was built, false if there is no PCR in the
+ *          file.
+ */
+        bool buildPcrIndex();
+/**
+ *  \brief  Select the PID whose PCR is used for the time based seeks.
+ *  \param  pid PCR PID, PID_NULL to use the PCR PID of the first program,
+ *          which is the default.
+ */
+        void setPcrPid(uint16_t pid);
 /**
  *  \brief  Get the file size.
  *  \return File size.
@@ -197,6 +536,37 @@ class TsFile
  *  \return Packet size.
  */
         uint8_t getPacketSize();
+/**
+ *  \brief  Get the file offset of the first packet.
+ *  \return Offset, non zero when the file does not start with a packet.
+ */
+        uint64_t getDataOffset();
+/**
+ *  \brief  Get the number of complete packets in the file. The count goes
+ *          down when the sync turns out to be lost later on, as the bytes
+ *          skipped are not part of any packet.
+ *  \return Number of packets.
+ */
+        uint64_t getPacketCount();
+/**
+ *  \brief  Get the backend currently used for reading the file.
+ *  \return IO mode of the opened file.
+ */
+        IoMode getIoMode();
+/**
+ *  \brief  Set the number of chunks of about BUFFER_SIZE bytes kept in flight in
+ *          IO_MODE_READ_AHEAD and IO_MODE_IO_URING. Takes effect on the next
+ *          call to open().
+ *  \param  depth Number of buffers, values less than 2 are treated as 2.
+ */
+        void setQueueDepth(uint8_t depth);
+/**
+ *  \brief  Bypass the page cache using O_DIRECT in IO_MODE_IO_URING. Takes
+ *          effect on the next call to open(), and is ignored when the file
+ *          system does not support O_DIRECT.
+ *  \param  directIo Use O_DIRECT or not.
+ */
+        void setDirectIo(bool directIo);
 };
 
 inline uint64_t TsFile::getFileSize()
@@ -209,14 +579,84 @@ inline uint8_t TsFile::getPacketSize()
     return packetSize;
 }
 
+inline uint64_t TsFile::getDataOffset()
+{
+    return dataOffset;
+}
+
+inline uint64_t TsFile::getPacketCount()
+{
+    if (!packetSize || syncSegments.empty())
+    {
+        return 0;
+    }
+    const SyncSegment& last = syncSegments.back();
+    return last.packetNumber + ((fileSize > last.offset) ? (fileSize - last.offset) / packetSize : 0);
+}
+
+inline bool TsFile::hasIndexFile()
+{
+    return (indexFile != NULL);
+}
+
+inline bool TsFile::hasPidIndex()
+{
+    return (pidIndex != NULL);
+}
+
+inline bool TsFile::hasRapIndex()
+{
+    return (rapIndex != NULL);
+}
+
+inline TsFile::IoMode TsFile::getIoMode()
+{
+    return ioMode;
+}
+
+inline void TsFile::setQueueDepth(uint8_t depth)
+{
+    queueDepth = (depth < 2) ? 2 : depth;
+}
+
+inline void TsFile::setDirectIo(bool directIo)
+{
+    isDirectIo = directIo;
+}
+
+inline void TsFile::setTableTracking(bool isEnabled)
+{
+    metadata.setTracking(isEnabled);
+}
+
+inline TableCache& TsFile::getTableCache()
+{
+    return metadata.getTableCache();
+}
+
 inline const TsFile::PatInfo& TsFile::getPatInfo()
 {
-    return patInfo;
+    return metadata.getPatInfo();
 }
 
 inline const TsFile::PmtInfoList& TsFile::getPmtInfoList()
 {
-    return pmtInfoList;
+    return metadata.getPmtInfoList();
+}
+
+inline const TsFile::CatInfo& TsFile::getCatInfo()
+{
+    return metadata.getCatInfo();
+}
+
+inline const TsFile::TsdtInfo& TsFile::getTsdtInfo()
+{
+    return metadata.getTsdtInfo();
+}
+
+inline const TsFile::NitInfo& TsFile::getNitInfo()
+{
+    return metadata.getNitInfo();
 }
 
 #endif
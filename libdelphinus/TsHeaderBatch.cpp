@@ -0,0 +1,219 @@
+/*
+ *  TsHeaderBatch.cpp - Decodes the headers of many TS packets at once into
+ *  separate arrays per field
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TsHeaderBatch.h"
+#include "SyncScanner.h"
+#include "Ts.h"
+#include <cassert>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TS_HEADER_BATCH_X86
+#include <immintrin.h>
+#endif
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_TS_HEADER_BATCH 8
+#define CURRENT_MODULE MODULE_TS_HEADER_BATCH
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define GET_LESS(x, y) ((x) < (y) ? (x) : (y))
+
+#ifdef TS_HEADER_BATCH_X86
+void storeBytes(uint8_t* destination, __m256i values);
+void storeWords(uint16_t* destination, __m256i values);
+
+__attribute__((target("avx2")))
+void storeBytes(uint8_t* destination, __m256i values)
+{
+    // Narrow the 8 32-bit lanes to bytes, which end up as the first 4 bytes
+    // of each of the 128-bit halves
+    __m256i words = _mm256_packus_epi32(values, values);
+    __m256i bytes = _mm256_packus_epi16(words, words);
+    uint32_t low = _mm256_extract_epi32(bytes, 0);
+    uint32_t high = _mm256_extract_epi32(bytes, 4);
+    memcpy(destination, &low, 4);
+    memcpy(destination + 4, &high, 4);
+}
+
+__attribute__((target("avx2")))
+void storeWords(uint16_t* destination, __m256i values)
+{
+    __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(values, values), 0x08);
+    _mm_storeu_si128((__m128i*)destination, _mm256_castsi256_si128(words));
+}
+#endif
+
+TsHeaderBatch::TsHeaderBatch(uint32_t maxPackets)
+    :   capacity(maxPackets),
+        count(0),
+        pids(NULL),
+        continuityCounters(NULL),
+        adaptationFieldControls(NULL),
+        payloadUnitStartIndicators(NULL),
+        payloadOffsets(NULL),
+        errorFlags(NULL),
+        decodeHeaders(decodeScalar)
+{
+    pids = new uint16_t[capacity];
+    continuityCounters = new uint8_t[capacity];
+    adaptationFieldControls = new uint8_t[capacity];
+    payloadUnitStartIndicators = new uint8_t[capacity];
+    payloadOffsets = new uint8_t[capacity];
+    errorFlags = new uint8_t[capacity];
+#ifdef TS_HEADER_BATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        decodeHeaders = decodeAvx2;
+    }
+#endif
+}
+
+TsHeaderBatch::~TsHeaderBatch()
+{
+    delete[] pids;
+    delete[] continuityCounters;
+    delete[] adaptationFieldControls;
+    delete[] payloadUnitStartIndicators;
+    delete[] payloadOffsets;
+    delete[] errorFlags;
+}
+
+void TsHeaderBatch::decodeScalar(TsHeaderBatch* batch, uint32_t first, const uint8_t* data,
+                                 uint32_t packets, uint8_t packetSize, uint8_t headerOffset)
+{
+    data += headerOffset;
+    for (uint32_t ix = first; ix < first + packets; ++ix)
+    {
+        DelphinusUtils::ByteField* header = (DelphinusUtils::ByteField*)const_cast<uint8_t*>(data);
+        uint8_t afc = TS_GET_AFC(header);
+        uint8_t errors = 0;
+        if (TS_GET_SYNC_BYTE(header) != TS_SYNC_BYTE)
+        {
+            errors |= ERROR_SYNC;
+        }
+        if (TS_GET_TEI(header))
+        {
+            errors |= ERROR_TRANSPORT;
+        }
+        uint8_t payloadOffset = PACKET_SIZE_TS;
+        if (afc == 0x01)
+        {
+            payloadOffset = 4;
+        }
+        else if ((afc & 0x02) && data[4] > AF_MAX_LENGTH)
+        {
+            errors |= ERROR_ADAPTATION_FIELD;
+        }
+        else if (afc == 0x03)
+        {
+            payloadOffset = 5 + data[4];
+        }
+        batch->pids[ix] = TS_GET_PID(header);
+        batch->continuityCounters[ix] = TS_GET_CC(header);
+        batch->adaptationFieldControls[ix] = afc;
+        batch->payloadUnitStartIndicators[ix] = TS_GET_PUSI(header);
+        batch->payloadOffsets[ix] = payloadOffset;
+        batch->errorFlags[ix] = errors;
+        data += packetSize;
+    }
+}
+
+#ifdef TS_HEADER_BATCH_X86
+__attribute__((target("avx2")))
+void TsHeaderBatch::decodeAvx2(TsHeaderBatch* batch, uint32_t first, const uint8_t* data,
+                               uint32_t packets, uint8_t packetSize, uint8_t headerOffset)
+{
+    // Byte offsets of the headers of 8 consecutive packets
+    const __m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                               _mm256_set1_epi32(packetSize));
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i three = _mm256_set1_epi32(3);
+    uint32_t ix = 0;
+    for (; ix + 8 <= packets; ix += 8)
+    {
+        const uint8_t* base = data + ix * packetSize + headerOffset;
+        // The header bytes 0 to 3 land in the bits 0 to 31 of each lane, the
+        // adaptation field length follows the header
+        __m256i header = _mm256_i32gather_epi32((const int*)base, offsets, 1);
+        __m256i afLength = _mm256_and_si256(_mm256_i32gather_epi32((const int*)(base + 4),
+                                                                   offsets, 1), byteMask);
+
+        __m256i pid = _mm256_or_si256(_mm256_and_si256(header, _mm256_set1_epi32(0x1F00)),
+                                      _mm256_and_si256(_mm256_srli_epi32(header, 16), byteMask));
+        __m256i pusi = _mm256_and_si256(_mm256_srli_epi32(header, 14), one);
+        __m256i tei = _mm256_and_si256(_mm256_srli_epi32(header, 15), one);
+        __m256i afc = _mm256_and_si256(_mm256_srli_epi32(header, 28), three);
+        __m256i cc = _mm256_and_si256(_mm256_srli_epi32(header, 24), _mm256_set1_epi32(0x0F));
+        __m256i isSyncLost = _mm256_xor_si256(
+                _mm256_cmpeq_epi32(_mm256_and_si256(header, byteMask),
+                                   _mm256_set1_epi32(TS_SYNC_BYTE)),
+                _mm256_set1_epi32(-1));
+
+        __m256i hasAdaptationField = _mm256_cmpgt_epi32(afc, one);
+        __m256i isAfTooLong = _mm256_and_si256(hasAdaptationField,
+                                               _mm256_cmpgt_epi32(afLength,
+                                                                  _mm256_set1_epi32(AF_MAX_LENGTH)));
+        __m256i payloadOffset = _mm256_set1_epi32(PACKET_SIZE_TS);
+        payloadOffset = _mm256_blendv_epi8(payloadOffset, _mm256_set1_epi32(4),
+                                           _mm256_cmpeq_epi32(afc, one));
+        payloadOffset = _mm256_blendv_epi8(payloadOffset,
+                                           _mm256_add_epi32(afLength, _mm256_set1_epi32(5)),
+                                           _mm256_andnot_si256(isAfTooLong,
+                                                               _mm256_cmpeq_epi32(afc, three)));
+        __m256i errors = _mm256_or_si256(tei, _mm256_and_si256(isSyncLost,
+                                                               _mm256_set1_epi32(ERROR_SYNC)));
+        errors = _mm256_or_si256(errors, _mm256_and_si256(isAfTooLong,
+                                                          _mm256_set1_epi32(ERROR_ADAPTATION_FIELD)));
+
+        storeWords(batch->pids + first + ix, pid);
+        storeBytes(batch->continuityCounters + first + ix, cc);
+        storeBytes(batch->adaptationFieldControls + first + ix, afc);
+        storeBytes(batch->payloadUnitStartIndicators + first + ix, pusi);
+        storeBytes(batch->payloadOffsets + first + ix, payloadOffset);
+        storeBytes(batch->errorFlags + first + ix, errors);
+    }
+    // Fewer than 8 packets left
+    decodeScalar(batch, first + ix, data + ix * packetSize, packets - ix, packetSize, headerOffset);
+}
+#endif
+
+uint32_t TsHeaderBatch::decode(const uint8_t* data, uint64_t size, uint8_t packetSize)
+{
+    assert(packetSize >= PACKET_SIZE_TS);
+    count = GET_LESS((uint64_t)capacity, size / packetSize);
+    decodeHeaders(this, 0, data, count, packetSize, SyncScanner::getSyncOffset(packetSize));
+    return count;
+}
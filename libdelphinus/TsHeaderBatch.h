@@ -0,0 +1,186 @@
+/*
+ *  TsHeaderBatch.h - Decodes the headers of many TS packets at once into
+ *  separate arrays per field
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   TsHeaderBatch.h
+ *  \brief  Batch decoding of TS packet headers.
+ *
+ *  Defines TsHeaderBatch, which holds the header fields of a run of TS
+ *  packets as one array per field.
+ */
+
+#ifndef DELPHINUS_TS_HEADER_BATCH_H
+#define DELPHINUS_TS_HEADER_BATCH_H
+
+#include "common/DelphinusUtils.h"
+
+/**
+ *  \brief  Header fields of a run of TS packets, one array per field.
+ *
+ *  TsHeaderBatch decodes the 4 byte header, and the adaptation field length
+ *  when present, of consecutive packets in a buffer. The headers of 8
+ *  packets at a time are loaded using the AVX2 gather when the CPU supports
+ *  it. Entry n of every array belongs to the n-th packet decoded, so that
+ *  counters and filters over the fields can run as simple loops over the
+ *  arrays instead of parsing one packet at a time.
+ */
+class TsHeaderBatch
+{
+    public:
+/**
+ *  \brief  Bits of the error flags of a packet.
+ */
+        enum ErrorFlags
+        {
+/** The transport error indicator is set. */
+            ERROR_TRANSPORT             = 0x01,
+/** The sync byte is missing, none of the other fields are meaningful. */
+            ERROR_SYNC                  = 0x02,
+/** The adaptation field is longer than the packet. */
+            ERROR_ADAPTATION_FIELD      = 0x04
+        };
+
+    private:
+        // Decode the headers into the entries from first onwards
+        typedef void (*DecodeFunction)(TsHeaderBatch* batch, uint32_t first, const uint8_t* data,
+                                       uint32_t packets, uint8_t packetSize, uint8_t headerOffset);
+
+        uint32_t capacity;
+        uint32_t count;
+        uint16_t* pids;
+        uint8_t* continuityCounters;
+        uint8_t* adaptationFieldControls;
+        uint8_t* payloadUnitStartIndicators;
+        uint8_t* payloadOffsets;
+        uint8_t* errorFlags;
+        DecodeFunction decodeHeaders;
+
+        static void decodeScalar(TsHeaderBatch* batch, uint32_t first, const uint8_t* data,
+                                 uint32_t packets, uint8_t packetSize, uint8_t headerOffset);
+        static void decodeAvx2(TsHeaderBatch* batch, uint32_t first, const uint8_t* data,
+                               uint32_t packets, uint8_t packetSize, uint8_t headerOffset);
+        // Not copyable, the arrays are owned
+        TsHeaderBatch(const TsHeaderBatch& batch);
+        TsHeaderBatch& operator=(const TsHeaderBatch& batch);
+
+    public:
+/**
+ *  \brief  Allocate the arrays.
+ *  \param  maxPackets Maximum number of packets decoded at once.
+ */
+        TsHeaderBatch(uint32_t maxPackets);
+        ~TsHeaderBatch();
+
+/**
+ *  \brief  Decode the headers of the complete packets in a buffer,
+ *          replacing the ones decoded earlier.
+ *  \param  data Start of the first packet.
+ *  \param  size Size of the data in bytes.
+ *  \param  packetSize Size of the packets, 188, 192 or 204.
+ *  \return Number of packets decoded, at most the capacity.
+ */
+        uint32_t decode(const uint8_t* data, uint64_t size, uint8_t packetSize);
+/**
+ *  \brief  Get the maximum number of packets decoded at once.
+ *  \return Capacity of the arrays.
+ */
+        uint32_t getCapacity();
+/**
+ *  \brief  Get the number of packets decoded by the last call to decode().
+ *  \return Number of valid entries in the arrays.
+ */
+        uint32_t getCount();
+/**
+ *  \brief  Get the PIDs.
+ *  \return Array of PIDs.
+ */
+        const uint16_t* getPids();
+/**
+ *  \brief  Get the continuity counters.
+ *  \return Array of continuity counters.
+ */
+        const uint8_t* getContinuityCounters();
+/**
+ *  \brief  Get the adaptation field controls.
+ *  \return Array of adaptation field controls, 0 to 3.
+ */
+        const uint8_t* getAdaptationFieldControls();
+/**
+ *  \brief  Get the payload unit start indicators.
+ *  \return Array of payload unit start indicators, 0 or 1.
+ */
+        const uint8_t* getPayloadUnitStartIndicators();
+/**
+ *  \brief  Get the offsets of the payloads from the start of the TS
+ *          headers, which excludes the timestamp of the TTS packets.
+ *  \return Array of payload offsets, 188 for the packets without payload.
+ */
+        const uint8_t* getPayloadOffsets();
+/**
+ *  \brief  Get the error flags.
+ *  \return Array of ErrorFlags bits, 0 for the packets without errors.
+ */
+        const uint8_t* getErrorFlags();
+};
+
+inline uint32_t TsHeaderBatch::getCapacity()
+{
+    return capacity;
+}
+
+inline uint32_t TsHeaderBatch::getCount()
+{
+    return count;
+}
+
+inline const uint16_t* TsHeaderBatch::getPids()
+{
+    return pids;
+}
+
+inline const uint8_t* TsHeaderBatch::getContinuityCounters()
+{
+    return continuityCounters;
+}
+
+inline const uint8_t* TsHeaderBatch::getAdaptationFieldControls()
+{
+    return adaptationFieldControls;
+}
+
+inline const uint8_t* TsHeaderBatch::getPayloadUnitStartIndicators()
+{
+    return payloadUnitStartIndicators;
+}
+
+inline const uint8_t* TsHeaderBatch::getPayloadOffsets()
+{
+    return payloadOffsets;
+}
+
+inline const uint8_t* TsHeaderBatch::getErrorFlags()
+{
+    return errorFlags;
+}
+
+#endif
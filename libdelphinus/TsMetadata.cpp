@@ -0,0 +1,539 @@
+/*
+ *  TsMetadata.cpp - Discovery of the PSI metadata from a sequence of TS packets
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TsMetadata.h"
+#include <cstring>
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_TS_METADATA 4
+#define CURRENT_MODULE MODULE_TS_METADATA
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+TsMetadata::TablePid::TablePid()
+    :   isFound(false),
+        isOptional(false)
+{
+}
+
+TsMetadata::TsMetadata()
+    :   missingTables(0),
+        missingOptionalTables(0),
+        firstPacketNumber((uint64_t) - 1),
+        optionalTablesDeadline((uint64_t) - 1),
+        isTracking(false),
+        currentPacketNumber(0)
+{
+    // Registered first, so that the metadata is up to date by the time the
+    // other listeners are called
+    tableCache.addListener(this);
+    clear();
+}
+
+TsMetadata::~TsMetadata()
+{
+}
+
+void TsMetadata::clear()
+{
+    tablePids.clear();
+    missingTables = 0;
+    missingOptionalTables = 0;
+    firstPacketNumber = (uint64_t) - 1;
+    optionalTablesDeadline = (uint64_t) - 1;
+    tableCache.clear();
+    patInfo.packetNumber = (uint64_t) - 1;
+    patInfo.lastPacketNumber = (uint64_t) - 1;
+    patInfo.transportStreamId = 0;
+    patInfo.versionNumber = 0;
+    patInfo.programList.clear();
+    pmtInfoList.clear();
+    pmtSections.clear();
+    catInfo.packetNumber = (uint64_t) - 1;
+    catInfo.lastPacketNumber = (uint64_t) - 1;
+    catInfo.versionNumber = 0;
+    catInfo.descriptor.start = NULL;
+    catInfo.descriptor.size = 0;
+    tsdtInfo.packetNumber = (uint64_t) - 1;
+    tsdtInfo.lastPacketNumber = (uint64_t) - 1;
+    tsdtInfo.versionNumber = 0;
+    tsdtInfo.descriptor.start = NULL;
+    tsdtInfo.descriptor.size = 0;
+    nitInfo.packetNumber = (uint64_t) - 1;
+    nitInfo.lastPacketNumber = (uint64_t) - 1;
+    nitInfo.pid = PID_NULL;
+    nitInfo.networkId = 0;
+    nitInfo.versionNumber = 0;
+    nitInfo.networkDescriptor.start = NULL;
+    nitInfo.networkDescriptor.size = 0;
+    nitInfo.tsInfoList.clear();
+    nitSections.clear();
+    addTablePid(PID_PAT, false, false);
+    // The NIT PID is known from the PAT
+    addTablePid(PID_CAT, false, true);
+    addTablePid(PID_TSDT, false, true);
+}
+
+void TsMetadata::setTracking(bool isEnabled)
+{
+    isTracking = isEnabled;
+    if (isTracking)
+    {
+        // Follow again the PIDs which were dropped once their table was
+        // found, the cache still has their versions
+        if (patInfo.packetNumber != (uint64_t) - 1)
+        {
+            addTablePid(PID_PAT, true, false);
+        }
+        for (PmtInfoList::const_iterator ix = pmtInfoList.begin(); ix != pmtInfoList.end(); ++ix)
+        {
+            addTablePid(ix->pmtPid, true, false);
+        }
+        // The optional tables given up are followed too, in case they show
+        // up later
+        addTablePid(PID_CAT, true, true);
+        addTablePid(PID_TSDT, true, true);
+        if (nitInfo.pid != PID_NULL)
+        {
+            addTablePid(nitInfo.pid, true, true);
+        }
+    }
+}
+
+void TsMetadata::addTablePid(uint16_t pid, bool isFound, bool isOptional)
+{
+    std::pair<TablePidMap::iterator, bool> result = tablePids.insert(std::make_pair(pid, TablePid()));
+    if (result.second)
+    {
+        result.first->second.isFound = isFound;
+        result.first->second.isOptional = isOptional;
+        if (!isFound && isOptional)
+        {
+            ++missingOptionalTables;
+            // Given a new window once the mandatory tables are found
+            optionalTablesDeadline = (uint64_t) - 1;
+        }
+        else if (!isFound)
+        {
+            ++missingTables;
+        }
+    }
+}
+
+void TsMetadata::setFound(uint16_t pid)
+{
+    TablePidMap::iterator tablePid = tablePids.find(pid);
+    if (tablePid != tablePids.end() && !tablePid->second.isFound)
+    {
+        tablePid->second.isFound = true;
+        if (tablePid->second.isOptional)
+        {
+            --missingOptionalTables;
+        }
+        else
+        {
+            --missingTables;
+        }
+    }
+}
+
+void TsMetadata::dropOptionalTables()
+{
+    // The optional tables not found by now are most likely not in the TS
+    for (TablePidMap::iterator tablePid = tablePids.begin(); tablePid != tablePids.end();)
+    {
+        if (tablePid->second.isOptional && !tablePid->second.isFound)
+        {
+            MSG("Giving up the table in PID: 0x%04x", tablePid->first);
+            --missingOptionalTables;
+            if (isTracking)
+            {
+                // Still followed, but no longer waited for
+                tablePid->second.isFound = true;
+                ++tablePid;
+            }
+            else
+            {
+                tablePids.erase(tablePid++);
+            }
+        }
+        else
+        {
+            ++tablePid;
+        }
+    }
+}
+
+uint8_t* TsMetadata::bufferSection(const std::vector<uint8_t>& section)
+{
+    // The sections are parsed from the pointer_field, which is put back in
+    // front of them
+    sectionBuffer.assign(1, 0);
+    sectionBuffer.insert(sectionBuffer.end(), section.begin(), section.end());
+    return &sectionBuffer[0];
+}
+
+bool TsMetadata::parsePat(const TableCache::Table& table)
+{
+    MSG("Found PAT version: %u sections: %u", table.versionNumber, table.lastSectionNumber + 1);
+    // Every section of the PAT carries whole programs, so the programs of
+    // the sections are merged, and the PAT is kept as it was until all of
+    // them are parsed
+    PatSection::ProgramList programList;
+    uint16_t networkPid = PID_NULL;
+    for (uint16_t ix = 0; ix <= table.lastSectionNumber; ++ix)
+    {
+        const std::vector<uint8_t>& section = table.sections[ix];
+        patSection.parseSection(bufferSection(section), section.size());
+        if (!patSection.isCompleteSection())
+        {
+            return false;
+        }
+        const PatSection::ProgramList& sectionPrograms = patSection.getPrograms();
+        programList.insert(programList.end(), sectionPrograms.begin(), sectionPrograms.end());
+        if (patSection.getNetworkPid() != PID_NULL)
+        {
+            networkPid = patSection.getNetworkPid();
+        }
+    }
+    MSG("complete PAT");
+    patInfo.programList = programList;
+    patInfo.packetNumber = table.firstPacketNumber;
+    patInfo.lastPacketNumber = currentPacketNumber;
+    patInfo.transportStreamId = patSection.getTransportStreamId();
+    patInfo.versionNumber = table.versionNumber;
+    for (PatSection::ProgramList::const_iterator ix = programList.begin();
+         ix != programList.end(); ++ix)
+    {
+        // Program number 0 carries the network PID, not a PMT
+        if (ix->programNumber != 0)
+        {
+            addTablePid(ix->pmtPid, false, false);
+        }
+    }
+    // Without a network PID in the PAT the NIT is in the DVB one
+    if (networkPid == PID_NULL)
+    {
+        networkPid = PID_NIT;
+    }
+    if (networkPid != nitInfo.pid)
+    {
+        MSG("NIT PID: 0x%04x", networkPid);
+        nitInfo.packetNumber = (uint64_t) - 1;
+        nitInfo.lastPacketNumber = (uint64_t) - 1;
+        nitInfo.pid = networkPid;
+        nitInfo.networkDescriptor.start = NULL;
+        nitInfo.networkDescriptor.size = 0;
+        nitInfo.tsInfoList.clear();
+        nitSections.clear();
+        addTablePid(networkPid, false, true);
+    }
+
+    // Drop the PMTs of the programs no longer in the PAT
+    for (PmtInfoList::iterator pmtInfo = pmtInfoList.begin(); pmtInfo != pmtInfoList.end();)
+    {
+        PatSection::ProgramList::const_iterator ix = programList.begin();
+        while (ix != programList.end() &&
+               !(ix->programNumber == pmtInfo->programNumber && ix->pmtPid == pmtInfo->pmtPid))
+        {
+            ++ix;
+        }
+        if (ix == programList.end())
+        {
+            MSG("Program %u removed", pmtInfo->programNumber);
+            pmtSections.erase(((uint32_t)pmtInfo->pmtPid << 16) | pmtInfo->programNumber);
+            pmtInfo = pmtInfoList.erase(pmtInfo);
+        }
+        else
+        {
+            ++pmtInfo;
+        }
+    }
+    for (TablePidMap::iterator tablePid = tablePids.begin(); tablePid != tablePids.end();)
+    {
+        uint16_t pid = tablePid->first;
+        bool isListed = (pid == PID_PAT);
+        if (tablePid->second.isOptional)
+        {
+            isListed = (pid == PID_CAT || pid == PID_TSDT || pid == nitInfo.pid);
+        }
+        for (PatSection::ProgramList::const_iterator ix = programList.begin();
+             !isListed && ix != programList.end(); ++ix)
+        {
+            isListed = (ix->programNumber != 0 && ix->pmtPid == pid);
+        }
+        if (!isListed)
+        {
+            if (!tablePid->second.isFound && tablePid->second.isOptional)
+            {
+                --missingOptionalTables;
+            }
+            else if (!tablePid->second.isFound)
+            {
+                --missingTables;
+            }
+            // A PID added back later has its PMT reported again
+            tableCache.erasePid(tablePid->first);
+            tablePids.erase(tablePid++);
+        }
+        else
+        {
+            ++tablePid;
+        }
+    }
+    return true;
+}
+
+bool TsMetadata::parsePmt(uint8_t* data, uint16_t size, const TableCache::Table& table)
+{
+    MSG("Found PMT PID: 0x%04x version: %u", table.pid, table.versionNumber);
+    // The program number is the table_id_extension
+    PmtSection& pmtSection = pmtSections[((uint32_t)table.pid << 16) | table.tableIdExtension];
+    pmtSection.parse(data, size);
+    if (!pmtSection.isCompleteSection())
+    {
+        return false;
+    }
+    MSG("complete PMT");
+    PmtInfoList::iterator pmtInfo = pmtInfoList.begin();
+    while (pmtInfo != pmtInfoList.end() &&
+           !(pmtInfo->pmtPid == table.pid && pmtInfo->programNumber == pmtSection.getProgramNumber()))
+    {
+        ++pmtInfo;
+    }
+    if (pmtInfo == pmtInfoList.end())
+    {
+        pmtInfo = pmtInfoList.insert(pmtInfoList.end(), PmtInfo());
+    }
+    pmtInfo->packetNumber = table.packetNumber;
+    pmtInfo->lastPacketNumber = currentPacketNumber;
+    pmtInfo->pmtPid = table.pid;
+    pmtInfo->programNumber = pmtSection.getProgramNumber();
+    pmtInfo->versionNumber = table.versionNumber;
+    pmtInfo->pcrPid = pmtSection.getPcrPid();
+    pmtInfo->programInfoDescriptor = pmtSection.getProgramInfoDescriptor();
+    // Reuses the storage of the previous version
+    pmtInfo->streamList = pmtSection.getStreamList();
+    return true;
+}
+
+bool TsMetadata::parseCat(const TableCache::Table& table)
+{
+    MSG("Found CAT version: %u sections: %u", table.versionNumber, table.lastSectionNumber + 1);
+    // Every section of the CAT carries whole descriptors, which are put
+    // back to back as the descriptor loop of the CAT
+    catDescriptors.clear();
+    for (uint16_t ix = 0; ix <= table.lastSectionNumber; ++ix)
+    {
+        const std::vector<uint8_t>& section = table.sections[ix];
+        catSection.parseSection(bufferSection(section), section.size());
+        if (!catSection.isCompleteSection())
+        {
+            catInfo.descriptor.start = NULL;
+            catInfo.descriptor.size = 0;
+            return false;
+        }
+        const PsiDescriptor& descriptor = catSection.getDescriptor();
+        catDescriptors.insert(catDescriptors.end(), descriptor.start, descriptor.start + descriptor.size);
+    }
+    catInfo.packetNumber = table.firstPacketNumber;
+    catInfo.lastPacketNumber = currentPacketNumber;
+    catInfo.versionNumber = table.versionNumber;
+    catInfo.descriptor.start = catDescriptors.empty() ? NULL : &catDescriptors[0];
+    catInfo.descriptor.size = catDescriptors.size();
+    return true;
+}
+
+bool TsMetadata::parseTsdt(uint8_t* data, uint16_t size, const TableCache::Table& table)
+{
+    MSG("Found TSDT version: %u", table.versionNumber);
+    tsdtSection.parse(data, size);
+    if (!tsdtSection.isCompleteSection())
+    {
+        return false;
+    }
+    tsdtInfo.packetNumber = table.packetNumber;
+    tsdtInfo.lastPacketNumber = currentPacketNumber;
+    tsdtInfo.versionNumber = table.versionNumber;
+    tsdtInfo.descriptor = tsdtSection.getDescriptor();
+    return true;
+}
+
+bool TsMetadata::parseNit(const TableCache::Table& table)
+{
+    MSG("Found NIT PID: 0x%04x version: %u sections: %u",
+        table.pid, table.versionNumber, table.lastSectionNumber + 1);
+    nitInfo.tsInfoList.clear();
+    for (uint16_t ix = 0; ix <= table.lastSectionNumber; ++ix)
+    {
+        // Every section of the NIT carries whole loops, so they are parsed
+        // one at a time
+        const std::vector<uint8_t>& section = table.sections[ix];
+        NitSection& nitSection = nitSections[ix];
+        nitSection.parseSection(bufferSection(section), section.size());
+        if (!nitSection.isCompleteSection())
+        {
+            nitSections.clear();
+            nitInfo.tsInfoList.clear();
+            return false;
+        }
+        const NitSection::TsInfoList& tsInfoList = nitSection.getTsInfoList();
+        nitInfo.tsInfoList.insert(nitInfo.tsInfoList.end(), tsInfoList.begin(), tsInfoList.end());
+    }
+    // The sections of an earlier version which had more of them
+    nitSections.erase(nitSections.upper_bound(table.lastSectionNumber), nitSections.end());
+    NitSection& firstSection = nitSections[0];
+    nitInfo.packetNumber = table.firstPacketNumber;
+    nitInfo.lastPacketNumber = currentPacketNumber;
+    nitInfo.networkId = firstSection.getNetworkId();
+    nitInfo.versionNumber = table.versionNumber;
+    nitInfo.networkDescriptor = firstSection.getNetworkDescriptor();
+    return true;
+}
+
+void TsMetadata::onTableUpdated(const TableCache::Table& table)
+{
+    if (tablePids.find(table.pid) == tablePids.end())
+    {
+        return;
+    }
+    // The PAT, the CAT and the NIT are parsed one section at a time,
+    // as their sections carry whole loops
+    bool isParsed = false;
+    if (table.tableId == TABLE_PAT && table.pid == PID_PAT)
+    {
+        isParsed = parsePat(table);
+    }
+    else if (table.tableId == TABLE_CAT && table.pid == PID_CAT)
+    {
+        isParsed = parseCat(table);
+    }
+    else if (table.tableId == TABLE_NETWORK_INFO_ACTUAL && table.pid == nitInfo.pid)
+    {
+        isParsed = parseNit(table);
+    }
+    else if (table.lastSectionNumber != 0)
+    {
+        // A PMT has a single section, and a TSDT spread over sections is
+        // not parsed
+        ERR("Table ID: 0x%02x PID: 0x%04x has %u sections, only one is supported",
+            table.tableId, table.pid, table.lastSectionNumber + 1);
+        return;
+    }
+    else
+    {
+        const std::vector<uint8_t>& section = table.sections[0];
+        uint8_t* data = bufferSection(section);
+        uint16_t size = section.size();
+        PsiSection psiSection;
+        if (!psiSection.parse(data))
+        {
+            return;
+        }
+        MSG("Parsing a PSI Section PID: 0x%04x", table.pid);
+        if (table.tableId == TABLE_TSDT && table.pid == PID_TSDT)
+        {
+            isParsed = parseTsdt(data, size, table);
+        }
+        else if (table.tableId == TABLE_PMT && table.pid != PID_PAT)
+        {
+            isParsed = parsePmt(data, size, table);
+        }
+    }
+    if (isParsed)
+    {
+        setFound(table.pid);
+    }
+}
+
+bool TsMetadata::parsePacket(TsPacket* tsPacket, uint64_t packetNumber)
+{
+    // Start looking for the PAT, once found look for the PMT PIDs in it:
+    //      The packets of the PIDs being followed are assembled into
+    //      sections, which may span packets or share a packet
+    //      The sections of the new versions of the tables complete them in
+    //      the table cache, which has the PAT and PMTs parsed
+    //      Without tracking, the PID is dropped once its table is found
+    //      The CAT, TSDT and NIT are given up if they are not found in time
+    //
+    if (isComplete() && !isTracking)
+    {
+        return true;
+    }
+    if (firstPacketNumber == (uint64_t) - 1)
+    {
+        firstPacketNumber = packetNumber;
+    }
+    if (missingTables == 0 && missingOptionalTables != 0)
+    {
+        if (optionalTablesDeadline == (uint64_t) - 1)
+        {
+            // The repetition rates of the tables are alike, so they are
+            // given as long as the PAT and the PMTs took
+            uint64_t window = OPTIONAL_TABLES_MIN_PACKETS;
+            if (packetNumber > firstPacketNumber && packetNumber - firstPacketNumber > window)
+            {
+                window = packetNumber - firstPacketNumber;
+            }
+            optionalTablesDeadline = packetNumber + window;
+        }
+        else if (packetNumber > optionalTablesDeadline)
+        {
+            dropOptionalTables();
+        }
+    }
+    uint16_t pid = tsPacket->getPid();
+    TablePidMap::iterator tablePid = tablePids.find(pid);
+    if (tablePid == tablePids.end())
+    {
+        return isComplete();
+    }
+
+    SectionAssembler& sectionAssembler = tablePid->second.assembler;
+    sectionAssembler.pushPacket(tsPacket, packetNumber);
+    currentPacketNumber = packetNumber;
+    uint8_t* section = NULL;
+    uint16_t size = 0;
+    while ((section = sectionAssembler.viewNextSection(size)) != NULL)
+    {
+        // The PAT only ever adds or drops the other PIDs, so this PID stays
+        tableCache.pushSection(pid, section, size, sectionAssembler.getSectionPacketNumber());
+        if (!isTracking && tablePid->second.isFound)
+        {
+            break;
+        }
+    }
+    if (!isTracking && tablePid->second.isFound)
+    {
+        tablePids.erase(tablePid);
+    }
+    return isComplete();
+}
@@ -0,0 +1,339 @@
+/*
+ *  TsMetadata.h - Discovery of the PSI metadata from a sequence of TS packets
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   TsMetadata.h
+ *  \brief  Incremental discovery of the PAT, PMT, CAT, TSDT and NIT.
+ *
+ *  Defines TsMetadata which is fed TS packets one at a time and collects the
+ *  metadata about the programs in the Transport Stream (TS). It is shared by
+ *  TsFile and TsStream.
+ */
+
+#ifndef DELPHINUS_TS_METADATA_H
+#define DELPHINUS_TS_METADATA_H
+
+#include <map>
+#include <vector>
+#include "Ts.h"
+#include "PsiTables.h"
+#include "SectionAssembler.h"
+#include "TableCache.h"
+
+/**
+ *  \brief  Collects the PSI metadata from the TS packets fed to it.
+ *
+ *  TsMetadata looks for the PAT, and then for the PMTs of all the programs
+ *  listed in the PAT, in the packets passed to parsePacket(). The CAT, the
+ *  TSDT and the NIT, in the network PID of the PAT or the DVB one if the PAT
+ *  has none, are looked for in the same packets but are optional: once the
+ *  PAT and the PMTs are found they are given up if they do not show up
+ *  within as many packets as it took to find the PMTs, and no less than
+ *  OPTIONAL_TABLES_MIN_PACKETS packets. The packets of the PIDs still to be
+ *  found are reassembled into sections, so the tables may span several
+ *  packets, and the packets can be fed from any forward-only source without
+ *  having to buffer them. The sections go through a TableCache, so only the
+ *  new versions of the tables are parsed. By default the PIDs are no longer
+ *  followed once their table is found, with tracking enabled the later
+ *  versions of the tables replace the metadata found earlier.
+ */
+class TsMetadata : private TableCache::Listener
+{
+    public:
+/**
+ *  \brief  PAT information.
+ */
+        struct PatInfo
+        {
+/** Packet number(starts at 0) in the TS where the PAT was located. */
+            uint64_t packetNumber;
+/** Packet number(starts at 0) of the last packet carrying the PAT. */
+            uint64_t lastPacketNumber;
+/** Transport Stream ID mentioned in the PAT. */
+            uint16_t transportStreamId;
+/** Version number of the PAT. */
+            uint8_t versionNumber;
+/** List of all the programs mentioned in the PAT. */
+            PatSection::ProgramList programList;
+        };
+/**
+ *  \brief  PMT information.
+ */
+        struct PmtInfo
+        {
+/** Packet number(starts at 0) in the TS where the PMT was located. */
+            uint64_t packetNumber;
+/** Packet number(starts at 0) of the last packet carrying the PMT. */
+            uint64_t lastPacketNumber;
+/** PMT PID. */
+            uint16_t pmtPid;
+/** Program number mentioned in the PMT. */
+            uint16_t programNumber;
+/** Version number of the PMT. */
+            uint8_t versionNumber;
+/** PCR PID of the program mentioned in the PMT. */
+            uint16_t pcrPid;
+/** Program info descriptors of the PMT. */
+            PsiDescriptor programInfoDescriptor;
+/** List of all the streams mentioned in the PMT. The descriptors stay valid
+ *  till a new version of the PMT is found, or the metadata is cleared. */
+            PmtSection::StreamList streamList;
+        };
+/**
+ *  \brief  A list of PMTs.
+ */
+        typedef std::vector<PmtInfo> PmtInfoList;
+/**
+ *  \brief  CAT information.
+ */
+        struct CatInfo
+        {
+/** Packet number(starts at 0) in the TS where the CAT was located,
+ *  (uint64_t) - 1 if the CAT was not found. */
+            uint64_t packetNumber;
+/** Packet number(starts at 0) of the last packet carrying the CAT. */
+            uint64_t lastPacketNumber;
+/** Version number of the CAT. */
+            uint8_t versionNumber;
+/** CA descriptors of the CAT. */
+            PsiDescriptor descriptor;
+        };
+/**
+ *  \brief  TSDT information.
+ */
+        struct TsdtInfo
+        {
+/** Packet number(starts at 0) in the TS where the TSDT was located,
+ *  (uint64_t) - 1 if the TSDT was not found. */
+            uint64_t packetNumber;
+/** Packet number(starts at 0) of the last packet carrying the TSDT. */
+            uint64_t lastPacketNumber;
+/** Version number of the TSDT. */
+            uint8_t versionNumber;
+/** Descriptors of the TSDT. */
+            PsiDescriptor descriptor;
+        };
+/**
+ *  \brief  Information from the NIT of the actual network.
+ */
+        struct NitInfo
+        {
+/** Packet number(starts at 0) in the TS where the NIT was located,
+ *  (uint64_t) - 1 if the NIT was not found. */
+            uint64_t packetNumber;
+/** Packet number(starts at 0) of the last packet carrying the NIT. */
+            uint64_t lastPacketNumber;
+/** PID carrying the NIT. */
+            uint16_t pid;
+/** Network ID mentioned in the NIT. */
+            uint16_t networkId;
+/** Version number of the NIT. */
+            uint8_t versionNumber;
+/** Network descriptors of the first section of the NIT. */
+            PsiDescriptor networkDescriptor;
+/** The Transport Streams listed in all the sections of the NIT. */
+            NitSection::TsInfoList tsInfoList;
+        };
+        enum
+        {
+/** Number of packets to keep looking for the CAT, the TSDT and the NIT once
+ *  the PAT and the PMTs are found, when finding them took fewer packets. */
+            OPTIONAL_TABLES_MIN_PACKETS = 16384
+        };
+
+    private:
+        struct TablePid
+        {
+            SectionAssembler assembler;
+            // The table of the PID was found, or is no longer waited for
+            bool isFound;
+            // The CAT, TSDT or NIT, which may not be in the TS
+            bool isOptional;
+
+            TablePid();
+        };
+        typedef std::map<uint16_t, TablePid> TablePidMap;
+        // PID in the upper 16 bits and program number in the lower ones
+        typedef std::map<uint32_t, PmtSection> PmtSectionMap;
+        // Indexed by the section number
+        typedef std::map<uint8_t, NitSection> NitSectionMap;
+
+        // Section assemblers of the PIDs being followed
+        TablePidMap tablePids;
+        // Number of PIDs in tablePids whose table is yet to be found
+        uint16_t missingTables;
+        // Same for the optional tables
+        uint16_t missingOptionalTables;
+        // Packet number of the first packet parsed since clear()
+        uint64_t firstPacketNumber;
+        // Packet number after which the optional tables are given up
+        uint64_t optionalTablesDeadline;
+        bool isTracking;
+        // Packet number of the packet being parsed
+        uint64_t currentPacketNumber;
+        TableCache tableCache;
+        PatInfo patInfo;
+        PmtInfoList pmtInfoList;
+        // Parsed again in place for every new version of the PAT
+        PatSection patSection;
+        // The last version of every PMT, which holds the descriptors of its
+        // PmtInfo and is parsed again in place for the next version
+        PmtSectionMap pmtSections;
+        CatInfo catInfo;
+        TsdtInfo tsdtInfo;
+        NitInfo nitInfo;
+        CatSection catSection;
+        // The descriptors of all the sections of the CAT, which CatInfo
+        // points to
+        std::vector<uint8_t> catDescriptors;
+        TsdtSection tsdtSection;
+        NitSectionMap nitSections;
+        // A cached section with the pointer_field put back in front of it,
+        // kept to be reused by every table parsed
+        std::vector<uint8_t> sectionBuffer;
+
+        void addTablePid(uint16_t pid, bool isFound, bool isOptional);
+        void setFound(uint16_t pid);
+        void onTableUpdated(const TableCache::Table& table);
+        uint8_t* bufferSection(const std::vector<uint8_t>& section);
+        bool parsePat(const TableCache::Table& table);
+        bool parsePmt(uint8_t* data, uint16_t size, const TableCache::Table& table);
+        bool parseCat(const TableCache::Table& table);
+        bool parseTsdt(uint8_t* data, uint16_t size, const TableCache::Table& table);
+        bool parseNit(const TableCache::Table& table);
+
+    public:
+        TsMetadata();
+        ~TsMetadata();
+
+/**
+ *  \brief  Forget all the metadata collected so far and start looking for
+ *          the PAT again.
+ */
+        void clear();
+/**
+ *  \brief  Keep following the tables after they are found, so that
+ *          their later versions update the metadata. The setting is kept
+ *          across clear().
+ *  \param  isEnabled Follow the tables or stop once they are all found.
+ */
+        void setTracking(bool isEnabled);
+/**
+ *  \brief  Check if the tables are followed after they are found.
+ *  \return true if the tracking is enabled, false otherwise.
+ */
+        bool isTrackingEnabled();
+/**
+ *  \brief  Get the cache of the tables seen so far, to register listeners
+ *          for their new versions. The metadata is updated before the
+ *          listeners registered here are called.
+ *  \return Table cache.
+ */
+        TableCache& getTableCache();
+/**
+ *  \brief  Stop waiting for the CAT, the TSDT and the NIT not found so far,
+ *          typically once the source runs dry. With tracking enabled they
+ *          are still followed.
+ */
+        void dropOptionalTables();
+/**
+ *  \brief  Look for the metadata in the given packet.
+ *  \param  tsPacket A valid TS packet.
+ *  \param  packetNumber Packet number(starts at 0) of the packet in the TS.
+ *  \return true if all the metadata has been found or given up, false
+ *          otherwise.
+ */
+        bool parsePacket(TsPacket* tsPacket, uint64_t packetNumber);
+/**
+ *  \brief  Check if all the metadata has been found.
+ *  \return true if the PAT and all the PMTs listed in the latest version of
+ *          it were found, and the optional tables were found or given up.
+ */
+        bool isComplete();
+/**
+ *  \brief  Get the PAT info.
+ *  \return PAT Info.
+ */
+        const PatInfo& getPatInfo();
+/**
+ *  \brief  Get the PMT information list.
+ *  \return List of PMT Info(s).
+ */
+        const PmtInfoList& getPmtInfoList();
+/**
+ *  \brief  Get the CAT info.
+ *  \return CAT Info.
+ */
+        const CatInfo& getCatInfo();
+/**
+ *  \brief  Get the TSDT info.
+ *  \return TSDT Info.
+ */
+        const TsdtInfo& getTsdtInfo();
+/**
+ *  \brief  Get the NIT info.
+ *  \return NIT Info.
+ */
+        const NitInfo& getNitInfo();
+};
+
+inline bool TsMetadata::isComplete()
+{
+    return (missingTables == 0 && missingOptionalTables == 0);
+}
+
+inline bool TsMetadata::isTrackingEnabled()
+{
+    return isTracking;
+}
+
+inline TableCache& TsMetadata::getTableCache()
+{
+    return tableCache;
+}
+
+inline const TsMetadata::PatInfo& TsMetadata::getPatInfo()
+{
+    return patInfo;
+}
+
+inline const TsMetadata::PmtInfoList& TsMetadata::getPmtInfoList()
+{
+    return pmtInfoList;
+}
+
+inline const TsMetadata::CatInfo& TsMetadata::getCatInfo()
+{
+    return catInfo;
+}
+
+inline const TsMetadata::TsdtInfo& TsMetadata::getTsdtInfo()
+{
+    return tsdtInfo;
+}
+
+inline const TsMetadata::NitInfo& TsMetadata::getNitInfo()
+{
+    return nitInfo;
+}
+
+#endif
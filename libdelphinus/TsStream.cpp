@@ -0,0 +1,324 @@
+/*
+ *  TsStream.cpp - An abstraction for reading a Transport Stream from a forward
+ *  only source like a pipe, FIFO or stdin
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "TsStream.h"
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+using namespace MpegConstants;
+
+//#define DEBUG
+
+#define MODULE_TS_STREAM 5
+#define CURRENT_MODULE MODULE_TS_STREAM
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+#define GET_LESS(x, y) ((x) < (y) ? (x) : (y))
+
+TsStream::TsStream()
+    :   buffer(NULL),
+        fileDescriptor(-1),
+        isOwnedDescriptor(false),
+        viewPacket(NULL),
+        validBufferSize(0),
+        bufferOffset(0),
+        bytesRead(0),
+        packetNumber(0),
+        packetSize(0),
+        syncOffset(0),
+        isTsStream(false),
+        isEof(true)
+{
+    buffer = new uint8_t[BUFFER_SIZE];
+    assert(buffer != NULL);
+    viewPacket = new TsPacket();
+    assert(viewPacket != NULL);
+}
+
+TsStream::~TsStream()
+{
+    close();
+    if (viewPacket)
+    {
+        delete viewPacket;
+        viewPacket = NULL;
+    }
+    if (buffer)
+    {
+        delete[] buffer;
+        buffer = NULL;
+    }
+}
+
+bool TsStream::fill(uint64_t minSize)
+{
+    assert(minSize <= BUFFER_SIZE);
+    // Move the partial packet left over to the start of the buffer, at most
+    // a few bytes get copied here
+    uint64_t remaining = validBufferSize - bufferOffset;
+    if (bufferOffset > 0)
+    {
+        memmove(buffer, buffer + bufferOffset, remaining);
+        bufferOffset = 0;
+        validBufferSize = remaining;
+    }
+
+    // Do not wait for the whole buffer to be filled, return as soon as the
+    // requested size is available so live sources are not delayed
+    while (!isEof && validBufferSize < minSize)
+    {
+        ssize_t readSize = read(fileDescriptor, buffer + validBufferSize,
+                                BUFFER_SIZE - validBufferSize);
+        if (readSize > 0)
+        {
+            validBufferSize += readSize;
+            bytesRead += readSize;
+        }
+        else if (readSize == 0)
+        {
+            MSG("EOF!");
+            isEof = true;
+        }
+        else if (errno != EINTR)
+        {
+            ERR("Unable to read: %s", strerror(errno));
+            isEof = true;
+        }
+    }
+    return validBufferSize >= minSize;
+}
+
+bool TsStream::lock(uint8_t size, uint64_t maxSkip)
+{
+    // size is 0 when the packet size is not known yet
+    uint64_t lostStart = bytesRead - (validBufferSize - bufferOffset);
+    uint64_t lockSize = VALID_PACKETS * (size ? size : (uint8_t)PACKET_SIZE_RS);
+    bool isLocked = false;
+
+    while (!isLocked)
+    {
+        fill(lockSize);
+        uint64_t available = validBufferSize - bufferOffset;
+        uint8_t lockPackets = VALID_PACKETS;
+        if (available < lockSize)
+        {
+            // Reached EOF, a short stream or the last few packets are
+            // accepted as long as all of them are in sync
+            lockPackets = GET_LESS((uint64_t)VALID_PACKETS,
+                                   available / (size ? size : (uint8_t)PACKET_SIZE_TS));
+        }
+        uint64_t packetOffset = 0;
+        if (lockPackets > 0)
+        {
+            isLocked = size ?
+                       syncScanner.findLock(buffer + bufferOffset, available, lockPackets,
+                                            size, packetOffset) :
+                       syncScanner.findLockWithSize(buffer + bufferOffset, available, lockPackets,
+                                                    packetSize, packetOffset);
+        }
+        if (isLocked)
+        {
+            bufferOffset += packetOffset;
+        }
+        else if (isEof)
+        {
+            bufferOffset = validBufferSize;
+            break;
+        }
+        else
+        {
+            // The candidates too close to the end of the data could not be
+            // confirmed yet, keep them for the next round
+            bufferOffset = validBufferSize - lockSize + 1;
+            if (maxSkip && bytesRead - (validBufferSize - bufferOffset) - lostStart > maxSkip)
+            {
+                break;
+            }
+        }
+    }
+
+    uint64_t lostEnd = bytesRead - (validBufferSize - bufferOffset);
+    if (lostEnd > lostStart)
+    {
+        MSG("Lost sync from: %" PRIu64 " to: %" PRIu64, lostStart, lostEnd);
+        LostSyncRegion region;
+        region.start = lostStart;
+        region.end = lostEnd;
+        lostSyncRegions.push_back(region);
+    }
+    return isLocked;
+}
+
+void TsStream::validate()
+{
+    packetSize = 0;
+    isTsStream = false;
+
+    // Anything which does not lock within a buffer worth of data is not a TS
+    if (!lock(0, BUFFER_SIZE))
+    {
+        packetSize = 0;
+        return;
+    }
+    syncOffset = SyncScanner::getSyncOffset(packetSize);
+    isTsStream = true;
+}
+
+bool TsStream::open(const char* fileName)
+{
+    close();
+    if (strcmp(fileName, "-") == 0)
+    {
+        return open(STDIN_FILENO);
+    }
+    int fd = ::open(fileName, O_RDONLY | O_BINARY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    open(fd);
+    isOwnedDescriptor = true;
+    return true;
+}
+
+bool TsStream::open(int fd)
+{
+    close();
+    if (fd < 0)
+    {
+        return false;
+    }
+    fileDescriptor = fd;
+    isOwnedDescriptor = false;
+    validBufferSize = 0;
+    bufferOffset = 0;
+    bytesRead = 0;
+    packetNumber = 0;
+    isEof = false;
+    metadata.clear();
+    lostSyncRegions.clear();
+
+    validate();
+    return true;
+}
+
+void TsStream::close()
+{
+    if (fileDescriptor >= 0)
+    {
+        if (isOwnedDescriptor)
+        {
+            ::close(fileDescriptor);
+        }
+        fileDescriptor = -1;
+        isOwnedDescriptor = false;
+        validBufferSize = 0;
+        bufferOffset = 0;
+        packetSize = 0;
+        syncOffset = 0;
+        isTsStream = false;
+        isEof = true;
+    }
+}
+
+TsPacket* TsStream::viewNextPacket()
+{
+    if (!isTsStream)
+    {
+        return NULL;
+    }
+    if (validBufferSize - bufferOffset < packetSize && !fill(packetSize))
+    {
+        // Reached EOF, ignore any trailing partial packet
+        return NULL;
+    }
+    if (buffer[bufferOffset + syncOffset] != TS_SYNC_BYTE && !lock(packetSize, 0))
+    {
+        // Nothing in sync till EOF
+        return NULL;
+    }
+
+    viewPacket->parse(buffer + bufferOffset, packetSize);
+    bufferOffset += packetSize;
+    if (!metadata.isComplete() || metadata.isTrackingEnabled())
+    {
+        metadata.parsePacket(viewPacket, packetNumber);
+    }
+    ++packetNumber;
+    return viewPacket;
+}
+
+uint64_t TsStream::skipPackets(uint64_t count)
+{
+    uint64_t skipped = 0;
+    if (!isTsStream)
+    {
+        return 0;
+    }
+    while (skipped < count)
+    {
+        if (validBufferSize - bufferOffset < packetSize && !fill(packetSize))
+        {
+            break;
+        }
+        uint64_t packets = GET_LESS(count - skipped, (validBufferSize - bufferOffset) / packetSize);
+        uint64_t size = packets * packetSize;
+        uint64_t syncedSize = SyncScanner::findSyncLoss(buffer + bufferOffset, size, packetSize);
+        bufferOffset += syncedSize;
+        skipped += syncedSize / packetSize;
+        if (syncedSize < size && !lock(packetSize, 0))
+        {
+            break;
+        }
+    }
+    packetNumber += skipped;
+    return skipped;
+}
+
+bool TsStream::collectMetadata()
+{
+    while (!metadata.isComplete())
+    {
+        if (!viewNextPacket())
+        {
+            // The tables which may not be in the TS are not waited for
+            metadata.dropOptionalTables();
+            break;
+        }
+    }
+    return metadata.isComplete();
+}
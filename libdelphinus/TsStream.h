@@ -0,0 +1,291 @@
+/*
+ *  TsStream.h - An abstraction for reading a Transport Stream from a forward
+ *  only source like a pipe, FIFO or stdin
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   TsStream.h
+ *  \brief  A forward-only abstraction to handle TS from pipes and FIFOs.
+ *
+ *  Defines TsStream class for reading a Transport Stream (TS) packet by
+ *  packet from a file descriptor which need not be seekable.
+ */
+
+#ifndef DELPHINUS_TSSTREAM_H
+#define DELPHINUS_TSSTREAM_H
+
+#include "Ts.h"
+#include "TsMetadata.h"
+#include "SyncScanner.h"
+
+/**
+ *  \brief  A forward-only abstraction to handle TS from pipes and FIFOs.
+ *
+ *  TsStream reads a Transport Stream (TS) from a file descriptor into a
+ *  fixed size buffer, so the memory used stays bounded irrespective of the
+ *  length of the stream. The packet size and the first packet are found by
+ *  locking to the sync bytes, skipping over any partial packet at the start
+ *  of a stream cut in the middle. When a packet is missing its sync byte the
+ *  stream is locked again from there, and the bytes skipped are reported as
+ *  a lost sync region. Every packet returned by viewNextPacket() is also fed
+ *  to the PAT and PMT discovery until all the metadata has been found, or
+ *  for as long as the stream is read when the table tracking is enabled.
+ */
+class TsStream
+{
+    public:
+/**
+ *  \brief  A range of bytes of the stream which is not part of any packet.
+ */
+        typedef SyncScanner::LostSyncRegion LostSyncRegion;
+/**
+ *  \brief  A list of lost sync regions.
+ */
+        typedef SyncScanner::LostSyncRegionList LostSyncRegionList;
+
+    private:
+        enum
+        {
+            // LCM of 188, 192 and 4096
+            BUFFER_SIZE = 577536,
+            VALID_PACKETS = 10
+        };
+        uint8_t* buffer;
+        int fileDescriptor;
+        // Close the descriptor in close(), when it was opened by TsStream
+        bool isOwnedDescriptor;
+        TsPacket* viewPacket;
+
+        // Number of bytes of data valid in the buffer currently
+        uint64_t validBufferSize;
+        // Offset within the buffer of the next packet to be returned
+        uint64_t bufferOffset;
+        // Total number of bytes read from the descriptor
+        uint64_t bytesRead;
+        // Packet number of the next packet to be returned
+        uint64_t packetNumber;
+        // Size of the packets of the current TS
+        uint8_t packetSize;
+        // Offset of the sync byte within the packets
+        uint8_t syncOffset;
+        // Indicated a valid TS
+        bool isTsStream;
+        // Indicates EOF on the descriptor
+        bool isEof;
+
+        // PAT, PMT info
+        TsMetadata metadata;
+
+        SyncScanner syncScanner;
+        LostSyncRegionList lostSyncRegions;
+
+        bool fill(uint64_t minSize);
+        bool lock(uint8_t size, uint64_t maxSkip);
+        void validate();
+
+    public:
+        TsStream();
+        ~TsStream();
+
+/**
+ *  \brief  Opens a given file or FIFO for reading. To check if it carries a
+ *          valid TS make use of isValid() instead.
+ *  \param  fileName The filename can be absolute or relative. "-" stands
+ *          for the standard input.
+ *  \return true if the file was opened successfully, false otherwise.
+ */
+        bool open(const char* fileName);
+/**
+ *  \brief  Start reading from an already open file descriptor. The
+ *          descriptor is not closed by TsStream.
+ *  \param  fd File descriptor to read from.
+ *  \return true if the descriptor is valid, false otherwise.
+ */
+        bool open(int fd);
+/**
+ *  \brief  Stop reading from the current source.
+ */
+        void close();
+/**
+ *  \brief  Check if the source carries a valid TS.
+ *  \return valid TS or not.
+ */
+        bool isValid();
+/**
+ *  \brief  View the next TS packet from the source, blocking till it is
+ *          available.
+ *          \warning The validity of the TsPacket handle is only till the
+ *          next call to viewNextPacket() or collectMetadata().
+ *          \warning To persist the TsPacket by allocating memory on the heap
+ *          use the TsPacket::copy() method.
+ *  \return TsPacket handle for the next packet, NULL on EOF.
+ */
+        TsPacket* viewNextPacket();
+/**
+ *  \brief  Skip over packets checking only their sync bytes, which is much
+ *          faster than viewing them. The sync is recovered the same way as
+ *          in viewNextPacket(), but the packets skipped are not fed to the
+ *          PAT and PMT discovery.
+ *  \param  count Number of packets to skip, (uint64_t) - 1 for all of them.
+ *  \return Number of packets skipped, less than count on EOF.
+ */
+        uint64_t skipPackets(uint64_t count);
+/**
+ *  \brief  Consume packets from the source till all the PAT and PMT
+ *          information has been found, along with the CAT, the TSDT and the
+ *          NIT unless they are given up, or the source runs dry.
+ *  \return true if all the metadata was found, false otherwise.
+ */
+        bool collectMetadata();
+/**
+ *  \brief  Check if all the PAT and PMT information has been found, and the
+ *          CAT, the TSDT and the NIT were found or given up.
+ *  \return true if all the metadata was found, false otherwise.
+ */
+        bool isMetadataComplete();
+/**
+ *  \brief  Keep following the PAT and the PMTs once they are found, so that
+ *          the info returned by getPatInfo() and getPmtInfoList() follows
+ *          their changes. The setting is kept across the calls to open().
+ *  \param  isEnabled Follow the tables or stop once they are all found.
+ */
+        void setTableTracking(bool isEnabled);
+/**
+ *  \brief  Get the cache of the PAT and the PMTs seen so far, to register
+ *          listeners for their new versions.
+ *  \return Table cache.
+ */
+        TableCache& getTableCache();
+/**
+ *  \brief  Get the PAT info found so far.
+ *  \return PAT Info.
+ */
+        const TsMetadata::PatInfo& getPatInfo();
+/**
+ *  \brief  Get the PMT information list found so far.
+ *  \return List of PMT Info(s).
+ */
+        const TsMetadata::PmtInfoList& getPmtInfoList();
+/**
+ *  \brief  Get the CAT info found so far.
+ *  \return CAT Info.
+ */
+        const TsMetadata::CatInfo& getCatInfo();
+/**
+ *  \brief  Get the TSDT info found so far.
+ *  \return TSDT Info.
+ */
+        const TsMetadata::TsdtInfo& getTsdtInfo();
+/**
+ *  \brief  Get the NIT info found so far.
+ *  \return NIT Info.
+ */
+        const TsMetadata::NitInfo& getNitInfo();
+/**
+ *  \brief  Get the number of bytes read from the source so far.
+ *  \return Number of bytes read.
+ */
+        uint64_t getBytesRead();
+/**
+ *  \brief  Get the number of packets returned so far.
+ *  \return Number of packets.
+ */
+        uint64_t getPacketCount();
+/**
+ *  \brief  Get the size of the packets in the TS.
+ *  \return Packet size.
+ */
+        uint8_t getPacketSize();
+/**
+ *  \brief  Get the regions skipped so far as they were not part of any
+ *          packet, including the bytes before the first packet.
+ *  \return List of lost sync regions, as offsets from the start of the
+ *          source.
+ */
+        const LostSyncRegionList& getLostSyncRegions();
+};
+
+inline bool TsStream::isValid()
+{
+    return isTsStream;
+}
+
+inline bool TsStream::isMetadataComplete()
+{
+    return metadata.isComplete();
+}
+
+inline void TsStream::setTableTracking(bool isEnabled)
+{
+    metadata.setTracking(isEnabled);
+}
+
+inline TableCache& TsStream::getTableCache()
+{
+    return metadata.getTableCache();
+}
+
+inline const TsMetadata::PatInfo& TsStream::getPatInfo()
+{
+    return metadata.getPatInfo();
+}
+
+inline const TsMetadata::PmtInfoList& TsStream::getPmtInfoList()
+{
+    return metadata.getPmtInfoList();
+}
+
+inline const TsMetadata::CatInfo& TsStream::getCatInfo()
+{
+    return metadata.getCatInfo();
+}
+
+inline const TsMetadata::TsdtInfo& TsStream::getTsdtInfo()
+{
+    return metadata.getTsdtInfo();
+}
+
+inline const TsMetadata::NitInfo& TsStream::getNitInfo()
+{
+    return metadata.getNitInfo();
+}
+
+inline uint64_t TsStream::getBytesRead()
+{
+    return bytesRead;
+}
+
+inline uint64_t TsStream::getPacketCount()
+{
+    return packetNumber;
+}
+
+inline uint8_t TsStream::getPacketSize()
+{
+    return packetSize;
+}
+
+inline const TsStream::LostSyncRegionList& TsStream::getLostSyncRegions()
+{
+    return lostSyncRegions;
+}
+
+#endif
@@ -0,0 +1,508 @@
+/*
+ *  UringReader.cpp - An asynchronous reader keeping several chunks of a file
+ *  in flight using the Linux io_uring interface
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "UringReader.h"
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+//#define DEBUG
+
+#define MODULE_URING_READER 3
+#define CURRENT_MODULE MODULE_URING_READER
+
+#ifdef DEBUG
+#define MSG(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_INFO, " " fmt " \n", ##__VA_ARGS__);
+#else
+#define MSG(fmt, ...);
+#endif
+
+#define ERR(fmt, ...); LogOutput(CURRENT_MODULE, DelphinusUtils::LOG_ERROR, " " fmt " \n", ##__VA_ARGS__);
+
+// Alignment required for the buffers, offsets and sizes with O_DIRECT
+#define DIRECT_IO_ALIGNMENT 4096
+
+UringReader::UringReader()
+    :   fileDescriptor(-1),
+        isDirectIo(false),
+        fileSize(0),
+        chunkSize(0),
+        slots(NULL),
+        iovecs(NULL),
+        numSlots(0),
+        consumeSlot(0),
+        isHoldingSlot(false),
+        nextOffset(0),
+        submitSlot(0),
+        submitOffset(0),
+        inFlight(0)
+{
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+}
+
+UringReader::~UringReader()
+{
+    stop();
+}
+
+#ifdef __linux__
+
+bool UringReader::setupRing(uint8_t entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring.fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring.fd < 0)
+    {
+        MSG("io_uring_setup failed: %s", strerror(errno));
+        ring.fd = -1;
+        return false;
+    }
+
+    ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool isSingleMmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+    if (isSingleMmap)
+    {
+        if (ring.cqRingSize > ring.sqRingSize)
+        {
+            ring.sqRingSize = ring.cqRingSize;
+        }
+        ring.cqRingSize = ring.sqRingSize;
+    }
+
+    ring.sqRing = mmap(NULL, ring.sqRingSize, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sqRing == MAP_FAILED)
+    {
+        ring.sqRing = NULL;
+        teardownRing();
+        return false;
+    }
+    if (isSingleMmap)
+    {
+        ring.cqRing = ring.sqRing;
+    }
+    else
+    {
+        ring.cqRing = mmap(NULL, ring.cqRingSize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (ring.cqRing == MAP_FAILED)
+        {
+            ring.cqRing = NULL;
+            teardownRing();
+            return false;
+        }
+    }
+    ring.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring.sqes = mmap(NULL, ring.sqesSize, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED)
+    {
+        ring.sqes = NULL;
+        teardownRing();
+        return false;
+    }
+
+    uint8_t* sq = (uint8_t*)ring.sqRing;
+    uint8_t* cq = (uint8_t*)ring.cqRing;
+    ring.sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring.sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring.sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring.sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring.cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring.cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring.cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring.cqes = cq + params.cq_off.cqes;
+    return true;
+}
+
+void UringReader::teardownRing()
+{
+    if (ring.sqes)
+    {
+        munmap(ring.sqes, ring.sqesSize);
+    }
+    if (ring.cqRing && ring.cqRing != ring.sqRing)
+    {
+        munmap(ring.cqRing, ring.cqRingSize);
+    }
+    if (ring.sqRing)
+    {
+        munmap(ring.sqRing, ring.sqRingSize);
+    }
+    if (ring.fd >= 0)
+    {
+        ::close(ring.fd);
+    }
+    memset(&ring, 0, sizeof(ring));
+    ring.fd = -1;
+}
+
+bool UringReader::start(const char* fileName, uint64_t size, uint64_t chunk,
+                        uint8_t depth, bool directIo)
+{
+    stop();
+    assert(depth >= 2);
+    isDirectIo = directIo && (chunk % DIRECT_IO_ALIGNMENT == 0);
+    fileDescriptor = open(fileName, O_RDONLY | (isDirectIo ? O_DIRECT : 0));
+    if (fileDescriptor < 0 && isDirectIo)
+    {
+        // The file system does not support O_DIRECT
+        isDirectIo = false;
+        fileDescriptor = open(fileName, O_RDONLY);
+    }
+    if (fileDescriptor < 0)
+    {
+        return false;
+    }
+    if (!setupRing(depth))
+    {
+        stop();
+        return false;
+    }
+
+    fileSize = size;
+    chunkSize = chunk;
+    numSlots = depth;
+    slots = new Slot[numSlots];
+    iovecs = new struct iovec[numSlots];
+    for (uint8_t ix = 0; ix < numSlots; ++ix)
+    {
+        void* data = NULL;
+        if (posix_memalign(&data, DIRECT_IO_ALIGNMENT, chunkSize))
+        {
+            data = NULL;
+        }
+        slots[ix].data = (uint8_t*)data;
+        slots[ix].offset = 0;
+        slots[ix].result = 0;
+        slots[ix].state = SLOT_IDLE;
+        if (data == NULL)
+        {
+            stop();
+            return false;
+        }
+    }
+
+    if (isDirectIo && fileSize > 0 &&
+        pread(fileDescriptor, slots[0].data, DIRECT_IO_ALIGNMENT, 0) < 0)
+    {
+        // Some file systems accept O_DIRECT on open but reject the reads
+        MSG("O_DIRECT reads failed, using buffered reads");
+        ::close(fileDescriptor);
+        isDirectIo = false;
+        fileDescriptor = open(fileName, O_RDONLY);
+        if (fileDescriptor < 0)
+        {
+            stop();
+            return false;
+        }
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (!isDirectIo)
+    {
+        posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    consumeSlot = 0;
+    isHoldingSlot = false;
+    nextOffset = (uint64_t) - 1;
+    submitSlot = 0;
+    submitOffset = 0;
+    inFlight = 0;
+    return true;
+}
+
+void UringReader::stop()
+{
+    if (ring.fd >= 0)
+    {
+        drain();
+        teardownRing();
+    }
+    if (slots)
+    {
+        for (uint8_t ix = 0; ix < numSlots; ++ix)
+        {
+            free(slots[ix].data);
+        }
+        delete[] slots;
+        slots = NULL;
+    }
+    if (iovecs)
+    {
+        delete[] (struct iovec*)iovecs;
+        iovecs = NULL;
+    }
+    numSlots = 0;
+    if (fileDescriptor >= 0)
+    {
+        ::close(fileDescriptor);
+        fileDescriptor = -1;
+    }
+}
+
+void UringReader::submit(uint8_t slot, uint64_t offset)
+{
+    // The SQE index is the same as the slot index, the ring has at least
+    // numSlots entries
+    struct iovec* iov = (struct iovec*)iovecs + slot;
+    iov->iov_base = slots[slot].data;
+    iov->iov_len = chunkSize;
+
+    struct io_uring_sqe* sqe = (struct io_uring_sqe*)ring.sqes + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fileDescriptor;
+    sqe->off = offset;
+    sqe->addr = (uint64_t)(uintptr_t)iov;
+    sqe->len = 1;
+    sqe->user_data = slot;
+
+    unsigned tail = *ring.sqTail;
+    ring.sqArray[tail & *ring.sqMask] = slot;
+    __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    slots[slot].offset = offset;
+    slots[slot].result = 0;
+    slots[slot].state = SLOT_IN_FLIGHT;
+    ++inFlight;
+}
+
+bool UringReader::reap(bool wait)
+{
+    unsigned head = *ring.cqHead;
+    unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    if (head == tail)
+    {
+        if (!wait || inFlight == 0)
+        {
+            return false;
+        }
+        if (syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR)
+        {
+            ERR("io_uring_enter failed: %s", strerror(errno));
+            return false;
+        }
+        tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    }
+
+    while (head != tail)
+    {
+        struct io_uring_cqe* cqe = (struct io_uring_cqe*)ring.cqes + (head & *ring.cqMask);
+        Slot& slot = slots[cqe->user_data];
+        slot.result = cqe->res;
+        // Short read before EOF, complete the rest synchronously
+        completeRead(slot);
+        slot.state = SLOT_DONE;
+        --inFlight;
+        ++head;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    return true;
+}
+
+void UringReader::completeRead(Slot& slot)
+{
+    while (slot.result >= 0 && (uint64_t)slot.result < chunkSize &&
+           slot.offset + slot.result < fileSize)
+    {
+        // With O_DIRECT the buffer, the size and the offset must all be
+        // aligned, so the read restarts from the last aligned offset
+        uint64_t done = slot.result;
+        if (isDirectIo)
+        {
+            done &= ~(uint64_t)(DIRECT_IO_ALIGNMENT - 1);
+        }
+        ssize_t readSize = pread(fileDescriptor, slot.data + done,
+                                 chunkSize - done, slot.offset + done);
+        if (readSize < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (readSize < 0 && slot.result == 0)
+        {
+            slot.result = -errno;
+        }
+        if (readSize <= 0 || done + readSize <= (uint64_t)slot.result)
+        {
+            break;
+        }
+        slot.result = done + readSize;
+    }
+}
+
+void UringReader::drain()
+{
+    while (inFlight > 0)
+    {
+        if (!reap(true))
+        {
+            break;
+        }
+    }
+}
+
+void UringReader::fillQueue()
+{
+    uint8_t submitted = 0;
+    while (submitOffset < fileSize && slots[submitSlot].state == SLOT_IDLE)
+    {
+        submit(submitSlot, submitOffset);
+        submitOffset += chunkSize;
+        submitSlot = (submitSlot + 1) % numSlots;
+        ++submitted;
+    }
+    if (submitted == 0)
+    {
+        return;
+    }
+    long consumed = syscall(__NR_io_uring_enter, ring.fd, submitted, 0, 0, NULL, 0);
+    if (consumed < 0)
+    {
+        ERR("io_uring_enter failed: %s", strerror(errno));
+        consumed = 0;
+    }
+    if (consumed < submitted)
+    {
+        // Take back the reads the kernel did not consume and do them
+        // synchronously, or their slots would wait for a completion which
+        // never comes
+        unsigned head = __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+        unsigned tail = *ring.sqTail;
+        __atomic_store_n(ring.sqTail, head, __ATOMIC_RELEASE);
+        for (; head != tail; ++head)
+        {
+            Slot& slot = slots[ring.sqArray[head & *ring.sqMask]];
+            completeRead(slot);
+            slot.state = SLOT_DONE;
+            --inFlight;
+        }
+    }
+}
+
+uint8_t* UringReader::fetch(uint64_t offset, uint64_t& validSize)
+{
+    assert(!isDirectIo || offset % DIRECT_IO_ALIGNMENT == 0);
+    if (isHoldingSlot)
+    {
+        // Reuse the current buffer for the next read
+        slots[consumeSlot].state = SLOT_IDLE;
+        consumeSlot = (consumeSlot + 1) % numSlots;
+        isHoldingSlot = false;
+    }
+    validSize = 0;
+    if (offset >= fileSize)
+    {
+        return NULL;
+    }
+    if (offset != nextOffset)
+    {
+        // Not a sequential read, throw away whatever is queued
+        MSG("Restarting reads from offset: %" PRIu64, offset);
+        drain();
+        for (uint8_t ix = 0; ix < numSlots; ++ix)
+        {
+            slots[ix].state = SLOT_IDLE;
+        }
+        consumeSlot = 0;
+        submitSlot = 0;
+        submitOffset = offset;
+    }
+    else
+    {
+        // Collect whatever has completed already, without blocking
+        reap(false);
+    }
+    fillQueue();
+
+    Slot& slot = slots[consumeSlot];
+    while (slot.state == SLOT_IN_FLIGHT)
+    {
+        if (!reap(true))
+        {
+            break;
+        }
+    }
+    assert(slot.offset == offset);
+    isHoldingSlot = true;
+    nextOffset = offset + chunkSize;
+    if (slot.state != SLOT_DONE || slot.result < 0)
+    {
+        ERR("Unable to read from offset: %" PRIu64, offset);
+        return NULL;
+    }
+    validSize = slot.result;
+    return slot.data;
+}
+
+#else
+
+bool UringReader::setupRing(uint8_t entries)
+{
+    (void)entries;
+    return false;
+}
+
+void UringReader::teardownRing()
+{
+}
+
+bool UringReader::start(const char* fileName, uint64_t size, uint64_t chunk,
+                        uint8_t depth, bool directIo)
+{
+    (void)fileName;
+    (void)size;
+    (void)chunk;
+    (void)depth;
+    (void)directIo;
+    return false;
+}
+
+void UringReader::stop()
+{
+}
+
+uint8_t* UringReader::fetch(uint64_t offset, uint64_t& validSize)
+{
+    (void)offset;
+    validSize = 0;
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ *  UringReader.h - An asynchronous reader keeping several chunks of a file
+ *  in flight using the Linux io_uring interface
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ *  \file   UringReader.h
+ *  \brief  Asynchronous file reads using io_uring.
+ *
+ *  Defines UringReader which is used by TsFile in TsFile::IO_MODE_IO_URING
+ *  to keep several chunk reads queued with the kernel during large scans.
+ */
+
+#ifndef DELPHINUS_URING_READER_H
+#define DELPHINUS_URING_READER_H
+
+#include "common/DelphinusUtils.h"
+
+/** \cond DEV */
+/**
+ *  \brief  Reads a file sequentially through io_uring.
+ *
+ *  UringReader keeps up to queue depth reads of one chunk each in flight
+ *  ahead of the chunk being consumed, optionally bypassing the page cache
+ *  with O_DIRECT. Only the raw io_uring system calls are used, so there is
+ *  no dependency on liburing. start() fails when the kernel does not
+ *  support io_uring, in which case the caller is expected to fall back to
+ *  a different reader.
+ */
+class UringReader
+{
+    private:
+        enum SlotState
+        {
+            SLOT_IDLE = 0,
+            SLOT_IN_FLIGHT = 1,
+            SLOT_DONE = 2
+        };
+
+        struct Slot
+        {
+            uint8_t* data;
+            uint64_t offset;
+            int64_t result;
+            uint8_t state;
+        };
+
+        struct Ring
+        {
+            int fd;
+            void* sqRing;
+            void* cqRing;
+            void* sqes;
+            uint64_t sqRingSize;
+            uint64_t cqRingSize;
+            uint64_t sqesSize;
+            unsigned* sqHead;
+            unsigned* sqTail;
+            unsigned* sqMask;
+            unsigned* sqArray;
+            unsigned* cqHead;
+            unsigned* cqTail;
+            unsigned* cqMask;
+            void* cqes;
+        };
+
+        int fileDescriptor;
+        bool isDirectIo;
+        uint64_t fileSize;
+        uint64_t chunkSize;
+        Slot* slots;
+        void* iovecs;
+        uint8_t numSlots;
+        Ring ring;
+
+        uint8_t consumeSlot;
+        bool isHoldingSlot;
+        uint64_t nextOffset;
+        // Slot and file offset of the next read to be queued
+        uint8_t submitSlot;
+        uint64_t submitOffset;
+        uint8_t inFlight;
+
+        bool setupRing(uint8_t entries);
+        void teardownRing();
+        void submit(uint8_t slot, uint64_t offset);
+        bool reap(bool wait);
+        void completeRead(Slot& slot);
+        void drain();
+        void fillQueue();
+
+    public:
+        UringReader();
+        ~UringReader();
+
+/**
+ *  \brief  Open the file and set up the submission and completion rings.
+ *  \param  fileName Name of the file to read.
+ *  \param  size Size of the file in bytes.
+ *  \param  chunk Size of each chunk, a multiple of 4096 when directIo is
+ *          used.
+ *  \param  depth Number of chunk reads to keep in flight, at least 2.
+ *  \param  directIo Open the file with O_DIRECT. Silently dropped when the
+ *          file system does not support it.
+ *  \return true if io_uring is usable for the file, false otherwise.
+ */
+        bool start(const char* fileName, uint64_t size, uint64_t chunk,
+                   uint8_t depth, bool directIo);
+/**
+ *  \brief  Wait for all the pending reads, tear down the rings and close
+ *          the file.
+ */
+        void stop();
+/**
+ *  \brief  Get the chunk starting at the given offset, waiting for its read
+ *          to complete if required. The chunk previously returned is reused
+ *          for a new read and must not be accessed anymore.
+ *  \param  offset File offset of the chunk, the chunks being read one after
+ *          the other are the chunk size apart. A multiple of 4096 when
+ *          using O_DIRECT.
+ *  \param  validSize Number of valid bytes in the returned chunk.
+ *  \return Start of the chunk, NULL if the offset is beyond the file size
+ *          or the read failed.
+ */
+        uint8_t* fetch(uint64_t offset, uint64_t& validSize);
+/**
+ *  \brief  Check if the file was opened with O_DIRECT.
+ *  \return true if the page cache is bypassed, false otherwise.
+ */
+        bool usesDirectIo();
+};
+
+inline bool UringReader::usesDirectIo()
+{
+    return isDirectIo;
+}
+/** \endcond DEV */
+
+#endif
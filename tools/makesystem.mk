@@ -144,7 +144,7 @@ LDFLAGS  += -Wl,-O3
 ifeq ($(TOOLCHAIN_ARCH_IS_MINGW),1)
     LDFLAGS += -Wl,--no-undefined
 else
-    LDFLAGS += -Wl-z,defs
+    LDFLAGS += -Wl,-z,defs
 endif
 LDFLAGS  += $(TOOLCHAIN_ARCH_LDFLAGS)
 LDFLAGS  += -L$(EXPORT_LIBS_DIR)
@@ -363,8 +363,24 @@ clocinfo:
 	$(silent)$(MAKE) distclean
 	$(silent)$(CLOC) --by-file-by-lang --force-lang=make,mk .
 
+# bench target also exists only for the root of the tree, the benchmarks are
+# not part of all and run against the libraries of the host
+BENCH_DIR := $(BASE_DIR)/bench
+BENCH_BIN := $(EXPORT_BASE_DIR)/$(ARCH_HOST)/$(EXPORT_BINS_DIR_NAME)/tsbench
+BENCH_LIBS_DIR := $(EXPORT_BASE_DIR)/$(ARCH_HOST)/$(EXPORT_LIBS_DIR_NAME)
+BENCH_ARGS ?=
+
+bench: all
+	$(silent)$(MAKE) -C $(BENCH_DIR)
+	$(silent)LD_LIBRARY_PATH=$(BENCH_LIBS_DIR) $(BENCH_BIN) $(BENCH_ARGS)
+
+clean: .bench_clean
+
+.bench_clean:
+	$(silent)$(MAKE) -C $(BENCH_DIR) local_clean
+
 else
-release doxy clocinfo:
+release doxy clocinfo bench:
 	@$(ECHO) "Target $@ can be run only when from the root of the source tree, aborting..."
 	$(silent)exit 1
 
@@ -377,11 +393,12 @@ help:
 	@$(ECHO) "make clean        : Clean the targets and the dependencies"
 	@$(ECHO) "make distclean    : Clean the targets, the dependencies and the dist directory(completely)"
 	@$(ECHO) "make release      : Create the release tarballs (requires the codebase to be from an Git repo)"
+	@$(ECHO) "make bench        : Build and run the benchmarks, BENCH_ARGS is passed to tsbench"
 	@$(ECHO) "make help         : Display this help message"
 
 
 .PHONY: all local_all clean local_clean distclean help
-.PHONY: release doxy clocinfo
+.PHONY: release doxy clocinfo bench .bench_clean
 .PHONY: .prereqs .local_all__* .local_clean__*
 
 endif
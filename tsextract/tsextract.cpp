@@ -0,0 +1,141 @@
+/*
+ *  tsextract.cpp - A program to extract the elementary streams of a MPEG-2
+ *  Transport Stream to files.
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "libdelphinus/TsFile.h"
+#include "libdelphinus/EsExtractor.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define DEBUG
+
+#ifdef DEBUG
+#define MSG(x, ...); ::fprintf(stderr, " " x " \n", ##__VA_ARGS__);
+#else
+#define MSG(x, ...);
+#endif
+
+#define ERR(x, ...); ::fprintf(stderr, " " x " \n", ##__VA_ARGS__);
+
+void printUsage(char* programName);
+bool parseOutput(const char* argument, uint16_t& pid, std::string& fileName);
+
+void printUsage(char* programName)
+{
+    ERR("Usage: %s [OPTIONS] <FILE> <PID>:<OUTPUT> [<PID>:<OUTPUT> ...]", programName);
+    ERR("  -p            Write the whole PES instead of the elementary stream");
+    ERR("  -s            Read the file through stdio instead of mapping it");
+    ERR("       Use - as the OUTPUT to write to the standard output");
+}
+
+bool parseOutput(const char* argument, uint16_t& pid, std::string& fileName)
+{
+    char* end = NULL;
+    unsigned long value = strtoul(argument, &end, 0);
+    if (end == argument || *end != ':' || end[1] == '\0' || value > MpegConstants::PID_NULL)
+    {
+        return false;
+    }
+    pid = value;
+    fileName = end + 1;
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    EsExtractor::OutputMode mode = EsExtractor::OUTPUT_ES;
+    TsFile::IoMode ioMode = TsFile::IO_MODE_MMAP;
+    int option;
+    while ((option = getopt(argc, argv, "ps")) != -1)
+    {
+        switch (option)
+        {
+            case 'p':
+                mode = EsExtractor::OUTPUT_PES;
+                break;
+            case 's':
+                ioMode = TsFile::IO_MODE_STDIO;
+                break;
+            default:
+                printUsage(argv[0]);
+                return -1;
+        }
+    }
+    if (argc - optind < 2)
+    {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    TsFile tsFile;
+    if (!tsFile.open(argv[optind], ioMode))
+    {
+        ERR("Unable to open the file: %s", argv[optind]);
+        return -1;
+    }
+    if (!tsFile.isValid())
+    {
+        ERR("Not a valid TS file");
+        return -1;
+    }
+
+    EsExtractor extractor;
+    std::vector<uint16_t> pids;
+    for (int ix = optind + 1; ix < argc; ++ix)
+    {
+        uint16_t pid = 0;
+        std::string fileName;
+        if (!parseOutput(argv[ix], pid, fileName))
+        {
+            ERR("Invalid output: %s", argv[ix]);
+            printUsage(argv[0]);
+            return -1;
+        }
+        if (!extractor.addOutput(pid, fileName.c_str(), mode))
+        {
+            return -1;
+        }
+        pids.push_back(pid);
+    }
+
+    bool isExtracted = extractor.extract(tsFile);
+    for (std::vector<uint16_t>::iterator ix = pids.begin(); ix != pids.end(); ++ix)
+    {
+        MSG("PID: 0x%04x (%u) - %" PRIu64 " bytes, %" PRIu64 " PES cut short",
+            *ix, *ix, extractor.getBytesWritten(*ix), extractor.getDroppedPesCount(*ix));
+    }
+    if (!extractor.clear() || !isExtracted)
+    {
+        ERR("Unable to extract the streams");
+        return -1;
+    }
+    if (extractor.getLostSyncPacketCount() > 0)
+    {
+        ERR("%" PRIu64 " packets lost the sync byte, the streams are incomplete",
+            extractor.getLostSyncPacketCount());
+        return -1;
+    }
+    return 0;
+}
@@ -22,9 +22,13 @@
  */
 
 #include "libdelphinus/TsFile.h"
+#include "libdelphinus/TsStream.h"
 #include "libdelphinus/Pes.h"
 #include "libdelphinus/PsiTables.h"
+#include "libdelphinus/Descriptors.h"
 #include <cassert>
+#include <cstring>
+#include <sys/stat.h>
 
 #define DEBUG
 
@@ -37,39 +41,25 @@
 #define ERR(x, ...); ::fprintf(stderr, " " x " \n", ##__VA_ARGS__);
 
 void printUsage(char* programName);
+void printMetadata(const TsMetadata::PatInfo& patInfo, const TsMetadata::PmtInfoList& pmtInfoList);
+void printNetworkInfo(const TsMetadata::CatInfo& catInfo, const TsMetadata::NitInfo& nitInfo);
+bool isStreamSource(const char* fileName);
+int parseStream(const char* fileName);
 
 void printUsage(char* programName)
 {
   ERR("Usage: %s <FILE>", programName);
+  ERR("       Use - as the FILE to read the TS from the standard input");
 }
 
-int main(int argc, char* argv[])
+void printMetadata(const TsMetadata::PatInfo& patInfo, const TsMetadata::PmtInfoList& pmtInfoList)
 {
-    if (argc != 2) {
-        printUsage(argv[0]);
-        return -1;
-    }
-
-    TsFile tsFile;
-    if (!tsFile.open(argv[1]))
+    if (patInfo.packetNumber == (uint64_t) - 1)
     {
-        ERR("Unable to open the file: %s", argv[1]);
-        return -1;
-    }
-
-    if (!tsFile.isValid())
-    {
-        ERR("Not a valid TS file");
-        return -1;
+        MSG("No PAT found");
+        MSG("");
+        return;
     }
-
-    MSG("-----------------------------------------------------------");
-    MSG("File size: %" PRIu64 " bytes", tsFile.getFileSize());
-    MSG("-----------------------------------------------------------");
-
-    const TsFile::PatInfo& patInfo = tsFile.getPatInfo();
-    const TsFile::PmtInfoList& pmtInfoList = tsFile.getPmtInfoList();
-
     MSG("Found PAT in packet %" PRIu64, patInfo.packetNumber);
     MSG("--- Transport Stream ID: 0x%04x (%u)",
         patInfo.transportStreamId, patInfo.transportStreamId);
@@ -79,7 +69,7 @@ int main(int argc, char* argv[])
         MSG("--- Program: %u PID: 0x%04x (%u)", ix->programNumber, ix->pmtPid, ix->pmtPid);
     }
     MSG("\n");
-    for (TsFile::PmtInfoList::const_iterator ix = pmtInfoList.begin();
+    for (TsMetadata::PmtInfoList::const_iterator ix = pmtInfoList.begin();
          ix != pmtInfoList.end(); ++ix)
     {
         MSG("Found PMT PID: 0x%04x (%u) in packet %" PRIu64,
@@ -92,9 +82,131 @@ int main(int argc, char* argv[])
         {
             MSG("--- PID: 0x%04x (%u) - %s (0x%02x)",
                 iy->pid, iy->pid, PmtSection::getStreamTypeStr(iy->streamType), iy->streamType);
+            for (DescriptorIterator iz(iy->descriptor); iz.isValid(); iz.next())
+            {
+                if (iz.getTag() == MpegConstants::TAG_ISO_639_LANGUAGE)
+                {
+                    Iso639LanguageDescriptor language(iz.getData(), iz.getLength());
+                    for (uint8_t lang = 0; lang < language.getCount(); ++lang)
+                    {
+                        const char* code = language.getLanguage(lang);
+                        MSG("------ %s: %c%c%c", DescriptorDispatcher::getTagStr(iz.getTag()),
+                            code[0], code[1], code[2]);
+                    }
+                }
+                else
+                {
+                    MSG("------ %s (0x%02x)", DescriptorDispatcher::getTagStr(iz.getTag()), iz.getTag());
+                }
+            }
+        }
+        MSG("");
+    }
+}
+
+void printNetworkInfo(const TsMetadata::CatInfo& catInfo, const TsMetadata::NitInfo& nitInfo)
+{
+    if (catInfo.packetNumber != (uint64_t) - 1)
+    {
+        MSG("Found CAT in packet %" PRIu64, catInfo.packetNumber);
+        for (DescriptorIterator ix(catInfo.descriptor); ix.isValid(); ix.next())
+        {
+            CaDescriptor ca(ix.getData(), ix.getLength());
+            if (ix.getTag() == MpegConstants::TAG_CA && ca.isValid())
+            {
+                MSG("--- CA System ID: 0x%04x EMM PID: 0x%04x (%u)",
+                    ca.getCaSystemId(), ca.getCaPid(), ca.getCaPid());
+            }
+        }
+        MSG("");
+    }
+    if (nitInfo.packetNumber != (uint64_t) - 1)
+    {
+        MSG("Found NIT PID: 0x%04x (%u) in packet %" PRIu64,
+            nitInfo.pid, nitInfo.pid, nitInfo.packetNumber);
+        MSG("--- Network ID: 0x%04x (%u)", nitInfo.networkId, nitInfo.networkId);
+        for (NitSection::TsInfoList::const_iterator ix = nitInfo.tsInfoList.begin();
+             ix != nitInfo.tsInfoList.end(); ++ix)
+        {
+            MSG("--- Transport Stream ID: 0x%04x Original Network ID: 0x%04x",
+                ix->transportStreamId, ix->originalNetworkId);
         }
         MSG("");
     }
+}
+
+bool isStreamSource(const char* fileName)
+{
+    // Standard input, pipes and FIFOs cannot be seeked into
+    if (strcmp(fileName, "-") == 0)
+    {
+        return true;
+    }
+    struct stat fileStat;
+    return (stat(fileName, &fileStat) == 0 && !S_ISREG(fileStat.st_mode));
+}
+
+int parseStream(const char* fileName)
+{
+    TsStream tsStream;
+    if (!tsStream.open(fileName))
+    {
+        ERR("Unable to open the file: %s", fileName);
+        return -1;
+    }
+
+    if (!tsStream.isValid())
+    {
+        ERR("Not a valid TS stream");
+        return -1;
+    }
+
+    tsStream.collectMetadata();
+    MSG("-----------------------------------------------------------");
+    MSG("Read: %" PRIu64 " bytes", tsStream.getBytesRead());
+    MSG("-----------------------------------------------------------");
+
+    printMetadata(tsStream.getPatInfo(), tsStream.getPmtInfoList());
+    printNetworkInfo(tsStream.getCatInfo(), tsStream.getNitInfo());
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    if (isStreamSource(argv[1]))
+    {
+        return parseStream(argv[1]);
+    }
+
+    TsFile tsFile;
+    if (!tsFile.open(argv[1]))
+    {
+        ERR("Unable to open the file: %s", argv[1]);
+        return -1;
+    }
+
+    if (!tsFile.isValid())
+    {
+        ERR("Not a valid TS file");
+        return -1;
+    }
+
+    MSG("-----------------------------------------------------------");
+    MSG("File size: %" PRIu64 " bytes", tsFile.getFileSize());
+    double duration = tsFile.getDuration();
+    if (duration > 0)
+    {
+        MSG("Duration: %.3f seconds", duration);
+    }
+    MSG("-----------------------------------------------------------");
+
+    printMetadata(tsFile.getPatInfo(), tsFile.getPmtInfoList());
+    printNetworkInfo(tsFile.getCatInfo(), tsFile.getNitInfo());
 
 #if 0
     uint64_t packetCount = 0;
@@ -0,0 +1,122 @@
+/*
+ *  tstrickplay.cpp - A program to write the I-frame only trick play TS of a
+ *  program of a MPEG-2 Transport Stream.
+ *
+ *  This file is part of delphinus.
+ *
+ *  Copyright (C) 2012 Ash (Tuxdude) <tuxdude.github@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as
+ *  published by the Free Software Foundation; either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this program.  If not, see
+ *  <http://www.gnu.org/licenses/>.
+ */
+
+#include "libdelphinus/TsFile.h"
+#include "libdelphinus/TrickPlayWriter.h"
+#include <cstdlib>
+#include <unistd.h>
+
+#define DEBUG
+
+#ifdef DEBUG
+#define MSG(x, ...); ::fprintf(stderr, " " x " \n", ##__VA_ARGS__);
+#else
+#define MSG(x, ...);
+#endif
+
+#define ERR(x, ...); ::fprintf(stderr, " " x " \n", ##__VA_ARGS__);
+
+void printUsage(char* programName);
+
+void printUsage(char* programName)
+{
+    ERR("Usage: %s [OPTIONS] <FILE> <PROGRAM> <OUTPUT>", programName);
+    ERR("  -n <STEP>     Write every STEP-th key frame only");
+    ERR("  -w            Write the index file when the key frames are not indexed yet");
+    ERR("       Use - as the OUTPUT to write to the standard output");
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t step = 1;
+    bool isIndexWritten = false;
+    int option;
+    while ((option = getopt(argc, argv, "n:w")) != -1)
+    {
+        switch (option)
+        {
+            case 'n':
+                step = strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                isIndexWritten = true;
+                break;
+            default:
+                printUsage(argv[0]);
+                return -1;
+        }
+    }
+    if (argc - optind != 3 || step == 0)
+    {
+        printUsage(argv[0]);
+        return -1;
+    }
+
+    char* end = NULL;
+    unsigned long programNumber = strtoul(argv[optind + 1], &end, 0);
+    if (end == argv[optind + 1] || *end != '\0' || programNumber > 0xFFFF)
+    {
+        ERR("Invalid program number: %s", argv[optind + 1]);
+        return -1;
+    }
+
+    // The index file carries the key frames, so they need not be found by
+    // reading through the whole file again
+    TsFile tsFile;
+    if (!tsFile.open(argv[optind]))
+    {
+        ERR("Unable to open the file: %s", argv[optind]);
+        return -1;
+    }
+    if (!tsFile.isValid())
+    {
+        ERR("Not a valid TS file");
+        return -1;
+    }
+    if (!tsFile.hasRapIndex())
+    {
+        MSG("Finding the key frames");
+        // Writing the index file finds them in the same pass as the PID index
+        if (isIndexWritten && !tsFile.writeIndexFile())
+        {
+            ERR("Unable to write the index file");
+        }
+        if (!tsFile.hasRapIndex() && !tsFile.buildRapIndex())
+        {
+            ERR("No video in the file");
+            return -1;
+        }
+    }
+
+    TrickPlayWriter writer;
+    if (!writer.write(tsFile, programNumber, argv[optind + 2], step))
+    {
+        ERR("Unable to write the key frames");
+        return -1;
+    }
+    MSG("Program %lu - %" PRIu64 " frames, %" PRIu64 " bytes written, %" PRIu64 " of %" PRIu64
+        " bytes read (%.1f%%)", programNumber, writer.getFrameCount(), writer.getBytesWritten(),
+        writer.getBytesRead(), tsFile.getFileSize(),
+        tsFile.getFileSize() ? 100.0 * writer.getBytesRead() / tsFile.getFileSize() : 0.0);
+    return 0;
+}